@@ -8,8 +8,12 @@
    To build a new project with gameguy you build a library that exports a ggGame struct.
    That struct contains a few pieces of information.
    * An update_and_render function that takes a ggGameMemory pointer and a ggGameInput pointer.
+   * Or instead an update and a render function, update runs at a fixed rate and render runs
+     once per frame with an interpolation alpha.
+   * Optionally a snapshot_size, then --pipeline runs update a frame ahead on its own thread.
 
    Then you can run the game from the command line with ./gameguy library_name.so
+   or benchmark it without a window with ./gameguy --headless --frames 1000 library_name.so
 
    Gameguy will handle setting up the window, recording input and calling
    your update_and_render function 60 times per second. It will also reload your library when
@@ -20,8 +24,8 @@
 
    In the future there may be the ability to modify settings for many of these pieces but for
    now it's very opinionated which lets me build many different demos and experiment rapidly.
-   It uses SDL for window and input handling and opengl 3.3. None of it is tested on anything
-   but osx.
+   It uses SDL for window and input handling and opengl 3.3. It's mostly tested on osx, linux
+   builds are used for headless benchmarks.
 
    Future wanted features.
    - Building static releases for multiple platforms.
@@ -36,16 +40,454 @@
 
 // This is needed for size_t and other types, @TODO ditch somehow.
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h> 
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 
 typedef int (*GetFileSizeFn)(const char* filename);
 typedef bool (*ReadEntireFileFn)(const char* filename, char* buffer, size_t buffer_size);
 
+struct ggGameInput;
+typedef void (*LatchInputFn)(struct ggGameInput* input);
+
+// An asset found in the pack, see Asset packs below.
+typedef struct {
+    const void* data;   // Straight into the mapped pack if it's stored uncompressed, else NULL.
+    size_t size;        // Uncompressed size.
+    uint32_t index;
+} ggAsset;
+
+struct ggNetStats;
+typedef const struct ggNetStats* (*GetNetStatsFn)(void);
+
+// Memory telemetry.
+// Every allocation the platform makes goes through gg_allocate with a tag, and games can use
+// the same allocator through platform_api (GG_ALLOC and friends). Each tag keeps its live
+// bytes, high-water mark, and how many allocations the last frame made, in
+// ggGameMemory.memory_stats. A steady-state frame loop should allocate nothing, check
+// memory_stats->last_frame_allocations or run with --frame-allocations to have gameguy
+// complain. Live allocations are listed by call site at exit, and at every hot reload the
+// ones made since the previous reload that are still around.
+// The allocator is in SAO_GAMEGUY_MEMORY_IMPLEMENTATION, the pack and net code use it too.
+// sao_gl.h can be pointed at it with SAOGL_MALLOC and friends.
+enum {
+    GG_TAG_PLATFORM,
+    GG_TAG_DEBUG,
+    GG_TAG_ASSETS,
+    GG_TAG_AUDIO,
+    GG_TAG_NET,
+    GG_TAG_STATE,   // persistent_storage and snapshots.
+    GG_TAG_GAME,    // Games can use GG_TAG_GAME + n up to GG_MEMORY_TAGS - 1.
+};
+#define GG_MEMORY_TAGS 16
+#define GG_MEMORY_RECENT 16
+
+typedef struct {
+    int64_t live_bytes;
+    int64_t live_count;
+    int64_t high_water_bytes;
+    int64_t mapped_bytes;       // mmaps counted with gg_memory_account, not in live_bytes.
+    uint64_t total_allocations;
+    uint64_t frame_allocations; // So far this frame.
+    uint64_t frame_bytes;
+    uint64_t last_frame_allocations;
+    uint64_t last_frame_bytes;
+    uint64_t max_frame_allocations;
+} ggMemoryTagStats;
+
+typedef struct {
+    const char* file;
+    int line;
+    uint32_t tag;
+    size_t size;
+} ggMemorySite;
+
+typedef struct {
+    ggMemoryTagStats tags[GG_MEMORY_TAGS];
+    const char* tag_names[GG_MEMORY_TAGS];  // Name your own tags here, NULL shows the number.
+    int64_t live_bytes;
+    int64_t high_water_bytes;
+    uint64_t frame;
+    uint64_t last_frame_allocations;        // All tags.
+    uint64_t last_frame_bytes;
+    uint64_t allocating_frames;             // Frames that allocated anything.
+    // The last allocations made, newest at (recent_count - 1) % GG_MEMORY_RECENT.
+    ggMemorySite recent[GG_MEMORY_RECENT];
+    uint64_t recent_count;
+} ggMemoryStats;
+
+typedef void* (*AllocateFn)(uint32_t tag, size_t size, const char* file, int line);
+typedef void* (*ReallocateFn)(uint32_t tag, void* memory, size_t size, const char* file, int line);
+typedef void (*DeallocateFn)(void* memory);
+
+// memory is the ggGameMemory*. Allocations come back zeroed, reallocating keeps the tag (tag is
+// only used when pointer is NULL) and zeroes anything new.
+#define GG_ALLOC(memory, tag, size) (memory)->platform_api.allocate((tag), (size), __FILE__, __LINE__)
+#define GG_REALLOC(memory, tag, pointer, size) \
+    (memory)->platform_api.reallocate((tag), (pointer), (size), __FILE__, __LINE__)
+#define GG_FREE(memory, pointer) (memory)->platform_api.deallocate(pointer)
+
+void* gg_allocate(uint32_t tag, size_t size, const char* file, int line);
+void* gg_reallocate(uint32_t tag, void* memory, size_t size, const char* file, int line);
+void gg_deallocate(void* memory);
+// Same as the platform_api ones, for code linked with the implementation.
+#define gg_alloc(tag, size) gg_allocate((tag), (size), __FILE__, __LINE__)
+#define gg_realloc(tag, pointer, size) gg_reallocate((tag), (pointer), (size), __FILE__, __LINE__)
+
+void gg_memory_account(uint32_t tag, int64_t bytes);
+// Adds to mapped_bytes, for memory that isn't from gg_allocate.
+ggMemoryStats* gg_memory_stats(void);
+void gg_memory_end_frame(void);
+// Moves this frame's counts to last_frame_*.
+uint32_t gg_memory_begin_generation(void);
+// Starts a new generation and returns it, gg_memory_report_live can list what was allocated
+// from then on.
+void gg_memory_report_live(const char* title, uint32_t first_generation, int max_sites);
+// Prints live allocations from first_generation on grouped by call site, largest first.
+void gg_memory_print_stats(void);
+
+typedef bool (*FindAssetFn)(const char* name, ggAsset* asset);
+typedef bool (*ReadAssetFn)(const ggAsset* asset, void* buffer, size_t buffer_size);
+typedef bool (*SavePersistentStorageFn)(void);
+
 typedef struct {
     GetFileSizeFn get_file_size;
     ReadEntireFileFn read_entire_file;
+
+    // Call right before you submit the frame's draws (after simulating) to get mouse
+    // movement that arrived since input was gathered, see latched_mouse_dx in ggGameInput.
+    LatchInputFn latch_input;
+
+    // Looks names up in the pack given with --pack, without touching the filesystem. Raw
+    // assets can be used in place through asset.data, read_asset copies or decompresses
+    // into your buffer. get_file_size and read_entire_file check the pack first too.
+    FindAssetFn find_asset;
+    ReadAssetFn read_asset;
+
+    // Writes persistent_storage to the --state image now instead of only at exit, false if
+    // there's no image or it couldn't be written.
+    SavePersistentStorageFn save_persistent_storage;
+
+    // Counters of the --host/--connect session, NULL when not networked.
+    GetNetStatsFn get_net_stats;
+
+    // The tagged allocator, see Memory telemetry.
+    AllocateFn allocate;
+    ReallocateFn reallocate;
+    DeallocateFn deallocate;
 } ggPlatformAPI;
 
+// Profiling.
+//
+// Wrap code in TIMED_BLOCK("name") or TIMED_FUNCTION() to time the rest of the enclosing
+// scope, or use BEGIN_TIMED_BLOCK/END_TIMED_BLOCK pairs. Events are cycle counter stamps
+// written into a ring per thread, the platform layer collates them at the end of every frame
+// into per block stats (memory->debug_table->last_frame) and optionally a chrome trace.
+// Recording is off until you run with --profile or --trace, or set debug_table->recording,
+// which takes effect from the next frame. Off, a block costs a relaxed load and a branch.
+// Define SAO_GAMEGUY_NO_PROFILE to compile the macros out completely.
+// The collator is in SAO_GAMEGUY_DEBUG_IMPLEMENTATION, it doesn't need the platform.
+//
+// Block names must be string literals. They're only read during collation, which happens
+// before the library is reloaded, after that the platform has its own copy.
+#ifndef GG_DEBUG_MAX_THREADS
+#define GG_DEBUG_MAX_THREADS 64
+#endif
+#ifndef GG_DEBUG_RING_SIZE
+#define GG_DEBUG_RING_SIZE (1 << 16) // Events per thread between collations, power of two.
+#endif
+#ifndef GG_DEBUG_MAX_BLOCKS
+#define GG_DEBUG_MAX_BLOCKS 512      // Unique block names.
+#endif
+
+enum {
+    GG_DEBUG_EVENT_BEGIN_BLOCK,
+    GG_DEBUG_EVENT_END_BLOCK,
+};
+
+typedef struct {
+    uint64_t clock;
+    const char* name;
+    uint32_t type;
+} ggDebugEvent;
+
+// One producer (the thread that claimed it) and one consumer (collation).
+typedef struct {
+    _Atomic uint64_t thread_id; // 0 until claimed.
+    _Atomic uint32_t write_index;
+    _Atomic uint32_t read_index;
+    _Atomic uint32_t dropped;
+    ggDebugEvent* events;
+} ggDebugEventRing;
+
+typedef struct {
+    const char* name;
+    uint32_t hit_count;
+    uint64_t total_cycles;
+    uint64_t min_cycles;
+    uint64_t max_cycles;
+} ggDebugBlockStats;
+
+typedef struct {
+    uint64_t frame_cycles;
+    double seconds_per_cycle;
+    uint32_t block_count;
+    ggDebugBlockStats blocks[GG_DEBUG_MAX_BLOCKS];
+} ggDebugFrameStats;
+
+typedef struct {
+    _Atomic bool recording;
+
+    _Atomic uint32_t ring_count;
+    ggDebugEventRing rings[GG_DEBUG_MAX_THREADS];
+
+    ggDebugFrameStats last_frame;
+} ggDebugTable;
+
+static inline uint64_t
+gg_read_cycle_counter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Cached per thread, per module so the game library finds its ring again after a reload.
+static _Thread_local ggDebugEventRing* _gg_thread_debug_ring;
+static _Thread_local ggDebugTable* _gg_thread_debug_table;
+
+static ggDebugEventRing*
+_gg_claim_debug_ring(ggDebugTable* table)
+{
+    uint64_t thread_id = (uint64_t)(uintptr_t)pthread_self();
+
+    uint32_t ring_count = atomic_load_explicit(&table->ring_count, memory_order_acquire);
+    for (uint32_t i=0; i<ring_count && i<GG_DEBUG_MAX_THREADS; i++) {
+        if (atomic_load_explicit(&table->rings[i].thread_id, memory_order_acquire) == thread_id) {
+            return &table->rings[i];
+        }
+    }
+
+    uint32_t index = atomic_fetch_add(&table->ring_count, 1);
+    if (index >= GG_DEBUG_MAX_THREADS) {
+        return NULL;
+    }
+
+    ggDebugEventRing* ring = &table->rings[index];
+    ring->events = (ggDebugEvent*)calloc(GG_DEBUG_RING_SIZE, sizeof(ggDebugEvent));
+    atomic_store_explicit(&ring->thread_id, thread_id, memory_order_release);
+    return ring;
+}
+
+static inline void
+gg_record_debug_event(ggDebugTable* table, const char* name, uint32_t type)
+{
+    if (!table || !atomic_load_explicit(&table->recording, memory_order_relaxed)) {
+        return;
+    }
+
+    ggDebugEventRing* ring = _gg_thread_debug_ring;
+    if (_gg_thread_debug_table != table) {
+        ring = _gg_claim_debug_ring(table);
+        _gg_thread_debug_ring = ring;
+        _gg_thread_debug_table = table;
+    }
+    if (!ring) {
+        return;
+    }
+
+    uint32_t write_index = atomic_load_explicit(&ring->write_index, memory_order_relaxed);
+    uint32_t read_index = atomic_load_explicit(&ring->read_index, memory_order_acquire);
+    if (write_index - read_index >= GG_DEBUG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    ggDebugEvent* event = ring->events + (write_index & (GG_DEBUG_RING_SIZE - 1));
+    event->clock = gg_read_cycle_counter();
+    event->name = name;
+    event->type = type;
+    atomic_store_explicit(&ring->write_index, write_index + 1, memory_order_release);
+}
+
+typedef struct {
+    ggDebugTable* table;
+    const char* name;
+} ggTimedBlock;
+
+static inline ggTimedBlock
+_gg_begin_timed_block(ggDebugTable* table, const char* name)
+{
+    gg_record_debug_event(table, name, GG_DEBUG_EVENT_BEGIN_BLOCK);
+    return (ggTimedBlock){table, name};
+}
+
+static inline void
+_gg_end_timed_block(ggTimedBlock* block)
+{
+    gg_record_debug_event(block->table, block->name, GG_DEBUG_EVENT_END_BLOCK);
+}
+
+// Game code records into the table the platform put in gg_game, the platform into its own.
+#ifndef GG_DEBUG_TABLE
+#ifdef SAO_GAMEGUY_IMPLEMENTATION
+static ggDebugTable* _gg_platform_debug_table;
+#define GG_DEBUG_TABLE _gg_platform_debug_table
+#else
+#define GG_DEBUG_TABLE gg_game.debug_table
+#endif
+#endif
+
+#define _GG_CONCAT_(a, b) a##b
+#define _GG_CONCAT(a, b) _GG_CONCAT_(a, b)
+
+#ifndef SAO_GAMEGUY_NO_PROFILE
+#define TIMED_BLOCK(name)                                               \
+    ggTimedBlock _GG_CONCAT(_gg_timed_block_, __LINE__)                 \
+    __attribute__((cleanup(_gg_end_timed_block))) =                     \
+        _gg_begin_timed_block(GG_DEBUG_TABLE, name)
+#define TIMED_FUNCTION() TIMED_BLOCK(__func__)
+#define BEGIN_TIMED_BLOCK(name) gg_record_debug_event(GG_DEBUG_TABLE, name, GG_DEBUG_EVENT_BEGIN_BLOCK)
+#define END_TIMED_BLOCK(name) gg_record_debug_event(GG_DEBUG_TABLE, name, GG_DEBUG_EVENT_END_BLOCK)
+#else
+#define TIMED_BLOCK(name)
+#define TIMED_FUNCTION()
+#define BEGIN_TIMED_BLOCK(name)
+#define END_TIMED_BLOCK(name)
+#endif
+
+// Audio.
+// The platform opens a stereo float device and mixes on SDL's audio thread. The game talks to
+// the mixer through memory->audio (NULL if there's no device), pushing commands into a single
+// producer ring the audio callback drains, so push from one thread at a time. Every command
+// carries the output sample it takes effect on, relative to audio->frame_sample: the sample
+// this frame starts playing at, one latency ahead of the device. Play something with
+// delay_seconds 0.5 on two frames 30 frames apart and they start exactly 30 frame times apart,
+// however the callbacks happen to line up.
+//
+// Sounds are the game's memory and have to stay alive and unchanged while they play.
+// The mixer is in SAO_GAMEGUY_AUDIO_IMPLEMENTATION, it runs without a device too.
+#ifndef GG_AUDIO_MAX_VOICES
+#define GG_AUDIO_MAX_VOICES 256
+#endif
+#ifndef GG_AUDIO_MAX_COMMANDS
+#define GG_AUDIO_MAX_COMMANDS 1024   // Power of two.
+#endif
+#ifndef GG_AUDIO_SAMPLE_RATE
+#define GG_AUDIO_SAMPLE_RATE 48000
+#endif
+#ifndef GG_AUDIO_BUFFER_FRAMES
+#define GG_AUDIO_BUFFER_FRAMES 512
+#endif
+
+typedef struct {
+    const float* samples;   // Interleaved if there are two channels.
+    uint32_t frame_count;
+    uint32_t channels;      // 1 or 2.
+    uint32_t sample_rate;
+} ggSound;
+
+enum {
+    GG_AUDIO_PLAY,
+    GG_AUDIO_SET,
+    GG_AUDIO_STOP,
+};
+
+enum {
+    GG_AUDIO_LOOP = 1 << 0,
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t voice;
+    uint64_t sample;        // Output sample it takes effect on.
+    const ggSound* sound;
+    float gain;
+    float pan;              // -1 left to 1 right.
+    float rate;             // Playback speed, 1 plays at the sound's own sample rate.
+    uint32_t flags;
+} ggAudioCommand;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t buffer_frames;
+    uint64_t frame_sample;
+
+    // Written by the mixer. Mix times are per buffer, compare them to
+    // buffer_frames / sample_rate to see how close it is to underrunning.
+    _Atomic uint64_t buffers_mixed;
+    _Atomic uint64_t total_mix_us;
+    _Atomic uint32_t last_mix_us;
+    _Atomic uint32_t max_mix_us;
+    _Atomic uint32_t voices_playing;
+    _Atomic uint32_t late_commands;  // Arrived after their sample, applied at the next buffer.
+    _Atomic uint32_t dropped_voices; // Played with all GG_AUDIO_MAX_VOICES busy.
+    uint32_t dropped_commands;       // Ring was full, written by the game.
+
+    uint32_t next_voice;
+    _Atomic uint32_t write_index;
+    _Atomic uint32_t read_index;
+    ggAudioCommand commands[GG_AUDIO_MAX_COMMANDS];
+} ggGameAudio;
+
+static inline bool
+_gg_audio_push(ggGameAudio* audio, const ggAudioCommand* command)
+{
+    uint32_t write = atomic_load_explicit(&audio->write_index, memory_order_relaxed);
+    uint32_t read = atomic_load_explicit(&audio->read_index, memory_order_acquire);
+    if (write - read >= GG_AUDIO_MAX_COMMANDS) {
+        audio->dropped_commands++;
+        return false;
+    }
+    audio->commands[write & (GG_AUDIO_MAX_COMMANDS - 1)] = *command;
+    atomic_store_explicit(&audio->write_index, write + 1, memory_order_release);
+    return true;
+}
+
+static inline uint64_t
+gg_audio_sample(const ggGameAudio* audio, float delay_seconds)
+{
+    return audio->frame_sample + (uint64_t)(delay_seconds * audio->sample_rate + 0.5f);
+}
+
+// Returns the voice to pass to set and stop, 0 if the ring is full.
+static inline uint32_t
+gg_audio_play(ggGameAudio* audio, const ggSound* sound, float delay_seconds,
+              float gain, float pan, float rate, uint32_t flags)
+{
+    if (++audio->next_voice == 0) {
+        audio->next_voice = 1;
+    }
+    ggAudioCommand command = {GG_AUDIO_PLAY, audio->next_voice, gg_audio_sample(audio, delay_seconds),
+                              sound, gain, pan, rate, flags};
+    return _gg_audio_push(audio, &command) ? command.voice : 0;
+}
+
+static inline bool
+gg_audio_set(ggGameAudio* audio, uint32_t voice, float delay_seconds, float gain, float pan, float rate)
+{
+    ggAudioCommand command = {GG_AUDIO_SET, voice, gg_audio_sample(audio, delay_seconds),
+                              NULL, gain, pan, rate, 0};
+    return _gg_audio_push(audio, &command);
+}
+
+static inline bool
+gg_audio_stop(ggGameAudio* audio, uint32_t voice, float delay_seconds)
+{
+    ggAudioCommand command = {GG_AUDIO_STOP, voice, gg_audio_sample(audio, delay_seconds)};
+    return _gg_audio_push(audio, &command);
+}
+
 typedef struct {
     // Use this pointer to record any memory you want the platform layer to keep track of.
     // This memory will be saved and replayed for looped editing and debugging.
@@ -53,289 +495,4275 @@ typedef struct {
     uint64_t persistent_storage_size;
     void*    persistent_storage;
 
+    // Set for the first frame when persistent_storage came back from a saved image, see
+    // ggGame.persistent_storage_size. Everything in it is as it was but anything owned by
+    // the old process (gl objects, heap pointers, file handles) has to be recreated.
+    bool persistent_storage_resumed;
+
     /* uint64_t transient_storage_size; */
     /* void*    transient_storage; */
 
-    bool executable_reloaded;
-    ggPlatformAPI platform_api;
+    bool executable_reloaded;
+    ggPlatformAPI platform_api;
+
+    // Profiler state, see TIMED_BLOCK. Toggle recording or read last_frame from here.
+    ggDebugTable* debug_table;
+
+    // Allocation counters, see Memory telemetry.
+    const ggMemoryStats* memory_stats;
+
+    float dt;       // seconds since last frame, or the fixed step when using update/render.
+    uint64_t ticks; // ms since game began.
+
+    // Only set in fixed timestep mode, how far render is between the last update and the
+    // next one in [0, 1). Blend previous and current state with it to get smooth motion.
+    float interpolation_alpha;
+
+    // Only set when ggGame.snapshot_size is, update writes what render needs here and render
+    // draws from it. With --pipeline render reads the one from the update before the last
+    // while update writes the next, so render must not touch simulated state anywhere else.
+    void* snapshot;
+
+    float display_width;
+    float display_height;
+    float drawable_width;
+    float drawable_height;
+
+    // See Audio, NULL when running without sound.
+    ggGameAudio* audio;
+} ggGameMemory;
+
+// Do I want casey style buttons.
+// half_transition_count, ended_down.
+// mouse_moved, mouse position.
+
+typedef struct {
+    bool ended_down;
+    int half_transition_count;
+} ggButton;
+
+// Every input event in the frame, in order, for when ended_down and transition counts
+// aren't enough (fast clicks, exact timing, text entry style key handling).
+#ifndef GG_MAX_INPUT_EVENTS
+#define GG_MAX_INPUT_EVENTS 256
+#endif
+#define GG_KEY_COUNT 512 // input->keys is indexed by SDL scancode (usb hid usage id).
+
+typedef enum {
+    GG_INPUT_KEY_DOWN,
+    GG_INPUT_KEY_UP,
+    GG_INPUT_MOUSE_DOWN,
+    GG_INPUT_MOUSE_UP,
+    GG_INPUT_MOUSE_MOVE,
+    GG_INPUT_MOUSE_WHEEL,
+} ggInputEventType;
+
+typedef struct {
+    uint32_t type;
+    uint32_t code; // Scancode for keys, 1 left, 2 middle, 3 right for mouse buttons.
+    float time;    // Seconds since game began, same clock as memory->ticks.
+    float x;       // Mouse position, or wheel amount.
+    float y;
+    float dx;      // Mouse movement.
+    float dy;
+} ggInputEvent;
+
+typedef struct ggGameInput {
+    // Mouse. (movement and clicks)
+    ggButton mouse1;
+    ggButton mouse2;
+
+    int horisontal_scroll;
+    int vertical_scroll;
+
+    float mouse_x;
+    float mouse_y;
+
+    // Sum of every mouse movement since the last frame.
+    bool mouse_moved;
+    float mouse_dx;
+    float mouse_dy;
+
+    // Set by platform_api.latch_input(), movement that came in after this frame's input was
+    // gathered. Add it to the camera you render with but not to simulated state, the next
+    // frame's mouse_dx/dy includes it again.
+    float latched_mouse_x;
+    float latched_mouse_y;
+    float latched_mouse_dx;
+    float latched_mouse_dy;
+    float latched_time;
+
+    // Buttons, used for game input situations.
+    union {
+        struct {
+            ggButton w;
+            ggButton a;
+            ggButton s;
+            ggButton d;
+            ggButton q;
+            ggButton e;
+            ggButton up;
+            ggButton down;
+            ggButton left;
+            ggButton right;
+            ggButton space;
+            ggButton ctrl;
+            ggButton shift;
+            ggButton n1;
+            ggButton n2;
+            ggButton n3;
+            ggButton n4;
+            ggButton n5;
+            ggButton n6;
+            ggButton n7;
+            ggButton n8;
+            ggButton n9;
+            ggButton n0;
+            ggButton escape;
+            ggButton ret;
+        } b;
+        ggButton e[25];
+    } button;
+
+    // The whole keyboard.
+    ggButton keys[GG_KEY_COUNT];
+
+    int event_count;
+    int events_dropped;
+    ggInputEvent events[GG_MAX_INPUT_EVENTS];
+
+    // Keyboard string input.
+    // @TODO
+} ggGameInput;
+
+typedef void (*UpdateAndRenderFn)(ggGameMemory *memory, ggGameInput* input);
+typedef void (*UpdateFn)(ggGameMemory *memory, ggGameInput* input);
+typedef void (*RenderFn)(ggGameMemory *memory, ggGameInput* input);
+typedef void (*SubmitFn)(ggGameMemory *memory);
+
+typedef struct {
+    /* int permanent_storage_size; */
+    /* int temp_storage_size; */
+    UpdateAndRenderFn update_and_render;
+
+    // Fixed timestep mode, used instead of update_and_render when update is set.
+    // update is called fixed_update_hz times a second (60 if 0) always with the same dt so
+    // the simulation is deterministic. render is called once per displayed frame after
+    // however many updates were needed to catch up, with memory->interpolation_alpha set.
+    UpdateFn update;
+    RenderFn render;
+    float fixed_update_hz;
+
+    // Size of memory->snapshot, read once at startup. Setting it lets you run with --pipeline,
+    // then update runs on a worker thread simulating the next frame while the main thread
+    // renders the last one from its snapshot, overlapping simulation with gl submission for a
+    // frame of extra latency. update must not call gl then, and render must not read state
+    // update writes except through the snapshot.
+    size_t snapshot_size;
+
+    // Optional, called every frame after update_and_render (or render) returns. Games that
+    // record render commands instead of calling gl directly sort and draw them here, see
+    // saogl_render_commands_submit in sao_gl.h.
+    SubmitFn submit;
+
+    // Set persistent_storage_size to have the platform provide persistent_storage instead
+    // of allocating it yourself. It's mapped at GG_PERSISTENT_STORAGE_ADDRESS every run so
+    // pointers into it stay valid, and with --state file.state it's resumed from that image
+    // (pages load as you touch them) and saved back on exit. Bump state_version whenever
+    // the layout of your state changes, images saved by other versions are ignored and left
+    // alone until the next save replaces them. Both are read once at startup.
+    uint64_t persistent_storage_size;
+    uint32_t state_version;
+
+    // Parts of persistent_storage to replicate with --host/--connect, see Networking.
+    const struct ggNetRegion* net_regions;
+    uint32_t net_region_count;
+    float net_hz;
+
+    // Filled in by the platform layer, used by the TIMED_BLOCK macros in game code.
+    ggDebugTable* debug_table;
+} ggGame;
+
+// Set this in game code.
+extern ggGame gg_game;
+
+// Asset packs.
+// One file holding every asset: a header, a table of contents, a hash table indexing it,
+// the names, then each asset's data 64 byte aligned and stored raw, lz4 or zstd compressed
+// (whichever the builder picked for it). The platform maps it once at startup and finds
+// names with one hash and usually one probe, no syscalls. Build packs with gameguy_pack
+// (sao_gameguy_pack.c) and run with --pack assets.pack.
+// zstd needs libzstd, define SAO_GAMEGUY_ZSTD and link -lzstd. lz4 is built in.
+// The pack code is in SAO_GAMEGUY_PACK_IMPLEMENTATION so tools can use it without the platform.
+#define GG_PACK_MAGIC 0x4B504747 // GGPK
+#define GG_PACK_VERSION 1
+#define GG_PACK_ALIGNMENT 64
+
+enum {
+    GG_PACK_RAW,
+    GG_PACK_LZ4,
+    GG_PACK_ZSTD,
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t slot_count;        // Power of two.
+    uint64_t entries_offset;
+    uint64_t slots_offset;      // uint32_t entry index + 1 per slot, 0 is empty.
+    uint64_t names_offset;
+    uint64_t data_offset;
+    uint64_t size;
+} ggPackHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t stored_size;
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t compression;
+} ggPackEntry;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    const ggPackHeader* header;
+    const ggPackEntry* entries;
+    const uint32_t* slots;
+    const char* names;
+} ggPack;
+
+// FNV-1a, the builder and the lookup have to agree.
+static inline uint64_t
+gg_pack_hash(const char* name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool gg_pack_open(ggPack* pack, const char* filename);
+void gg_pack_close(ggPack* pack);
+const ggPackEntry* gg_pack_find(const ggPack* pack, const char* name);
+bool gg_pack_read(const ggPack* pack, const ggPackEntry* entry, void* buffer, size_t buffer_size);
+// buffer_size has to be at least entry->size.
+
+bool gg_pack_build(const char* filename, const char** names, int count, int compression);
+// Reads each file in names and stores it under that name. With GG_PACK_LZ4 or GG_PACK_ZSTD
+// assets that don't shrink by at least 1/8 are stored raw.
+
+int gg_lz4_compress(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity);
+int gg_lz4_decompress(const uint8_t* src, int src_size, uint8_t* dst, int dst_size);
+// Plain lz4 blocks. Both return the bytes written or -1.
+
+// Networking.
+// Replicates regions of persistent_storage from a host to one client over udp. Run one gameguy
+// with --host port and one with --connect address:port, the game lists the regions in
+// ggGame.net_regions. net_hz times a second (64 if 0) the host quantizes every field into 32
+// bit words, delta encodes each entity against the last snapshot the client acknowledged
+// (zigzag differences for quantized numbers, xor for everything else) and bit packs it, so an
+// entity that didn't change costs one bit. Snapshots are split into packets that each decode
+// on their own and go out in one sendmmsg. The client applies a snapshot to its storage once
+// all of its packets are in, before its next update, and acks it. A lost packet only means
+// the host keeps encoding against an older baseline, but the first snapshot (or one after the
+// client fell GG_NET_HISTORY behind) is sent whole and needs all of its packets. Packets are
+// native endian. The socket buffers ask for 4MB, linux caps that at net.core.rmem_max.
+// The codec and sockets are in SAO_GAMEGUY_NET_IMPLEMENTATION, usable without the platform.
+// sendmmsg/recvmmsg need _GNU_SOURCE on linux, without it it's one syscall per packet.
+#define GG_NET_MAGIC 0x4E474747 // GGGN
+#ifndef GG_NET_HISTORY
+#define GG_NET_HISTORY 32           // Snapshots kept for baselines, power of two.
+#endif
+#ifndef GG_NET_MAX_PACKET
+#define GG_NET_MAX_PACKET 1200
+#endif
+#define GG_NET_BATCH 64
+
+enum {
+    GG_NET_BYTES,   // size bytes as they are.
+    GG_NET_INT32,
+    GG_NET_FLOAT,   // Quantized to bits (at most 24) over [min, max].
+    GG_NET_V3,      // Three of those.
+    GG_NET_QUAT,    // x y z w, smallest three with bits (at most 10) each.
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t offset;    // In the element.
+    uint32_t size;      // GG_NET_BYTES only.
+    uint32_t bits;
+    float min;
+    float max;
+} ggNetField;
+
+typedef struct ggNetRegion {
+    uint32_t offset;    // Of the first element in persistent_storage.
+    uint32_t stride;
+    uint32_t count;
+    const ggNetField* fields;
+    uint32_t field_count;
+} ggNetRegion;
+
+typedef struct ggNetStats {
+    bool host;
+    bool connected;             // Host heard from the client, client applied a snapshot.
+    uint32_t entity_count;
+    uint32_t snapshot_words;
+    uint64_t snapshots_sent;
+    uint64_t snapshots_applied;
+    uint64_t snapshots_dropped; // Client, replaced by a newer one before all its packets came.
+    uint64_t packets_sent;
+    uint64_t packets_received;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t encode_us;
+    uint64_t decode_us;
+    uint32_t last_snapshot_bytes;
+    uint32_t last_baseline_age; // Snapshots back the last one was encoded against, 0 for none.
+} ggNetStats;
+
+typedef struct {
+    int socket;
+    bool host;
+    uint32_t peer_address;      // Network order, 0 until the host hears from a client.
+    uint16_t peer_port;
+
+    const ggNetRegion* regions;
+    uint32_t region_count;
+    uint32_t* region_words;     // Words per element of each region.
+    uint8_t* region_kinds;      // For each word of an element, GG_NET_FLOAT words are differences.
+    uint32_t* region_kind_offset;
+    uint32_t entity_count;
+    uint32_t word_count;
+    uint32_t max_entity_bytes;
+
+    // Snapshot sent or applied last, and for the host the newest one the client acked.
+    uint32_t sequence;
+    uint32_t acked;
+    uint32_t* history;
+    uint32_t history_sequence[GG_NET_HISTORY];
+
+    // Client, the snapshot whose packets are coming in.
+    uint32_t* assembling;
+    uint32_t assembling_sequence;
+    uint32_t assembling_received;
+    uint8_t* assembling_fragments;
+
+    uint8_t* packets;
+    uint32_t* packet_sizes;
+    uint32_t packet_capacity;
+
+    // Drops this percentage of outgoing packets, for testing.
+    uint32_t loss_percent;
+    uint32_t loss_seed;
+
+    ggNetStats stats;
+} ggNet;
+
+bool gg_net_open(ggNet* net, bool host, const char* address, int port,
+                 const ggNetRegion* regions, uint32_t region_count);
+// The host listens on port, the client sends to address:port. Fails on fields out of range.
+void gg_net_close(ggNet* net);
+
+bool gg_net_send_snapshot(ggNet* net, const void* storage);
+// Host. Reads acks, then sends storage as the next snapshot if a client has said hello.
+int gg_net_receive(ggNet* net, void* storage);
+// Client. Applies every snapshot that completes into storage and acks it, says hello until the
+// first one. Returns how many were applied.
+void gg_net_print_stats(const ggNet* net, float hz);
+
+#endif
+
+#if (defined(SAO_GAMEGUY_IMPLEMENTATION) || defined(SAO_GAMEGUY_PACK_IMPLEMENTATION) || \
+     defined(SAO_GAMEGUY_NET_IMPLEMENTATION) || defined(SAO_GAMEGUY_DEBUG_IMPLEMENTATION)) && \
+    !defined(SAO_GAMEGUY_MEMORY_IMPLEMENTATION)
+#define SAO_GAMEGUY_MEMORY_IMPLEMENTATION
+#endif
+
+#ifdef SAO_GAMEGUY_MEMORY_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _GG_ALLOCATION_MAGIC 0x4747
+
+// In front of every allocation, live ones are in a list so they can be reported by call site.
+// 48 bytes so what follows stays 16 byte aligned.
+typedef struct _ggAllocation {
+    struct _ggAllocation* prev;
+    struct _ggAllocation* next;
+    const char* file;
+    size_t size;
+    int32_t line;
+    uint16_t tag;
+    uint16_t magic;
+    uint32_t generation;
+    uint32_t pad;
+} _ggAllocation;
+
+_Static_assert(sizeof(_ggAllocation) == 48, "allocation header has to keep 16 byte alignment");
+
+static pthread_mutex_t _gg_memory_lock = PTHREAD_MUTEX_INITIALIZER;
+static _ggAllocation _gg_allocations = {&_gg_allocations, &_gg_allocations};
+static uint32_t _gg_memory_generation;
+static ggMemoryStats _gg_memory = {
+    .tag_names = {"platform", "debug", "assets", "audio", "net", "state", "game"},
+};
+
+// Call with the lock held. size is negative for frees.
+void
+_gg_memory_count(uint32_t tag, int64_t size, int64_t count, const char* file, int line)
+{
+    ggMemoryTagStats* stats = &_gg_memory.tags[tag];
+    stats->live_bytes += size;
+    stats->live_count += count;
+    _gg_memory.live_bytes += size;
+    if (stats->live_bytes > stats->high_water_bytes) {
+        stats->high_water_bytes = stats->live_bytes;
+    }
+    if (_gg_memory.live_bytes > _gg_memory.high_water_bytes) {
+        _gg_memory.high_water_bytes = _gg_memory.live_bytes;
+    }
+    if (file) {
+        stats->total_allocations++;
+        stats->frame_allocations++;
+        stats->frame_bytes += size > 0 ? size : 0;
+        ggMemorySite* site = &_gg_memory.recent[_gg_memory.recent_count++ % GG_MEMORY_RECENT];
+        *site = (ggMemorySite){file, line, tag, (size_t)(size > 0 ? size : 0)};
+    }
+}
+
+static inline void
+_gg_allocation_link(_ggAllocation* allocation)
+{
+    allocation->prev = _gg_allocations.prev;
+    allocation->next = &_gg_allocations;
+    _gg_allocations.prev->next = allocation;
+    _gg_allocations.prev = allocation;
+}
+
+static inline void
+_gg_allocation_unlink(_ggAllocation* allocation)
+{
+    allocation->prev->next = allocation->next;
+    allocation->next->prev = allocation->prev;
+}
+
+void*
+gg_allocate(uint32_t tag, size_t size, const char* file, int line)
+{
+    tag = tag < GG_MEMORY_TAGS ? tag : GG_MEMORY_TAGS - 1;
+    _ggAllocation* allocation = (_ggAllocation*)calloc(1, sizeof(_ggAllocation) + size);
+    if (!allocation) {
+        fprintf(stderr, "Error: out of memory allocating %zu bytes at %s:%d\n", size, file, line);
+        return NULL;
+    }
+    allocation->file = file;
+    allocation->line = line;
+    allocation->size = size;
+    allocation->tag = (uint16_t)tag;
+    allocation->magic = _GG_ALLOCATION_MAGIC;
+
+    pthread_mutex_lock(&_gg_memory_lock);
+    allocation->generation = _gg_memory_generation;
+    _gg_allocation_link(allocation);
+    _gg_memory_count(tag, (int64_t)size, 1, file, line);
+    pthread_mutex_unlock(&_gg_memory_lock);
+    return allocation + 1;
+}
+
+static inline _ggAllocation*
+_gg_allocation_of(void* memory)
+{
+    _ggAllocation* allocation = (_ggAllocation*)memory - 1;
+    if (allocation->magic != _GG_ALLOCATION_MAGIC) {
+        fprintf(stderr, "Error: %p wasn't allocated by gg_allocate or was already freed\n", memory);
+        return NULL;
+    }
+    return allocation;
+}
+
+void*
+gg_reallocate(uint32_t tag, void* memory, size_t size, const char* file, int line)
+{
+    if (!memory) {
+        return gg_allocate(tag, size, file, line);
+    }
+    _ggAllocation* allocation = _gg_allocation_of(memory);
+    if (!allocation) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&_gg_memory_lock);
+    _gg_allocation_unlink(allocation);
+    size_t old_size = allocation->size;
+    _ggAllocation* moved = (_ggAllocation*)realloc(allocation, sizeof(_ggAllocation) + size);
+    if (!moved) {
+        _gg_allocation_link(allocation);
+        pthread_mutex_unlock(&_gg_memory_lock);
+        fprintf(stderr, "Error: out of memory reallocating %zu bytes at %s:%d\n", size, file, line);
+        return NULL;
+    }
+    if (size > old_size) {
+        memset((uint8_t*)(moved + 1) + old_size, 0, size - old_size);
+    }
+    moved->file = file;
+    moved->line = line;
+    moved->size = size;
+    _gg_allocation_link(moved);
+    _gg_memory_count(moved->tag, (int64_t)size - (int64_t)old_size, 0, file, line);
+    pthread_mutex_unlock(&_gg_memory_lock);
+    return moved + 1;
+}
+
+void
+gg_deallocate(void* memory)
+{
+    if (!memory) {
+        return;
+    }
+    _ggAllocation* allocation = _gg_allocation_of(memory);
+    if (!allocation) {
+        return;
+    }
+    pthread_mutex_lock(&_gg_memory_lock);
+    _gg_allocation_unlink(allocation);
+    _gg_memory_count(allocation->tag, -(int64_t)allocation->size, -1, NULL, 0);
+    pthread_mutex_unlock(&_gg_memory_lock);
+    allocation->magic = 0;
+    free(allocation);
+}
+
+void
+gg_memory_account(uint32_t tag, int64_t bytes)
+{
+    tag = tag < GG_MEMORY_TAGS ? tag : GG_MEMORY_TAGS - 1;
+    pthread_mutex_lock(&_gg_memory_lock);
+    _gg_memory.tags[tag].mapped_bytes += bytes;
+    pthread_mutex_unlock(&_gg_memory_lock);
+}
+
+ggMemoryStats*
+gg_memory_stats(void)
+{
+    return &_gg_memory;
+}
+
+void
+gg_memory_end_frame(void)
+{
+    pthread_mutex_lock(&_gg_memory_lock);
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    for (int i=0; i<GG_MEMORY_TAGS; i++) {
+        ggMemoryTagStats* stats = &_gg_memory.tags[i];
+        stats->last_frame_allocations = stats->frame_allocations;
+        stats->last_frame_bytes = stats->frame_bytes;
+        if (stats->frame_allocations > stats->max_frame_allocations) {
+            stats->max_frame_allocations = stats->frame_allocations;
+        }
+        allocations += stats->frame_allocations;
+        bytes += stats->frame_bytes;
+        stats->frame_allocations = 0;
+        stats->frame_bytes = 0;
+    }
+    _gg_memory.last_frame_allocations = allocations;
+    _gg_memory.last_frame_bytes = bytes;
+    _gg_memory.allocating_frames += allocations != 0;
+    _gg_memory.frame++;
+    pthread_mutex_unlock(&_gg_memory_lock);
+}
+
+uint32_t
+gg_memory_begin_generation(void)
+{
+    pthread_mutex_lock(&_gg_memory_lock);
+    uint32_t generation = ++_gg_memory_generation;
+    pthread_mutex_unlock(&_gg_memory_lock);
+    return generation;
+}
+
+const char*
+_gg_memory_tag_name(uint32_t tag, char* buffer, size_t buffer_size)
+{
+    if (_gg_memory.tag_names[tag]) {
+        return _gg_memory.tag_names[tag];
+    }
+    snprintf(buffer, buffer_size, "tag %u", tag);
+    return buffer;
+}
+
+typedef struct {
+    const char* file;
+    int line;
+    uint32_t tag;
+    uint64_t count;
+    uint64_t bytes;
+} _ggMemorySiteTotal;
+
+int
+_gg_memory_compare_sites(const void* a, const void* b)
+{
+    uint64_t a_bytes = ((const _ggMemorySiteTotal*)a)->bytes;
+    uint64_t b_bytes = ((const _ggMemorySiteTotal*)b)->bytes;
+    return a_bytes < b_bytes ? 1 : a_bytes > b_bytes ? -1 : 0;
+}
+
+void
+gg_memory_report_live(const char* title, uint32_t first_generation, int max_sites)
+{
+    pthread_mutex_lock(&_gg_memory_lock);
+    // Few sites stay live at once, a linear search is fine. This is plain malloc so the report
+    // doesn't show up in itself.
+    _ggMemorySiteTotal* sites = NULL;
+    int site_count = 0;
+    int site_capacity = 0;
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    for (_ggAllocation* a = _gg_allocations.next; a != &_gg_allocations; a = a->next) {
+        if (a->generation < first_generation) {
+            continue;
+        }
+        int i = 0;
+        while (i < site_count &&
+               (sites[i].line != a->line || sites[i].tag != a->tag || strcmp(sites[i].file, a->file) != 0)) {
+            i++;
+        }
+        if (i == site_count) {
+            if (site_count == site_capacity) {
+                site_capacity = site_capacity ? site_capacity * 2 : 64;
+                _ggMemorySiteTotal* grown = (_ggMemorySiteTotal*)realloc(sites, site_capacity * sizeof(*sites));
+                if (!grown) {
+                    break;
+                }
+                sites = grown;
+            }
+            sites[site_count++] = (_ggMemorySiteTotal){a->file, a->line, a->tag, 0, 0};
+        }
+        sites[i].count++;
+        sites[i].bytes += a->size;
+        count++;
+        bytes += a->size;
+    }
+    pthread_mutex_unlock(&_gg_memory_lock);
+
+    if (count) {
+        qsort(sites, site_count, sizeof(*sites), _gg_memory_compare_sites);
+        fprintf(stderr, "%s: %llu allocations, %llu bytes\n", title, (unsigned long long)count,
+                (unsigned long long)bytes);
+        for (int i=0; i<site_count && i<max_sites; i++) {
+            char name[16];
+            fprintf(stderr, "  %10llu bytes %6llu x %-8s %s:%d\n", (unsigned long long)sites[i].bytes,
+                    (unsigned long long)sites[i].count, _gg_memory_tag_name(sites[i].tag, name, sizeof(name)),
+                    sites[i].file, sites[i].line);
+        }
+        if (site_count > max_sites) {
+            fprintf(stderr, "  and %d more sites\n", site_count - max_sites);
+        }
+    }
+    free(sites);
+}
+
+void
+gg_memory_print_stats(void)
+{
+    pthread_mutex_lock(&_gg_memory_lock);
+    fprintf(stderr, "Memory: high water %.2f MB, %llu of %llu frames allocated\n",
+            _gg_memory.high_water_bytes / (1024.0 * 1024.0), (unsigned long long)_gg_memory.allocating_frames,
+            (unsigned long long)_gg_memory.frame);
+    fprintf(stderr, "  %-8s %12s %12s %12s %10s %12s\n", "tag", "live", "high water", "mapped", "allocs",
+            "max/frame");
+    for (uint32_t i=0; i<GG_MEMORY_TAGS; i++) {
+        const ggMemoryTagStats* stats = &_gg_memory.tags[i];
+        if (!stats->total_allocations && !stats->mapped_bytes) {
+            continue;
+        }
+        char name[16];
+        fprintf(stderr, "  %-8s %12lld %12lld %12lld %10llu %12llu\n", _gg_memory_tag_name(i, name, sizeof(name)),
+                (long long)stats->live_bytes, (long long)stats->high_water_bytes, (long long)stats->mapped_bytes,
+                (unsigned long long)stats->total_allocations, (unsigned long long)stats->max_frame_allocations);
+    }
+    pthread_mutex_unlock(&_gg_memory_lock);
+}
+
+#endif // SAO_GAMEGUY_MEMORY_IMPLEMENTATION
+
+#if defined(SAO_GAMEGUY_IMPLEMENTATION) && !defined(SAO_GAMEGUY_PACK_IMPLEMENTATION)
+#define SAO_GAMEGUY_PACK_IMPLEMENTATION
+#endif
+
+#ifdef SAO_GAMEGUY_PACK_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef SAO_GAMEGUY_ZSTD
+#include <zstd.h>
+#endif
+
+// lz4 block format. A sequence is a token (literal length << 4 | match length - 4), more
+// length bytes if either is 15, the literals, then a 2 byte offset back to the match. The
+// last sequence is only literals. Matches can't start in the last 12 bytes or end in the last 5.
+#define _GG_LZ4_HASH_BITS 14
+#define _GG_LZ4_MIN_MATCH 4
+#define _GG_LZ4_LAST_LITERALS 5
+#define _GG_LZ4_MATCH_LIMIT 12
+
+static inline uint32_t
+_gg_read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+uint8_t*
+_gg_lz4_write_length(uint8_t* out, uint8_t* out_end, int length)
+{
+    for (; length >= 255; length -= 255) {
+        if (out >= out_end) return NULL;
+        *out++ = 255;
+    }
+    if (out >= out_end) return NULL;
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+// Writes literals [anchor, ip) and a match, match_length 0 means the last literals only.
+uint8_t*
+_gg_lz4_write_sequence(uint8_t* out, uint8_t* out_end, const uint8_t* anchor, int literal_length,
+                       int offset, int match_length)
+{
+    if (!out || out >= out_end) {
+        return NULL;
+    }
+    uint8_t* token = out++;
+    *token = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15 && !(out = _gg_lz4_write_length(out, out_end, literal_length - 15))) {
+        return NULL;
+    }
+    if (out + literal_length > out_end) {
+        return NULL;
+    }
+    memcpy(out, anchor, literal_length);
+    out += literal_length;
+
+    if (match_length) {
+        int extra = match_length - _GG_LZ4_MIN_MATCH;
+        *token |= (uint8_t)(extra < 15 ? extra : 15);
+        if (out + 2 > out_end) {
+            return NULL;
+        }
+        *out++ = (uint8_t)offset;
+        *out++ = (uint8_t)(offset >> 8);
+        if (extra >= 15 && !(out = _gg_lz4_write_length(out, out_end, extra - 15))) {
+            return NULL;
+        }
+    }
+    return out;
+}
+
+int
+gg_lz4_compress(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity)
+{
+    // Positions + 1 of the last time each 4 byte hash was seen.
+    int* table = (int*)gg_alloc(GG_TAG_ASSETS, (1 << _GG_LZ4_HASH_BITS) * sizeof(int));
+    if (!table) {
+        return -1;
+    }
+
+    uint8_t* out = dst;
+    uint8_t* out_end = dst + dst_capacity;
+    int anchor = 0;
+    int ip = 0;
+    int match_limit = src_size - _GG_LZ4_MATCH_LIMIT;
+    int match_end_limit = src_size - _GG_LZ4_LAST_LITERALS;
+
+    while (ip < match_limit) {
+        uint32_t sequence = _gg_read32(src + ip);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - _GG_LZ4_HASH_BITS);
+        int candidate = table[hash] - 1;
+        table[hash] = ip + 1;
+
+        if (candidate < 0 || ip - candidate > 65535 || _gg_read32(src + candidate) != sequence) {
+            ip++;
+            continue;
+        }
+
+        int length = _GG_LZ4_MIN_MATCH;
+        while (ip + length < match_end_limit && src[candidate + length] == src[ip + length]) {
+            length++;
+        }
+        out = _gg_lz4_write_sequence(out, out_end, src + anchor, ip - anchor, ip - candidate, length);
+        if (!out) {
+            gg_deallocate(table);
+            return -1;
+        }
+        ip += length;
+        anchor = ip;
+    }
+
+    out = _gg_lz4_write_sequence(out, out_end, src + anchor, src_size - anchor, 0, 0);
+    gg_deallocate(table);
+    return out ? (int)(out - dst) : -1;
+}
+
+int
+gg_lz4_decompress(const uint8_t* src, int src_size, uint8_t* dst, int dst_size)
+{
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_size;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= ip_end) return -1;
+                byte = *ip++;
+                literal_length += byte;
+            } while (byte == 255);
+        }
+        if (literal_length > (size_t)(ip_end - ip) || literal_length > (size_t)(op_end - op)) {
+            return -1;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= ip_end) return -1;
+                byte = *ip++;
+                match_length += byte;
+            } while (byte == 255);
+        }
+        match_length += _GG_LZ4_MIN_MATCH;
+        if (match_length > (size_t)(op_end - op)) {
+            return -1;
+        }
+        // Byte at a time, matches can overlap what they're writing.
+        const uint8_t* match = op - offset;
+        for (size_t i=0; i<match_length; i++) {
+            op[i] = match[i];
+        }
+        op += match_length;
+    }
+    return (int)(op - dst);
+}
+
+// True if count items of item_size starting at offset are inside size bytes.
+static bool
+_gg_pack_fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / item_size;
+}
+
+// Checks everything find and read rely on, so a damaged pack can't make them read outside the
+// mapping or probe forever.
+static bool
+_gg_pack_valid(const uint8_t* data, size_t size)
+{
+    const ggPackHeader* header = (const ggPackHeader*)data;
+    if (header->magic != GG_PACK_MAGIC || header->version != GG_PACK_VERSION || header->size != size ||
+        !header->slot_count || (header->slot_count & (header->slot_count - 1)) != 0 ||
+        header->slot_count <= header->entry_count ||
+        header->entries_offset % 8 != 0 || header->slots_offset % 4 != 0 ||
+        !_gg_pack_fits(header->entries_offset, header->entry_count, sizeof(ggPackEntry), size) ||
+        !_gg_pack_fits(header->slots_offset, header->slot_count, sizeof(uint32_t), size) ||
+        header->names_offset > size || header->data_offset > size) {
+        return false;
+    }
+
+    const uint32_t* slots = (const uint32_t*)(data + header->slots_offset);
+    for (uint32_t i=0; i<header->slot_count; i++) {
+        if (slots[i] > header->entry_count) {
+            return false;
+        }
+    }
+
+    const ggPackEntry* entries = (const ggPackEntry*)(data + header->entries_offset);
+    size_t names_size = size - header->names_offset;
+    for (uint32_t i=0; i<header->entry_count; i++) {
+        const ggPackEntry* entry = entries + i;
+        if (entry->name_offset >= names_size ||
+            !memchr(data + header->names_offset + entry->name_offset, '\0', names_size - entry->name_offset) ||
+            !_gg_pack_fits(entry->offset, entry->stored_size, 1, size) ||
+            entry->compression > GG_PACK_ZSTD ||
+            (entry->compression == GG_PACK_RAW && entry->stored_size != entry->size) ||
+            (entry->compression != GG_PACK_RAW && (entry->size > INT32_MAX || entry->stored_size > INT32_MAX))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+gg_pack_open(ggPack* pack, const char* filename)
+{
+    memset(pack, 0, sizeof(*pack));
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Error opening pack: %s\n", filename);
+        return false;
+    }
+    struct stat attr;
+    if (fstat(fd, &attr) == -1 || (size_t)attr.st_size < sizeof(ggPackHeader)) {
+        fprintf(stderr, "Error: %s is too small to be a pack\n", filename);
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, attr.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error mapping pack: %s\n", filename);
+        return false;
+    }
+
+    size_t size = attr.st_size;
+    if (!_gg_pack_valid((const uint8_t*)data, size)) {
+        fprintf(stderr, "Error: %s isn't a version %d pack or is damaged\n", filename, GG_PACK_VERSION);
+        munmap(data, size);
+        return false;
+    }
+    const ggPackHeader* header = (const ggPackHeader*)data;
+
+    pack->data = (const uint8_t*)data;
+    pack->size = size;
+    pack->header = header;
+    pack->entries = (const ggPackEntry*)(pack->data + header->entries_offset);
+    pack->slots = (const uint32_t*)(pack->data + header->slots_offset);
+    pack->names = (const char*)(pack->data + header->names_offset);
+    return true;
+}
+
+void
+gg_pack_close(ggPack* pack)
+{
+    if (pack->data) {
+        munmap((void*)pack->data, pack->size);
+    }
+    memset(pack, 0, sizeof(*pack));
+}
+
+const ggPackEntry*
+gg_pack_find(const ggPack* pack, const char* name)
+{
+    if (!pack->data || !pack->header->slot_count) {
+        return NULL;
+    }
+    uint64_t hash = gg_pack_hash(name);
+    uint32_t mask = pack->header->slot_count - 1;
+    // Open made sure there are more slots than entries, so probing ends at an empty one.
+    for (uint32_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        uint32_t index = pack->slots[slot];
+        if (!index || index > pack->header->entry_count) {
+            return NULL;
+        }
+        const ggPackEntry* entry = pack->entries + index - 1;
+        if (entry->hash == hash && strcmp(pack->names + entry->name_offset, name) == 0) {
+            return entry;
+        }
+    }
+}
+
+bool
+gg_pack_read(const ggPack* pack, const ggPackEntry* entry, void* buffer, size_t buffer_size)
+{
+    if (entry->offset + entry->stored_size > pack->size || buffer_size < entry->size) {
+        fprintf(stderr, "Error reading %s from pack\n", pack->names + entry->name_offset);
+        return false;
+    }
+    const uint8_t* stored = pack->data + entry->offset;
+
+    switch (entry->compression) {
+    case GG_PACK_RAW:
+        memcpy(buffer, stored, entry->size);
+        return true;
+    case GG_PACK_LZ4:
+        if (gg_lz4_decompress(stored, (int)entry->stored_size, (uint8_t*)buffer, (int)entry->size) == (int)entry->size) {
+            return true;
+        }
+        break;
+#ifdef SAO_GAMEGUY_ZSTD
+    case GG_PACK_ZSTD:
+        if (ZSTD_decompress(buffer, entry->size, stored, entry->stored_size) == entry->size) {
+            return true;
+        }
+        break;
+#endif
+    default:
+        fprintf(stderr, "Error: %s uses compression %u which this build can't read\n",
+                pack->names + entry->name_offset, entry->compression);
+        return false;
+    }
+    fprintf(stderr, "Error decompressing %s from pack\n", pack->names + entry->name_offset);
+    return false;
+}
+
+static inline uint64_t
+_gg_pack_align(uint64_t offset)
+{
+    return (offset + GG_PACK_ALIGNMENT - 1) & ~(uint64_t)(GG_PACK_ALIGNMENT - 1);
+}
+
+// Compresses data with the requested method, falls back to raw when it doesn't help.
+// Returns what to write, which is either data or *scratch.
+const uint8_t*
+_gg_pack_compress(const uint8_t* data, size_t size, int compression, uint8_t** scratch,
+                  size_t* scratch_size, ggPackEntry* entry)
+{
+    entry->compression = GG_PACK_RAW;
+    entry->stored_size = size;
+    if (compression == GG_PACK_RAW || size < 64) {
+        return data;
+    }
+
+    size_t bound = size + size / 255 + 64;
+    if (*scratch_size < bound) {
+        gg_deallocate(*scratch);
+        *scratch = (uint8_t*)gg_alloc(GG_TAG_ASSETS, bound);
+        *scratch_size = *scratch ? bound : 0;
+        if (!*scratch) {
+            return data;
+        }
+    }
+
+    long long compressed = -1;
+    if (compression == GG_PACK_LZ4 && size < INT32_MAX) {
+        compressed = gg_lz4_compress(data, (int)size, *scratch, (int)bound);
+    }
+#ifdef SAO_GAMEGUY_ZSTD
+    if (compression == GG_PACK_ZSTD) {
+        size_t result = ZSTD_compress(*scratch, bound, data, size, 9);
+        compressed = ZSTD_isError(result) ? -1 : (long long)result;
+    }
+#endif
+    if (compressed < 0 || (size_t)compressed > size - size / 8) {
+        return data;
+    }
+    entry->compression = compression;
+    entry->stored_size = compressed;
+    return *scratch;
+}
+
+bool
+gg_pack_build(const char* filename, const char** names, int count, int compression)
+{
+#ifndef SAO_GAMEGUY_ZSTD
+    if (compression == GG_PACK_ZSTD) {
+        fprintf(stderr, "Error: built without SAO_GAMEGUY_ZSTD\n");
+        return false;
+    }
+#endif
+
+    uint32_t slot_count = 16;
+    while (slot_count < (uint32_t)count * 2) {
+        slot_count *= 2;
+    }
+    size_t names_size = 0;
+    for (int i=0; i<count; i++) {
+        names_size += strlen(names[i]) + 1;
+    }
+
+    ggPackHeader header = {0};
+    header.magic = GG_PACK_MAGIC;
+    header.version = GG_PACK_VERSION;
+    header.entry_count = count;
+    header.slot_count = slot_count;
+    header.entries_offset = sizeof(ggPackHeader);
+    header.slots_offset = header.entries_offset + (uint64_t)count * sizeof(ggPackEntry);
+    header.names_offset = header.slots_offset + (uint64_t)slot_count * sizeof(uint32_t);
+    header.data_offset = _gg_pack_align(header.names_offset + names_size);
+
+    ggPackEntry* entries = (ggPackEntry*)gg_alloc(GG_TAG_ASSETS, (count + 1) * sizeof(ggPackEntry));
+    uint32_t* slots = (uint32_t*)gg_alloc(GG_TAG_ASSETS, slot_count * sizeof(uint32_t));
+    char* name_data = (char*)gg_alloc(GG_TAG_ASSETS, names_size + 1);
+    FILE* out = fopen(filename, "wb");
+    uint8_t* file_data = NULL;
+    size_t file_capacity = 0;
+    uint8_t* scratch = NULL;
+    size_t scratch_size = 0;
+    bool ok = entries && slots && name_data && out;
+    if (!out) {
+        fprintf(stderr, "Error creating pack: %s\n", filename);
+    }
+
+    uint64_t offset = header.data_offset;
+    size_t name_at = 0;
+    for (int i=0; ok && i<count; i++) {
+        ggPackEntry* entry = entries + i;
+        entry->hash = gg_pack_hash(names[i]);
+        entry->name_offset = (uint32_t)name_at;
+        memcpy(name_data + name_at, names[i], strlen(names[i]) + 1);
+        name_at += strlen(names[i]) + 1;
+
+        // Open addressing, linear probing.
+        uint32_t slot = entry->hash & (slot_count - 1);
+        for (; slots[slot]; slot = (slot + 1) & (slot_count - 1)) {
+            const ggPackEntry* other = entries + slots[slot] - 1;
+            if (other->hash == entry->hash && strcmp(name_data + other->name_offset, names[i]) == 0) {
+                fprintf(stderr, "Error: %s is in the pack twice\n", names[i]);
+                ok = false;
+                break;
+            }
+        }
+        slots[slot] = i + 1;
+
+        FILE* in = ok ? fopen(names[i], "rb") : NULL;
+        if (!in) {
+            fprintf(stderr, "Error reading %s\n", names[i]);
+            ok = false;
+            break;
+        }
+        fseek(in, 0, SEEK_END);
+        size_t size = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        if (size + 1 > file_capacity) {
+            gg_deallocate(file_data);
+            file_capacity = size + 1;
+            file_data = (uint8_t*)gg_alloc(GG_TAG_ASSETS, file_capacity);
+        }
+        ok = file_data && fread(file_data, 1, size, in) == size;
+        fclose(in);
+        if (!ok) {
+            fprintf(stderr, "Error reading %s\n", names[i]);
+            break;
+        }
+
+        entry->size = size;
+        entry->offset = offset;
+        const uint8_t* stored = _gg_pack_compress(file_data, size, compression, &scratch, &scratch_size, entry);
+        ok = fseek(out, offset, SEEK_SET) == 0 && fwrite(stored, 1, entry->stored_size, out) == entry->stored_size;
+        offset = _gg_pack_align(offset + entry->stored_size);
+    }
+
+    header.size = offset;
+    if (ok) {
+        // Pad the last blob so the file is as long as the header says.
+        static const uint8_t zeros[GG_PACK_ALIGNMENT] = {0};
+        long end = ftell(out);
+        ok = fwrite(zeros, 1, offset - end, out) == offset - end &&
+            fseek(out, 0, SEEK_SET) == 0 &&
+            fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(entries, sizeof(ggPackEntry), count, out) == (size_t)count &&
+            fwrite(slots, sizeof(uint32_t), slot_count, out) == slot_count &&
+            fwrite(name_data, 1, names_size, out) == names_size;
+    }
+
+    if (out && fclose(out) != 0) {
+        ok = false;
+    }
+    if (!ok && out) {
+        remove(filename);
+    }
+    gg_deallocate(entries);
+    gg_deallocate(slots);
+    gg_deallocate(name_data);
+    gg_deallocate(file_data);
+    gg_deallocate(scratch);
+    return ok;
+}
+
+#endif
+
+#if defined(SAO_GAMEGUY_IMPLEMENTATION) && !defined(SAO_GAMEGUY_NET_IMPLEMENTATION)
+#define SAO_GAMEGUY_NET_IMPLEMENTATION
+#endif
+
+#ifdef SAO_GAMEGUY_NET_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#define _GG_NET_MMSG
+#endif
+
+enum {
+    _GG_NET_SNAPSHOT,
+    _GG_NET_ACK,    // sequence is the newest snapshot applied, 0 says hello.
+};
+
+enum {
+    _GG_NET_XOR,
+    _GG_NET_DIFFERENCE,
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t baseline;          // 0 when encoded against nothing.
+    uint32_t first_entity;
+    uint16_t entity_count;
+    uint16_t fragment;
+    uint16_t fragment_count;
+    uint16_t type;
+} _ggNetHeader;
+
+#define _GG_NET_PAYLOAD (GG_NET_MAX_PACKET - sizeof(_ggNetHeader))
+
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+    uint32_t at;        // Bytes written or read.
+    uint64_t buffer;
+    uint32_t bits;
+} _ggBits;
+
+static inline void
+_gg_bits_write(_ggBits* bits, uint32_t value, uint32_t count)
+{
+    bits->buffer |= (uint64_t)value << bits->bits;
+    bits->bits += count;
+    while (bits->bits >= 8) {
+        bits->data[bits->at++] = (uint8_t)bits->buffer;
+        bits->buffer >>= 8;
+        bits->bits -= 8;
+    }
+}
+
+static inline void
+_gg_bits_flush(_ggBits* bits)
+{
+    if (bits->bits) {
+        bits->data[bits->at++] = (uint8_t)bits->buffer;
+        bits->buffer = 0;
+        bits->bits = 0;
+    }
+}
+
+// Reads past the end come back as zeros, check bits->at <= bits->size after.
+static inline uint32_t
+_gg_bits_read(_ggBits* bits, uint32_t count)
+{
+    while (bits->bits < count) {
+        uint64_t byte = bits->at < bits->size ? bits->data[bits->at] : 0;
+        bits->at++;
+        bits->buffer |= byte << bits->bits;
+        bits->bits += 8;
+    }
+    uint32_t value = (uint32_t)(bits->buffer & ((count == 32) ? 0xFFFFFFFFull : ((1ull << count) - 1)));
+    bits->buffer >>= count;
+    bits->bits -= count;
+    return value;
+}
+
+uint64_t
+_gg_net_microseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Quantized fields need a step, which 0 bits or min >= max don't have, and have to fit their
+// word, which is 24 bits for floats to stay exact and three of 10 plus 2 for quaternions.
+bool
+_gg_net_field_valid(const ggNetField* field)
+{
+    switch (field->type) {
+    case GG_NET_BYTES:
+    case GG_NET_INT32:
+        return true;
+    case GG_NET_FLOAT:
+    case GG_NET_V3:
+        return field->bits >= 1 && field->bits <= 24 && field->max > field->min;
+    case GG_NET_QUAT:
+        return field->bits >= 1 && field->bits <= 10;
+    default:
+        return false;
+    }
+}
+
+uint32_t
+_gg_net_field_words(const ggNetField* field)
+{
+    switch (field->type) {
+    case GG_NET_BYTES: return (field->size + 3) / 4;
+    case GG_NET_V3: return 3;
+    default: return 1;
+    }
+}
+
+static inline uint32_t
+_gg_quantize(float value, const ggNetField* field)
+{
+    float t = (value - field->min) / (field->max - field->min);
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    return (uint32_t)(t * (float)((1u << field->bits) - 1) + 0.5f);
+}
+
+static inline float
+_gg_dequantize(uint32_t value, const ggNetField* field)
+{
+    return field->min + (float)value / (float)((1u << field->bits) - 1) * (field->max - field->min);
+}
+
+// Smallest three, the largest component is dropped (and made positive) and rebuilt from the
+// others, which are all within +-1/sqrt(2).
+uint32_t
+_gg_quantize_quat(const float* q, uint32_t bits)
+{
+    float length = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    length = length > 0 ? length : 1;
+    uint32_t largest = 0;
+    for (uint32_t i=1; i<4; i++) {
+        largest = fabsf(q[i]) > fabsf(q[largest]) ? i : largest;
+    }
+    float sign = q[largest] < 0 ? -1.0f : 1.0f;
+    ggNetField range = {GG_NET_FLOAT, 0, 0, bits, -0.70710678f, 0.70710678f};
+
+    uint32_t word = largest;
+    uint32_t shift = 2;
+    for (uint32_t i=0; i<4; i++) {
+        if (i != largest) {
+            word |= _gg_quantize(q[i] * sign / length, &range) << shift;
+            shift += bits;
+        }
+    }
+    return word;
+}
+
+void
+_gg_dequantize_quat(uint32_t word, uint32_t bits, float* q)
+{
+    ggNetField range = {GG_NET_FLOAT, 0, 0, bits, -0.70710678f, 0.70710678f};
+    uint32_t largest = word & 3;
+    uint32_t shift = 2;
+    float sum = 0;
+    for (uint32_t i=0; i<4; i++) {
+        if (i != largest) {
+            q[i] = _gg_dequantize((word >> shift) & ((1u << bits) - 1), &range);
+            sum += q[i] * q[i];
+            shift += bits;
+        }
+    }
+    q[largest] = sqrtf(sum < 1 ? 1 - sum : 0);
+}
+
+void
+_gg_net_quantize(const ggNet* net, const uint8_t* storage, uint32_t* words)
+{
+    for (uint32_t r=0; r<net->region_count; r++) {
+        const ggNetRegion* region = &net->regions[r];
+        for (uint32_t e=0; e<region->count; e++) {
+            const uint8_t* element = storage + region->offset + (size_t)e * region->stride;
+            for (uint32_t f=0; f<region->field_count; f++) {
+                const ggNetField* field = &region->fields[f];
+                const uint8_t* data = element + field->offset;
+                float v[4];
+                switch (field->type) {
+                case GG_NET_BYTES:
+                    words[_gg_net_field_words(field) - 1] = 0;
+                    memcpy(words, data, field->size);
+                    break;
+                case GG_NET_INT32:
+                    memcpy(words, data, 4);
+                    break;
+                case GG_NET_FLOAT:
+                case GG_NET_V3:
+                    memcpy(v, data, _gg_net_field_words(field) * sizeof(float));
+                    for (uint32_t i=0; i<_gg_net_field_words(field); i++) {
+                        words[i] = _gg_quantize(v[i], field);
+                    }
+                    break;
+                case GG_NET_QUAT:
+                    memcpy(v, data, sizeof(v));
+                    words[0] = _gg_quantize_quat(v, field->bits);
+                    break;
+                }
+                words += _gg_net_field_words(field);
+            }
+        }
+    }
+}
+
+void
+_gg_net_dequantize(const ggNet* net, const uint32_t* words, uint8_t* storage)
+{
+    for (uint32_t r=0; r<net->region_count; r++) {
+        const ggNetRegion* region = &net->regions[r];
+        for (uint32_t e=0; e<region->count; e++) {
+            uint8_t* element = storage + region->offset + (size_t)e * region->stride;
+            for (uint32_t f=0; f<region->field_count; f++) {
+                const ggNetField* field = &region->fields[f];
+                uint8_t* data = element + field->offset;
+                float v[4];
+                switch (field->type) {
+                case GG_NET_BYTES:
+                    memcpy(data, words, field->size);
+                    break;
+                case GG_NET_INT32:
+                    memcpy(data, words, 4);
+                    break;
+                case GG_NET_FLOAT:
+                case GG_NET_V3:
+                    for (uint32_t i=0; i<_gg_net_field_words(field); i++) {
+                        v[i] = _gg_dequantize(words[i], field);
+                    }
+                    memcpy(data, v, _gg_net_field_words(field) * sizeof(float));
+                    break;
+                case GG_NET_QUAT:
+                    _gg_dequantize_quat(words[0], field->bits, v);
+                    memcpy(data, v, sizeof(v));
+                    break;
+                }
+                words += _gg_net_field_words(field);
+            }
+        }
+    }
+}
+
+// Unchanged is a 0 bit. Otherwise a 1, then per word a 0 bit if it's the same or a 1, the
+// delta's length - 1 in 5 bits and the delta.
+void
+_gg_net_encode_entity(_ggBits* bits, const uint32_t* words, const uint32_t* baseline,
+                      const uint8_t* kinds, uint32_t count)
+{
+    uint32_t deltas[64];
+    bool changed = false;
+    for (uint32_t i=0; i<count; i++) {
+        uint32_t delta;
+        if (kinds[i] == _GG_NET_DIFFERENCE) {
+            int32_t difference = (int32_t)(words[i] - baseline[i]);
+            delta = ((uint32_t)difference << 1) ^ (uint32_t)(difference >> 31);
+        } else {
+            delta = words[i] ^ baseline[i];
+        }
+        deltas[i] = delta;
+        changed |= delta != 0;
+    }
+
+    _gg_bits_write(bits, changed, 1);
+    if (!changed) {
+        return;
+    }
+    for (uint32_t i=0; i<count; i++) {
+        if (!deltas[i]) {
+            _gg_bits_write(bits, 0, 1);
+            continue;
+        }
+        uint32_t length = 32 - __builtin_clz(deltas[i]);
+        _gg_bits_write(bits, 1 | ((length - 1) << 1), 6);
+        _gg_bits_write(bits, deltas[i], length);
+    }
+}
+
+// Applies an entity's deltas to words, which holds the baseline.
+void
+_gg_net_decode_entity(_ggBits* bits, uint32_t* words, const uint8_t* kinds, uint32_t count)
+{
+    if (!_gg_bits_read(bits, 1)) {
+        return;
+    }
+    for (uint32_t i=0; i<count; i++) {
+        if (!_gg_bits_read(bits, 1)) {
+            continue;
+        }
+        uint32_t length = _gg_bits_read(bits, 5) + 1;
+        uint32_t delta = _gg_bits_read(bits, length);
+        if (kinds[i] == _GG_NET_DIFFERENCE) {
+            int32_t difference = (int32_t)((delta >> 1) ^ (0u - (delta & 1)));
+            words[i] += (uint32_t)difference;
+        } else {
+            words[i] ^= delta;
+        }
+    }
+}
+
+// Which region a global entity index is in.
+static inline uint32_t
+_gg_net_region_of(const ggNet* net, uint32_t entity, uint32_t* first_entity, uint32_t* first_word)
+{
+    *first_entity = 0;
+    *first_word = 0;
+    for (uint32_t r=0; r<net->region_count; r++) {
+        if (entity < *first_entity + net->regions[r].count) {
+            return r;
+        }
+        *first_entity += net->regions[r].count;
+        *first_word += net->regions[r].count * net->region_words[r];
+    }
+    return net->region_count;
+}
+
+bool
+_gg_net_send(ggNet* net, uint32_t count)
+{
+    struct sockaddr_in peer = {0};
+    peer.sin_family = AF_INET;
+    peer.sin_addr.s_addr = net->peer_address;
+    peer.sin_port = net->peer_port;
+
+    bool ok = true;
+    for (uint32_t first = 0; first < count; first += GG_NET_BATCH) {
+        uint32_t batch = count - first < GG_NET_BATCH ? count - first : GG_NET_BATCH;
+#ifdef _GG_NET_MMSG
+        struct mmsghdr messages[GG_NET_BATCH];
+        struct iovec vectors[GG_NET_BATCH];
+        uint32_t sending = 0;
+        for (uint32_t i=0; i<batch; i++) {
+            uint32_t packet = first + i;
+            if (net->loss_percent && (net->loss_seed = net->loss_seed * 1664525 + 1013904223) % 100 < net->loss_percent) {
+                continue;
+            }
+            vectors[sending] = (struct iovec){net->packets + (size_t)packet * GG_NET_MAX_PACKET, net->packet_sizes[packet]};
+            messages[sending] = (struct mmsghdr){0};
+            messages[sending].msg_hdr.msg_name = &peer;
+            messages[sending].msg_hdr.msg_namelen = sizeof(peer);
+            messages[sending].msg_hdr.msg_iov = &vectors[sending];
+            messages[sending].msg_hdr.msg_iovlen = 1;
+            sending++;
+        }
+        int sent = sending ? sendmmsg(net->socket, messages, sending, 0) : 0;
+        ok &= sent == (int)sending;
+#else
+        for (uint32_t i=0; i<batch; i++) {
+            uint32_t packet = first + i;
+            if (net->loss_percent && (net->loss_seed = net->loss_seed * 1664525 + 1013904223) % 100 < net->loss_percent) {
+                continue;
+            }
+            ok &= sendto(net->socket, net->packets + (size_t)packet * GG_NET_MAX_PACKET, net->packet_sizes[packet], 0,
+                         (struct sockaddr*)&peer, sizeof(peer)) == (ssize_t)net->packet_sizes[packet];
+        }
+#endif
+    }
+    for (uint32_t i=0; i<count; i++) {
+        net->stats.bytes_sent += net->packet_sizes[i];
+    }
+    net->stats.packets_sent += count;
+    return ok;
+}
+
+// Reads up to GG_NET_BATCH packets into net->packets and where each came from, returns how
+// many. The client only listens to the host, anything else gets size 0.
+uint32_t
+_gg_net_receive_batch(ggNet* net, struct sockaddr_in* from)
+{
+    uint32_t count = 0;
+#ifdef _GG_NET_MMSG
+    struct mmsghdr messages[GG_NET_BATCH];
+    struct iovec vectors[GG_NET_BATCH];
+    for (uint32_t i=0; i<GG_NET_BATCH; i++) {
+        vectors[i] = (struct iovec){net->packets + (size_t)i * GG_NET_MAX_PACKET, GG_NET_MAX_PACKET};
+        messages[i] = (struct mmsghdr){0};
+        messages[i].msg_hdr.msg_name = &from[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received = recvmmsg(net->socket, messages, GG_NET_BATCH, MSG_DONTWAIT, NULL);
+    for (int i=0; i<received; i++) {
+        net->packet_sizes[count++] = messages[i].msg_len;
+    }
+#else
+    for (; count < GG_NET_BATCH; count++) {
+        socklen_t length = sizeof(from[count]);
+        ssize_t received = recvfrom(net->socket, net->packets + (size_t)count * GG_NET_MAX_PACKET, GG_NET_MAX_PACKET,
+                                    0, (struct sockaddr*)&from[count], &length);
+        if (received < 0) {
+            break;
+        }
+        net->packet_sizes[count] = (uint32_t)received;
+    }
+#endif
+    for (uint32_t i=0; i<count; i++) {
+        net->stats.bytes_received += net->packet_sizes[i];
+        if (!net->host && (from[i].sin_addr.s_addr != net->peer_address || from[i].sin_port != net->peer_port)) {
+            net->packet_sizes[i] = 0;
+        }
+    }
+    net->stats.packets_received += count;
+    return count;
+}
+
+bool
+gg_net_open(ggNet* net, bool host, const char* address, int port,
+            const ggNetRegion* regions, uint32_t region_count)
+{
+    memset(net, 0, sizeof(*net));
+    net->socket = -1;
+    net->host = host;
+    net->regions = regions;
+    net->region_count = region_count;
+    net->loss_seed = 1;
+    net->stats.host = host;
+
+    uint32_t kind_count = 0;
+    net->region_words = (uint32_t*)gg_alloc(GG_TAG_NET, (region_count + 1) * sizeof(uint32_t));
+    net->region_kind_offset = (uint32_t*)gg_alloc(GG_TAG_NET, (region_count + 1) * sizeof(uint32_t));
+    for (uint32_t r=0; r<region_count; r++) {
+        for (uint32_t f=0; f<regions[r].field_count; f++) {
+            const ggNetField* field = &regions[r].fields[f];
+            if (!_gg_net_field_valid(field)) {
+                fprintf(stderr, "Error: net region %u field %u has type %u with %u bits over [%g, %g]\n",
+                        r, f, field->type, field->bits, field->min, field->max);
+                gg_net_close(net);
+                return false;
+            }
+            net->region_words[r] += _gg_net_field_words(field);
+        }
+        if (net->region_words[r] > 64) {
+            fprintf(stderr, "Error: net region %u has more than 256 bytes of fields per element\n", r);
+            gg_net_close(net);
+            return false;
+        }
+        net->region_kind_offset[r] = kind_count;
+        kind_count += net->region_words[r];
+        net->entity_count += regions[r].count;
+        net->word_count += regions[r].count * net->region_words[r];
+        uint32_t entity_bytes = (1 + net->region_words[r] * 38) / 8 + 2;
+        net->max_entity_bytes = entity_bytes > net->max_entity_bytes ? entity_bytes : net->max_entity_bytes;
+    }
+    net->region_kinds = (uint8_t*)gg_alloc(GG_TAG_NET, kind_count + 1);
+    for (uint32_t r=0; r<region_count; r++) {
+        uint8_t* kinds = net->region_kinds + net->region_kind_offset[r];
+        for (uint32_t f=0; f<regions[r].field_count; f++) {
+            const ggNetField* field = &regions[r].fields[f];
+            uint8_t kind = field->type == GG_NET_FLOAT || field->type == GG_NET_V3 ? _GG_NET_DIFFERENCE : _GG_NET_XOR;
+            for (uint32_t i=0; i<_gg_net_field_words(field); i++) {
+                *kinds++ = kind;
+            }
+        }
+    }
+    net->stats.entity_count = net->entity_count;
+    net->stats.snapshot_words = net->word_count;
+
+    // Worst case every entity fully changed, at least one per packet.
+    uint32_t per_packet = (uint32_t)(_GG_NET_PAYLOAD / (net->max_entity_bytes ? net->max_entity_bytes : 1));
+    per_packet = per_packet ? per_packet : 1;
+    net->packet_capacity = net->entity_count / per_packet + GG_NET_BATCH + 1;
+    net->packets = (uint8_t*)gg_alloc(GG_TAG_NET, (size_t)net->packet_capacity * GG_NET_MAX_PACKET);
+    net->packet_sizes = (uint32_t*)gg_alloc(GG_TAG_NET, net->packet_capacity * sizeof(uint32_t));
+    net->history = (uint32_t*)gg_alloc(GG_TAG_NET, ((size_t)GG_NET_HISTORY * net->word_count + 1) * sizeof(uint32_t));
+    net->assembling = (uint32_t*)gg_alloc(GG_TAG_NET, ((size_t)net->word_count + 1) * sizeof(uint32_t));
+    net->assembling_fragments = (uint8_t*)gg_alloc(GG_TAG_NET, net->packet_capacity / 8 + 1);
+    if (!net->region_kinds || !net->packets || !net->packet_sizes || !net->history ||
+        !net->assembling || !net->assembling_fragments) {
+        fprintf(stderr, "Error: out of memory for networking\n");
+        gg_net_close(net);
+        return false;
+    }
+    net->socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (net->socket == -1) {
+        fprintf(stderr, "Error creating socket: %s\n", strerror(errno));
+        gg_net_close(net);
+        return false;
+    }
+    fcntl(net->socket, F_SETFL, fcntl(net->socket, F_GETFL, 0) | O_NONBLOCK);
+    // A snapshot goes out as a burst, give the kernel room for a few of them.
+    int buffer_size = 4 << 20;
+    setsockopt(net->socket, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(net->socket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    if (host) {
+        struct sockaddr_in bind_address = {0};
+        bind_address.sin_family = AF_INET;
+        bind_address.sin_addr.s_addr = htonl(INADDR_ANY);
+        bind_address.sin_port = htons((uint16_t)port);
+        if (bind(net->socket, (struct sockaddr*)&bind_address, sizeof(bind_address)) == -1) {
+            fprintf(stderr, "Error binding port %d: %s\n", port, strerror(errno));
+            gg_net_close(net);
+            return false;
+        }
+        return true;
+    }
+
+    struct addrinfo hints = {0};
+    struct addrinfo* found = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(address, NULL, &hints, &found) != 0 || !found) {
+        fprintf(stderr, "Error: couldn't resolve %s\n", address);
+        gg_net_close(net);
+        return false;
+    }
+    net->peer_address = ((struct sockaddr_in*)found->ai_addr)->sin_addr.s_addr;
+    net->peer_port = htons((uint16_t)port);
+    freeaddrinfo(found);
+    return true;
+}
+
+void
+gg_net_close(ggNet* net)
+{
+    if (net->socket != -1) {
+        close(net->socket);
+    }
+    gg_deallocate(net->region_words);
+    gg_deallocate(net->region_kinds);
+    gg_deallocate(net->region_kind_offset);
+    gg_deallocate(net->packets);
+    gg_deallocate(net->packet_sizes);
+    gg_deallocate(net->history);
+    gg_deallocate(net->assembling);
+    gg_deallocate(net->assembling_fragments);
+    net->socket = -1;
+    net->region_words = NULL;
+    net->region_kinds = NULL;
+    net->region_kind_offset = NULL;
+    net->packets = NULL;
+    net->packet_sizes = NULL;
+    net->history = NULL;
+    net->assembling = NULL;
+    net->assembling_fragments = NULL;
+}
+
+bool
+_gg_net_send_ack(ggNet* net, uint32_t sequence)
+{
+    _ggNetHeader header = {GG_NET_MAGIC, sequence, 0, 0, 0, 0, 0, _GG_NET_ACK};
+    struct sockaddr_in peer = {0};
+    peer.sin_family = AF_INET;
+    peer.sin_addr.s_addr = net->peer_address;
+    peer.sin_port = net->peer_port;
+    net->stats.packets_sent++;
+    net->stats.bytes_sent += sizeof(header);
+    return sendto(net->socket, &header, sizeof(header), 0, (struct sockaddr*)&peer, sizeof(peer)) == sizeof(header);
+}
+
+bool
+gg_net_send_snapshot(ggNet* net, const void* storage)
+{
+    // Acks first, they pick the baseline.
+    struct sockaddr_in from[GG_NET_BATCH];
+    uint32_t count;
+    while ((count = _gg_net_receive_batch(net, from))) {
+        for (uint32_t i=0; i<count; i++) {
+            _ggNetHeader header;
+            if (net->packet_sizes[i] < sizeof(header)) {
+                continue;
+            }
+            memcpy(&header, net->packets + (size_t)i * GG_NET_MAX_PACKET, sizeof(header));
+            if (header.magic != GG_NET_MAGIC || header.type != _GG_NET_ACK) {
+                continue;
+            }
+            // The host answers whoever acked last.
+            net->peer_address = from[i].sin_addr.s_addr;
+            net->peer_port = from[i].sin_port;
+            net->stats.connected = true;
+            if (header.sequence > net->acked && header.sequence <= net->sequence) {
+                net->acked = header.sequence;
+            }
+        }
+    }
+    if (!net->stats.connected) {
+        return true;
+    }
+
+    uint64_t start = _gg_net_microseconds();
+    net->sequence++;
+    uint32_t* words = net->history + (size_t)(net->sequence % GG_NET_HISTORY) * net->word_count;
+    net->history_sequence[net->sequence % GG_NET_HISTORY] = net->sequence;
+    _gg_net_quantize(net, (const uint8_t*)storage, words);
+
+    static const uint32_t zeros[64];
+    uint32_t baseline = 0;
+    const uint32_t* baseline_words = NULL;
+    if (net->acked && net->sequence - net->acked < GG_NET_HISTORY &&
+        net->history_sequence[net->acked % GG_NET_HISTORY] == net->acked) {
+        baseline = net->acked;
+        baseline_words = net->history + (size_t)(baseline % GG_NET_HISTORY) * net->word_count;
+    }
+
+    uint32_t packet = 0;
+    uint32_t packet_first = 0;
+    _ggBits bits = {net->packets + sizeof(_ggNetHeader), _GG_NET_PAYLOAD};
+    uint32_t entity = 0;
+    for (uint32_t r=0; r<net->region_count; r++) {
+        uint32_t word_count = net->region_words[r];
+        const uint8_t* kinds = net->region_kinds + net->region_kind_offset[r];
+        for (uint32_t e=0; e<net->regions[r].count; e++, entity++) {
+            if (bits.at + net->max_entity_bytes > _GG_NET_PAYLOAD) {
+                _gg_bits_flush(&bits);
+                uint8_t* data = net->packets + (size_t)packet * GG_NET_MAX_PACKET;
+                _ggNetHeader header = {GG_NET_MAGIC, net->sequence, baseline, packet_first,
+                                       (uint16_t)(entity - packet_first), (uint16_t)packet, 0, _GG_NET_SNAPSHOT};
+                memcpy(data, &header, sizeof(header));
+                net->packet_sizes[packet] = sizeof(header) + bits.at;
+                packet++;
+                packet_first = entity;
+                bits = (_ggBits){net->packets + (size_t)packet * GG_NET_MAX_PACKET + sizeof(_ggNetHeader), _GG_NET_PAYLOAD};
+            }
+            _gg_net_encode_entity(&bits, words, baseline_words ? baseline_words : zeros, kinds, word_count);
+            words += word_count;
+            if (baseline_words) {
+                baseline_words += word_count;
+            }
+        }
+    }
+    _gg_bits_flush(&bits);
+    _ggNetHeader header = {GG_NET_MAGIC, net->sequence, baseline, packet_first,
+                           (uint16_t)(entity - packet_first), (uint16_t)packet, 0, _GG_NET_SNAPSHOT};
+    memcpy(net->packets + (size_t)packet * GG_NET_MAX_PACKET, &header, sizeof(header));
+    net->packet_sizes[packet] = sizeof(header) + bits.at;
+    packet++;
+
+    uint32_t bytes = 0;
+    for (uint32_t i=0; i<packet; i++) {
+        _ggNetHeader* written = (_ggNetHeader*)(net->packets + (size_t)i * GG_NET_MAX_PACKET);
+        written->fragment_count = (uint16_t)packet;
+        bytes += net->packet_sizes[i];
+    }
+    net->stats.encode_us += _gg_net_microseconds() - start;
+    net->stats.snapshots_sent++;
+    net->stats.last_snapshot_bytes = bytes;
+    net->stats.last_baseline_age = baseline ? net->sequence - baseline : 0;
+    return _gg_net_send(net, packet);
+}
+
+// Starts assembling a newer snapshot on top of its baseline, false if that baseline is gone.
+bool
+_gg_net_begin_snapshot(ggNet* net, const _ggNetHeader* header)
+{
+    if (net->assembling_sequence && net->assembling_sequence > net->acked) {
+        net->stats.snapshots_dropped++;
+    }
+    net->assembling_sequence = 0;
+    if (header->fragment_count == 0 || header->fragment_count > net->packet_capacity) {
+        return false;
+    }
+    if (header->baseline == 0) {
+        memset(net->assembling, 0, (size_t)net->word_count * sizeof(uint32_t));
+    } else if (net->history_sequence[header->baseline % GG_NET_HISTORY] == header->baseline) {
+        memcpy(net->assembling, net->history + (size_t)(header->baseline % GG_NET_HISTORY) * net->word_count,
+               (size_t)net->word_count * sizeof(uint32_t));
+    } else {
+        return false;
+    }
+    memset(net->assembling_fragments, 0, net->packet_capacity / 8 + 1);
+    net->assembling_sequence = header->sequence;
+    net->assembling_received = 0;
+    return true;
+}
+
+bool
+_gg_net_decode_fragment(ggNet* net, const _ggNetHeader* header, uint8_t* data, uint32_t size)
+{
+    if (header->first_entity > net->entity_count || header->entity_count > net->entity_count - header->first_entity) {
+        return false;
+    }
+    // Nothing to decode, and first_entity can be one past the last region.
+    if (header->entity_count == 0) {
+        return true;
+    }
+    uint32_t first_entity, first_word;
+    uint32_t r = _gg_net_region_of(net, header->first_entity, &first_entity, &first_word);
+    uint32_t* words = net->assembling + first_word + (header->first_entity - first_entity) * net->region_words[r];
+    uint32_t region_left = first_entity + net->regions[r].count - header->first_entity;
+
+    _ggBits bits = {data, size};
+    for (uint32_t e=0; e<header->entity_count; e++) {
+        while (!region_left) {
+            r++;
+            region_left = net->regions[r].count;
+        }
+        _gg_net_decode_entity(&bits, words, net->region_kinds + net->region_kind_offset[r], net->region_words[r]);
+        words += net->region_words[r];
+        region_left--;
+    }
+    return bits.at <= bits.size;
+}
+
+int
+gg_net_receive(ggNet* net, void* storage)
+{
+    int applied = 0;
+    struct sockaddr_in from[GG_NET_BATCH];
+    uint32_t count;
+    while ((count = _gg_net_receive_batch(net, from))) {
+        uint64_t start = _gg_net_microseconds();
+        for (uint32_t i=0; i<count; i++) {
+            uint8_t* data = net->packets + (size_t)i * GG_NET_MAX_PACKET;
+            _ggNetHeader header;
+            if (net->packet_sizes[i] < sizeof(header)) {
+                continue;
+            }
+            memcpy(&header, data, sizeof(header));
+            if (header.magic != GG_NET_MAGIC || header.type != _GG_NET_SNAPSHOT ||
+                header.sequence <= net->acked || header.fragment >= header.fragment_count) {
+                continue;
+            }
+            if (header.sequence > net->assembling_sequence && !_gg_net_begin_snapshot(net, &header)) {
+                continue;
+            }
+            if (header.sequence != net->assembling_sequence ||
+                header.fragment_count > net->packet_capacity ||
+                net->assembling_fragments[header.fragment / 8] & (1 << (header.fragment % 8))) {
+                continue;
+            }
+            if (!_gg_net_decode_fragment(net, &header, data + sizeof(header), net->packet_sizes[i] - sizeof(header))) {
+                fprintf(stderr, "Warning: dropping malformed snapshot %u\n", header.sequence);
+                net->assembling_sequence = 0;
+                net->stats.snapshots_dropped++;
+                continue;
+            }
+            net->assembling_fragments[header.fragment / 8] |= 1 << (header.fragment % 8);
+            if (++net->assembling_received < header.fragment_count) {
+                continue;
+            }
+
+            memcpy(net->history + (size_t)(header.sequence % GG_NET_HISTORY) * net->word_count, net->assembling,
+                   (size_t)net->word_count * sizeof(uint32_t));
+            net->history_sequence[header.sequence % GG_NET_HISTORY] = header.sequence;
+            net->acked = header.sequence;
+            net->sequence = header.sequence;
+            net->stats.last_baseline_age = header.baseline ? header.sequence - header.baseline : 0;
+            _gg_net_dequantize(net, net->assembling, (uint8_t*)storage);
+            net->stats.connected = true;
+            net->stats.snapshots_applied++;
+            applied++;
+            _gg_net_send_ack(net, header.sequence);
+        }
+        net->stats.decode_us += _gg_net_microseconds() - start;
+    }
+    // Say hello until the host starts sending.
+    if (!net->stats.connected) {
+        _gg_net_send_ack(net, 0);
+    }
+    return applied;
+}
+
+void
+gg_net_print_stats(const ggNet* net, float hz)
+{
+    const ggNetStats* stats = &net->stats;
+    uint64_t snapshots = stats->host ? stats->snapshots_sent : stats->snapshots_applied;
+    uint64_t bytes = stats->host ? stats->bytes_sent : stats->bytes_received;
+    double per_snapshot = snapshots ? (double)bytes / snapshots : 0;
+    double codec_us = (double)(stats->host ? stats->encode_us : stats->decode_us);
+    fprintf(stderr, "Net %s: %u entities, %llu snapshots, %.0f bytes each (%.1f kbit/s at %.0f Hz), "
+            "%s %.1f us each, %llu dropped, %llu packets sent, %llu received\n",
+            stats->host ? "host" : "client", stats->entity_count, (unsigned long long)snapshots,
+            per_snapshot, per_snapshot * 8 * hz / 1000.0, hz, stats->host ? "encode" : "decode",
+            snapshots ? codec_us / snapshots : 0, (unsigned long long)stats->snapshots_dropped,
+            (unsigned long long)stats->packets_sent, (unsigned long long)stats->packets_received);
+}
+
+#endif // SAO_GAMEGUY_NET_IMPLEMENTATION
+
+#if defined(SAO_GAMEGUY_IMPLEMENTATION) && !defined(SAO_GAMEGUY_AUDIO_IMPLEMENTATION)
+#define SAO_GAMEGUY_AUDIO_IMPLEMENTATION
+#endif
+
+#ifdef SAO_GAMEGUY_AUDIO_IMPLEMENTATION
+
+#include <string.h>
+#include <math.h>
+
+// Audio mixing.
+// The callback drains the command ring into a pending list, then mixes the buffer in segments
+// split at each pending command's sample so every command lands on exactly its sample. Voices
+// are mixed four frames at a time with gcc/clang vector types, which become sse or neon.
+// Resampling is linear, pan is constant power.
+typedef float ggF32x4 __attribute__((vector_size(16)));
+
+typedef struct {
+    const ggSound* sound;
+    uint32_t id;
+    uint32_t flags;
+    double position;    // In source frames.
+    double step;
+    float gain_left;
+    float gain_right;
+} ggVoice;
+
+typedef struct {
+    ggGameAudio* game;
+    uint32_t device;    // SDL_AudioDeviceID, set by the platform.
+    uint32_t sample_rate;
+
+    int voice_count;
+    ggVoice voices[GG_AUDIO_MAX_VOICES];
+    int pending_count;
+    ggAudioCommand pending[GG_AUDIO_MAX_COMMANDS];
+
+    // Where the device was at the last callback, to place frame_sample between callbacks.
+    _Atomic uint64_t mixed_samples;
+    _Atomic uint64_t callback_counter;
+} ggAudio;
+
+// Sets up the mixer without a device, the platform does this in gg_audio_open.
+void
+gg_audio_mixer_init(ggAudio* audio, ggGameAudio* game, uint32_t sample_rate, uint32_t buffer_frames)
+{
+    memset(audio, 0, sizeof(*audio));
+    memset(game, 0, sizeof(*game));
+    audio->game = game;
+    audio->sample_rate = sample_rate;
+    game->sample_rate = sample_rate;
+    game->buffer_frames = buffer_frames;
+}
+
+static inline ggF32x4
+_gg_load4(const float* p)
+{
+    ggF32x4 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void
+_gg_add4(float* p, ggF32x4 v)
+{
+    ggF32x4 sum = _gg_load4(p) + v;
+    memcpy(p, &sum, sizeof(sum));
+}
+
+void
+_gg_voice_set(ggVoice* voice, uint32_t output_rate, float gain, float pan, float rate)
+{
+    float angle = (pan < -1 ? -1 : pan > 1 ? 1 : pan) * 0.78539816f + 0.78539816f;
+    voice->gain_left = gain * cosf(angle);
+    voice->gain_right = gain * sinf(angle);
+    // Backwards isn't supported, 0 (or nan) holds the voice where it is.
+    voice->step = rate > 0 ? (double)rate * voice->sound->sample_rate / output_rate : 0;
+}
+
+// Mixes frames of voice into stereo out. Returns false once a one shot voice has finished.
+bool
+_gg_mix_voice(ggVoice* voice, float* out, int frames)
+{
+    const ggSound* sound = voice->sound;
+    const float* samples = sound->samples;
+    bool stereo = sound->channels == 2;
+    ggF32x4 gain = {voice->gain_left, voice->gain_right, voice->gain_left, voice->gain_right};
+
+    if (voice->step == 0) {
+        return true;
+    }
+
+    int i = 0;
+    while (i < frames) {
+        if (voice->position >= sound->frame_count) {
+            if (!(voice->flags & GG_AUDIO_LOOP) || sound->frame_count == 0) {
+                return false;
+            }
+            voice->position -= sound->frame_count;
+            continue;
+        }
+
+        float* o = out + 2*i;
+        if (voice->step == 1.0 && voice->position == (uint32_t)voice->position) {
+            // Straight copy at the source rate.
+            uint32_t index = (uint32_t)voice->position;
+            int n = frames - i;
+            if ((uint32_t)n > sound->frame_count - index) {
+                n = sound->frame_count - index;
+            }
+            int j = 0;
+            if (stereo) {
+                const float* s = samples + 2*index;
+                for (; j + 2 <= n; j += 2) {
+                    _gg_add4(o + 2*j, _gg_load4(s + 2*j) * gain);
+                }
+                for (; j < n; j++) {
+                    o[2*j] += s[2*j] * voice->gain_left;
+                    o[2*j + 1] += s[2*j + 1] * voice->gain_right;
+                }
+            } else {
+                const float* s = samples + index;
+                for (; j + 4 <= n; j += 4) {
+                    ggF32x4 v = _gg_load4(s + j);
+                    _gg_add4(o + 2*j, (ggF32x4){v[0], v[0], v[1], v[1]} * gain);
+                    _gg_add4(o + 2*j + 4, (ggF32x4){v[2], v[2], v[3], v[3]} * gain);
+                }
+                for (; j < n; j++) {
+                    o[2*j] += s[j] * voice->gain_left;
+                    o[2*j + 1] += s[j] * voice->gain_right;
+                }
+            }
+            voice->position += n;
+            i += n;
+            continue;
+        }
+
+        // Resampling, as many frames as stay before the last source frame, interpolating
+        // towards it. The last step into the end or loop point is done a frame at a time.
+        double last = sound->frame_count - 1;
+        int n = voice->position < last ? (int)((last - voice->position) / voice->step) : 0;
+        if (n > frames - i) {
+            n = frames - i;
+        }
+        double position = voice->position;
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            float a[8], b[8], t[4];
+            for (int k=0; k<4; k++) {
+                double p = position + (j + k) * voice->step;
+                uint32_t index = (uint32_t)p;
+                t[k] = (float)(p - index);
+                if (stereo) {
+                    a[k] = samples[2*index];
+                    b[k] = samples[2*index + 2];
+                    a[k + 4] = samples[2*index + 1];
+                    b[k + 4] = samples[2*index + 3];
+                } else {
+                    a[k] = samples[index];
+                    b[k] = samples[index + 1];
+                }
+            }
+            ggF32x4 f = _gg_load4(t);
+            ggF32x4 left = _gg_load4(a) + (_gg_load4(b) - _gg_load4(a)) * f;
+            ggF32x4 right = stereo ? _gg_load4(a + 4) + (_gg_load4(b + 4) - _gg_load4(a + 4)) * f : left;
+            _gg_add4(o + 2*j, (ggF32x4){left[0], right[0], left[1], right[1]} * gain);
+            _gg_add4(o + 2*j + 4, (ggF32x4){left[2], right[2], left[3], right[3]} * gain);
+        }
+        voice->position = position + j * voice->step;
+        i += j;
+
+        // Then a frame at a time, which covers the tail and interpolating across the end.
+        if (i < frames) {
+            uint32_t index = (uint32_t)voice->position;
+            uint32_t next = index + 1 < sound->frame_count ? index + 1
+                : (voice->flags & GG_AUDIO_LOOP) ? 0 : index;
+            float t = (float)(voice->position - index);
+            float* frame = out + 2*i;
+            if (stereo) {
+                frame[0] += (samples[2*index] + (samples[2*next] - samples[2*index]) * t) * voice->gain_left;
+                frame[1] += (samples[2*index + 1] + (samples[2*next + 1] - samples[2*index + 1]) * t) * voice->gain_right;
+            } else {
+                float v = samples[index] + (samples[next] - samples[index]) * t;
+                frame[0] += v * voice->gain_left;
+                frame[1] += v * voice->gain_right;
+            }
+            voice->position += voice->step;
+            i++;
+        }
+    }
+    return true;
+}
+
+void
+_gg_audio_apply(ggAudio* audio, const ggAudioCommand* command)
+{
+    ggGameAudio* game = audio->game;
+    if (command->type == GG_AUDIO_PLAY) {
+        if (audio->voice_count == GG_AUDIO_MAX_VOICES || !command->sound) {
+            atomic_fetch_add_explicit(&game->dropped_voices, 1, memory_order_relaxed);
+            return;
+        }
+        ggVoice* voice = &audio->voices[audio->voice_count++];
+        voice->sound = command->sound;
+        voice->id = command->voice;
+        voice->flags = command->flags;
+        voice->position = 0;
+        _gg_voice_set(voice, audio->sample_rate, command->gain, command->pan, command->rate);
+        return;
+    }
+
+    for (int i=0; i<audio->voice_count; i++) {
+        ggVoice* voice = &audio->voices[i];
+        if (voice->id != command->voice) {
+            continue;
+        }
+        if (command->type == GG_AUDIO_SET) {
+            _gg_voice_set(voice, audio->sample_rate, command->gain, command->pan, command->rate);
+        } else {
+            *voice = audio->voices[--audio->voice_count];
+        }
+        return;
+    }
+}
+
+void
+_gg_audio_mix_segment(ggAudio* audio, float* out, int frames)
+{
+    for (int i=0; i<audio->voice_count; ) {
+        if (_gg_mix_voice(&audio->voices[i], out, frames)) {
+            i++;
+        } else {
+            audio->voices[i] = audio->voices[--audio->voice_count];
+        }
+    }
+}
+
+// Mixes frames of stereo into out starting at output sample start.
+void
+gg_audio_mix(ggAudio* audio, float* out, int frames, uint64_t start)
+{
+    ggGameAudio* game = audio->game;
+    uint64_t end = start + frames;
+
+    uint32_t read = atomic_load_explicit(&game->read_index, memory_order_relaxed);
+    uint32_t write = atomic_load_explicit(&game->write_index, memory_order_acquire);
+    for (; read != write && audio->pending_count < GG_AUDIO_MAX_COMMANDS; read++) {
+        ggAudioCommand* command = &audio->pending[audio->pending_count++];
+        *command = game->commands[read & (GG_AUDIO_MAX_COMMANDS - 1)];
+        if (command->sample < start) {
+            atomic_fetch_add_explicit(&game->late_commands, 1, memory_order_relaxed);
+            command->sample = start;
+        }
+    }
+    atomic_store_explicit(&game->read_index, read, memory_order_release);
+
+    memset(out, 0, frames * 2 * sizeof(float));
+    uint64_t at = start;
+    while (at < end) {
+        // Apply everything due now, in the order it was pushed, then mix up to the next one.
+        uint64_t next = end;
+        int kept = 0;
+        for (int i=0; i<audio->pending_count; i++) {
+            ggAudioCommand* command = &audio->pending[i];
+            if (command->sample <= at) {
+                _gg_audio_apply(audio, command);
+            } else {
+                next = command->sample < next ? command->sample : next;
+                audio->pending[kept++] = *command;
+            }
+        }
+        audio->pending_count = kept;
+
+        _gg_audio_mix_segment(audio, out + 2*(at - start), (int)(next - at));
+        at = next;
+    }
+
+    for (int i=0; i<frames * 2; i++) {
+        out[i] = out[i] > 1 ? 1 : out[i] < -1 ? -1 : out[i];
+    }
+}
+
+#endif // SAO_GAMEGUY_AUDIO_IMPLEMENTATION
+
+#if defined(SAO_GAMEGUY_IMPLEMENTATION) && !defined(SAO_GAMEGUY_DEBUG_IMPLEMENTATION)
+#define SAO_GAMEGUY_DEBUG_IMPLEMENTATION
+#endif
+
+#ifdef SAO_GAMEGUY_DEBUG_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Profiler collation.
+// Runs on the main thread at the end of every frame, drains every thread's ring, matches
+// begin/end events and aggregates them per block. With a trace file open it also keeps
+// every event so it can be written out as a chrome://tracing / perfetto json file.
+#ifndef GG_DEBUG_MAX_DEPTH
+#define GG_DEBUG_MAX_DEPTH 64
+#endif
+#ifndef GG_DEBUG_MAX_TRACE_EVENTS
+#define GG_DEBUG_MAX_TRACE_EVENTS (1 << 22)
+#endif
+#define GG_DEBUG_NAME_CACHE_SIZE 1024 // power of two, > GG_DEBUG_MAX_BLOCKS
+
+typedef struct {
+    uint32_t name_index;
+    uint64_t begin_clock;
+} ggDebugOpenBlock;
+
+typedef struct {
+    uint64_t clock;
+    uint32_t name_index;
+    uint16_t thread_index;
+    uint16_t type;
+} ggDebugTraceEvent;
+
+typedef struct {
+    ggDebugTable table;
+
+    // Names are copied so stats and traces survive the game library being unloaded.
+    // cache maps the game's string pointers to name indices and is cleared on reload.
+    char* names[GG_DEBUG_MAX_BLOCKS];
+    uint32_t name_count;
+    const char* cache_keys[GG_DEBUG_NAME_CACHE_SIZE];
+    uint32_t cache_values[GG_DEBUG_NAME_CACHE_SIZE];
+
+    ggDebugOpenBlock stacks[GG_DEBUG_MAX_THREADS][GG_DEBUG_MAX_DEPTH];
+    int depths[GG_DEBUG_MAX_THREADS];
+    uint32_t dropped_seen[GG_DEBUG_MAX_THREADS];
+
+    ggDebugBlockStats totals[GG_DEBUG_MAX_BLOCKS];
+    uint64_t frames_collated;
+    uint64_t last_collate_clock;
+
+    bool capture_trace;
+    ggDebugTraceEvent* trace;
+    size_t trace_count;
+    size_t trace_capacity;
+
+    uint64_t start_clock;
+    uint64_t start_nanoseconds;
+} ggDebugCollator;
+
+uint64_t
+_gg_debug_nanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+gg_debug_init(ggDebugCollator* collator, bool recording, bool capture_trace)
+{
+    memset(collator, 0, sizeof(*collator));
+    atomic_store(&collator->table.recording, recording);
+    collator->capture_trace = capture_trace;
+    collator->start_clock = gg_read_cycle_counter();
+    collator->start_nanoseconds = _gg_debug_nanoseconds();
+    collator->last_collate_clock = collator->start_clock;
+}
+
+void
+gg_debug_free(ggDebugCollator* collator)
+{
+    // Rings are claimed from whichever module recorded first, so they're plain calloc.
+    uint32_t ring_count = atomic_load(&collator->table.ring_count);
+    for (uint32_t i=0; i<ring_count && i<GG_DEBUG_MAX_THREADS; i++) {
+        free(collator->table.rings[i].events);
+    }
+    // A table allocated at the same address later must not find this thread's old ring.
+    if (_gg_thread_debug_table == &collator->table) {
+        _gg_thread_debug_table = NULL;
+    }
+    for (uint32_t i=0; i<collator->name_count; i++) {
+        gg_deallocate(collator->names[i]);
+    }
+    gg_deallocate(collator->trace);
+    gg_deallocate(collator);
+}
+
+// Old string pointers can't be trusted once the library they lived in is gone.
+void
+gg_debug_library_reloaded(ggDebugCollator* collator)
+{
+    memset(collator->cache_keys, 0, sizeof(collator->cache_keys));
+}
+
+double
+gg_debug_seconds_per_cycle(ggDebugCollator* collator)
+{
+    uint64_t cycles = gg_read_cycle_counter() - collator->start_clock;
+    double seconds = (_gg_debug_nanoseconds() - collator->start_nanoseconds) * 1e-9;
+    return cycles ? seconds / (double)cycles : 0;
+}
+
+uint32_t
+_gg_debug_name_index(ggDebugCollator* collator, const char* name)
+{
+    uint32_t slot = (uint32_t)(((uintptr_t)name >> 3) * 2654435761u) & (GG_DEBUG_NAME_CACHE_SIZE - 1);
+    while (collator->cache_keys[slot]) {
+        if (collator->cache_keys[slot] == name) {
+            return collator->cache_values[slot];
+        }
+        slot = (slot + 1) & (GG_DEBUG_NAME_CACHE_SIZE - 1);
+    }
+
+    // Cache miss, only happens the first time we see a name after a reload.
+    uint32_t index;
+    for (index=0; index<collator->name_count; index++) {
+        if (strcmp(collator->names[index], name) == 0) {
+            break;
+        }
+    }
+    if (index == collator->name_count) {
+        if (collator->name_count == GG_DEBUG_MAX_BLOCKS) {
+            return GG_DEBUG_MAX_BLOCKS;
+        }
+        collator->names[collator->name_count++] = strcpy((char*)gg_alloc(GG_TAG_DEBUG, strlen(name) + 1), name);
+    }
+
+    collator->cache_keys[slot] = name;
+    collator->cache_values[slot] = index;
+    return index;
+}
+
+void
+_gg_debug_add_sample(ggDebugBlockStats* stats, uint64_t cycles)
+{
+    if (stats->hit_count == 0 || cycles < stats->min_cycles) {
+        stats->min_cycles = cycles;
+    }
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+    stats->hit_count++;
+    stats->total_cycles += cycles;
+}
+
+void
+_gg_debug_trace_event(ggDebugCollator* collator, uint64_t clock, uint32_t name_index,
+                      uint32_t thread_index, uint32_t type)
+{
+    if (collator->trace_count == collator->trace_capacity) {
+        if (collator->trace_capacity == GG_DEBUG_MAX_TRACE_EVENTS) {
+            return;
+        }
+        collator->trace_capacity = collator->trace_capacity ? collator->trace_capacity * 2 : 4096;
+        collator->trace = (ggDebugTraceEvent*)gg_realloc(GG_TAG_DEBUG, collator->trace,
+                                                      collator->trace_capacity * sizeof(ggDebugTraceEvent));
+    }
+
+    ggDebugTraceEvent* event = collator->trace + collator->trace_count++;
+    event->clock = clock;
+    event->name_index = name_index;
+    event->thread_index = thread_index;
+    event->type = type;
+}
+
+void
+gg_debug_collate(ggDebugCollator* collator)
+{
+    ggDebugTable* table = &collator->table;
+    ggDebugFrameStats* frame = &table->last_frame;
+
+    uint64_t now = gg_read_cycle_counter();
+    frame->frame_cycles = now - collator->last_collate_clock;
+    collator->last_collate_clock = now;
+
+    uint32_t ring_count = atomic_load_explicit(&table->ring_count, memory_order_acquire);
+    if (ring_count > GG_DEBUG_MAX_THREADS) {
+        ring_count = GG_DEBUG_MAX_THREADS;
+    }
+
+    // Recording can be toggled at any time, read it every frame. Events recorded before it
+    // was switched off are still collated, after that there's nothing to do.
+    bool recording = atomic_load_explicit(&table->recording, memory_order_relaxed);
+    if (!recording) {
+        bool pending = false;
+        for (uint32_t t=0; t<ring_count && !pending; t++) {
+            ggDebugEventRing* ring = &table->rings[t];
+            pending = atomic_load_explicit(&ring->thread_id, memory_order_acquire) &&
+                atomic_load_explicit(&ring->read_index, memory_order_relaxed) !=
+                atomic_load_explicit(&ring->write_index, memory_order_acquire);
+        }
+        if (!pending) {
+            frame->block_count = 0;
+            return;
+        }
+    }
+
+    frame->block_count = collator->name_count;
+    for (uint32_t i=0; i<frame->block_count; i++) {
+        frame->blocks[i] = (ggDebugBlockStats){.name = collator->names[i]};
+    }
+
+    for (uint32_t t=0; t<ring_count; t++) {
+        ggDebugEventRing* ring = &table->rings[t];
+        if (!atomic_load_explicit(&ring->thread_id, memory_order_acquire)) {
+            continue;
+        }
+
+        uint32_t read_index = atomic_load_explicit(&ring->read_index, memory_order_relaxed);
+        uint32_t write_index = atomic_load_explicit(&ring->write_index, memory_order_acquire);
+
+        for (; read_index != write_index; read_index++) {
+            ggDebugEvent* event = ring->events + (read_index & (GG_DEBUG_RING_SIZE - 1));
+            uint32_t name_index = _gg_debug_name_index(collator, event->name);
+            if (name_index == GG_DEBUG_MAX_BLOCKS) {
+                continue;
+            }
+
+            if (event->type == GG_DEBUG_EVENT_BEGIN_BLOCK) {
+                if (collator->depths[t] < GG_DEBUG_MAX_DEPTH) {
+                    ggDebugOpenBlock* open = &collator->stacks[t][collator->depths[t]++];
+                    open->name_index = name_index;
+                    open->begin_clock = event->clock;
+                }
+            } else {
+                // Unwind to the nearest matching begin, anything above it lost its end.
+                // Unmatched ends come from dropped begins, skip them.
+                int depth = collator->depths[t];
+                while (depth > 0 && collator->stacks[t][depth-1].name_index != name_index) {
+                    depth--;
+                }
+                if (depth == 0) {
+                    continue;
+                }
+                uint64_t cycles = event->clock - collator->stacks[t][depth-1].begin_clock;
+                collator->depths[t] = depth - 1;
+
+                // First time seeing this name.
+                for (; frame->block_count <= name_index; frame->block_count++) {
+                    frame->blocks[frame->block_count] =
+                        (ggDebugBlockStats){.name = collator->names[frame->block_count]};
+                }
+                _gg_debug_add_sample(&frame->blocks[name_index], cycles);
+            }
+
+            if (collator->capture_trace) {
+                _gg_debug_trace_event(collator, event->clock, name_index, t, event->type);
+            }
+        }
+
+        atomic_store_explicit(&ring->read_index, read_index, memory_order_release);
+
+        // Once events are dropped or recording stops, open blocks may never see their end.
+        uint32_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != collator->dropped_seen[t] || !recording) {
+            collator->dropped_seen[t] = dropped;
+            collator->depths[t] = 0;
+        }
+    }
+
+    frame->seconds_per_cycle = gg_debug_seconds_per_cycle(collator);
+
+    for (uint32_t i=0; i<frame->block_count; i++) {
+        ggDebugBlockStats* block = &frame->blocks[i];
+        ggDebugBlockStats* total = &collator->totals[i];
+        if (block->hit_count == 0) {
+            continue;
+        }
+        total->name = block->name;
+        if (total->hit_count == 0 || block->min_cycles < total->min_cycles) {
+            total->min_cycles = block->min_cycles;
+        }
+        if (block->max_cycles > total->max_cycles) {
+            total->max_cycles = block->max_cycles;
+        }
+        total->hit_count += block->hit_count;
+        total->total_cycles += block->total_cycles;
+    }
+    collator->frames_collated++;
+}
+
+int
+_gg_compare_block_totals(const void* a, const void* b)
+{
+    uint64_t x = ((const ggDebugBlockStats*)a)->total_cycles;
+    uint64_t y = ((const ggDebugBlockStats*)b)->total_cycles;
+    return (x < y) - (x > y);
+}
+
+void
+gg_debug_print_summary(ggDebugCollator* collator)
+{
+    if (collator->frames_collated == 0) {
+        return;
+    }
+
+    ggDebugBlockStats sorted[GG_DEBUG_MAX_BLOCKS];
+    memcpy(sorted, collator->totals, collator->name_count * sizeof(ggDebugBlockStats));
+    qsort(sorted, collator->name_count, sizeof(ggDebugBlockStats), _gg_compare_block_totals);
+
+    double ms_per_cycle = gg_debug_seconds_per_cycle(collator) * 1000.0;
+    fprintf(stderr, "Profile over %llu frames:\n", (unsigned long long)collator->frames_collated);
+    fprintf(stderr, "  %-32s %10s %12s %12s %12s\n", "block", "hits/frame", "ms/frame", "min ms", "max ms");
+    for (uint32_t i=0; i<collator->name_count; i++) {
+        ggDebugBlockStats* block = &sorted[i];
+        if (block->hit_count == 0) {
+            continue;
+        }
+        fprintf(stderr, "  %-32s %10.1f %12.4f %12.4f %12.4f\n",
+                block->name,
+                (double)block->hit_count / collator->frames_collated,
+                block->total_cycles * ms_per_cycle / collator->frames_collated,
+                block->min_cycles * ms_per_cycle,
+                block->max_cycles * ms_per_cycle);
+    }
+
+    uint32_t dropped = 0;
+    for (uint32_t t=0; t<GG_DEBUG_MAX_THREADS; t++) {
+        dropped += atomic_load(&collator->table.rings[t].dropped);
+    }
+    if (dropped) {
+        fprintf(stderr, "  %u events dropped, rings were full.\n", dropped);
+    }
+}
+
+void
+_gg_write_json_string(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+        }
+        if ((unsigned char)*s >= 0x20) {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Chrome trace event format, loads in chrome://tracing and ui.perfetto.dev.
+bool
+gg_debug_write_chrome_trace(ggDebugCollator* collator, const char* filename)
+{
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        fprintf(stderr, "Error writing trace file: %s\n", filename);
+        return false;
+    }
+
+    double us_per_cycle = gg_debug_seconds_per_cycle(collator) * 1000000.0;
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i=0; i<collator->trace_count; i++) {
+        ggDebugTraceEvent* event = collator->trace + i;
+        fprintf(f, "{\"name\": ");
+        _gg_write_json_string(f, collator->names[event->name_index]);
+        fprintf(f, ", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u}%s\n",
+                event->type == GG_DEBUG_EVENT_BEGIN_BLOCK ? 'B' : 'E',
+                (event->clock - collator->start_clock) * us_per_cycle,
+                event->thread_index,
+                i+1 < collator->trace_count ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    fprintf(stderr, "Wrote %zu trace events to %s\n", collator->trace_count, filename);
+    return true;
+}
+
+#endif // SAO_GAMEGUY_DEBUG_IMPLEMENTATION
+
+#ifdef SAO_GAMEGUY_IMPLEMENTATION
+
+#include <SDL2/SDL.h>
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
+#include <assert.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+// The pack from --pack, file reads look in here before the filesystem.
+static ggPack _gg_pack;
+
+bool
+gg_find_asset(const char* name, ggAsset* asset)
+{
+    const ggPackEntry* entry = gg_pack_find(&_gg_pack, name);
+    if (!entry) {
+        return false;
+    }
+    asset->data = entry->compression == GG_PACK_RAW ? _gg_pack.data + entry->offset : NULL;
+    asset->size = entry->size;
+    asset->index = (uint32_t)(entry - _gg_pack.entries);
+    return true;
+}
+
+bool
+gg_read_asset(const ggAsset* asset, void* buffer, size_t buffer_size)
+{
+    if (!_gg_pack.data || asset->index >= _gg_pack.header->entry_count) {
+        return false;
+    }
+    return gg_pack_read(&_gg_pack, _gg_pack.entries + asset->index, buffer, buffer_size);
+}
+
+int
+gg_debug_get_file_size(const char* filename)
+{
+    const ggPackEntry* entry = gg_pack_find(&_gg_pack, filename);
+    if (entry) {
+        return (int)entry->size+1;
+    }
+
+    struct stat attr;
+    if (stat(filename, &attr) == -1) {
+        fprintf(stderr, "Error reading file size: %s\n", filename);
+        return -1;
+    };
+    return attr.st_size+1;
+}
+
+bool
+gg_debug_read_entire_file(const char* filename, char* buffer, size_t buffer_size)
+{
+    const ggPackEntry* entry = gg_pack_find(&_gg_pack, filename);
+    if (entry && buffer_size > entry->size) {
+        buffer[entry->size] = '\0';
+        return gg_pack_read(&_gg_pack, entry, buffer, buffer_size);
+    }
+
+    FILE* f = fopen(filename, "r");
+    fread(buffer, 1, buffer_size-1, f);
+    fclose(f);
+
+    buffer[buffer_size-1] = '\0';
+    
+    return true;
+}
+
+// Persistent storage images.
+// A header then the storage at GG_STATE_DATA_OFFSET, which is page aligned everywhere so
+// the storage can be mapped straight from the file. The mapping is private, the game's
+// writes never reach the image, saving writes a new image next to it and renames it over
+// so a crash mid save leaves the old one intact.
+#ifndef GG_PERSISTENT_STORAGE_ADDRESS
+#define GG_PERSISTENT_STORAGE_ADDRESS 0x200000000000ull
+#endif
+#define GG_STATE_MAGIC 0x54534747 // GGST
+#define GG_STATE_FORMAT_VERSION 1
+#define GG_STATE_DATA_OFFSET 65536
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t state_version;
+    uint32_t pointer_size;
+    uint64_t address;
+    uint64_t size;
+} ggStateHeader;
+
+static const char* _gg_state_filename;
+static void* _gg_state_storage;
+static uint64_t _gg_state_size;
+static uint32_t _gg_state_version;
+
+// Maps size bytes at GG_PERSISTENT_STORAGE_ADDRESS, from the image in filename if it matches
+// state_version, else zeroed. Sets *resumed if it came from the image.
+void*
+gg_persistent_storage_map(const char* filename, uint64_t size, uint32_t state_version, bool* resumed)
+{
+    void* address = (void*)(uintptr_t)GG_PERSISTENT_STORAGE_ADDRESS;
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_FIXED_NOREPLACE
+    // Don't stomp on anything that happens to be mapped there already.
+    flags = MAP_PRIVATE | MAP_FIXED_NOREPLACE;
+#endif
+    *resumed = false;
+
+    int fd = filename ? open(filename, O_RDONLY) : -1;
+    if (fd != -1) {
+        ggStateHeader header;
+        struct stat attr;
+        bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+            fstat(fd, &attr) == 0 &&
+            header.magic == GG_STATE_MAGIC &&
+            header.format_version == GG_STATE_FORMAT_VERSION &&
+            header.pointer_size == sizeof(void*) &&
+            header.address == GG_PERSISTENT_STORAGE_ADDRESS &&
+            (uint64_t)attr.st_size == GG_STATE_DATA_OFFSET + header.size;
+
+        if (!valid) {
+            fprintf(stderr, "Warning: %s isn't a state image from this platform, starting fresh.\n", filename);
+        } else if (header.state_version != state_version || header.size != size) {
+            fprintf(stderr, "Warning: %s is state version %u (%llu bytes), the game wants %u (%llu bytes), "
+                    "starting fresh.\n", filename, header.state_version, (unsigned long long)header.size,
+                    state_version, (unsigned long long)size);
+        } else {
+            void* storage = mmap(address, size, PROT_READ | PROT_WRITE, flags, fd, GG_STATE_DATA_OFFSET);
+            if (storage == address) {
+                close(fd);
+                *resumed = true;
+                return storage;
+            }
+            if (storage != MAP_FAILED) {
+                munmap(storage, size);
+            }
+            fprintf(stderr, "Warning: couldn't map %s at %p, starting fresh.\n", filename, address);
+        }
+        close(fd);
+    }
+
+    void* storage = mmap(address, size, PROT_READ | PROT_WRITE, flags | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (storage != address) {
+        fprintf(stderr, "Error: couldn't reserve persistent storage at %p.\n", address);
+        if (storage != MAP_FAILED) {
+            munmap(storage, size);
+        }
+        return NULL;
+    }
+    return storage;
+}
+
+bool
+gg_persistent_storage_save(const char* filename, const void* storage, uint64_t size, uint32_t state_version)
+{
+    char temp_filename[4096];
+    snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+    int fd = open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Error saving persistent storage to %s\n", temp_filename);
+        return false;
+    }
+
+    ggStateHeader header = {
+        .magic = GG_STATE_MAGIC,
+        .format_version = GG_STATE_FORMAT_VERSION,
+        .state_version = state_version,
+        .pointer_size = sizeof(void*),
+        .address = GG_PERSISTENT_STORAGE_ADDRESS,
+        .size = size,
+    };
+    bool ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        ftruncate(fd, GG_STATE_DATA_OFFSET + size) == 0;
+
+    // Chunks that are all zero are left as holes, most of a big arena usually is.
+    static const uint8_t zeros[GG_STATE_DATA_OFFSET] = {0};
+    const uint8_t* data = (const uint8_t*)storage;
+    for (uint64_t at = 0; ok && at < size; at += GG_STATE_DATA_OFFSET) {
+        size_t chunk = size - at < GG_STATE_DATA_OFFSET ? size - at : GG_STATE_DATA_OFFSET;
+        if (memcmp(data + at, zeros, chunk) != 0) {
+            ok = pwrite(fd, data + at, chunk, GG_STATE_DATA_OFFSET + at) == (ssize_t)chunk;
+        }
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(temp_filename, filename) != 0) {
+        fprintf(stderr, "Error saving persistent storage to %s\n", filename);
+        remove(temp_filename);
+        return false;
+    }
+    return true;
+}
+
+bool
+gg_save_persistent_storage(void)
+{
+    if (!_gg_state_filename || !_gg_state_storage) {
+        return false;
+    }
+    return gg_persistent_storage_save(_gg_state_filename, _gg_state_storage, _gg_state_size, _gg_state_version);
+}
+
+// Timing.
+// Everything is measured with the performance counter, SDL_GetTicks is only ms resolution.
+#ifndef GG_SPIN_SECONDS
+// How long before a deadline we stop sleeping and spin instead. SDL_Delay can overshoot by
+// a ms or two depending on the scheduler so this has to cover that.
+#define GG_SPIN_SECONDS 0.002
+#endif
+
+#ifndef GG_SWAP_MARGIN_SECONDS
+// With vsync on we stop pacing this long before the frame deadline and let the swap block.
+#define GG_SWAP_MARGIN_SECONDS 0.001
+#endif
+
+#ifndef GG_MAX_CATCHUP_UPDATES
+// Max fixed updates run in a single frame. After a hitch (or sitting in a debugger) the extra
+// time is dropped instead of trying to simulate all of it.
+#define GG_MAX_CATCHUP_UPDATES 8
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GG_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define GG_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define GG_CPU_RELAX()
+#endif
+
+static uint64_t _gg_counter_frequency;
+
+double
+gg_seconds_elapsed(uint64_t start_counter, uint64_t end_counter)
+{
+    return (double)(end_counter - start_counter) / (double)_gg_counter_frequency;
+}
+
+// Sleep for most of the wait and spin for the rest.
+void
+gg_wait_until(uint64_t target_counter)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (now >= target_counter) {
+        return;
+    }
+
+    double sleep_seconds = gg_seconds_elapsed(now, target_counter) - GG_SPIN_SECONDS;
+    if (sleep_seconds >= 0.001) {
+        SDL_Delay((uint32_t)(sleep_seconds * 1000.0));
+    }
+
+    while (SDL_GetPerformanceCounter() < target_counter) {
+        GG_CPU_RELAX();
+    }
+}
+
+// Running mean and variance of frame times (welford) so we can see how steady pacing is.
+typedef struct {
+    uint64_t count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+} ggFrameStats;
+
+void
+gg_frame_stats_add(ggFrameStats* stats, double seconds)
+{
+    stats->count++;
+    if (stats->count == 1) {
+        stats->min = seconds;
+        stats->max = seconds;
+    }
+    stats->min = seconds < stats->min ? seconds : stats->min;
+    stats->max = seconds > stats->max ? seconds : stats->max;
+
+    double delta = seconds - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (seconds - stats->mean);
+}
+
+void
+gg_frame_stats_print(ggFrameStats* stats)
+{
+    if (stats->count < 2) {
+        return;
+    }
+    double stddev = sqrt(stats->m2 / (stats->count - 1));
+    fprintf(stderr, "Frame time: mean %.3fms, stddev %.3fms, min %.3fms, max %.3fms over %llu frames\n",
+            stats->mean * 1000.0, stddev * 1000.0, stats->min * 1000.0, stats->max * 1000.0,
+            (unsigned long long)stats->count);
+}
+
+// Game library reloading.
+//
+// A thread watches the library (inotify on linux, polling stat everywhere else). When it
+// changes we wait until no lock file exists and the file has stopped changing, copy it to
+// a unique temp path and dlopen the copy, so the compiler can overwrite the original while
+// it's loaded and we never load a half written file. The new library is handed to the main
+// thread which swaps it in at the start of the next frame.
+//
+// If your build script can, create <library>.lock before building and delete it after.
+#ifndef GG_RELOAD_POLL_MS
+#define GG_RELOAD_POLL_MS 100
+#endif
+#ifndef GG_RELOAD_SETTLE_MS
+#define GG_RELOAD_SETTLE_MS 50 // File has to be unchanged this long before we load it.
+#endif
+#define GG_RELOAD_LOCK_SUFFIX ".lock"
+
+typedef struct {
+    void* handle;
+    ggGame* gg_game;
+
+    uint64_t change_counter; // When the watcher first saw the change.
+    double wait_seconds;
+    double copy_seconds;
+    double load_seconds;
+} ggLoadedLibrary;
+
+typedef struct {
+    void *handle;
+    ggGame* gg_game;
+
+    const char* library;
+    char lock_filename[1024];
+    struct stat loaded_attr;
+    uint32_t copy_count;
+
+    SDL_Thread* watch_thread;
+    _Atomic bool quit;
+    _Atomic(ggLoadedLibrary*) pending;
+} CurrentGame;
+
+bool
+_gg_same_file_version(struct stat* a, struct stat* b)
+{
+    return a->st_ino == b->st_ino &&
+        a->st_size == b->st_size &&
+        a->st_mtime == b->st_mtime;
+}
+
+bool
+_gg_copy_file(const char* from, const char* to)
+{
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return false;
+    }
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    char buffer[1 << 16];
+    ssize_t bytes;
+    bool ok = true;
+    while ((bytes = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, bytes) != bytes) {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && bytes == 0;
+
+    close(in);
+    close(out);
+    return ok;
+}
+
+// Copies the library somewhere unique and loads it. Safe to call from any thread.
+ggLoadedLibrary*
+_gg_load_library_copy(CurrentGame* current_game)
+{
+    const char* library = current_game->library;
+
+    const char* tmp_dir = getenv("TMPDIR");
+    if (!tmp_dir) {
+        tmp_dir = "/tmp";
+    }
+    const char* extension = strrchr(library, '.');
+    if (!extension || strchr(extension, '/')) {
+        extension = "";
+    }
+
+    char copy_filename[1024];
+    snprintf(copy_filename, sizeof(copy_filename), "%s/gameguy_%d_%u%s",
+             tmp_dir, (int)getpid(), current_game->copy_count++, extension);
+
+    uint64_t start_counter = SDL_GetPerformanceCounter();
+    if (!_gg_copy_file(library, copy_filename)) {
+        fprintf(stderr, "Error copying game library to %s\n", copy_filename);
+        unlink(copy_filename);
+        return NULL;
+    }
+    uint64_t copied_counter = SDL_GetPerformanceCounter();
+
+    void* handle = dlopen(copy_filename, RTLD_NOW | RTLD_LOCAL);
+    // The mapping stays valid, no need to leave temp files around.
+    unlink(copy_filename);
+
+    if (!handle) {
+        fprintf(stderr, "Error loading game library: %s\n", dlerror());
+        return NULL;
+    }
+
+    ggGame* game = (ggGame*)dlsym(handle, "gg_game");
+    if (!game) {
+        fprintf(stderr, "[error] Error loading api symbol.\n");
+        dlclose(handle);
+        return NULL;
+    }
+
+    ggLoadedLibrary* loaded = (ggLoadedLibrary*)gg_alloc(GG_TAG_PLATFORM, sizeof(ggLoadedLibrary));
+    loaded->handle = handle;
+    loaded->gg_game = game;
+    loaded->copy_seconds = gg_seconds_elapsed(start_counter, copied_counter);
+    loaded->load_seconds = gg_seconds_elapsed(copied_counter, SDL_GetPerformanceCounter());
+    return loaded;
+}
+
+// Blocks until there's no lock file and the library has stopped changing.
+bool
+_gg_wait_for_library_write(CurrentGame* current_game, struct stat* attr)
+{
+    struct stat last = {0};
+    bool have_last = false;
+
+    while (!atomic_load(&current_game->quit)) {
+        struct stat lock_attr;
+        if (stat(current_game->lock_filename, &lock_attr) == 0 ||
+            stat(current_game->library, attr) != 0) {
+            have_last = false;
+
+        } else if (have_last && _gg_same_file_version(attr, &last)) {
+            return true;
+
+        } else {
+            last = *attr;
+            have_last = true;
+        }
+        SDL_Delay(GG_RELOAD_SETTLE_MS);
+    }
+    return false;
+}
+
+#ifdef __linux__
+// Watches the library's directory, returns an inotify fd or -1 if we should poll.
+int
+_gg_watch_library(const char* library)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    char directory[1024];
+    const char* slash = strrchr(library, '/');
+    if (slash) {
+        snprintf(directory, sizeof(directory), "%.*s", (int)(slash - library), library);
+    } else {
+        snprintf(directory, sizeof(directory), ".");
+    }
+    if (directory[0] == '\0') {
+        snprintf(directory, sizeof(directory), "/");
+    }
+
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM;
+    if (inotify_add_watch(fd, directory, mask) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Waits up to GG_RELOAD_POLL_MS, true if anything with the library or lock file name happened.
+bool
+_gg_wait_for_inotify(int fd, const char* library, const char* lock_filename)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, GG_RELOAD_POLL_MS) <= 0) {
+        return false;
+    }
+
+    const char* library_name = strrchr(library, '/') ? strrchr(library, '/') + 1 : library;
+    const char* lock_name = strrchr(lock_filename, '/') ? strrchr(lock_filename, '/') + 1 : lock_filename;
+
+    bool changed = false;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t bytes;
+    while ((bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* at = buffer; at < buffer + bytes; ) {
+            struct inotify_event* event = (struct inotify_event*)at;
+            if (event->len &&
+                (strcmp(event->name, library_name) == 0 || strcmp(event->name, lock_name) == 0)) {
+                changed = true;
+            }
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+#endif
+
+int
+_gg_library_watch_thread(void* data)
+{
+    CurrentGame* current_game = (CurrentGame*)data;
+
+    int watch_fd = -1;
+#ifdef __linux__
+    watch_fd = _gg_watch_library(current_game->library);
+#endif
+    if (watch_fd < 0) {
+        fprintf(stderr, "Watching %s by polling.\n", current_game->library);
+    }
+
+    while (!atomic_load(&current_game->quit)) {
+        bool changed = false;
+        struct stat attr;
+
+#ifdef __linux__
+        if (watch_fd >= 0) {
+            changed = _gg_wait_for_inotify(watch_fd, current_game->library, current_game->lock_filename);
+        }
+#endif
+        if (watch_fd < 0) {
+            SDL_Delay(GG_RELOAD_POLL_MS);
+            changed = stat(current_game->library, &attr) == 0 &&
+                !_gg_same_file_version(&attr, &current_game->loaded_attr);
+        }
+
+        if (!changed) {
+            continue;
+        }
+
+        uint64_t change_counter = SDL_GetPerformanceCounter();
+        if (!_gg_wait_for_library_write(current_game, &attr)) {
+            continue;
+        }
+        if (_gg_same_file_version(&attr, &current_game->loaded_attr)) {
+            // Touched but not rebuilt, or the lock file went away with nothing new.
+            continue;
+        }
+        double wait_seconds = gg_seconds_elapsed(change_counter, SDL_GetPerformanceCounter());
+
+        ggLoadedLibrary* loaded = _gg_load_library_copy(current_game);
+        current_game->loaded_attr = attr;
+        if (!loaded) {
+            continue;
+        }
+        loaded->change_counter = change_counter;
+        loaded->wait_seconds = wait_seconds;
+
+        // If the main thread hasn't picked up the last one yet this one replaces it.
+        ggLoadedLibrary* skipped = atomic_exchange(&current_game->pending, loaded);
+        if (skipped) {
+            dlclose(skipped->handle);
+            gg_deallocate(skipped);
+        }
+    }
+
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
+    return 0;
+}
+
+// Loads the library right away and starts watching it for changes.
+bool
+gg_game_load(CurrentGame* current_game, const char* library)
+{
+    current_game->library = library;
+    snprintf(current_game->lock_filename, sizeof(current_game->lock_filename),
+             "%s%s", library, GG_RELOAD_LOCK_SUFFIX);
+    atomic_store(&current_game->quit, false);
+    atomic_store(&current_game->pending, NULL);
+
+    if (stat(library, &current_game->loaded_attr) != 0) {
+        fprintf(stderr, "Error loading game library, can't stat %s.\n", library);
+    } else {
+        ggLoadedLibrary* loaded = _gg_load_library_copy(current_game);
+        if (loaded) {
+            current_game->handle = loaded->handle;
+            current_game->gg_game = loaded->gg_game;
+            gg_deallocate(loaded);
+        }
+    }
+
+    current_game->watch_thread = SDL_CreateThread(_gg_library_watch_thread, "gameguy reload", current_game);
+    return current_game->gg_game != NULL;
+}
+
+// Called at the start of every frame, swaps in a library the watcher finished loading.
+// No syscalls unless there is something to swap.
+bool
+gg_game_reload(CurrentGame* current_game, const char* library)
+{
+    if (!atomic_load_explicit(&current_game->pending, memory_order_relaxed)) {
+        return false;
+    }
+
+    ggLoadedLibrary* loaded = atomic_exchange(&current_game->pending, NULL);
+    if (!loaded) {
+        return false;
+    }
+
+    if (current_game->handle) {
+        dlclose(current_game->handle);
+    }
+    current_game->handle = loaded->handle;
+    current_game->gg_game = loaded->gg_game;
+
+    fprintf(stderr, "Reloaded Game Library in %.1fms (waiting for write %.1fms, copy %.1fms, dlopen %.1fms)\n",
+            gg_seconds_elapsed(loaded->change_counter, SDL_GetPerformanceCounter()) * 1000.0,
+            loaded->wait_seconds * 1000.0,
+            loaded->copy_seconds * 1000.0,
+            loaded->load_seconds * 1000.0);
+
+    gg_deallocate(loaded);
+    return true;
+}
+
+void
+gg_game_unload(CurrentGame* current_game)
+{
+    atomic_store(&current_game->quit, true);
+    SDL_WaitThread(current_game->watch_thread, NULL);
+
+    ggLoadedLibrary* loaded = atomic_exchange(&current_game->pending, NULL);
+    if (loaded) {
+        dlclose(loaded->handle);
+        gg_deallocate(loaded);
+    }
+    if (current_game->handle) {
+        dlclose(current_game->handle);
+        current_game->handle = NULL;
+    }
+}
+
+void
+_gg_clear_input_transitions(ggGameInput* input)
+{
+    for (int i=0; i<sizeof(input->button.e)/sizeof(input->button.e[0]); i++) {
+        input->button.e[i].half_transition_count = 0;
+    }
+    for (int i=0; i<GG_KEY_COUNT; i++) {
+        input->keys[i].half_transition_count = 0;
+    }
+    input->mouse1.half_transition_count = 0;
+    input->mouse2.half_transition_count = 0;
+
+    input->horisontal_scroll = 0;
+    input->vertical_scroll = 0;
+
+    input->mouse_moved = false;
+    input->mouse_dx = 0;
+    input->mouse_dy = 0;
+    input->latched_mouse_dx = 0;
+    input->latched_mouse_dy = 0;
+
+    input->event_count = 0;
+    input->events_dropped = 0;
+}
+
+// Named buttons in input->button.e by scancode, stored +1 so 0 means not a named button.
+// Scancodes are physical key positions so wasd stays wasd on other keyboard layouts.
+static const uint8_t _gg_scancode_buttons[SDL_NUM_SCANCODES] = {
+    [SDL_SCANCODE_W] = 1,
+    [SDL_SCANCODE_A] = 2,
+    [SDL_SCANCODE_S] = 3,
+    [SDL_SCANCODE_D] = 4,
+    [SDL_SCANCODE_Q] = 5,
+    [SDL_SCANCODE_E] = 6,
+    [SDL_SCANCODE_UP] = 7,
+    [SDL_SCANCODE_DOWN] = 8,
+    [SDL_SCANCODE_LEFT] = 9,
+    [SDL_SCANCODE_RIGHT] = 10,
+    [SDL_SCANCODE_SPACE] = 11,
+    [SDL_SCANCODE_LCTRL] = 12,
+    [SDL_SCANCODE_LSHIFT] = 13,
+    [SDL_SCANCODE_1] = 14,
+    [SDL_SCANCODE_2] = 15,
+    [SDL_SCANCODE_3] = 16,
+    [SDL_SCANCODE_4] = 17,
+    [SDL_SCANCODE_5] = 18,
+    [SDL_SCANCODE_6] = 19,
+    [SDL_SCANCODE_7] = 20,
+    [SDL_SCANCODE_8] = 21,
+    [SDL_SCANCODE_9] = 22,
+    [SDL_SCANCODE_0] = 23,
+    [SDL_SCANCODE_ESCAPE] = 24,
+    [SDL_SCANCODE_RETURN] = 25,
+};
+
+// SDL event timestamps are SDL_GetTicks ms, this is SDL_GetTicks when the game began.
+static uint32_t _gg_start_ticks;
+
+void
+_gg_push_input_event(ggGameInput* input, uint32_t type, uint32_t code, uint32_t timestamp,
+                     float x, float y, float dx, float dy)
+{
+    if (input->event_count == GG_MAX_INPUT_EVENTS) {
+        input->events_dropped++;
+        return;
+    }
+    ggInputEvent* event = input->events + input->event_count++;
+    event->type = type;
+    event->code = code;
+    event->time = (float)(timestamp - _gg_start_ticks) / 1000.0f;
+    event->x = x;
+    event->y = y;
+    event->dx = dx;
+    event->dy = dy;
+}
+
+void
+_gg_update_button(ggButton* button, bool down)
+{
+    if (button->ended_down != down) {
+        button->half_transition_count++;
+        button->ended_down = down;
+    }
+}
+
+// Returns false if the event asks us to quit.
+bool
+gg_process_input_event(ggGameInput* input, SDL_Event* event)
+{
+    switch(event->type) {
+    case SDL_QUIT:
+        return false;
+
+    case SDL_MOUSEWHEEL:
+        input->horisontal_scroll += event->wheel.x;
+        input->vertical_scroll += event->wheel.y;
+        _gg_push_input_event(input, GG_INPUT_MOUSE_WHEEL, 0, event->wheel.timestamp,
+                             event->wheel.x, event->wheel.y, 0, 0);
+        break;
+
+    case SDL_MOUSEMOTION:
+        input->mouse_moved = true;
+        input->mouse_dx += event->motion.xrel;
+        input->mouse_dy += event->motion.yrel;
+        _gg_push_input_event(input, GG_INPUT_MOUSE_MOVE, 0, event->motion.timestamp,
+                             event->motion.x, event->motion.y, event->motion.xrel, event->motion.yrel);
+        break;
+
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP: {
+        bool down = event->type == SDL_MOUSEBUTTONDOWN;
+        if (event->button.button == SDL_BUTTON_LEFT) {
+            _gg_update_button(&input->mouse1, down);
+        } else if (event->button.button == SDL_BUTTON_RIGHT) {
+            _gg_update_button(&input->mouse2, down);
+        }
+        _gg_push_input_event(input, down ? GG_INPUT_MOUSE_DOWN : GG_INPUT_MOUSE_UP,
+                             event->button.button, event->button.timestamp,
+                             event->button.x, event->button.y, 0, 0);
+    } break;
+
+    case SDL_KEYDOWN:
+    case SDL_KEYUP: {
+        if (event->key.repeat) {
+            break;
+        }
+
+        bool down = event->type == SDL_KEYDOWN;
+        if (down && event->key.keysym.sym == SDLK_ESCAPE) {
+            return false;
+        }
+
+        SDL_Scancode scancode = event->key.keysym.scancode;
+        if (scancode < 0 || scancode >= GG_KEY_COUNT) {
+            break;
+        }
+
+        _gg_update_button(&input->keys[scancode], down);
+        if (scancode < SDL_NUM_SCANCODES && _gg_scancode_buttons[scancode]) {
+            _gg_update_button(&input->button.e[_gg_scancode_buttons[scancode] - 1], down);
+        }
+        _gg_push_input_event(input, down ? GG_INPUT_KEY_DOWN : GG_INPUT_KEY_UP,
+                             scancode, event->key.timestamp, 0, 0, 0, 0);
+    } break;
+
+    default:
+        break;
+    };
+
+    return true;
+}
+
+// platform_api.latch_input. Looks at the mouse movement waiting in SDL's queue without taking
+// it out, it still shows up as normal input next frame.
+void
+gg_latch_input(ggGameInput* input)
+{
+    SDL_PumpEvents();
+
+    SDL_Event motion[GG_MAX_INPUT_EVENTS];
+    int count = SDL_PeepEvents(motion, GG_MAX_INPUT_EVENTS, SDL_PEEKEVENT,
+                               SDL_MOUSEMOTION, SDL_MOUSEMOTION);
+
+    input->latched_mouse_dx = 0;
+    input->latched_mouse_dy = 0;
+    for (int i=0; i<count; i++) {
+        input->latched_mouse_dx += motion[i].motion.xrel;
+        input->latched_mouse_dy += motion[i].motion.yrel;
+    }
+
+    int mouse_x, mouse_y;
+    SDL_GetMouseState(&mouse_x, &mouse_y);
+    input->latched_mouse_x = mouse_x;
+    input->latched_mouse_y = mouse_y;
+    input->latched_time = (float)(SDL_GetTicks() - _gg_start_ticks) / 1000.0f;
+}
+
+// Audio device.
+#ifndef GG_AUDIO_LATENCY_FRAMES
+#define GG_AUDIO_LATENCY_FRAMES (2 * GG_AUDIO_BUFFER_FRAMES)
+#endif
+
+void
+_gg_audio_callback(void* data, uint8_t* stream, int length)
+{
+    ggAudio* audio = (ggAudio*)data;
+    ggGameAudio* game = audio->game;
+    uint64_t start_counter = SDL_GetPerformanceCounter();
+
+    int frames = length / (2 * sizeof(float));
+    uint64_t start = atomic_load_explicit(&audio->mixed_samples, memory_order_relaxed);
+    gg_audio_mix(audio, (float*)stream, frames, start);
+
+    uint64_t end_counter = SDL_GetPerformanceCounter();
+    uint32_t mix_us = (uint32_t)((end_counter - start_counter) * 1000000 / _gg_counter_frequency);
+    atomic_store_explicit(&game->last_mix_us, mix_us, memory_order_relaxed);
+    if (mix_us > atomic_load_explicit(&game->max_mix_us, memory_order_relaxed)) {
+        atomic_store_explicit(&game->max_mix_us, mix_us, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&game->total_mix_us, mix_us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&game->buffers_mixed, 1, memory_order_relaxed);
+    atomic_store_explicit(&game->voices_playing, audio->voice_count, memory_order_relaxed);
+
+    atomic_store_explicit(&audio->callback_counter, end_counter, memory_order_relaxed);
+    atomic_store_explicit(&audio->mixed_samples, start + frames, memory_order_release);
+}
+
+bool
+gg_audio_open(ggAudio* audio)
+{
+    memset(audio, 0, sizeof(*audio));
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        fprintf(stderr, "Warning: no audio (%s)\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioSpec want = {0};
+    SDL_AudioSpec have;
+    want.freq = GG_AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_F32SYS;
+    want.channels = 2;
+    want.samples = GG_AUDIO_BUFFER_FRAMES;
+    want.callback = _gg_audio_callback;
+    want.userdata = audio;
+    // SDL converts if the device wants something else, the mixer only does stereo float.
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (!audio->device) {
+        fprintf(stderr, "Warning: no audio device (%s)\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioDeviceID device = audio->device;
+    ggGameAudio* game = (ggGameAudio*)gg_alloc(GG_TAG_AUDIO, sizeof(ggGameAudio));
+    if (!game) {
+        fprintf(stderr, "Warning: no memory for audio\n");
+        SDL_CloseAudioDevice(device);
+        audio->device = 0;
+        return false;
+    }
+    gg_audio_mixer_init(audio, game, have.freq, have.samples);
+    audio->device = device;
+    fprintf(stderr, "Audio: %s, %d Hz, %d frame buffers\n", SDL_GetCurrentAudioDriver(), have.freq, have.samples);
+    SDL_PauseAudioDevice(audio->device, 0);
+    return true;
+}
+
+// Moves frame_sample to where the device will be one latency from now. Never backwards, so
+// commands scheduled in order stay in order.
+void
+gg_audio_begin_frame(ggAudio* audio)
+{
+    uint64_t mixed = atomic_load_explicit(&audio->mixed_samples, memory_order_acquire);
+    uint64_t callback_counter = atomic_load_explicit(&audio->callback_counter, memory_order_relaxed);
+    uint64_t now = SDL_GetPerformanceCounter();
+    uint64_t since = callback_counter && now > callback_counter ? now - callback_counter : 0;
+
+    uint64_t sample = mixed + since * audio->sample_rate / _gg_counter_frequency + GG_AUDIO_LATENCY_FRAMES;
+    if (sample > audio->game->frame_sample) {
+        audio->game->frame_sample = sample;
+    }
+}
+
+void
+gg_audio_close(ggAudio* audio)
+{
+    SDL_CloseAudioDevice(audio->device);
+    ggGameAudio* game = audio->game;
+    uint64_t buffers = game->buffers_mixed;
+    double buffer_ms = 1000.0 * game->buffer_frames / game->sample_rate;
+    double mean_ms = buffers ? game->total_mix_us / 1000.0 / buffers : 0;
+    fprintf(stderr, "Audio: %llu buffers of %.2f ms, mix mean %.3f ms (%.1f%%), max %.3f ms, "
+            "%u late commands, %u dropped voices, %u dropped commands\n",
+            (unsigned long long)buffers, buffer_ms, mean_ms, 100.0 * mean_ms / buffer_ms,
+            game->max_mix_us / 1000.0, game->late_commands, game->dropped_voices, game->dropped_commands);
+    gg_deallocate(game);
+}
+
+// Command line options.
+// ./gameguy [--headless] [--frames n] [--dt seconds] [--record-input file] [--replay-input file]
+//           [--profile] [--trace file.json] [--pack assets.pack] [--pipeline]
+//           [--state file.state] [--no-audio] [--host port | --connect address:port]
+//           [--frame-allocations warmup_frames] library.so
+//
+// Headless mode runs the game for a fixed number of frames with a fixed dt as fast as it can
+// without a visible window (SDL offscreen driver, falling back to no gl context at all) and
+// prints frame time statistics as json to stdout. Use it for benchmarks and ci.
+//
+// --record-input writes the input of every frame to a file, --replay-input plays one back in
+// place of the keyboard and mouse. Both work headless and windowed, replay a recording made
+// in a window headless to reproduce it in ci.
+//
+// --profile turns on TIMED_BLOCK recording and prints per block stats at exit, --trace also
+// writes every event to a chrome trace.
+//
+// --pack maps an asset pack built with gameguy_pack, see Asset packs.
+//
+// --pipeline runs update on its own thread a frame ahead of render, see ggGame.snapshot_size.
+// Compare the headless fps and latency with and without it.
+//
+// --state resumes persistent_storage from an image and saves it there on exit, see
+// ggGame.persistent_storage_size.
+//
+// Headless runs use SDL's dummy audio driver unless SDL_AUDIODRIVER says otherwise (disk
+// writes the mix to a file), --no-audio skips opening a device at all.
+//
+// --host and --connect replicate ggGame.net_regions from one to the other, see Networking.
+//
+// --frame-allocations reports every frame after the first warmup_frames that allocated through
+// gg_allocate or platform_api.allocate, with the call sites, and headless runs exit with 1.
+typedef struct {
+    const char* library_filename;
+    bool headless;
+    int frames;
+    float fixed_dt;
+    const char* record_input_filename;
+    const char* replay_input_filename;
+    bool profile;
+    const char* trace_filename;
+    const char* pack_filename;
+    bool pipeline;
+    const char* state_filename;
+    bool audio;
+    int host_port;
+    const char* connect_address;
+    int connect_port;
+    int frame_allocations_warmup;   // -1 to not check.
+} ggOptions;
+
+bool
+gg_parse_options(ggOptions* options, int argc, char* argv[])
+{
+    options->library_filename = NULL;
+    options->headless = false;
+    options->frames = 600;
+    options->fixed_dt = 1.0f / 60.0f;
+    options->record_input_filename = NULL;
+    options->replay_input_filename = NULL;
+    options->profile = false;
+    options->trace_filename = NULL;
+    options->pack_filename = NULL;
+    options->pipeline = false;
+    options->state_filename = NULL;
+    options->audio = true;
+    options->host_port = 0;
+    options->connect_address = NULL;
+    options->connect_port = 0;
+    options->frame_allocations_warmup = -1;
+
+    for (int i=1; i<argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i+1 < argc;
+
+        if (strcmp(arg, "--headless") == 0) {
+            options->headless = true;
+
+        } else if (strcmp(arg, "--frames") == 0 && has_value) {
+            options->frames = atoi(argv[++i]);
+
+        } else if (strcmp(arg, "--dt") == 0 && has_value) {
+            options->fixed_dt = atof(argv[++i]);
+
+        } else if (strcmp(arg, "--record-input") == 0 && has_value) {
+            options->record_input_filename = argv[++i];
+
+        } else if (strcmp(arg, "--replay-input") == 0 && has_value) {
+            options->replay_input_filename = argv[++i];
+
+        } else if (strcmp(arg, "--profile") == 0) {
+            options->profile = true;
+
+        } else if (strcmp(arg, "--trace") == 0 && has_value) {
+            options->profile = true;
+            options->trace_filename = argv[++i];
+
+        } else if (strcmp(arg, "--pack") == 0 && has_value) {
+            options->pack_filename = argv[++i];
+
+        } else if (strcmp(arg, "--pipeline") == 0) {
+            options->pipeline = true;
+
+        } else if (strcmp(arg, "--state") == 0 && has_value) {
+            options->state_filename = argv[++i];
+
+        } else if (strcmp(arg, "--no-audio") == 0) {
+            options->audio = false;
+
+        } else if (strcmp(arg, "--frame-allocations") == 0 && has_value) {
+            options->frame_allocations_warmup = atoi(argv[++i]);
+
+        } else if (strcmp(arg, "--host") == 0 && has_value) {
+            options->host_port = atoi(argv[++i]);
+
+        } else if (strcmp(arg, "--connect") == 0 && has_value) {
+            // address:port, the address is copied so the port can be split off.
+            static char address[256];
+            snprintf(address, sizeof(address), "%s", argv[++i]);
+            char* colon = strrchr(address, ':');
+            if (!colon) {
+                fprintf(stderr, "Error: --connect wants address:port\n");
+                return false;
+            }
+            *colon = '\0';
+            options->connect_address = address;
+            options->connect_port = atoi(colon + 1);
+
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Error: unknown option %s\n", arg);
+            return false;
+
+        } else {
+            options->library_filename = arg;
+        }
+    }
+
+    if (options->frames <= 0 || options->fixed_dt <= 0) {
+        fprintf(stderr, "Error: --frames and --dt must be positive.\n");
+        return false;
+    }
+
+    if (options->host_port && options->connect_address) {
+        fprintf(stderr, "Error: --host and --connect can't both be used.\n");
+        return false;
+    }
+
+    // Opening the recording would truncate the replay before it's read.
+    if (options->record_input_filename && options->replay_input_filename &&
+        strcmp(options->record_input_filename, options->replay_input_filename) == 0) {
+        fprintf(stderr, "Error: --record-input and --replay-input can't be the same file.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Networking, the session started with --host or --connect.
+static ggNet* _gg_net;
+static uint64_t _gg_net_counts_per_snapshot;
+static uint64_t _gg_net_accumulator;
+
+const ggNetStats*
+gg_get_net_stats(void)
+{
+    return _gg_net ? &_gg_net->stats : NULL;
+}
+
+bool
+gg_net_start(const ggOptions* options, const ggGame* game)
+{
+    if (!game->net_region_count || !game->persistent_storage_size) {
+        fprintf(stderr, "Warning: networking needs the game to set net_regions and persistent_storage_size.\n");
+        return false;
+    }
+    for (uint32_t r=0; r<game->net_region_count; r++) {
+        const ggNetRegion* region = &game->net_regions[r];
+        if (region->offset + (uint64_t)region->stride * region->count > game->persistent_storage_size) {
+            fprintf(stderr, "Error: net region %u is outside persistent_storage\n", r);
+            return false;
+        }
+    }
+    ggNet* net = (ggNet*)gg_alloc(GG_TAG_NET, sizeof(ggNet));
+    bool host = options->host_port != 0;
+    if (!gg_net_open(net, host, options->connect_address, host ? options->host_port : options->connect_port,
+                     game->net_regions, game->net_region_count)) {
+        gg_deallocate(net);
+        return false;
+    }
+    float hz = game->net_hz > 0 ? game->net_hz : 64.0f;
+    _gg_net = net;
+    _gg_net_counts_per_snapshot = (uint64_t)(_gg_counter_frequency / hz);
+    _gg_net_accumulator = 0;
+    fprintf(stderr, "Net: %s %u entities in %u regions at %.0f Hz\n", host ? "hosting" : "connecting,",
+            net->entity_count, net->region_count, hz);
+    return true;
+}
+
+// Client, snapshots that came in since last frame land in storage before the update sees it.
+void
+gg_net_begin_frame(ggGameMemory* memory)
+{
+    if (_gg_net && !_gg_net->host) {
+        TIMED_BLOCK("net receive");
+        gg_net_receive(_gg_net, memory->persistent_storage);
+    }
+}
+
+// Host, sends at most one snapshot a frame of the state the update just left.
+void
+gg_net_end_frame(ggGameMemory* memory, uint64_t frame_counts)
+{
+    if (!_gg_net || !_gg_net->host) {
+        return;
+    }
+    _gg_net_accumulator += frame_counts;
+    if (_gg_net_accumulator < _gg_net_counts_per_snapshot) {
+        return;
+    }
+    _gg_net_accumulator -= _gg_net_counts_per_snapshot;
+    if (_gg_net_accumulator > _gg_net_counts_per_snapshot) {
+        _gg_net_accumulator = 0;
+    }
+    TIMED_BLOCK("net send");
+    gg_net_send_snapshot(_gg_net, memory->persistent_storage);
+}
+
+void
+gg_net_stop(float hz)
+{
+    if (_gg_net) {
+        gg_net_print_stats(_gg_net, hz);
+        gg_net_close(_gg_net);
+        gg_deallocate(_gg_net);
+        _gg_net = NULL;
+    }
+}
+
+// Memory checks in the frame loop, see --frame-allocations.
+#define GG_MEMORY_MAX_REPORTS 10
+
+typedef struct {
+    int warmup;                 // Frames before allocating is an error, -1 to not check.
+    int reports;
+    bool failed;
+    uint32_t reload_generation;
+} ggMemoryCheck;
+
+void
+gg_memory_check_frame(ggMemoryCheck* check, bool reloaded)
+{
+    gg_memory_end_frame();
+    const ggMemoryStats* stats = gg_memory_stats();
+    // Loading the new library allocates, that's expected.
+    if (check->warmup < 0 || reloaded || stats->frame <= (uint64_t)check->warmup ||
+        !stats->last_frame_allocations) {
+        return;
+    }
+    check->failed = true;
+    if (check->reports++ >= GG_MEMORY_MAX_REPORTS) {
+        return;
+    }
+    fprintf(stderr, "Error: frame %llu allocated %llu times, %llu bytes%s\n", (unsigned long long)stats->frame,
+            (unsigned long long)stats->last_frame_allocations, (unsigned long long)stats->last_frame_bytes,
+            check->reports == GG_MEMORY_MAX_REPORTS ? ", not reporting any more" : "");
+    uint64_t shown = stats->last_frame_allocations < GG_MEMORY_RECENT ? stats->last_frame_allocations : GG_MEMORY_RECENT;
+    for (uint64_t i=0; i<shown && i<stats->recent_count; i++) {
+        const ggMemorySite* site = &stats->recent[(stats->recent_count - 1 - i) % GG_MEMORY_RECENT];
+        char name[16];
+        fprintf(stderr, "  %10zu bytes %-8s %s:%d\n", site->size, _gg_memory_tag_name(site->tag, name, sizeof(name)),
+                site->file, site->line);
+    }
+}
+
+// Lists what's still around from before the reload. Setup code that runs again after every
+// reload without freeing the old setup shows up here each time.
+void
+gg_memory_library_reloaded(ggMemoryCheck* check)
+{
+    gg_memory_report_live("Memory allocated since the last reload and still live", check->reload_generation, 8);
+    check->reload_generation = gg_memory_begin_generation();
+}
+
+// Input recordings are a header followed by one raw ggGameInput per frame. They are only valid
+// for the build that wrote them, the header is there to catch the struct changing.
+#define GG_INPUT_RECORDING_MAGIC 0x52494747 // GGIR
+#define GG_INPUT_RECORDING_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t input_size;
+} ggInputRecordingHeader;
+
+FILE*
+gg_open_input_recording(const char* filename, bool write)
+{
+    FILE* f = fopen(filename, write ? "wb" : "rb");
+    if (!f) {
+        fprintf(stderr, "Error opening input recording: %s\n", filename);
+        return NULL;
+    }
+
+    ggInputRecordingHeader expected = {.magic = GG_INPUT_RECORDING_MAGIC,
+                                       .version = GG_INPUT_RECORDING_VERSION,
+                                       .input_size = sizeof(ggGameInput)};
+    if (write) {
+        fwrite(&expected, sizeof(expected), 1, f);
+        return f;
+    }
+
+    ggInputRecordingHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != expected.magic ||
+        header.version != expected.version ||
+        header.input_size != expected.input_size) {
+        fprintf(stderr, "Error: %s isn't an input recording from this build.\n", filename);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// A replayed frame replaces whatever input the frame gathered itself, recording writes what
+// the game is about to see, so replaying and recording at once copies a recording.
+void
+gg_input_recording_frame(ggGameInput* input, FILE** replay, FILE* record, int frame)
+{
+    if (*replay && fread(input, sizeof(*input), 1, *replay) != 1) {
+        fprintf(stderr, "Input recording ended at frame %d.\n", frame);
+        fclose(*replay);
+        *replay = NULL;
+    }
+    if (record) {
+        fwrite(input, sizeof(*input), 1, record);
+    }
+}
+
+int
+_gg_compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Mean and percentiles of count samples in ms, sorts samples in place.
+typedef struct {
+    double mean_ms;
+    double min_ms;
+    double median_ms;
+    double p99_ms;
+    double max_ms;
+} ggTimeSummary;
+
+ggTimeSummary
+_gg_summarize_seconds(double* samples, int count)
+{
+    ggTimeSummary summary = {0};
+    if (count == 0) {
+        return summary;
+    }
+
+    qsort(samples, count, sizeof(double), _gg_compare_doubles);
+
+    double total = 0;
+    for (int i=0; i<count; i++) {
+        total += samples[i];
+    }
+
+    double median = (count % 2) ? samples[count/2]
+        : (samples[count/2 - 1] + samples[count/2]) / 2.0;
+    int p99_index = (int)ceil(count * 0.99) - 1;
 
-    float dt;       // seconds since last frame.
-    uint64_t ticks; // ms since game began.
+    summary.mean_ms = total / count * 1000.0;
+    summary.min_ms = samples[0] * 1000.0;
+    summary.median_ms = median * 1000.0;
+    summary.p99_ms = samples[p99_index] * 1000.0;
+    summary.max_ms = samples[count-1] * 1000.0;
+    return summary;
+}
 
-    float display_width;
-    float display_height;
-    float drawable_width;
-    float drawable_height;
-} ggGameMemory;
+// Sorts frame_seconds and latency_seconds in place. Latency is from gathering a frame's
+// input to the end of the frame that drew it, which is a frame later when pipelined.
+void
+gg_print_frame_times_json(FILE* out, const char* mode, double* frame_seconds, int count,
+                          double* latency_seconds, int latency_count)
+{
+    if (count == 0) {
+        fprintf(out, "{\"mode\": \"%s\", \"frames\": 0}\n", mode);
+        return;
+    }
 
-// Do I want casey style buttons.
-// half_transition_count, ended_down.
-// mouse_moved, mouse position.
+    ggTimeSummary frame = _gg_summarize_seconds(frame_seconds, count);
+    ggTimeSummary latency = _gg_summarize_seconds(latency_seconds, latency_count);
 
-typedef struct {
-    bool ended_down;
-    int half_transition_count;
-} ggButton;
+    fprintf(out,
+            "{\"mode\": \"%s\", \"frames\": %d, \"fps\": %.1f, \"mean_ms\": %.4f, \"min_ms\": %.4f, "
+            "\"median_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, "
+            "\"latency_mean_ms\": %.4f, \"latency_p99_ms\": %.4f}\n",
+            mode,
+            count,
+            1000.0 / frame.mean_ms,
+            frame.mean_ms,
+            frame.min_ms,
+            frame.median_ms,
+            frame.p99_ms,
+            frame.max_ms,
+            latency.mean_ms,
+            latency.p99_ms);
+}
 
-typedef struct {
-    // Mouse. (movement and clicks)
-    ggButton mouse1;
-    ggButton mouse2;
+void
+_gg_game_submit(ggGame* game, ggGameMemory* memory)
+{
+    if (game->submit) {
+        TIMED_BLOCK("submit");
+        game->submit(memory);
+    }
+}
 
-    int horisontal_scroll;
-    int vertical_scroll;
+// Runs as many fixed updates as frame_counts covers and sets the interpolation alpha.
+// Returns how many ran, any that did saw the input.
+int
+_gg_game_update(ggGame* game, ggGameMemory* memory, ggGameInput* input,
+                uint64_t frame_counts, uint64_t* update_accumulator)
+{
+    int updates = 0;
+    float update_hz = game->fixed_update_hz > 0 ? game->fixed_update_hz : 60.0f;
+    uint64_t counts_per_update = (uint64_t)(_gg_counter_frequency / update_hz);
 
-    float mouse_x;
-    float mouse_y;
+    // Accumulate in counter ticks, no float drift.
+    *update_accumulator += frame_counts;
+    if (*update_accumulator > GG_MAX_CATCHUP_UPDATES * counts_per_update) {
+        *update_accumulator = GG_MAX_CATCHUP_UPDATES * counts_per_update;
+    }
 
-    bool mouse_moved;
-    float mouse_dx;
-    float mouse_dy;
+    memory->dt = 1.0f / update_hz;
+    while (*update_accumulator >= counts_per_update) {
+        TIMED_BLOCK("update");
+        game->update(memory, input);
+        *update_accumulator -= counts_per_update;
 
-    // Buttons, used for game input situations.
-    union {
-        struct {
-            ggButton w;
-            ggButton a;
-            ggButton s;
-            ggButton d;
-            ggButton q;
-            ggButton e;
-            ggButton up;
-            ggButton down;
-            ggButton left;
-            ggButton right;
-            ggButton space;
-            ggButton ctrl;
-            ggButton shift;
-            ggButton n1;
-            ggButton n2;
-            ggButton n3;
-            ggButton n4;
-            ggButton n5;
-            ggButton n6;
-            ggButton n7;
-            ggButton n8;
-            ggButton n9;
-            ggButton n0;
-            ggButton escape;
-            ggButton ret;
-        } b;
-        ggButton e[25];
-    } button;
+        // Later updates in the same frame shouldn't see the same presses again.
+        _gg_clear_input_transitions(input);
+        updates++;
+    }
 
-    // Keyboard string input.
-    // @TODO
-} ggGameInput;
+    memory->interpolation_alpha = (float)*update_accumulator / (float)counts_per_update;
+    return updates;
+}
 
-typedef void (*UpdateAndRenderFn)(ggGameMemory *memory, ggGameInput* input);
+// Runs the game for one frame, either update_and_render or as many fixed updates as
+// frame_counts covers and a render. Returns true if the input was seen by the game.
+bool
+gg_game_tick(ggGame* game, ggGameMemory* memory, ggGameInput* input,
+             uint64_t frame_counts, uint64_t* update_accumulator)
+{
+    TIMED_BLOCK("gg_game_tick");
 
-typedef struct {
-    /* int permanent_storage_size; */
-    /* int temp_storage_size; */
-    UpdateAndRenderFn update_and_render;
-} ggGame;
+    if (!game->update) {
+        game->update_and_render(memory, input);
+        _gg_game_submit(game, memory);
+        return true;
+    }
 
-// Set this in game code.
-extern ggGame gg_game;
+    bool input_consumed = _gg_game_update(game, memory, input, frame_counts, update_accumulator) > 0;
+    if (game->render) {
+        TIMED_BLOCK("render");
+        game->render(memory, input);
+    }
+    _gg_game_submit(game, memory);
 
+    return input_consumed;
+}
+
+// Pipelined mode, see ggGame.snapshot_size.
+// Frame N is handed to the worker by publishing N in kicked, the worker publishes it in
+// finished when it's done. Between the two the worker owns frames[N & 1] and snapshots[N & 1]
+// and the main thread only touches frame N-1's, so all it takes is two atomics and a wait at
+// the end of every frame. The worker spins briefly for the next frame then naps so an idle
+// worker doesn't burn a core while the main thread waits for vsync.
+#ifndef GG_PIPELINE_SPINS
+#define GG_PIPELINE_SPINS 2000
+#endif
+#ifndef GG_PIPELINE_NAP_NANOSECONDS
+#define GG_PIPELINE_NAP_NANOSECONDS 50000
 #endif
 
-#ifdef SAO_GAMEGUY_IMPLEMENTATION
+typedef struct {
+    ggGame* game;
+    ggGameMemory memory;
+    ggGameInput input;
+    uint64_t frame_counts;
+    uint64_t input_counter; // When the input was gathered.
+    bool input_consumed;
+} ggPipelineFrame;
 
-#include <SDL2/SDL.h>
-#include <OpenGL/gl3.h>
+typedef struct {
+    pthread_t thread;
+    _Atomic uint64_t kicked;
+    _Atomic uint64_t finished;
+    _Atomic bool quit;
 
-#include <stdlib.h>
-#include <stdbool.h>
-#include <stdio.h>
-#include <sys/stat.h>
-#include <dlfcn.h>
-#include <assert.h>
+    uint64_t frame;
+    uint64_t update_accumulator;   // Only touched by the worker once it's started.
+    uint64_t rendered_input_counter; // Input time of the frame rendered last tick, 0 if none.
+    void* snapshots[2];
+    size_t snapshot_size;
+    ggPipelineFrame frames[2];
+} ggPipeline;
 
-typedef struct {
-    void *handle;
-    ino_t id;
-    ggGame* gg_game;
-} CurrentGame;
+// Waits until value reaches target, or quit is set if it's not NULL.
+void
+_gg_pipeline_wait(_Atomic uint64_t* value, uint64_t target, _Atomic bool* quit)
+{
+    for (int spins=0; atomic_load_explicit(value, memory_order_acquire) < target; spins++) {
+        if (quit && atomic_load_explicit(quit, memory_order_acquire)) {
+            return;
+        }
+        if (spins >= GG_PIPELINE_SPINS) {
+            struct timespec nap = {0, GG_PIPELINE_NAP_NANOSECONDS};
+            nanosleep(&nap, NULL);
+        }
+    }
+}
 
-int
-gg_debug_get_file_size(const char* filename)
+void*
+_gg_pipeline_worker(void* data)
 {
-    struct stat attr;
-    if (stat(filename, &attr) == -1) {
-        fprintf(stderr, "Error reading file size: %s\n", filename);
-        return -1;
-    };
-    return attr.st_size+1;
+    ggPipeline* pipeline = (ggPipeline*)data;
+    for (uint64_t frame=1; ; frame++) {
+        _gg_pipeline_wait(&pipeline->kicked, frame, &pipeline->quit);
+        if (atomic_load_explicit(&pipeline->quit, memory_order_acquire)) {
+            return NULL;
+        }
+
+        ggPipelineFrame* next = &pipeline->frames[frame & 1];
+        int updates = _gg_game_update(next->game, &next->memory, &next->input,
+                                      next->frame_counts, &pipeline->update_accumulator);
+        next->input_consumed = updates > 0;
+        if (!updates) {
+            // Faster display than updates. This frame's snapshot is still the one from two
+            // frames ago, carry the last frame's forward so render doesn't go back in time.
+            // Render only reads that one, and update N-1 finished before N was kicked.
+            memcpy(next->memory.snapshot, pipeline->snapshots[(frame - 1) & 1], pipeline->snapshot_size);
+        }
+        atomic_store_explicit(&pipeline->finished, frame, memory_order_release);
+    }
 }
 
 bool
-gg_debug_read_entire_file(const char* filename, char* buffer, size_t buffer_size)
+gg_pipeline_init(ggPipeline* pipeline, size_t snapshot_size)
 {
-    FILE* f = fopen(filename, "r");
-    fread(buffer, 1, buffer_size-1, f);
-    fclose(f);
-
-    buffer[buffer_size-1] = '\0';
-    
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->snapshot_size = snapshot_size;
+    pipeline->snapshots[0] = gg_alloc(GG_TAG_STATE, snapshot_size);
+    pipeline->snapshots[1] = gg_alloc(GG_TAG_STATE, snapshot_size);
+    if (!pipeline->snapshots[0] || !pipeline->snapshots[1] ||
+        pthread_create(&pipeline->thread, NULL, _gg_pipeline_worker, pipeline) != 0) {
+        fprintf(stderr, "Error starting the update thread.\n");
+        gg_deallocate(pipeline->snapshots[0]);
+        gg_deallocate(pipeline->snapshots[1]);
+        return false;
+    }
     return true;
 }
 
+void
+gg_pipeline_free(ggPipeline* pipeline)
+{
+    atomic_store_explicit(&pipeline->quit, true, memory_order_release);
+    pthread_join(pipeline->thread, NULL);
+    gg_deallocate(pipeline->snapshots[0]);
+    gg_deallocate(pipeline->snapshots[1]);
+}
+
+// Starts updating this frame on the worker, renders the last one, then waits for the update.
+// Same contract as gg_game_tick.
 bool
-gg_game_reload(CurrentGame* current_game, const char* library)
+gg_game_tick_pipelined(ggPipeline* pipeline, ggGame* game, ggGameMemory* memory,
+                       ggGameInput* input, uint64_t frame_counts)
 {
-    bool game_reloaded = false;
-    
-    struct stat attr;
-    if ((stat(library, &attr) == 0) && (current_game->id != attr.st_ino)) {
-        fprintf(stderr, "New Library to load.\n");
-        
-        if (current_game->handle) {
-            dlclose(current_game->handle);
-        }
-        
-        void* handle = dlopen(library, RTLD_NOW);
-
-        if (handle) {
-            current_game->handle = handle;
-            current_game->id = attr.st_ino;
-
-            ggGame* game = (ggGame*)dlsym(handle, "gg_game");
-            if (game != NULL) {
-                current_game->gg_game = game;
-                fprintf(stderr, "Reloaded Game Library\n");
-                game_reloaded = true;
-                
-            } else {
-                fprintf(stderr, "[error] Error loading api symbol.\n");
-                dlclose(handle);
-                current_game->handle = NULL;
-                current_game->id = 0;
-            }
-            
-        } else {
-            fprintf(stderr, "Error loading game library.\n");
-            current_game->handle = NULL;
-            current_game->id = 0;
+    TIMED_BLOCK("gg_game_tick");
+
+    uint64_t frame = ++pipeline->frame;
+    ggPipelineFrame* next = &pipeline->frames[frame & 1];
+    next->game = game;
+    next->memory = *memory;
+    next->memory.snapshot = pipeline->snapshots[frame & 1];
+    next->input = *input;
+    next->frame_counts = frame_counts;
+    next->input_counter = SDL_GetPerformanceCounter();
+    atomic_store_explicit(&pipeline->kicked, frame, memory_order_release);
+
+    // Current platform state but the snapshot and timing of the frame being drawn.
+    ggPipelineFrame* last = &pipeline->frames[(frame - 1) & 1];
+    pipeline->rendered_input_counter = 0;
+    if (frame > 1) {
+        ggGameMemory render_memory = *memory;
+        render_memory.snapshot = last->memory.snapshot;
+        render_memory.dt = last->memory.dt;
+        render_memory.interpolation_alpha = last->memory.interpolation_alpha;
+        if (game->render) {
+            TIMED_BLOCK("render");
+            game->render(&render_memory, &last->input);
         }
+        _gg_game_submit(game, &render_memory);
+        pipeline->rendered_input_counter = last->input_counter;
     }
 
-    return game_reloaded;
-}
+    {
+        TIMED_BLOCK("wait for update");
+        _gg_pipeline_wait(&pipeline->finished, frame, NULL);
+    }
 
-// @TODO: Metaprogram this or use a hash or something.
-int
-_gg_get_button_index(SDL_Keycode sym)
-{
-    int button_index;
-    switch(sym) {
-    case(SDLK_w):
-        button_index = 0;
-        break;
-    case(SDLK_a):
-        button_index = 1;
-        break;
-    case(SDLK_s):
-        button_index = 2;
-        break;
-    case(SDLK_d):
-        button_index = 3;
-        break;
-    case(SDLK_q):
-        button_index = 4;
-        break;
-    case(SDLK_e):
-        button_index = 5;
-        break;
-    case(SDLK_UP):
-        button_index = 6;
-        break;
-    case(SDLK_DOWN):
-        button_index = 7;
-        break;
-    case(SDLK_LEFT):
-        button_index = 8;
-        break;
-    case(SDLK_RIGHT):
-        button_index = 9;
-        break;
-    case(SDLK_SPACE):
-        button_index = 10;
-        break;
-    case(SDLK_LCTRL):
-        button_index = 11;
-        break;
-    case(SDLK_LSHIFT):
-        button_index = 12;
-        break;
-    case(SDLK_1):
-        button_index = 13;
-        break;
-    case(SDLK_2):
-        button_index = 14;
-        break;
-    case(SDLK_3):
-        button_index = 15;
-        break;
-    case(SDLK_4):
-        button_index = 16;
-        break;
-    case(SDLK_5):
-        button_index = 17;
-        break;
-    case(SDLK_6):
-        button_index = 18;
-        break;
-    case(SDLK_7):
-        button_index = 19;
-        break;
-    case(SDLK_8):
-        button_index = 20;
-        break;
-    case(SDLK_9):
-        button_index = 21;
-        break;
-    case(SDLK_0):
-        button_index = 22;
-        break;
-    case(SDLK_ESCAPE):
-        button_index = 23;
-        break;
-    case(SDLK_RETURN):
-        button_index = 24;
-        break;
-    };
-    return button_index;
+    // Storage update allocated has to outlive its frame.
+    memory->persistent_storage = next->memory.persistent_storage;
+    memory->persistent_storage_size = next->memory.persistent_storage_size;
+    return next->input_consumed;
 }
 
 int
 main(int argc, char* argv[]) {
+    ggOptions options;
+    if (!gg_parse_options(&options, argc, argv)) {
+        exit(1);
+    }
+    _gg_counter_frequency = SDL_GetPerformanceFrequency();
+
+    if (options.pack_filename) {
+        if (!gg_pack_open(&_gg_pack, options.pack_filename)) {
+            exit(1);
+        }
+        fprintf(stderr, "Pack: %s, %u assets\n", options.pack_filename, _gg_pack.header->entry_count);
+        gg_memory_account(GG_TAG_ASSETS, (int64_t)_gg_pack.size);
+    }
+
 #ifndef SAO_GAMEGUY_STATIC_LINK
     #ifndef SAO_GAMEGUY_LIBRARY_NAME
-    if (argc != 2) {
+    if (!options.library_filename) {
         fprintf(stderr, "Error: must specify library filename.\n");
         exit(1);
     }
-    const char* library_filename = argv[1];
+    const char* library_filename = options.library_filename;
     #else
     const char* library_filename = SAO_GAMEGUY_LIBRARY_NAME;
     #endif
     fprintf(stderr, "Loading Library: %s\n", library_filename);
 
     CurrentGame game = {.handle = NULL,
-                        .id = 0,
                         .gg_game = NULL};
-    gg_game_reload(&game, library_filename);
+    if (!gg_game_load(&game, library_filename)) {
+        exit(1);
+    }
 #endif
 
     float game_update_hz = 60;
     float target_seconds_per_frame = 1.0f / game_update_hz;
 
     // Init Stuff
-    if (SDL_Init(SDL_INIT_VIDEO)) {
+    if (options.headless) {
+        // Offscreen gives us a real gl context with no display, dummy has no gl at all but
+        // still lets us run the game logic.
+        if (SDL_VideoInit("offscreen") < 0) {
+            fprintf(stderr, "Warning: no offscreen video driver (%s), using dummy.\n", SDL_GetError());
+            if (SDL_VideoInit("dummy") < 0) {
+                fprintf(stderr, "Error initializing SDL: %s\n", SDL_GetError());
+            }
+        }
+    } else if (SDL_Init(SDL_INIT_VIDEO)) {
         fprintf(stderr, "Error initializing SDL: %s\ns", SDL_GetError());
     }
+
+    ggAudio* audio = NULL;
+    if (options.audio) {
+        if (options.headless) {
+            setenv("SDL_AUDIODRIVER", "dummy", 0);
+        }
+        audio = (ggAudio*)gg_alloc(GG_TAG_AUDIO, sizeof(ggAudio));
+        if (!gg_audio_open(audio)) {
+            gg_deallocate(audio);
+            audio = NULL;
+        }
+    }
     
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
@@ -358,6 +4786,7 @@ main(int argc, char* argv[]) {
                                           1920,
                                           1080,
                                           SDL_WINDOW_OPENGL |
+                                          (options.headless ? SDL_WINDOW_HIDDEN : 0) |
                                           SDL_WINDOW_RESIZABLE |
                                           SDL_WINDOW_ALLOW_HIGHDPI);
 
@@ -370,10 +4799,15 @@ main(int argc, char* argv[]) {
     fprintf(stderr, "Drawable Resolution: %d x %d\n", width, height);
 
     SDL_GLContext context = SDL_GL_CreateContext(window);
+    if (!context) {
+        fprintf(stderr, "Warning: no gl context, gl calls will do nothing. SDL Error: %s\n", SDL_GetError());
+    }
 
-    // Use Vsync
-    if (SDL_GL_SetSwapInterval(1) < 0) {
+    // Use Vsync, headless runs unthrottled.
+    bool vsync = true;
+    if (SDL_GL_SetSwapInterval(options.headless ? 0 : 1) < 0) {
         fprintf(stderr, "Warning: Unable to set VSync! SDL Error: %s\n", SDL_GetError());
+        vsync = false;
     }
 
     ggGameMemory game_memory = {};
@@ -384,22 +4818,176 @@ main(int argc, char* argv[]) {
 
     game_memory.platform_api.get_file_size = gg_debug_get_file_size;
     game_memory.platform_api.read_entire_file = gg_debug_read_entire_file;
+    game_memory.platform_api.latch_input = gg_latch_input;
+    game_memory.platform_api.find_asset = gg_find_asset;
+    game_memory.platform_api.read_asset = gg_read_asset;
+    game_memory.platform_api.save_persistent_storage = gg_save_persistent_storage;
+    game_memory.platform_api.get_net_stats = gg_get_net_stats;
+    game_memory.platform_api.allocate = gg_allocate;
+    game_memory.platform_api.reallocate = gg_reallocate;
+    game_memory.platform_api.deallocate = gg_deallocate;
+    game_memory.memory_stats = gg_memory_stats();
+    game_memory.audio = audio ? audio->game : NULL;
     
     ggGameInput input = {};
+    // In fixed timestep mode a frame can run zero updates, keep transitions around until
+    // an update has seen them.
+    bool input_consumed = true;
+
+    FILE* record_input = NULL;
+    if (options.record_input_filename) {
+        record_input = gg_open_input_recording(options.record_input_filename, true);
+    }
+
+    FILE* replay_input = NULL;
+    if (options.replay_input_filename) {
+        replay_input = gg_open_input_recording(options.replay_input_filename, false);
+    }
+
+    uint64_t counts_per_frame = (uint64_t)(_gg_counter_frequency * target_seconds_per_frame);
+    uint64_t swap_margin_counts = vsync ? (uint64_t)(_gg_counter_frequency * GG_SWAP_MARGIN_SECONDS) : 0;
+
+    uint64_t first_counter = SDL_GetPerformanceCounter();
+    _gg_start_ticks = SDL_GetTicks();
+    uint64_t last_counter = first_counter;
+    uint64_t update_accumulator = 0;
 
-    uint32_t update_time = 0;
-    uint32_t frame_time = 0;
+    ggFrameStats frame_stats = {};
 
-    uint64_t last_counter = SDL_GetPerformanceCounter();
-    uint32_t last_start_time = SDL_GetTicks();
+    ggDebugCollator* debug = (ggDebugCollator*)gg_alloc(GG_TAG_DEBUG, sizeof(ggDebugCollator));
+    gg_debug_init(debug, options.profile, options.trace_filename != NULL);
+    _gg_platform_debug_table = &debug->table;
+    game_memory.debug_table = &debug->table;
 
-    bool running = true;
+#ifdef SAO_GAMEGUY_STATIC_LINK
+    ggGame* first_game = &gg_game;
+#else
+    ggGame* first_game = game.gg_game;
+#endif
+    if (first_game->snapshot_size) {
+        game_memory.snapshot = gg_alloc(GG_TAG_STATE, first_game->snapshot_size);
+    }
+    if (first_game->persistent_storage_size) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        _gg_state_size = first_game->persistent_storage_size;
+        _gg_state_version = first_game->state_version;
+        _gg_state_storage = gg_persistent_storage_map(options.state_filename, _gg_state_size, _gg_state_version,
+                                                      &game_memory.persistent_storage_resumed);
+        if (!_gg_state_storage) {
+            exit(1);
+        }
+        _gg_state_filename = options.state_filename;
+        gg_memory_account(GG_TAG_STATE, (int64_t)_gg_state_size);
+        game_memory.persistent_storage = _gg_state_storage;
+        game_memory.persistent_storage_size = _gg_state_size;
+        fprintf(stderr, "Persistent storage: %llu bytes, %s in %.3f ms\n", (unsigned long long)_gg_state_size,
+                game_memory.persistent_storage_resumed ? "resumed" : "fresh",
+                gg_seconds_elapsed(start, SDL_GetPerformanceCounter()) * 1000.0);
+    } else if (options.state_filename) {
+        fprintf(stderr, "Warning: --state needs the game to set persistent_storage_size.\n");
+    }
+    if ((options.host_port || options.connect_address) && !gg_net_start(&options, first_game)) {
+        exit(1);
+    }
+    ggPipeline* pipeline = NULL;
+    if (options.pipeline && (!first_game->update || !first_game->snapshot_size)) {
+        fprintf(stderr, "Warning: --pipeline needs update, render and snapshot_size, running serially.\n");
+    } else if (options.pipeline && _gg_net) {
+        // The next update would be writing the storage while it's sent or received.
+        fprintf(stderr, "Warning: --pipeline doesn't work with networking, running serially.\n");
+    } else if (options.pipeline) {
+        pipeline = (ggPipeline*)gg_alloc(GG_TAG_STATE, sizeof(ggPipeline));
+        if (!gg_pipeline_init(pipeline, first_game->snapshot_size)) {
+            gg_deallocate(pipeline);
+            pipeline = NULL;
+        }
+    }
+
+    ggMemoryCheck memory_check = {options.frame_allocations_warmup};
+    memory_check.reload_generation = gg_memory_begin_generation();
+
+    if (options.headless) {
+        double* frame_seconds = (double*)gg_alloc(GG_TAG_PLATFORM, options.frames * sizeof(double));
+        double* latency_seconds = (double*)gg_alloc(GG_TAG_PLATFORM, options.frames * sizeof(double));
+        int latency_count = 0;
+        uint64_t headless_counts = (uint64_t)(_gg_counter_frequency * options.fixed_dt);
+
+        for (int frame=0; frame<options.frames; frame++) {
+            BEGIN_TIMED_BLOCK("frame");
+#ifndef SAO_GAMEGUY_STATIC_LINK
+            game_memory.executable_reloaded = gg_game_reload(&game, library_filename);
+            if (game_memory.executable_reloaded) {
+                gg_debug_library_reloaded(debug);
+                gg_memory_library_reloaded(&memory_check);
+            }
+            ggGame* current = game.gg_game;
+#else
+            ggGame* current = &gg_game;
+#endif
+            current->debug_table = &debug->table;
+            game_memory.ticks = (uint64_t)((double)frame * options.fixed_dt * 1000.0);
+            game_memory.dt = options.fixed_dt;
+            game_memory.display_width = width;
+            game_memory.display_height = height;
+            game_memory.drawable_width = width;
+            game_memory.drawable_height = height;
+
+            if (input_consumed) {
+                _gg_clear_input_transitions(&input);
+            }
+            gg_input_recording_frame(&input, &replay_input, record_input, frame);
+
+            uint64_t start_counter = SDL_GetPerformanceCounter();
+            if (audio) {
+                gg_audio_begin_frame(audio);
+            }
+
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            gg_net_begin_frame(&game_memory);
+            if (pipeline && current->update) {
+                input_consumed = gg_game_tick_pipelined(pipeline, current, &game_memory, &input, headless_counts);
+            } else {
+                input_consumed = gg_game_tick(current, &game_memory, &input, headless_counts, &update_accumulator);
+            }
+            game_memory.persistent_storage_resumed = false;
+            gg_net_end_frame(&game_memory, headless_counts);
+            if (context) {
+                // Count the gpu work too, not just submission.
+                TIMED_BLOCK("glFinish");
+                glFinish();
+            }
+
+            uint64_t end_counter = SDL_GetPerformanceCounter();
+            frame_seconds[frame] = gg_seconds_elapsed(start_counter, end_counter);
+            if (!pipeline) {
+                latency_seconds[latency_count++] = frame_seconds[frame];
+            } else if (pipeline->rendered_input_counter) {
+                latency_seconds[latency_count++] = gg_seconds_elapsed(pipeline->rendered_input_counter, end_counter);
+            }
+            END_TIMED_BLOCK("frame");
+            gg_debug_collate(debug);
+            gg_memory_check_frame(&memory_check, game_memory.executable_reloaded);
+            SDL_GL_SwapWindow(window);
+        }
+
+        gg_print_frame_times_json(stdout, pipeline ? "pipelined" : "serial", frame_seconds, options.frames,
+                                  latency_seconds, latency_count);
+        gg_deallocate(frame_seconds);
+        gg_deallocate(latency_seconds);
+    }
+
+    bool running = !options.headless;
+    int frame = 0;
 
     while (running) {
-        uint32_t start_time = SDL_GetTicks();
-        frame_time = start_time - last_start_time;
-        float dt = (float)frame_time / 1000.0;
-        last_start_time = start_time;
+        uint64_t start_counter = SDL_GetPerformanceCounter();
+        uint64_t frame_counts = start_counter - last_counter;
+        float dt = (float)gg_seconds_elapsed(last_counter, start_counter);
+        last_counter = start_counter;
+        if (start_counter != first_counter) {
+            gg_frame_stats_add(&frame_stats, dt);
+        }
+        BEGIN_TIMED_BLOCK("frame");
 
         int w, h;
 	SDL_GetWindowSize(window, &w, &h);
@@ -410,8 +4998,12 @@ main(int argc, char* argv[]) {
         // Reload Game
 #ifndef SAO_GAMEGUY_STATIC_LINK
         game_memory.executable_reloaded = gg_game_reload(&game, library_filename);
+        if (game_memory.executable_reloaded) {
+            gg_debug_library_reloaded(debug);
+            gg_memory_library_reloaded(&memory_check);
+        }
 #endif
-        game_memory.ticks = start_time;
+        game_memory.ticks = (start_counter - first_counter) * 1000 / _gg_counter_frequency;
         game_memory.dt = dt;
         game_memory.display_width = w;
         game_memory.display_height = h;
@@ -419,61 +5011,20 @@ main(int argc, char* argv[]) {
         game_memory.drawable_height = draw_h;
 
         /* Handle SDL Events */
-        for (int i=0; i<sizeof(input.button.e)/sizeof(input.button.e[0]); i++) {
-            input.button.e[i].half_transition_count = 0;
+        if (input_consumed) {
+            _gg_clear_input_transitions(&input);
         }
-
-        input.horisontal_scroll = 0;
-        input.vertical_scroll = 0;
         
+        BEGIN_TIMED_BLOCK("input");
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
-            // handle event
-            switch(event.type) {
-            case SDL_QUIT:
+            if (!gg_process_input_event(&input, &event)) {
                 running = false;
-                break;
-                
-            case SDL_MOUSEWHEEL:
-                input.horisontal_scroll += event.wheel.x;
-                input.vertical_scroll += event.wheel.y;
-                break;
-                
-            case SDL_MOUSEBUTTONDOWN:
-                if (event.button.button == SDL_BUTTON_LEFT) {
-                    input.mouse1.half_transition_count++;
-                    input.mouse1.ended_down = true;
-                }
-                break;
-
-            case SDL_MOUSEBUTTONUP:
-                if (event.button.button == SDL_BUTTON_LEFT) {
-                    input.mouse1.half_transition_count++;
-                    input.mouse1.ended_down = false;
-                }
-                break;
-
-            case SDL_KEYDOWN: {
-                if (SDLK_ESCAPE == event.key.keysym.sym) {
-                    running = false;
-                }
-
-                int button_index = _gg_get_button_index(event.key.keysym.sym);
-                input.button.e[button_index].half_transition_count++;
-                input.button.e[button_index].ended_down = true;
-            } break;
-
-            case SDL_KEYUP: {
-                int button_index = _gg_get_button_index(event.key.keysym.sym);
-                input.button.e[button_index].half_transition_count++;
-                input.button.e[button_index].ended_down = false;
-            } break;
-                
-            default:
-                break;
-            };
+            }
         }
         
+        input_consumed = false;
+
         if (running == false) {
             break;
         }
@@ -482,13 +5033,6 @@ main(int argc, char* argv[]) {
         SDL_GetMouseState(&mouse_x, &mouse_y);
 
         if (SDL_GetWindowFlags(window) & SDL_WINDOW_MOUSE_FOCUS) {
-            if (mouse_x != input.mouse_x ||
-                mouse_y != input.mouse_y) {
-                input.mouse_moved = true;
-                input.mouse_dx = mouse_x - input.mouse_x;
-                input.mouse_dy = mouse_y - input.mouse_y;
-                
-            }
             input.mouse_x = mouse_x;
             input.mouse_y = mouse_y;
 
@@ -497,33 +5041,90 @@ main(int argc, char* argv[]) {
             input.mouse_y = -1;
         }
 
+        gg_input_recording_frame(&input, &replay_input, record_input, frame++);
+        END_TIMED_BLOCK("input");
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (audio) {
+            gg_audio_begin_frame(audio);
+        }
 
         // Run Game Tick
         #ifdef SAO_GAMEGUY_STATIC_LINK
-        gg_game.update_and_render(&game_memory, &input);
+        ggGame* current = &gg_game;
         #else
-        game.gg_game->update_and_render(&game_memory, &input);
+        ggGame* current = game.gg_game;
         #endif
-        
-        // End Frame        
-        update_time = SDL_GetTicks() - start_time;
+        current->debug_table = &debug->table;
 
-        float time_till_vsync = target_seconds_per_frame*1000.0 - (SDL_GetTicks()-start_time);
-        if (time_till_vsync > 3) {
-            SDL_Delay(time_till_vsync - 2);
+        gg_net_begin_frame(&game_memory);
+        if (pipeline && current->update) {
+            input_consumed = gg_game_tick_pipelined(pipeline, current, &game_memory, &input, frame_counts);
+        } else {
+            input_consumed = gg_game_tick(current, &game_memory, &input, frame_counts, &update_accumulator);
+        }
+        game_memory.persistent_storage_resumed = false;
+        gg_net_end_frame(&game_memory, frame_counts);
+        
+        // End Frame
+        {
+            TIMED_BLOCK("wait");
+            gg_wait_until(start_counter + counts_per_frame - swap_margin_counts);
         }
+        END_TIMED_BLOCK("frame");
+        gg_debug_collate(debug);
+        gg_memory_check_frame(&memory_check, game_memory.executable_reloaded);
 
         SDL_GL_SwapWindow(window);
+    }
+
+    gg_frame_stats_print(&frame_stats);
+
+    if (options.profile) {
+        gg_debug_print_summary(debug);
+    }
+    if (options.trace_filename) {
+        gg_debug_write_chrome_trace(debug, options.trace_filename);
+    }
 
-        uint64_t end_counter = SDL_GetPerformanceCounter();
-        last_counter = end_counter;
+    if (record_input) {
+        fclose(record_input);
+    }
+    if (replay_input) {
+        fclose(replay_input);
     }
 
     fprintf(stderr, "Closing\n");
+    if (pipeline) {
+        gg_pipeline_free(pipeline);
+        gg_deallocate(pipeline);
+    }
+    if (_gg_state_filename) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        if (gg_save_persistent_storage()) {
+            fprintf(stderr, "Saved persistent storage to %s in %.3f ms\n", _gg_state_filename,
+                    gg_seconds_elapsed(start, SDL_GetPerformanceCounter()) * 1000.0);
+        }
+    }
+    gg_deallocate(game_memory.snapshot);
+    gg_net_stop(first_game->net_hz > 0 ? first_game->net_hz : 64.0f);
+    if (audio) {
+        gg_audio_close(audio);
+        gg_deallocate(audio);
+    }
+#ifndef SAO_GAMEGUY_STATIC_LINK
+    gg_game_unload(&game);
+#endif
+    gg_pack_close(&_gg_pack);
+    _gg_platform_debug_table = NULL;
+    gg_debug_free(debug);
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
     SDL_Quit();
+
+    gg_memory_print_stats();
+    gg_memory_report_live("Memory leaked", 0, 16);
+    return options.headless && memory_check.failed ? 1 : 0;
 }
 
 #endif
@@ -0,0 +1,111 @@
+// Builds an asset pack for gameguy --pack.
+// ./gameguy_pack [--lz4 | --zstd] out.pack files or directories...
+// Directories are walked recursively, assets are named by the path you passed in so run it
+// from the directory the game loads from.
+#define SAO_GAMEGUY_PACK_IMPLEMENTATION
+#include "sao_gameguy.h"
+
+#include <dirent.h>
+
+typedef struct {
+    char** names;
+    int count;
+    int capacity;
+} NameList;
+
+bool
+add_path(NameList* list, const char* path)
+{
+    struct stat attr;
+    if (stat(path, &attr) == -1) {
+        fprintf(stderr, "Error: can't find %s\n", path);
+        return false;
+    }
+
+    if (S_ISDIR(attr.st_mode)) {
+        DIR* dir = opendir(path);
+        if (!dir) {
+            fprintf(stderr, "Error opening directory %s\n", path);
+            return false;
+        }
+        bool ok = true;
+        struct dirent* child;
+        while (ok && (child = readdir(dir))) {
+            if (child->d_name[0] == '.') {
+                continue;
+            }
+            char child_path[4096];
+            snprintf(child_path, sizeof(child_path), "%s/%s", path, child->d_name);
+            ok = add_path(list, child_path);
+        }
+        closedir(dir);
+        return ok;
+    }
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->names = (char**)realloc(list->names, list->capacity * sizeof(char*));
+    }
+    list->names[list->count++] = strdup(path);
+    return true;
+}
+
+int
+compare_names(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int
+main(int argc, char* argv[])
+{
+    int compression = GG_PACK_RAW;
+    const char* output = NULL;
+    NameList list = {0};
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--lz4") == 0) {
+            compression = GG_PACK_LZ4;
+        } else if (strcmp(argv[i], "--zstd") == 0) {
+            compression = GG_PACK_ZSTD;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Error: unknown option %s\n", argv[i]);
+            return 1;
+        } else if (!output) {
+            output = argv[i];
+        } else if (!add_path(&list, argv[i])) {
+            return 1;
+        }
+    }
+    if (!output || !list.count) {
+        fprintf(stderr, "Usage: %s [--lz4 | --zstd] out.pack files or directories...\n", argv[0]);
+        return 1;
+    }
+
+    // Sorted so the same inputs always give the same pack.
+    qsort(list.names, list.count, sizeof(char*), compare_names);
+    if (!gg_pack_build(output, (const char**)list.names, list.count, compression)) {
+        return 1;
+    }
+
+    ggPack pack;
+    if (!gg_pack_open(&pack, output)) {
+        return 1;
+    }
+    uint64_t size = 0;
+    uint64_t stored_size = 0;
+    for (uint32_t i=0; i<pack.header->entry_count; i++) {
+        size += pack.entries[i].size;
+        stored_size += pack.entries[i].stored_size;
+    }
+    printf("%s: %u assets, %llu bytes stored as %llu, pack is %llu bytes\n", output,
+           pack.header->entry_count, (unsigned long long)size, (unsigned long long)stored_size,
+           (unsigned long long)pack.size);
+    gg_pack_close(&pack);
+
+    for (int i=0; i<list.count; i++) {
+        free(list.names[i]);
+    }
+    free(list.names);
+    return 0;
+}
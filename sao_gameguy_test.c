@@ -6,7 +6,12 @@
 #define SAO_GL_IMPLEMENTATION
 #include "sao_gl.h"
 
+#ifdef __APPLE__
 #include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
 
 const GLchar *vertex_shader =
     "#version 330\n"
@@ -29,11 +34,14 @@ typedef struct {
     GLint shader_program;
     GLuint triangle_vao;
     GLuint triangle_vertex_vbo;
+    saogl_RenderCommands render_commands;
 } GameState;
 
 // Make a triangle spin or something. Good proof of concept.
 void
 game_update_and_render(ggGameMemory *memory, ggGameInput* input) {
+    TIMED_FUNCTION();
+
     GameState* game_state = (GameState*)memory->persistent_storage;
     if (!game_state) {
         // Allocate memory to use by the game and store it's pointer and size in game memory
@@ -43,8 +51,9 @@ game_update_and_render(ggGameMemory *memory, ggGameInput* input) {
         game_state = (GameState*)memory->persistent_storage;
 
         // Set up an opengl triangle.
-        GLint program = saogl_compile_shader_program(vertex_shader, fragment_shader);
-        glUseProgram(program);
+        saogl_Program program;
+        saogl_program_build(&program, vertex_shader, fragment_shader);
+        saogl_use_program(program.program);
 
         float vertices[] = {
             -0.5f, -0.5f, 0.0f,
@@ -53,17 +62,19 @@ game_update_and_render(ggGameMemory *memory, ggGameInput* input) {
         };
 
         glGenVertexArrays(1, &game_state->triangle_vao);
-        glBindVertexArray(game_state->triangle_vao);
+        saogl_bind_vertex_array(game_state->triangle_vao);
 
         glGenBuffers(1, &game_state->triangle_vertex_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, game_state->triangle_vertex_vbo);
+        saogl_bind_buffer(GL_ARRAY_BUFFER, game_state->triangle_vertex_vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-        int position_i = glGetAttribLocation(program, "position");
+        int position_i = saogl_attribute(&program, "position");
         glVertexAttribPointer(position_i, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(0);
 
-        game_state->shader_program = program;
+        game_state->shader_program = program.program;
+        saogl_program_free(&program);
+        saogl_render_commands_init(&game_state->render_commands);
     }
 
     if (input->button.b.w.half_transition_count > 1 ||
@@ -72,12 +83,26 @@ game_update_and_render(ggGameMemory *memory, ggGameInput* input) {
         fprintf(stderr, "You pressed w\n");
     }
 
-    // Draw opengl triangle.
-    glBindVertexArray(game_state->triangle_vao);
-    glUseProgram(game_state->shader_program);
-    glDrawArrays(GL_TRIANGLES, 0, 9);
+    // Draw opengl triangle, it's drawn in game_submit.
+    saogl_DrawCommand draw = {
+        .program = game_state->shader_program,
+        .vertex_array = game_state->triangle_vao,
+        .mode = GL_TRIANGLES,
+        .count = 3,
+    };
+    saogl_push_draw(&game_state->render_commands, saogl_sort_key(0, 0, 0, 0.0f), &draw);
+}
+
+void
+game_submit(ggGameMemory* memory)
+{
+    GameState* game_state = (GameState*)memory->persistent_storage;
+    if (game_state) {
+        saogl_render_commands_submit(&game_state->render_commands);
+    }
 }
 
 ggGame gg_game = {
-    .update_and_render = game_update_and_render
+    .update_and_render = game_update_and_render,
+    .submit = game_submit
 };
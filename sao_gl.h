@@ -9,6 +9,12 @@
 #ifndef _sao_gl_h
 #define _sao_gl_h
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 int saogl_compile_shader_program(const char* vertex_shader_src, const char* fragment_shader_src);
 // Returns an opengl shader program or 0 on error. Writes any errors to stderr.
 
@@ -21,13 +27,877 @@ saogl_build_shader_from_files(saogl_GetFileSizeFn get_file_size,
                               const char* vertex_shader_filename,
                               const char* fragment_shader_filename);
 
+// Shader program cache.
+// Keeps linked program binaries (glGetProgramBinary) in one file keyed by a hash of the
+// shader sources and the driver, so programs that haven't changed skip compiling and
+// linking. If the driver has no binary formats or rejects a binary we compile as normal.
+// Open it once, keep the pointer in your game state so it survives reloads.
+//
+//   cache = saogl_shader_cache_open("shaders.cache");
+//   program = saogl_compile_shader_program_cached(cache, vert_src, frag_src);
+//   saogl_shader_cache_save(cache); // when you're done loading, or at exit.
+typedef struct {
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+    void* data;
+} saogl_ShaderCacheEntry;
+
+typedef struct {
+    char* filename;
+    uint64_t driver_hash;
+    bool supported;
+    bool dirty;
+
+    // Open addressed on key, capacity is a power of two.
+    saogl_ShaderCacheEntry* entries;
+    uint32_t capacity;
+    uint32_t count;
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t rejected; // Binaries the driver wouldn't take, counted as misses too.
+} saogl_ShaderCache;
+
+saogl_ShaderCache* saogl_shader_cache_open(const char* filename);
+// Needs a current gl context. Returns NULL only if out of memory, a missing or stale file
+// just means an empty cache.
+
+int saogl_compile_shader_program_cached(saogl_ShaderCache* cache,
+                                        const char* vertex_shader_src,
+                                        const char* fragment_shader_src);
+// Same as saogl_compile_shader_program but uses and fills the cache. cache can be NULL.
+
+bool saogl_shader_cache_save(saogl_ShaderCache* cache);
+// Writes the cache file if anything was added. Returns false if writing failed.
+
+void saogl_shader_cache_close(saogl_ShaderCache* cache);
+// Saves and frees the cache.
+
+void saogl_shader_cache_print_stats(saogl_ShaderCache* cache);
+
+bool saogl_has_extension(const char* name);
+// True if the current context lists the extension. Checks GL_NUM_EXTENSIONS each call,
+// cache the answer.
+
+// Batched shader compilation.
+// saogl_compile_shader_program waits on the driver for every shader it compiles. A batch
+// submits compiles and links for all its programs first and only asks for results in
+// saogl_shader_batch_poll. With GL_KHR_parallel_shader_compile the driver compiles on its
+// own threads and poll never blocks, so you can call it once a frame while loading.
+//
+//   saogl_ShaderBatch batch;
+//   saogl_shader_batch_init(&batch);
+//   int sky = saogl_shader_batch_add(&batch, "sky", sky_vert, sky_frag);
+//   ...
+//   if (saogl_shader_batch_poll(&batch)) { // every frame until it returns true
+//       GLint program = batch.programs[sky].program; // 0 if it failed
+//   }
+enum {
+    SAOGL_SHADER_PENDING,
+    SAOGL_SHADER_READY,
+    SAOGL_SHADER_FAILED,
+};
+
+typedef struct {
+    const char* name; // Used in error messages, not copied.
+    uint32_t vert_shader;
+    uint32_t frag_shader;
+    uint32_t program;
+    int status;
+} saogl_ShaderBatchProgram;
+
+typedef struct {
+    saogl_ShaderBatchProgram* programs;
+    uint32_t count;
+    uint32_t capacity;
+
+    uint32_t pending_count;
+    uint32_t ready_count;
+    uint32_t failed_count;
+
+    bool parallel; // Driver has parallel shader compile.
+} saogl_ShaderBatch;
+
+void saogl_shader_batch_init(saogl_ShaderBatch* batch);
+
+int saogl_shader_batch_add(saogl_ShaderBatch* batch, const char* name,
+                           const char* vertex_shader_src, const char* fragment_shader_src);
+// Starts compiling and linking, returns the program's index in batch->programs.
+
+bool saogl_shader_batch_poll(saogl_ShaderBatch* batch);
+// Finishes whatever programs are done and returns true once none are pending. Errors are
+// written to stderr with the program's name. Blocks if the driver can't compile in parallel.
+
+void saogl_shader_batch_free(saogl_ShaderBatch* batch);
+// Frees the batch, not the programs that were built.
+
+// Program reflection.
+// Lists a linked program's active uniforms, attributes and uniform blocks once, sorted by
+// a hash of their names. Look a uniform up by name once (at init or after a reload), keep
+// the index and set it with the saogl_set_uniform_* functions every frame. Those remember
+// the last value uploaded and skip the gl call when it hasn't changed.
+// Setters use glProgramUniform* so the program doesn't need to be bound (gl 4.1).
+// Array names are stored without the "[0]", block members have location -1.
+typedef struct {
+    uint32_t hash;
+    const char* name;
+    int32_t location;
+    uint32_t type;        // GL_FLOAT_VEC3, GL_SAMPLER_2D, ...
+    int32_t size;         // Array length, 1 if not an array.
+    int32_t block_index;  // Uniform block it's in or -1.
+    int32_t offset;       // Byte offset inside its block.
+    uint32_t value_offset;
+    uint32_t value_size;  // Bytes of last uploaded value we keep, 0 means always upload.
+    bool has_value;
+} saogl_ShaderVariable;
+
+typedef struct {
+    uint32_t hash;
+    const char* name;
+    uint32_t index;
+    int32_t binding;
+    int32_t data_size;
+} saogl_UniformBlock;
+
+typedef struct {
+    int program;
+
+    saogl_ShaderVariable* uniforms;
+    uint32_t uniform_count;
+    saogl_ShaderVariable* attributes;
+    uint32_t attribute_count;
+    saogl_UniformBlock* blocks;
+    uint32_t block_count;
+
+    char* names;
+    uint8_t* values;
+
+    uint32_t uploads;
+    uint32_t skipped_uploads;
+} saogl_Program;
+
+bool saogl_program_reflect(saogl_Program* program, int gl_program);
+// Builds the tables for an already linked program. False if gl_program isn't linked.
+
+bool saogl_program_build(saogl_Program* program, const char* vertex_shader_src, const char* fragment_shader_src);
+// saogl_compile_shader_program then saogl_program_reflect.
+
+void saogl_program_free(saogl_Program* program);
+// Frees the tables, not the gl program.
+
+int saogl_uniform(saogl_Program* program, const char* name);
+// Index into program->uniforms or -1.
+
+int saogl_attribute(saogl_Program* program, const char* name);
+// Attribute location or -1, replaces glGetAttribLocation.
+
+int saogl_uniform_block(saogl_Program* program, const char* name);
+// Index into program->blocks or -1.
+
+void saogl_set_uniform_1i(saogl_Program* program, int uniform, int32_t value);
+void saogl_set_uniform_1f(saogl_Program* program, int uniform, float value);
+void saogl_set_uniform_2fv(saogl_Program* program, int uniform, int count, const float* value);
+void saogl_set_uniform_3fv(saogl_Program* program, int uniform, int count, const float* value);
+void saogl_set_uniform_4fv(saogl_Program* program, int uniform, int count, const float* value);
+void saogl_set_uniform_matrix3fv(saogl_Program* program, int uniform, int count, const float* value);
+void saogl_set_uniform_matrix4fv(saogl_Program* program, int uniform, int count, const float* value);
+// uniform is from saogl_uniform, -1 is ignored so missing uniforms are harmless.
+
+// State cache.
+// Shadows the gl state we set most and skips calls that wouldn't change anything. Use these
+// instead of the gl calls they wrap. Everything starts unknown (so the first call always goes
+// through) and a freshly loaded game library starts with a new cache. If anything else
+// touches the same state, or you delete an object that might still be bound, call
+// saogl_state_invalidate. Binding a vertex array also forgets the element buffer binding
+// since it belongs to the vao.
+#define SAOGL_MAX_TEXTURE_UNITS 16
+
+typedef struct {
+    uint32_t issued;
+    uint32_t skipped;
+} saogl_StateStats;
+
+void saogl_use_program(uint32_t program);
+void saogl_bind_vertex_array(uint32_t vao);
+void saogl_bind_buffer(uint32_t target, uint32_t buffer);
+// GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_PIXEL_UNPACK_BUFFER,
+// GL_COPY_READ/WRITE_BUFFER are shadowed, any other target goes straight to glBindBuffer.
+void saogl_bind_texture(uint32_t unit, uint32_t target, uint32_t texture);
+// unit is 0 based, not GL_TEXTURE0.
+void saogl_set_blend(bool enabled, uint32_t src_factor, uint32_t dst_factor);
+void saogl_set_depth(bool test, bool write, uint32_t func);
+void saogl_set_cull(bool enabled, uint32_t face);
+
+void saogl_state_invalidate(void);
+saogl_StateStats saogl_state_stats(void);
+void saogl_state_reset_stats(void);
+void saogl_state_print_stats(void);
+
+// Render commands.
+// Record clears, uniform changes and draws with a 64 bit sort key instead of calling gl,
+// then saogl_render_commands_submit sorts them by key (radix sort, stable so commands with
+// the same key keep the order they were pushed in), merges neighbouring draws that share
+// all their state into one glMultiDraw* call and runs them through the state cache.
+// Any thread can push, each one records into its own list so there's no locking. Don't
+// push while submit runs. Pointers in commands must stay valid until submit.
+//
+//   uint64_t key = saogl_sort_key(PASS_OPAQUE, shader_id, material_id, depth);
+//   saogl_push_uniform(&commands, key, &program, model_uniform, GL_FLOAT_MAT4, 1, model);
+//   saogl_push_draw(&commands, key, &(saogl_DrawCommand){...});
+//   ...
+//   saogl_render_commands_submit(&commands); // from gg_game.submit
+#define SAOGL_MAX_COMMAND_LISTS 32
+#define SAOGL_DRAW_TEXTURES 4
+
+uint64_t saogl_sort_key(uint8_t pass, uint16_t shader, uint16_t material, float depth);
+// pass:8 shader:16 material:16 depth:24, depth is clamped to 0..1. Pass 1 - depth for back
+// to front.
+
+typedef struct {
+    uint32_t program;
+    uint32_t vertex_array;
+    uint32_t textures[SAOGL_DRAW_TEXTURES]; // GL_TEXTURE_2D on units 0..3, 0 leaves the unit alone.
+    uint32_t mode;                          // GL_TRIANGLES, ...
+    uint32_t index_type;                    // 0 for glDrawArrays, otherwise GL_UNSIGNED_SHORT or INT.
+    uint32_t first;                         // First vertex or first index.
+    uint32_t count;
+    uint32_t instance_count;                // 0 or 1 for a normal draw.
+    int32_t base_vertex;
+} saogl_DrawCommand;
+
+typedef struct {
+    uint64_t key;
+    uint32_t list;
+    uint32_t offset;
+} saogl_CommandEntry;
+
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+    uint32_t capacity;
+    saogl_CommandEntry* entries;
+    uint32_t count;
+    uint32_t entry_capacity;
+} saogl_CommandList;
+
+typedef struct {
+    uint32_t commands;
+    uint32_t draws;
+    uint32_t merged_draws;  // Draws folded into an earlier call.
+    uint32_t draw_calls;    // What gl actually saw.
+} saogl_RenderStats;
+
+typedef struct {
+    saogl_CommandList lists[SAOGL_MAX_COMMAND_LISTS];
+    atomic_uint list_count;
+    atomic_uint generation;
+
+    // Scratch for sorting and merging, kept between frames.
+    saogl_CommandEntry* sorted;
+    saogl_CommandEntry* sort_temp;
+    uint32_t sort_capacity;
+    int32_t* multi_firsts;
+    int32_t* multi_counts;
+    int32_t* multi_base_vertices;
+    uint32_t multi_capacity;
+
+    saogl_RenderStats last_frame;
+} saogl_RenderCommands;
+
+void saogl_render_commands_init(saogl_RenderCommands* commands);
+void saogl_render_commands_free(saogl_RenderCommands* commands);
+
+void saogl_push_clear(saogl_RenderCommands* commands, uint64_t key, uint32_t mask,
+                      float r, float g, float b, float a, float depth);
+void saogl_push_draw(saogl_RenderCommands* commands, uint64_t key, const saogl_DrawCommand* draw);
+void saogl_push_uniform(saogl_RenderCommands* commands, uint64_t key, saogl_Program* program,
+                        int uniform, uint32_t type, int count, const void* value);
+// type is GL_INT, GL_FLOAT, GL_FLOAT_VEC2/3/4 or GL_FLOAT_MAT3/4, value is copied.
+
+void saogl_render_commands_submit(saogl_RenderCommands* commands);
+// Sorts, merges and draws everything pushed since the last submit then empties the lists.
+// Stats for it end up in commands->last_frame. Needs the gl context.
+
+// Streaming buffer.
+// One buffer object for data that changes every frame (debug lines, particles, ui, per
+// frame uniforms). Allocations are bump allocated out of the current frame's part of a
+// ring and never free, saogl_stream_end_frame fences that part and moves on to the next.
+// With ARB_buffer_storage (gl 4.4) the whole ring is persistently mapped and the gpu reads
+// straight from where you wrote, a fence per frame in flight keeps us from writing over
+// data it hasn't drawn yet. Without it (osx) we write to a cpu copy, orphan the buffer
+// each frame and upload in saogl_stream_flush.
+//
+//   saogl_StreamAllocation a = saogl_stream_alloc(&stream, sizeof(vertices), 16);
+//   if (a.data) {
+//       memcpy(a.data, vertices, sizeof(vertices));
+//       saogl_stream_flush(&stream); // before the draw that reads it
+//       glVertexAttribPointer(..., (void*)(uintptr_t)a.offset);
+//   }
+//   ...
+//   saogl_stream_end_frame(&stream); // after the frame's draws, before swapping
+#define SAOGL_STREAM_FRAMES 3
+
+enum {
+    SAOGL_STREAM_ORPHAN = 1 << 0, // Don't use persistent mapping even if we could.
+};
+
+typedef struct {
+    uint64_t allocations;
+    uint64_t bytes;
+    uint32_t peak_frame_bytes;
+    uint32_t failed_allocations;   // Didn't fit in what's left of the frame.
+    uint32_t stalls;               // Times end_frame had to wait on the gpu.
+    double stall_seconds;
+} saogl_StreamStats;
+
+typedef struct {
+    uint32_t buffer;
+    uint32_t frame_size;
+    uint32_t frame_count;          // SAOGL_STREAM_FRAMES, 1 when orphaning.
+    uint32_t frame;
+    uint32_t offset;               // Next free byte in the current frame.
+    uint32_t flushed;              // Orphaning only, bytes uploaded so far this frame.
+    int32_t uniform_alignment;     // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, use it for uniform blocks.
+    bool persistent;
+    uint8_t* mapped;               // Persistent mapping or the cpu copy.
+    void* fences[SAOGL_STREAM_FRAMES];
+    saogl_StreamStats stats;
+} saogl_StreamBuffer;
+
+typedef struct {
+    void* data;                    // Where to write, NULL if it didn't fit.
+    uint32_t offset;               // Byte offset in stream->buffer for gl calls.
+} saogl_StreamAllocation;
+
+bool saogl_stream_init(saogl_StreamBuffer* stream, uint32_t frame_size, int flags);
+// frame_size is how much can be allocated each frame.
+void saogl_stream_free(saogl_StreamBuffer* stream);
+
+saogl_StreamAllocation saogl_stream_alloc(saogl_StreamBuffer* stream, uint32_t size, uint32_t alignment);
+// alignment has to be a power of two.
+void saogl_stream_flush(saogl_StreamBuffer* stream);
+// Makes everything written so far visible to gl. Nothing to do when persistently mapped.
+void saogl_stream_end_frame(saogl_StreamBuffer* stream);
+void saogl_stream_print_stats(saogl_StreamBuffer* stream);
+
+// Instanced drawing.
+// Draws one mesh many times with a transform (and optionally one more attribute, like a
+// color) per instance. The per instance data for the visible instances is packed into a
+// stream buffer and drawn with glDraw*Instanced, split into chunks if there are more than
+// max_instances_per_draw or the stream is running out of room for this frame.
+// SAOGL_INSTANCE_MAT4 transforms are 16 floats, column major like sao_math's Mat4. They go
+// to 4 vec4 attributes starting at transform_location, so the shader declares
+// `layout (location = N) in mat4 transform;`. SAOGL_INSTANCE_AFFINE transforms are the top
+// 3 rows of the matrix, 12 floats row major, to 3 vec4 attributes. 25% smaller, rebuild it with
+// `transpose(mat4(row0, row1, row2, vec4(0, 0, 0, 1)))`.
+// Draws with the bound program and changes the instance attribute pointers in the mesh's vao.
+enum {
+    SAOGL_INSTANCE_MAT4,
+    SAOGL_INSTANCE_AFFINE,
+};
+
+typedef struct {
+    uint32_t vertex_array;          // With the per vertex attributes and element buffer set up.
+    uint32_t mode;                  // GL_TRIANGLES, ...
+    uint32_t index_type;            // 0 for glDrawArraysInstanced.
+    uint32_t count;                 // Indices or vertices per instance.
+
+    int transform_format;
+    int transform_location;
+    int attribute_location;         // -1 for none.
+    int attribute_components;       // Floats per instance, up to 4.
+    uint32_t max_instances_per_draw; // 0 for no limit.
+
+    // Totals since the mesh was set up.
+    uint64_t instances_drawn;
+    uint64_t instances_dropped;     // Didn't fit in the stream buffer.
+    uint64_t draw_calls;
+} saogl_InstancedMesh;
+
+uint32_t saogl_draw_instanced(saogl_StreamBuffer* stream, saogl_InstancedMesh* mesh,
+                              const float* transforms, const float* attributes,
+                              const uint32_t* visible, uint32_t count);
+// Draws count instances, or if visible isn't NULL the count instances it indexes (from
+// culling). attributes can be NULL if the mesh has none. Returns the number of draw calls.
+
+// Debug drawing.
+// Immediate mode lines, boxes, spheres, frusta, axes and text for looking at what the game is
+// doing. Everything is appended to one cpu vertex array for the frame, world lines and
+// screen text separately, and saogl_debug_draw_submit draws each with one call. Appending
+// reserves space with an atomic compare and swap so jobs can draw from any thread, anything
+// past the capacity is counted and dropped. Don't append while submit runs.
+// Points are float[3] (pass a V3's .e), matrices are 16 floats column major like Mat4.
+// Text is in pixels from the top left of the viewport, drawn with line segments.
+// Define SAOGL_NO_DEBUG_DRAW to compile every call out, or clear enabled to skip at runtime.
+#define SAOGL_RGBA(r, g, b, a) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | ((uint32_t)(a) << 24))
+
+typedef struct {
+    float position[3];
+    uint32_t color;
+} saogl_DebugVertex;
+
+typedef struct {
+    bool enabled;
+    bool depth_test;                // For world lines, text is always on top.
+
+    saogl_DebugVertex* lines;
+    uint32_t line_capacity;         // In vertices, 2 per line.
+    atomic_uint line_count;
+    saogl_DebugVertex* text;
+    uint32_t text_capacity;
+    atomic_uint text_count;
+    atomic_uint dropping;           // Lines that didn't fit since the last submit.
+
+    saogl_Program program;
+    int transform_uniform;
+    uint32_t vertex_array;
+    uint32_t vertex_buffer;
+
+    // Last submit.
+    uint32_t lines_drawn;
+    uint32_t text_lines_drawn;
+    uint32_t dropped;
+} saogl_DebugDraw;
+
+bool saogl_debug_draw_init(saogl_DebugDraw* dd, uint32_t max_lines, uint32_t max_text_lines);
+void saogl_debug_draw_free(saogl_DebugDraw* dd);
+void saogl_debug_draw_submit(saogl_DebugDraw* dd, const float* view_projection);
+// Draws and clears everything appended since the last submit. Needs the gl context.
+
+#ifndef SAOGL_NO_DEBUG_DRAW
+void saogl_debug_line(saogl_DebugDraw* dd, const float* a, const float* b, uint32_t color);
+void saogl_debug_aabb(saogl_DebugDraw* dd, const float* min, const float* max, uint32_t color);
+void saogl_debug_sphere(saogl_DebugDraw* dd, const float* center, float radius, uint32_t color);
+void saogl_debug_frustum(saogl_DebugDraw* dd, const float* view_projection, uint32_t color);
+// Outline of what view_projection (perspective * look_at) sees.
+void saogl_debug_axes(saogl_DebugDraw* dd, const float* transform, float size);
+// x, y and z of transform in red, green and blue.
+void saogl_debug_text(saogl_DebugDraw* dd, float x, float y, float size, uint32_t color, const char* format, ...);
+// printf style, size is the height of a letter in pixels. Letters, numbers and some symbols.
+#else
+static inline void saogl_debug_line(saogl_DebugDraw* dd, const float* a, const float* b, uint32_t color) {}
+static inline void saogl_debug_aabb(saogl_DebugDraw* dd, const float* min, const float* max, uint32_t color) {}
+static inline void saogl_debug_sphere(saogl_DebugDraw* dd, const float* center, float radius, uint32_t color) {}
+static inline void saogl_debug_frustum(saogl_DebugDraw* dd, const float* view_projection, uint32_t color) {}
+static inline void saogl_debug_axes(saogl_DebugDraw* dd, const float* transform, float size) {}
+static inline void saogl_debug_text(saogl_DebugDraw* dd, float x, float y, float size, uint32_t color, const char* format, ...) {}
+#endif
+
+// Texture streaming.
+// Loads textures without stalling the frame. Worker threads read and decode the files into
+// staging memory, then saogl_texture_streamer_update (once a frame on the gl thread) copies
+// at most bytes_per_frame of it through a pixel unpack buffer (a saogl_StreamBuffer) into
+// the textures. Big levels are split by rows. The smallest mip is uploaded first and
+// GL_TEXTURE_BASE_LEVEL follows the finest finished level, so textures sharpen as they
+// stream in instead of popping in at the end.
+// Reads uncompressed 24/32 bit .tga (mips are generated on the worker) and .ktx (version 1)
+// with RGBA8 or any block compressed format the driver lists (BC1-7, ETC2/EAC), using the
+// mips in the file.
+//
+//   saogl_TextureStreamer streamer;
+//   saogl_texture_streamer_init(&streamer, 2, 4 << 20);
+//   saogl_Texture* rock = saogl_texture_load(&streamer, "rock.ktx");
+//   ...
+//   saogl_texture_streamer_update(&streamer); // every frame
+//   if (rock->status != SAOGL_TEXTURE_FAILED) saogl_bind_texture(0, GL_TEXTURE_2D, rock->texture);
+#define SAOGL_MAX_MIP_LEVELS 16
+#define SAOGL_MAX_TEXTURE_SIZE (1 << (SAOGL_MAX_MIP_LEVELS - 1)) // Width or height.
+
+enum {
+    SAOGL_TEXTURE_QUEUED,
+    SAOGL_TEXTURE_DECODED,     // Waiting for the gl thread.
+    SAOGL_TEXTURE_UPLOADING,   // Usable, lower mips are in.
+    SAOGL_TEXTURE_READY,
+    SAOGL_TEXTURE_FAILED,
+};
+
+typedef struct {
+    uint32_t internal_format;
+    bool compressed;
+    uint32_t block_bytes;      // Bytes per 4x4 block, or per pixel if not compressed.
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    size_t level_offsets[SAOGL_MAX_MIP_LEVELS];
+    size_t level_sizes[SAOGL_MAX_MIP_LEVELS];
+    uint8_t* data;
+} saogl_Image;
+
+typedef struct {
+    uint32_t texture;          // Made right away, so it can be stored before it's loaded.
+    atomic_int status;
+    char* filename;
+    saogl_Image image;         // Owned by the worker until DECODED, freed when READY.
+
+    // Upload progress, levels go from last to 0.
+    int level;
+    uint32_t row;
+    bool finished;
+} saogl_Texture;
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t bytes_last_frame;
+    uint32_t peak_bytes_frame;
+    double seconds_last_frame;
+    double peak_seconds_frame;
+    uint32_t loaded;
+    uint32_t failed;
+} saogl_TextureStreamStats;
+
+typedef struct {
+    uint32_t bytes_per_frame;
+    saogl_StreamBuffer upload;
+
+    int32_t* compressed_formats;
+    int compressed_format_count;
+
+    // Everything loaded, and the ones the gl thread still has to look at.
+    saogl_Texture** textures;
+    uint32_t texture_count;
+    uint32_t texture_capacity;
+    uint32_t first_pending;
+
+    // Work for the decode threads.
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    saogl_Texture** queue;
+    uint32_t queue_head;
+    uint32_t queue_count;
+    uint32_t queue_capacity;
+    bool quit;
+
+    saogl_TextureStreamStats stats;
+} saogl_TextureStreamer;
+
+bool saogl_texture_streamer_init(saogl_TextureStreamer* streamer, int thread_count, uint32_t bytes_per_frame);
+void saogl_texture_streamer_free(saogl_TextureStreamer* streamer);
+// Stops the workers and deletes every texture it loaded.
+
+saogl_Texture* saogl_texture_load(saogl_TextureStreamer* streamer, const char* filename);
+void saogl_texture_streamer_update(saogl_TextureStreamer* streamer);
+bool saogl_texture_streamer_busy(saogl_TextureStreamer* streamer);
+// True while anything is still decoding or uploading.
+void saogl_texture_streamer_print_stats(saogl_TextureStreamer* streamer);
+
+bool saogl_load_image(const char* filename, saogl_Image* image);
+// What the workers run, .tga or .ktx by extension. Usable on its own, free image->data (with
+// SAOGL_FREE if you pointed that elsewhere).
+
+// Mesh import.
+// Loads .obj (v, vt, vn and f lines, polygons are fanned into triangles, everything else is
+// skipped) or the .mesh files saogl_save_mesh writes into one interleaved vertex array and a
+// uint32 index array, ready for glBufferData. Files are memory mapped. An obj is split into
+// chunks at line breaks, one per thread, that are counted then parsed in parallel straight
+// into the shared arrays. Floats are parsed by hand, strtod is slow and looks up the locale.
+// Corners are deduplicated with a hash map so each unique position/texcoord/normal triple is
+// one vertex. Convert big obj files to .mesh once, loading those is a checked copy.
+//
+// Vertex layout is position xyz, then normal xyz if the file has any, then texcoord uv if it
+// has any. Corners without one get zeros.
+enum {
+    SAOGL_MESH_NORMALS = 1 << 0,
+    SAOGL_MESH_TEXCOORDS = 1 << 1,
+};
+
+typedef struct {
+    uint32_t format;           // SAOGL_MESH_* flags.
+    uint32_t stride;           // Floats per vertex.
+    uint32_t vertex_count;
+    uint32_t index_count;
+    float* vertices;
+    uint32_t* indices;
+} saogl_Mesh;
+
+bool saogl_load_mesh(saogl_Mesh* mesh, const char* filename, int thread_count);
+// .mesh by extension, anything else is parsed as obj. thread_count 0 uses every core.
+bool saogl_parse_obj(saogl_Mesh* mesh, const char* text, size_t size, int thread_count);
+bool saogl_save_mesh(const saogl_Mesh* mesh, const char* filename);
+void saogl_mesh_free(saogl_Mesh* mesh);
+
+void saogl_mesh_upload(const saogl_Mesh* mesh, uint32_t* vertex_array, uint32_t* vertex_buffer,
+                       uint32_t* index_buffer);
+// Makes a vao with position at attribute 0, normal at 1 and texcoord at 2 (when the mesh has
+// them) and fills the two buffers. Needs the gl context.
+
+// Level of detail.
+// Picks a level for every object from how big the level's simplification error would look on
+// screen: error * projection_scale / distance pixels, where projection_scale is
+// viewport_height / (2 * tan(field_of_view / 2)) for the same field_of_view you give
+// perspective() and distance is to the near side of the object's bounding sphere. Each object
+// gets the coarsest level under threshold_pixels. Objects are stored as arrays (x, y, z,
+// radius, model) so the distances are computed four at a time.
+// To avoid popping back and forth at a boundary an object only goes coarser once the coarser
+// level is hysteresis (a fraction) under the threshold, going finer is immediate.
+// With a triangle_budget, objects that don't fit are coarsened starting from the one whose
+// error looks smallest, usually the farthest, each down to its coarsest level before the next.
+// The result is a list of object indices for every model and level, ready for
+// saogl_draw_instanced's visible argument with that level's mesh. No gl calls.
+//
+//   saogl_lod_init(&lod, models, model_count, object_count);
+//   // fill lod.x, y, z, radius and model for lod.count objects
+//   saogl_lod_select(&lod, eye, 60.0f, drawable_height, 0.1f);
+//   for each model m and level l: saogl_lod_list(&lod, m, l, &count)
+#define SAOGL_MAX_LODS 8
+
+typedef struct {
+    uint32_t level_count;
+    float error[SAOGL_MAX_LODS];        // World space, increasing, error[0] is usually 0.
+    uint32_t triangles[SAOGL_MAX_LODS];
+} saogl_LodModel;
+
+typedef struct {
+    uint64_t triangles;
+    uint64_t full_detail_triangles;     // If every object drew level 0.
+    uint32_t changed;                   // Objects on a different level than last time.
+    uint32_t held;                      // Kept finer than needed by the hysteresis.
+    uint32_t coarsened;                 // Levels dropped to fit the triangle budget.
+    double seconds;
+} saogl_LodStats;
+
+typedef struct {
+    // Objects, count of them. Arrays have room for capacity rounded up to 4.
+    float* x;
+    float* y;
+    float* z;
+    float* radius;
+    uint16_t* model;
+    uint8_t* level;                     // What it drew last time, start new objects at 0.
+    uint32_t count;
+    uint32_t capacity;
+
+    const saogl_LodModel* models;
+    uint32_t model_count;
+
+    float threshold_pixels;             // 1 by default.
+    float hysteresis;                   // 0.1 by default.
+    uint64_t triangle_budget;           // 0 for none.
+
+    // Object indices grouped by list, list model * SAOGL_MAX_LODS + level starts at
+    // list_first and has list_count of them.
+    uint32_t* indices;
+    uint32_t* list_first;
+    uint32_t* list_count;
+
+    // Scratch.
+    float* allowed_error;
+    saogl_CommandEntry* sort;
+    saogl_CommandEntry* sort_temp;
+
+    saogl_LodStats last_select;
+} saogl_Lod;
+
+bool saogl_lod_init(saogl_Lod* lod, const saogl_LodModel* models, uint32_t model_count, uint32_t capacity);
+bool saogl_lod_resize(saogl_Lod* lod, uint32_t count);
+// Keeps the objects that were there, grows the arrays if needed. New ones start at level 0.
+void saogl_lod_free(saogl_Lod* lod);
+
+void saogl_lod_select(saogl_Lod* lod, const float* eye, float field_of_view, float viewport_height,
+                      float near_clip);
+// eye is xyz, field_of_view in degrees like perspective().
+
+static inline const uint32_t*
+saogl_lod_list(const saogl_Lod* lod, uint32_t model, uint32_t level, uint32_t* count)
+{
+    uint32_t list = model * SAOGL_MAX_LODS + level;
+    *count = lod->list_count[list];
+    return lod->indices + lod->list_first[list];
+}
+
+// Shader hot reload.
+// Register programs by their vertex and fragment files and they rebuild whenever a file they
+// were made from changes. Sources go through a small preprocessor that expands
+// #include "file" (relative to the including file, each file at most once per stage like
+// #pragma once) and remembers every file a program used, so an edit only rebuilds the
+// programs that depend on it. Every file is marked with #line, so "3(12)" in a compile
+// error is line 12 of file 3 in the list printed with it.
+// A thread waits on inotify (elsewhere it checks modification times every poll_ms), reads
+// and preprocesses the affected programs and queues their sources. saogl_shader_watch_update,
+// once a frame on the gl thread, compiles and links them in a saogl_ShaderBatch and swaps each
+// program in once it has linked. If it doesn't link the errors go to stderr and the old
+// program stays. Update never waits on the thread, and with GL_KHR_parallel_shader_compile
+// not on the driver either. Without it update starts SAOGL_WATCH_SERIAL_BUILDS builds a
+// frame and waits for those.
+//
+//   saogl_ShaderWatch watch;
+//   saogl_shader_watch_init(&watch);
+//   int sky = saogl_shader_watch_add(&watch, "shaders/sky.vert", "shaders/sky.frag");
+//   ...
+//   saogl_shader_watch_update(&watch); // every frame
+//   saogl_WatchedProgram* p = watch.programs + sky;
+//   if (p->version != sky_version) { saogl_program_reflect(...) again, sky_version = p->version; }
+//   saogl_use_program(p->program); // 0 until it first links
+typedef struct {
+    char* path;
+    const char* name;    // After the last '/', what inotify reports.
+    int watch;           // inotify watch on its directory, -1 if there isn't one.
+    int64_t modified;    // When polling, in nanoseconds.
+} saogl_ShaderFile;
+
+typedef struct {
+    char* vertex_filename;
+    char* fragment_filename;
+    uint32_t program;    // 0 until it first links.
+    uint32_t version;    // Goes up every time program is replaced.
+
+    // Written by the thread under the mutex.
+    uint32_t* files;     // What it was last built from, indices into watch->files.
+    uint32_t file_count;
+    bool dirty;
+
+    uint32_t building;   // Batch index + 1 of its newest build, 0 if none.
+} saogl_WatchedProgram;
+
+typedef struct {
+    uint32_t program;
+    char* vertex_src;
+    char* fragment_src;
+    char* file_list;     // Printed with errors.
+    double seen;         // When the change was noticed.
+} saogl_ShaderJob;
+
+typedef struct {
+    uint32_t changes;    // Files the thread saw change.
+    uint32_t swapped;
+    uint32_t failed;
+    uint32_t superseded; // Builds a newer edit replaced before they finished.
+    double last_seconds; // From a change being noticed to the program being swapped in.
+    double max_seconds;
+} saogl_ShaderWatchStats;
+
+typedef struct {
+    saogl_WatchedProgram* programs;
+    uint32_t program_count;
+    uint32_t program_capacity;
+    saogl_ShaderFile* files;
+    uint32_t file_count;
+    uint32_t file_capacity;
+
+    // Preprocessed sources from the thread, waiting for update.
+    saogl_ShaderJob* jobs;
+    uint32_t job_count;
+    uint32_t job_capacity;
+
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    bool started;        // Init succeeded, free joins the thread.
+    atomic_bool quit;
+    int notify;          // inotify descriptor, -1 when polling.
+    int poll_ms;
+
+    // Gl thread only, builds is parallel to batch.programs.
+    saogl_ShaderBatch batch;
+    saogl_ShaderJob* builds;
+    uint32_t build_capacity;
+
+    saogl_ShaderWatchStats stats;
+} saogl_ShaderWatch;
+
+bool saogl_shader_watch_init(saogl_ShaderWatch* watch);
+// Needs the gl context, starts the thread.
+void saogl_shader_watch_free(saogl_ShaderWatch* watch);
+// Stops the thread and deletes every program it built. Does nothing if init failed.
+
+int saogl_shader_watch_add(saogl_ShaderWatch* watch, const char* vertex_filename, const char* fragment_filename);
+// Reads the files now and returns the index into watch->programs, -1 if out of memory. Files
+// that are missing or don't build are still watched.
+
+bool saogl_shader_watch_update(saogl_ShaderWatch* watch);
+// Starts queued builds and swaps in the ones that linked. True when nothing is building.
+
+void saogl_shader_watch_print_stats(saogl_ShaderWatch* watch);
+
 #endif
 
 #ifdef SAO_GL_IMPLEMENTATION
 
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#ifdef __APPLE__
 #include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
+
+// Define all three before including the implementation to allocate from somewhere else, like
+// sao_gameguy's tagged allocator. SAOGL_REALLOC(NULL, size) has to work like malloc.
+#ifndef SAOGL_MALLOC
+#define SAOGL_MALLOC(size) malloc(size)
+#define SAOGL_REALLOC(pointer, size) realloc(pointer, size)
+#define SAOGL_FREE(pointer) free(pointer)
+#endif
+
+#ifndef SAOGL_INFO_LOG_SIZE
+#define SAOGL_INFO_LOG_SIZE 4096 // Longer compile and link logs are cut off.
+#endif
+#ifndef SAOGL_WATCH_SERIAL_BUILDS
+#define SAOGL_WATCH_SERIAL_BUILDS 1 // Shader watch builds started a frame without parallel compile.
+#endif
+
+static inline void*
+_saogl_calloc(size_t count, size_t size)
+{
+    void* memory = SAOGL_MALLOC(count * size);
+    if (memory) {
+        memset(memory, 0, count * size);
+    }
+    return memory;
+}
+
+static inline char*
+_saogl_strdup(const char* s)
+{
+    size_t size = strlen(s) + 1;
+    char* copy = (char*)SAOGL_MALLOC(size);
+    if (copy) {
+        memcpy(copy, s, size);
+    }
+    return copy;
+}
+
+// The whole file, nul terminated, or NULL.
+char*
+_saogl_read_shader_file(saogl_GetFileSizeFn get_file_size, saogl_ReadEntireFileFn read_file,
+                        const char* filename)
+{
+    int size = get_file_size(filename);
+    if (size < 0) {
+        fprintf(stderr, "Error: couldn't read shader file %s\n", filename);
+        return NULL;
+    }
+    char* buffer = (char*)SAOGL_MALLOC(size + 1);
+    if (buffer && !read_file(filename, buffer, size)) {
+        fprintf(stderr, "Error: couldn't read shader file %s\n", filename);
+        SAOGL_FREE(buffer);
+        return NULL;
+    }
+    if (buffer) {
+        buffer[size] = '\0';
+    }
+    return buffer;
+}
 
 int
 _saogl_check_shader_error(GLint shader)
@@ -38,14 +908,9 @@ _saogl_check_shader_error(GLint shader)
         return 0;
 
     } else {
-        int log_length;
-        char* log;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
-        log = (char*)malloc(log_length);
-        glGetShaderInfoLog(shader, log_length, NULL, log);
-        
+        char log[SAOGL_INFO_LOG_SIZE];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
         fprintf(stderr, "Error Compiling Shader: %s", log);
-        free(log);
         return 1;
     }
 }
@@ -59,20 +924,15 @@ _saogl_check_program_error(GLint program)
         return 0;
 
     } else {
-        int log_length;
-        char* log;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
-        log = (char*)malloc(log_length);
-        glGetProgramInfoLog(program, log_length, NULL, log);
-        
+        char log[SAOGL_INFO_LOG_SIZE];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
         fprintf(stderr, "Error Linking Program: %s", log);
-        free(log);
         return 1;
     }
 }
 
-int
-saogl_compile_shader_program(const char* vertex_shader_src, const char* fragment_shader_src)
+GLint
+_saogl_link_program(const char* vertex_shader_src, const char* fragment_shader_src, bool retrievable)
 {
     GLint vert_shader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vert_shader, 1, &vertex_shader_src, NULL);
@@ -92,6 +952,9 @@ saogl_compile_shader_program(const char* vertex_shader_src, const char* fragment
     }
 
     GLint program = glCreateProgram();
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glAttachShader(program, vert_shader);
     glAttachShader(program, frag_shader);
     glLinkProgram(program);
@@ -107,6 +970,11 @@ saogl_compile_shader_program(const char* vertex_shader_src, const char* fragment
     return program;
 }
 
+int
+saogl_compile_shader_program(const char* vertex_shader_src, const char* fragment_shader_src)
+{
+    return _saogl_link_program(vertex_shader_src, fragment_shader_src, false);
+}
 
 int
 saogl_build_shader_from_files(saogl_GetFileSizeFn get_file_size,
@@ -114,31 +982,4334 @@ saogl_build_shader_from_files(saogl_GetFileSizeFn get_file_size,
                               const char* vertex_shader_filename,
                               const char* fragment_shader_filename)
 {
-    // Load shaders.
-    int vert_shader_size = get_file_size(vertex_shader_filename);
-    if (vert_shader_size < 0) {
-        fprintf(stderr, "Error: couldn't read vertex shader file\n");
-        return -1;
+    char* vert_buf = _saogl_read_shader_file(get_file_size, read_file, vertex_shader_filename);
+    char* frag_buf = _saogl_read_shader_file(get_file_size, read_file, fragment_shader_filename);
+    GLint shader = -1;
+    if (vert_buf && frag_buf) {
+        shader = saogl_compile_shader_program(vert_buf, frag_buf);
+        if (shader < 0) {
+            fprintf(stderr, "Error: Couldn't compile shaders\n");
+        }
     }
-    char* vert_buf = malloc(vert_shader_size);
-    read_file(vertex_shader_filename, vert_buf, vert_shader_size);
-    /* fprintf(stderr, "Vertex Shader: %s", vert_buf); */
+    SAOGL_FREE(vert_buf);
+    SAOGL_FREE(frag_buf);
+    return shader;
+}
 
-    int frag_shader_size = get_file_size(fragment_shader_filename);
-    if (frag_shader_size < 0) {
-        fprintf(stderr, "Error: couldn't read fragment shader file\n");
-        return -1;
+// Shader cache.
+// File layout, native endian:
+//   header  magic, version, driver hash, entry count
+//   index   entry count * (key, format, size, offset)
+//   blobs   8 byte aligned program binaries
+#define SAOGL_SHADER_CACHE_MAGIC 0x434c4753 // SGLC
+#define SAOGL_SHADER_CACHE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t driver_hash;
+    uint32_t entry_count;
+    uint32_t pad;
+} _saogl_ShaderCacheHeader;
+
+typedef struct {
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+    uint64_t offset;
+} _saogl_ShaderCacheIndex;
+
+uint64_t
+_saogl_hash_string(uint64_t hash, const char* s)
+{
+    // fnv-1a, the terminator is hashed too so "ab"+"c" != "a"+"bc".
+    do {
+        hash ^= (uint8_t)*s;
+        hash *= 0x100000001b3ull;
+    } while (*s++);
+    return hash;
+}
+
+uint64_t
+_saogl_driver_hash(void)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = _saogl_hash_string(hash, (const char*)glGetString(GL_VENDOR));
+    hash = _saogl_hash_string(hash, (const char*)glGetString(GL_RENDERER));
+    hash = _saogl_hash_string(hash, (const char*)glGetString(GL_VERSION));
+    return hash;
+}
+
+saogl_ShaderCacheEntry*
+_saogl_shader_cache_find(saogl_ShaderCache* cache, uint64_t key)
+{
+    uint32_t mask = cache->capacity - 1;
+    for (uint32_t i = (uint32_t)key & mask; ; i = (i + 1) & mask) {
+        saogl_ShaderCacheEntry* entry = cache->entries + i;
+        if (entry->data == NULL || entry->key == key) {
+            return entry;
+        }
     }
-    char* frag_buf = malloc(frag_shader_size);
-    read_file(fragment_shader_filename, frag_buf, frag_shader_size);
-    /* fprintf(stderr, "Fragment Shader: %s", frag_buf); */
+}
 
-    GLint shader = saogl_compile_shader_program(vert_buf, frag_buf);
-    if (shader < 0) {
-        fprintf(stderr, "Error: Couldn't compile shaders\n");
-        return -1;
+void
+_saogl_shader_cache_put(saogl_ShaderCache* cache, uint64_t key, uint32_t format, uint32_t size, void* data)
+{
+    if ((cache->count + 1) * 10 > cache->capacity * 7) {
+        saogl_ShaderCacheEntry* old_entries = cache->entries;
+        uint32_t old_capacity = cache->capacity;
+
+        cache->capacity = old_capacity ? old_capacity * 2 : 64;
+        cache->entries = (saogl_ShaderCacheEntry*)_saogl_calloc(cache->capacity, sizeof(saogl_ShaderCacheEntry));
+        cache->count = 0;
+        for (uint32_t i=0; i<old_capacity; i++) {
+            if (old_entries[i].data) {
+                *_saogl_shader_cache_find(cache, old_entries[i].key) = old_entries[i];
+                cache->count++;
+            }
+        }
+        SAOGL_FREE(old_entries);
     }
 
-    return shader;
+    saogl_ShaderCacheEntry* entry = _saogl_shader_cache_find(cache, key);
+    if (entry->data) {
+        SAOGL_FREE(entry->data);
+    } else {
+        cache->count++;
+    }
+    entry->key = key;
+    entry->format = format;
+    entry->size = size;
+    entry->data = data;
+}
+
+bool
+_saogl_shader_cache_load(saogl_ShaderCache* cache)
+{
+    FILE* f = fopen(cache->filename, "rb");
+    if (!f) {
+        return false;
+    }
+
+    _saogl_ShaderCacheHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != SAOGL_SHADER_CACHE_MAGIC ||
+        header.version != SAOGL_SHADER_CACHE_VERSION ||
+        header.driver_hash != cache->driver_hash) {
+        // Different driver or format, start over.
+        fclose(f);
+        return false;
+    }
+
+    _saogl_ShaderCacheIndex* index =
+        (_saogl_ShaderCacheIndex*)SAOGL_MALLOC((size_t)header.entry_count * sizeof(_saogl_ShaderCacheIndex) + 1);
+    if (!index) {
+        // Out of memory, everything is a miss.
+        fclose(f);
+        return false;
+    }
+    bool ok = fread(index, sizeof(_saogl_ShaderCacheIndex), header.entry_count, f) == header.entry_count;
+
+    for (uint32_t i=0; ok && i<header.entry_count; i++) {
+        void* data = SAOGL_MALLOC(index[i].size);
+        ok = data &&
+            fseek(f, (long)index[i].offset, SEEK_SET) == 0 &&
+            fread(data, 1, index[i].size, f) == index[i].size;
+        if (ok) {
+            _saogl_shader_cache_put(cache, index[i].key, index[i].format, index[i].size, data);
+        } else {
+            SAOGL_FREE(data);
+        }
+    }
+
+    SAOGL_FREE(index);
+    fclose(f);
+    return ok;
+}
+
+saogl_ShaderCache*
+saogl_shader_cache_open(const char* filename)
+{
+    saogl_ShaderCache* cache = (saogl_ShaderCache*)_saogl_calloc(1, sizeof(saogl_ShaderCache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->filename = _saogl_strdup(filename);
+    cache->driver_hash = _saogl_driver_hash();
+
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    cache->supported = format_count > 0;
+    if (!cache->supported) {
+        fprintf(stderr, "Shader cache: driver has no program binary formats, not caching.\n");
+        return cache;
+    }
+
+    if (!_saogl_shader_cache_load(cache)) {
+        cache->dirty = true;
+    }
+    return cache;
+}
+
+int
+saogl_compile_shader_program_cached(saogl_ShaderCache* cache,
+                                    const char* vertex_shader_src,
+                                    const char* fragment_shader_src)
+{
+    if (!cache || !cache->supported) {
+        if (cache) {
+            cache->misses++;
+        }
+        return saogl_compile_shader_program(vertex_shader_src, fragment_shader_src);
+    }
+
+    uint64_t key = cache->driver_hash;
+    key = _saogl_hash_string(key, vertex_shader_src);
+    key = _saogl_hash_string(key, fragment_shader_src);
+
+    saogl_ShaderCacheEntry* entry = cache->capacity ? _saogl_shader_cache_find(cache, key) : NULL;
+    if (entry && entry->data) {
+        GLint program = glCreateProgram();
+        glProgramBinary(program, entry->format, entry->data, entry->size);
+
+        GLint is_ok;
+        glGetProgramiv(program, GL_LINK_STATUS, &is_ok);
+        if (is_ok) {
+            cache->hits++;
+            return program;
+        }
+
+        // The driver can refuse binaries whenever it likes, eg after an update.
+        glDeleteProgram(program);
+        cache->rejected++;
+    }
+
+    cache->misses++;
+    GLint program = _saogl_link_program(vertex_shader_src, fragment_shader_src, true);
+    if (program < 0) {
+        return program;
+    }
+
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size > 0) {
+        void* data = SAOGL_MALLOC(size);
+        GLenum format;
+        GLsizei written = 0;
+        glGetProgramBinary(program, size, &written, &format, data);
+        if (written > 0) {
+            _saogl_shader_cache_put(cache, key, format, written, data);
+            cache->dirty = true;
+        } else {
+            SAOGL_FREE(data);
+        }
+    }
+
+    return program;
+}
+
+bool
+saogl_shader_cache_save(saogl_ShaderCache* cache)
+{
+    if (!cache || !cache->supported || !cache->dirty) {
+        return true;
+    }
+
+    // Write next to it and rename so a crash never leaves a half written cache.
+    size_t filename_length = strlen(cache->filename);
+    char* tmp_filename = (char*)SAOGL_MALLOC(filename_length + 5);
+    memcpy(tmp_filename, cache->filename, filename_length);
+    memcpy(tmp_filename + filename_length, ".tmp", 5);
+
+    FILE* f = fopen(tmp_filename, "wb");
+    if (!f) {
+        fprintf(stderr, "Error writing shader cache: %s\n", tmp_filename);
+        SAOGL_FREE(tmp_filename);
+        return false;
+    }
+
+    _saogl_ShaderCacheHeader header = {.magic = SAOGL_SHADER_CACHE_MAGIC,
+                                       .version = SAOGL_SHADER_CACHE_VERSION,
+                                       .driver_hash = cache->driver_hash,
+                                       .entry_count = cache->count};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    uint64_t offset = sizeof(header) + cache->count * sizeof(_saogl_ShaderCacheIndex);
+    for (uint32_t i=0; ok && i<cache->capacity; i++) {
+        saogl_ShaderCacheEntry* entry = cache->entries + i;
+        if (!entry->data) {
+            continue;
+        }
+        _saogl_ShaderCacheIndex index = {entry->key, entry->format, entry->size, offset};
+        ok = fwrite(&index, sizeof(index), 1, f) == 1;
+        offset += (entry->size + 7) & ~7u;
+    }
+
+    static const uint8_t padding[8];
+    for (uint32_t i=0; ok && i<cache->capacity; i++) {
+        saogl_ShaderCacheEntry* entry = cache->entries + i;
+        if (!entry->data) {
+            continue;
+        }
+        uint32_t padding_size = ((entry->size + 7) & ~7u) - entry->size;
+        ok = fwrite(entry->data, 1, entry->size, f) == entry->size &&
+            fwrite(padding, 1, padding_size, f) == padding_size;
+    }
+
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+        ok = rename(tmp_filename, cache->filename) == 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error writing shader cache: %s\n", cache->filename);
+        remove(tmp_filename);
+    } else {
+        cache->dirty = false;
+    }
+
+    SAOGL_FREE(tmp_filename);
+    return ok;
+}
+
+void
+saogl_shader_cache_close(saogl_ShaderCache* cache)
+{
+    if (!cache) {
+        return;
+    }
+    saogl_shader_cache_save(cache);
+
+    for (uint32_t i=0; i<cache->capacity; i++) {
+        SAOGL_FREE(cache->entries[i].data);
+    }
+    SAOGL_FREE(cache->entries);
+    SAOGL_FREE(cache->filename);
+    SAOGL_FREE(cache);
+}
+
+void
+saogl_shader_cache_print_stats(saogl_ShaderCache* cache)
+{
+    fprintf(stderr, "Shader cache: %u hits, %u misses (%u rejected binaries), %u programs stored\n",
+            cache->hits, cache->misses, cache->rejected, cache->count);
+}
+
+bool
+saogl_has_extension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i=0; i<count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Batched shader compilation.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+void
+saogl_shader_batch_init(saogl_ShaderBatch* batch)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->parallel = saogl_has_extension("GL_KHR_parallel_shader_compile") ||
+        saogl_has_extension("GL_ARB_parallel_shader_compile");
+}
+
+int
+saogl_shader_batch_add(saogl_ShaderBatch* batch, const char* name,
+                       const char* vertex_shader_src, const char* fragment_shader_src)
+{
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 32;
+        batch->programs = (saogl_ShaderBatchProgram*)SAOGL_REALLOC(batch->programs,
+                                                             batch->capacity * sizeof(saogl_ShaderBatchProgram));
+    }
+
+    saogl_ShaderBatchProgram* program = batch->programs + batch->count;
+    program->name = name;
+    program->status = SAOGL_SHADER_PENDING;
+
+    // No status queries here, any of them would wait for the compile to finish. If a shader
+    // doesn't compile the link fails and poll goes back and finds out why.
+    program->vert_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(program->vert_shader, 1, &vertex_shader_src, NULL);
+    glCompileShader(program->vert_shader);
+
+    program->frag_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(program->frag_shader, 1, &fragment_shader_src, NULL);
+    glCompileShader(program->frag_shader);
+
+    program->program = glCreateProgram();
+    glAttachShader(program->program, program->vert_shader);
+    glAttachShader(program->program, program->frag_shader);
+    glLinkProgram(program->program);
+
+    batch->pending_count++;
+    return batch->count++;
+}
+
+void
+_saogl_shader_batch_finish(saogl_ShaderBatch* batch, saogl_ShaderBatchProgram* program)
+{
+    int is_ok;
+    glGetProgramiv(program->program, GL_LINK_STATUS, &is_ok);
+
+    if (!is_ok) {
+        fprintf(stderr, "Error building shader program %s\n", program->name ? program->name : "");
+        if (!_saogl_check_shader_error(program->vert_shader) &&
+            !_saogl_check_shader_error(program->frag_shader)) {
+            _saogl_check_program_error(program->program);
+        }
+        glDeleteProgram(program->program);
+        program->program = 0;
+        program->status = SAOGL_SHADER_FAILED;
+        batch->failed_count++;
+    } else {
+        glDetachShader(program->program, program->vert_shader);
+        glDetachShader(program->program, program->frag_shader);
+        program->status = SAOGL_SHADER_READY;
+        batch->ready_count++;
+    }
+
+    glDeleteShader(program->vert_shader);
+    glDeleteShader(program->frag_shader);
+    program->vert_shader = 0;
+    program->frag_shader = 0;
+    batch->pending_count--;
+}
+
+bool
+saogl_shader_batch_poll(saogl_ShaderBatch* batch)
+{
+    for (uint32_t i=0; i<batch->count && batch->pending_count; i++) {
+        saogl_ShaderBatchProgram* program = batch->programs + i;
+        if (program->status != SAOGL_SHADER_PENDING) {
+            continue;
+        }
+
+        if (batch->parallel) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(program->program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done) {
+                continue;
+            }
+        }
+        _saogl_shader_batch_finish(batch, program);
+    }
+
+    return batch->pending_count == 0;
+}
+
+void
+saogl_shader_batch_free(saogl_ShaderBatch* batch)
+{
+    SAOGL_FREE(batch->programs);
+    memset(batch, 0, sizeof(*batch));
+}
+
+// Program reflection.
+uint32_t
+_saogl_name_hash(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Bytes needed to remember one element's value, 0 for types we don't track.
+uint32_t
+_saogl_uniform_type_size(GLenum type)
+{
+    switch (type) {
+    case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL:
+        return 4;
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+        return 8;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+        return 12;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4:
+    case GL_FLOAT_MAT2:
+        return 16;
+    case GL_FLOAT_MAT3:
+        return 36;
+    case GL_FLOAT_MAT4:
+        return 64;
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_SAMPLER_2D_MULTISAMPLE:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+int
+_saogl_compare_variables(const void* a, const void* b)
+{
+    uint32_t x = ((const saogl_ShaderVariable*)a)->hash;
+    uint32_t y = ((const saogl_ShaderVariable*)b)->hash;
+    return (x > y) - (x < y);
+}
+
+int
+_saogl_compare_blocks(const void* a, const void* b)
+{
+    uint32_t x = ((const saogl_UniformBlock*)a)->hash;
+    uint32_t y = ((const saogl_UniformBlock*)b)->hash;
+    return (x > y) - (x < y);
+}
+
+// Drops a trailing "[0]" so arrays are found by their plain name.
+void
+_saogl_strip_array_suffix(char* name)
+{
+    size_t length = strlen(name);
+    if (length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+        name[length - 3] = '\0';
+    }
+}
+
+bool
+saogl_program_reflect(saogl_Program* program, int gl_program)
+{
+    memset(program, 0, sizeof(*program));
+    program->program = gl_program;
+
+    GLint is_ok = 0;
+    if (gl_program > 0) {
+        glGetProgramiv(gl_program, GL_LINK_STATUS, &is_ok);
+    }
+    if (!is_ok) {
+        return false;
+    }
+
+    GLint uniform_count, uniform_name_length;
+    GLint attribute_count, attribute_name_length;
+    GLint block_count, block_name_length;
+    glGetProgramiv(gl_program, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(gl_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniform_name_length);
+    glGetProgramiv(gl_program, GL_ACTIVE_ATTRIBUTES, &attribute_count);
+    glGetProgramiv(gl_program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attribute_name_length);
+    glGetProgramiv(gl_program, GL_ACTIVE_UNIFORM_BLOCKS, &block_count);
+    glGetProgramiv(gl_program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &block_name_length);
+
+    program->names = (char*)SAOGL_MALLOC(uniform_count * uniform_name_length +
+                                   attribute_count * attribute_name_length +
+                                   block_count * block_name_length + 1);
+    program->uniforms = (saogl_ShaderVariable*)_saogl_calloc(uniform_count + 1, sizeof(saogl_ShaderVariable));
+    program->attributes = (saogl_ShaderVariable*)_saogl_calloc(attribute_count + 1, sizeof(saogl_ShaderVariable));
+    program->blocks = (saogl_UniformBlock*)_saogl_calloc(block_count + 1, sizeof(saogl_UniformBlock));
+    char* name_at = program->names;
+
+    uint32_t values_size = 0;
+    for (GLint i=0; i<uniform_count; i++) {
+        saogl_ShaderVariable* uniform = program->uniforms + program->uniform_count++;
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(gl_program, i, uniform_name_length, &length, &size, &type, name_at);
+        _saogl_strip_array_suffix(name_at);
+
+        GLuint index = i;
+        GLint block_index, offset;
+        glGetActiveUniformsiv(gl_program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block_index);
+        glGetActiveUniformsiv(gl_program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+
+        uniform->name = name_at;
+        uniform->hash = _saogl_name_hash(name_at);
+        uniform->type = type;
+        uniform->size = size;
+        uniform->block_index = block_index;
+        uniform->offset = offset;
+        uniform->location = block_index < 0 ? glGetUniformLocation(gl_program, name_at) : -1;
+        if (uniform->location >= 0) {
+            uniform->value_offset = values_size;
+            uniform->value_size = _saogl_uniform_type_size(type) * size;
+            values_size += (uniform->value_size + 3) & ~3u;
+        }
+        name_at += strlen(name_at) + 1;
+    }
+
+    for (GLint i=0; i<attribute_count; i++) {
+        saogl_ShaderVariable* attribute = program->attributes + program->attribute_count++;
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(gl_program, i, attribute_name_length, &length, &size, &type, name_at);
+        _saogl_strip_array_suffix(name_at);
+
+        attribute->name = name_at;
+        attribute->hash = _saogl_name_hash(name_at);
+        attribute->type = type;
+        attribute->size = size;
+        attribute->block_index = -1;
+        attribute->location = glGetAttribLocation(gl_program, name_at);
+        name_at += strlen(name_at) + 1;
+    }
+
+    for (GLint i=0; i<block_count; i++) {
+        saogl_UniformBlock* block = program->blocks + program->block_count++;
+        GLsizei length;
+        glGetActiveUniformBlockName(gl_program, i, block_name_length, &length, name_at);
+        glGetActiveUniformBlockiv(gl_program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block->data_size);
+        glGetActiveUniformBlockiv(gl_program, i, GL_UNIFORM_BLOCK_BINDING, &block->binding);
+
+        block->name = name_at;
+        block->hash = _saogl_name_hash(name_at);
+        block->index = i;
+        name_at += strlen(name_at) + 1;
+    }
+
+    program->values = (uint8_t*)_saogl_calloc(values_size + 1, 1);
+
+    qsort(program->uniforms, program->uniform_count, sizeof(saogl_ShaderVariable), _saogl_compare_variables);
+    qsort(program->attributes, program->attribute_count, sizeof(saogl_ShaderVariable), _saogl_compare_variables);
+    qsort(program->blocks, program->block_count, sizeof(saogl_UniformBlock), _saogl_compare_blocks);
+    return true;
+}
+
+bool
+saogl_program_build(saogl_Program* program, const char* vertex_shader_src, const char* fragment_shader_src)
+{
+    int gl_program = saogl_compile_shader_program(vertex_shader_src, fragment_shader_src);
+    if (!saogl_program_reflect(program, gl_program)) {
+        if (gl_program > 0) {
+            glDeleteProgram(gl_program);
+        }
+        program->program = -1;
+        return false;
+    }
+    return true;
+}
+
+void
+saogl_program_free(saogl_Program* program)
+{
+    SAOGL_FREE(program->uniforms);
+    SAOGL_FREE(program->attributes);
+    SAOGL_FREE(program->blocks);
+    SAOGL_FREE(program->names);
+    SAOGL_FREE(program->values);
+    memset(program, 0, sizeof(*program));
+}
+
+// Binary search on hash then compare names, collisions are next to each other.
+int
+_saogl_find_variable(saogl_ShaderVariable* variables, uint32_t count, const char* name)
+{
+    uint32_t hash = _saogl_name_hash(name);
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        if (variables[middle].hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (uint32_t i=low; i<count && variables[i].hash == hash; i++) {
+        if (strcmp(variables[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int
+saogl_uniform(saogl_Program* program, const char* name)
+{
+    return _saogl_find_variable(program->uniforms, program->uniform_count, name);
+}
+
+int
+saogl_attribute(saogl_Program* program, const char* name)
+{
+    int index = _saogl_find_variable(program->attributes, program->attribute_count, name);
+    return index < 0 ? -1 : program->attributes[index].location;
+}
+
+int
+saogl_uniform_block(saogl_Program* program, const char* name)
+{
+    uint32_t hash = _saogl_name_hash(name);
+    for (uint32_t i=0; i<program->block_count; i++) {
+        if (program->blocks[i].hash == hash && strcmp(program->blocks[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the uniform if the value is different from the last one we uploaded.
+saogl_ShaderVariable*
+_saogl_uniform_changed(saogl_Program* program, int uniform, const void* value, uint32_t size)
+{
+    if (uniform < 0 || uniform >= (int)program->uniform_count) {
+        return NULL;
+    }
+
+    saogl_ShaderVariable* variable = program->uniforms + uniform;
+    if (variable->location < 0) {
+        return NULL;
+    }
+
+    if (size <= variable->value_size) {
+        uint8_t* last = program->values + variable->value_offset;
+        if (variable->has_value && memcmp(last, value, size) == 0) {
+            program->skipped_uploads++;
+            return NULL;
+        }
+        memcpy(last, value, size);
+        // Only the start of an array might have been written, the rest stays unknown.
+        variable->has_value = size == variable->value_size;
+    } else {
+        // Bigger than we keep, what's uploaded no longer matches what we have.
+        variable->has_value = false;
+    }
+
+    program->uploads++;
+    return variable;
+}
+
+void
+saogl_set_uniform_1i(saogl_Program* program, int uniform, int32_t value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, &value, sizeof(value));
+    if (v) {
+        glProgramUniform1i(program->program, v->location, value);
+    }
+}
+
+void
+saogl_set_uniform_1f(saogl_Program* program, int uniform, float value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, &value, sizeof(value));
+    if (v) {
+        glProgramUniform1f(program->program, v->location, value);
+    }
+}
+
+void
+saogl_set_uniform_2fv(saogl_Program* program, int uniform, int count, const float* value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, value, count * 2 * sizeof(float));
+    if (v) {
+        glProgramUniform2fv(program->program, v->location, count, value);
+    }
+}
+
+void
+saogl_set_uniform_3fv(saogl_Program* program, int uniform, int count, const float* value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, value, count * 3 * sizeof(float));
+    if (v) {
+        glProgramUniform3fv(program->program, v->location, count, value);
+    }
+}
+
+void
+saogl_set_uniform_4fv(saogl_Program* program, int uniform, int count, const float* value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, value, count * 4 * sizeof(float));
+    if (v) {
+        glProgramUniform4fv(program->program, v->location, count, value);
+    }
+}
+
+void
+saogl_set_uniform_matrix3fv(saogl_Program* program, int uniform, int count, const float* value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, value, count * 9 * sizeof(float));
+    if (v) {
+        glProgramUniformMatrix3fv(program->program, v->location, count, GL_FALSE, value);
+    }
+}
+
+void
+saogl_set_uniform_matrix4fv(saogl_Program* program, int uniform, int count, const float* value)
+{
+    saogl_ShaderVariable* v = _saogl_uniform_changed(program, uniform, value, count * 16 * sizeof(float));
+    if (v) {
+        glProgramUniformMatrix4fv(program->program, v->location, count, GL_FALSE, value);
+    }
+}
+
+// State cache.
+enum {
+    _SAOGL_KNOWN_PROGRAM = 1 << 0,
+    _SAOGL_KNOWN_VERTEX_ARRAY = 1 << 1,
+    _SAOGL_KNOWN_ACTIVE_TEXTURE = 1 << 2,
+    _SAOGL_KNOWN_BLEND = 1 << 3,
+    _SAOGL_KNOWN_DEPTH = 1 << 4,
+    _SAOGL_KNOWN_CULL = 1 << 5,
+    _SAOGL_KNOWN_BLEND_FUNC = 1 << 6,
+};
+
+#define _SAOGL_BUFFER_TARGETS 6
+static const GLenum _saogl_buffer_targets[_SAOGL_BUFFER_TARGETS] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER
+};
+
+// Zeroed means nothing is known, which is what we want for a new library or context.
+static struct {
+    uint32_t known;
+    uint32_t known_buffers;
+    uint32_t known_textures;
+
+    GLuint program;
+    GLuint vertex_array;
+    GLuint buffers[_SAOGL_BUFFER_TARGETS];
+    GLuint active_texture;
+    GLenum texture_targets[SAOGL_MAX_TEXTURE_UNITS];
+    GLuint textures[SAOGL_MAX_TEXTURE_UNITS];
+
+    bool blend;
+    GLenum blend_src, blend_dst;
+    bool depth_test, depth_write;
+    GLenum depth_func;
+    bool cull;
+    GLenum cull_face;
+
+    saogl_StateStats stats;
+} _saogl_state;
+
+void
+saogl_use_program(uint32_t program)
+{
+    if ((_saogl_state.known & _SAOGL_KNOWN_PROGRAM) && _saogl_state.program == program) {
+        _saogl_state.stats.skipped++;
+        return;
+    }
+    glUseProgram(program);
+    _saogl_state.program = program;
+    _saogl_state.known |= _SAOGL_KNOWN_PROGRAM;
+    _saogl_state.stats.issued++;
+}
+
+void
+saogl_bind_vertex_array(uint32_t vao)
+{
+    if ((_saogl_state.known & _SAOGL_KNOWN_VERTEX_ARRAY) && _saogl_state.vertex_array == vao) {
+        _saogl_state.stats.skipped++;
+        return;
+    }
+    glBindVertexArray(vao);
+    _saogl_state.vertex_array = vao;
+    _saogl_state.known |= _SAOGL_KNOWN_VERTEX_ARRAY;
+    // The element buffer is part of the vao.
+    _saogl_state.known_buffers &= ~(1u << 1);
+    _saogl_state.stats.issued++;
+}
+
+void
+saogl_bind_buffer(uint32_t target, uint32_t buffer)
+{
+    int slot = -1;
+    for (int i=0; i<_SAOGL_BUFFER_TARGETS; i++) {
+        if (_saogl_buffer_targets[i] == target) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot >= 0 && (_saogl_state.known_buffers & (1u << slot)) && _saogl_state.buffers[slot] == buffer) {
+        _saogl_state.stats.skipped++;
+        return;
+    }
+    glBindBuffer(target, buffer);
+    if (slot >= 0) {
+        _saogl_state.buffers[slot] = buffer;
+        _saogl_state.known_buffers |= 1u << slot;
+    }
+    _saogl_state.stats.issued++;
+}
+
+void
+saogl_bind_texture(uint32_t unit, uint32_t target, uint32_t texture)
+{
+    if (unit >= SAOGL_MAX_TEXTURE_UNITS) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        _saogl_state.known &= ~_SAOGL_KNOWN_ACTIVE_TEXTURE;
+        _saogl_state.stats.issued += 2;
+        return;
+    }
+
+    if ((_saogl_state.known_textures & (1u << unit)) &&
+        _saogl_state.textures[unit] == texture &&
+        _saogl_state.texture_targets[unit] == target) {
+        _saogl_state.stats.skipped++;
+        return;
+    }
+
+    if (!(_saogl_state.known & _SAOGL_KNOWN_ACTIVE_TEXTURE) || _saogl_state.active_texture != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        _saogl_state.active_texture = unit;
+        _saogl_state.known |= _SAOGL_KNOWN_ACTIVE_TEXTURE;
+        _saogl_state.stats.issued++;
+    }
+    glBindTexture(target, texture);
+    _saogl_state.textures[unit] = texture;
+    _saogl_state.texture_targets[unit] = target;
+    _saogl_state.known_textures |= 1u << unit;
+    _saogl_state.stats.issued++;
+}
+
+void
+_saogl_set_capability(GLenum capability, bool enabled)
+{
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+    _saogl_state.stats.issued++;
+}
+
+void
+saogl_set_blend(bool enabled, uint32_t src_factor, uint32_t dst_factor)
+{
+    if (!(_saogl_state.known & _SAOGL_KNOWN_BLEND) || _saogl_state.blend != enabled) {
+        _saogl_set_capability(GL_BLEND, enabled);
+        _saogl_state.blend = enabled;
+        _saogl_state.known |= _SAOGL_KNOWN_BLEND;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+
+    // Factors don't matter while blending is off, set them when it gets turned on.
+    if (!enabled) {
+        return;
+    }
+    if (!(_saogl_state.known & _SAOGL_KNOWN_BLEND_FUNC) ||
+        _saogl_state.blend_src != src_factor || _saogl_state.blend_dst != dst_factor) {
+        glBlendFunc(src_factor, dst_factor);
+        _saogl_state.blend_src = src_factor;
+        _saogl_state.blend_dst = dst_factor;
+        _saogl_state.known |= _SAOGL_KNOWN_BLEND_FUNC;
+        _saogl_state.stats.issued++;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+}
+
+void
+saogl_set_depth(bool test, bool write, uint32_t func)
+{
+    bool known = _saogl_state.known & _SAOGL_KNOWN_DEPTH;
+    if (!known || _saogl_state.depth_test != test) {
+        _saogl_set_capability(GL_DEPTH_TEST, test);
+        _saogl_state.depth_test = test;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+
+    if (!known || _saogl_state.depth_write != write) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        _saogl_state.depth_write = write;
+        _saogl_state.stats.issued++;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+
+    if (!known || _saogl_state.depth_func != func) {
+        glDepthFunc(func);
+        _saogl_state.depth_func = func;
+        _saogl_state.stats.issued++;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+    _saogl_state.known |= _SAOGL_KNOWN_DEPTH;
+}
+
+void
+saogl_set_cull(bool enabled, uint32_t face)
+{
+    bool known = _saogl_state.known & _SAOGL_KNOWN_CULL;
+    if (!known || _saogl_state.cull != enabled) {
+        _saogl_set_capability(GL_CULL_FACE, enabled);
+        _saogl_state.cull = enabled;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+
+    if (!known || _saogl_state.cull_face != face) {
+        glCullFace(face);
+        _saogl_state.cull_face = face;
+        _saogl_state.stats.issued++;
+    } else {
+        _saogl_state.stats.skipped++;
+    }
+    _saogl_state.known |= _SAOGL_KNOWN_CULL;
+}
+
+void
+saogl_state_invalidate(void)
+{
+    _saogl_state.known = 0;
+    _saogl_state.known_buffers = 0;
+    _saogl_state.known_textures = 0;
+}
+
+saogl_StateStats
+saogl_state_stats(void)
+{
+    return _saogl_state.stats;
+}
+
+void
+saogl_state_reset_stats(void)
+{
+    _saogl_state.stats = (saogl_StateStats){0};
+}
+
+void
+saogl_state_print_stats(void)
+{
+    uint32_t total = _saogl_state.stats.issued + _saogl_state.stats.skipped;
+    fprintf(stderr, "GL state: %u calls issued, %u skipped (%.1f%%)\n",
+            _saogl_state.stats.issued, _saogl_state.stats.skipped,
+            total ? 100.0 * _saogl_state.stats.skipped / total : 0.0);
+}
+
+// Render commands.
+enum {
+    _SAOGL_COMMAND_CLEAR,
+    _SAOGL_COMMAND_DRAW,
+    _SAOGL_COMMAND_UNIFORM,
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} _saogl_CommandHeader;
+
+typedef struct {
+    _saogl_CommandHeader header;
+    GLbitfield mask;
+    float color[4];
+    float depth;
+} _saogl_ClearCommand;
+
+typedef struct {
+    _saogl_CommandHeader header;
+    saogl_DrawCommand draw;
+} _saogl_DrawCommandData;
+
+typedef struct {
+    _saogl_CommandHeader header;
+    saogl_Program* program;
+    int uniform;
+    GLenum type;
+    int count;
+    // Followed by the value.
+} _saogl_UniformCommand;
+
+uint64_t
+saogl_sort_key(uint8_t pass, uint16_t shader, uint16_t material, float depth)
+{
+    if (!(depth > 0.0f)) {
+        depth = 0.0f;
+    } else if (depth > 1.0f) {
+        depth = 1.0f;
+    }
+    uint64_t depth_bits = (uint64_t)(depth * (float)0xFFFFFF);
+    return ((uint64_t)pass << 56) | ((uint64_t)shader << 40) | ((uint64_t)material << 24) | depth_bits;
+}
+
+void
+saogl_render_commands_init(saogl_RenderCommands* commands)
+{
+    memset(commands, 0, sizeof(*commands));
+    atomic_init(&commands->list_count, 0);
+    atomic_init(&commands->generation, 1);
+}
+
+void
+saogl_render_commands_free(saogl_RenderCommands* commands)
+{
+    for (int i=0; i<SAOGL_MAX_COMMAND_LISTS; i++) {
+        SAOGL_FREE(commands->lists[i].data);
+        SAOGL_FREE(commands->lists[i].entries);
+    }
+    SAOGL_FREE(commands->sorted);
+    SAOGL_FREE(commands->sort_temp);
+    SAOGL_FREE(commands->multi_firsts);
+    SAOGL_FREE(commands->multi_counts);
+    SAOGL_FREE(commands->multi_base_vertices);
+    memset(commands, 0, sizeof(*commands));
+}
+
+// Each thread keeps the list it claimed this frame in each of the last few command buffers
+// it pushed to, so alternating between a scene and a ui buffer doesn't claim a list per
+// switch. A new frame (generation) means claiming again.
+#define _SAOGL_THREAD_COMMAND_BUFFERS 8
+
+static _Thread_local struct {
+    saogl_RenderCommands* commands;
+    unsigned generation;
+    uint32_t list;
+} _saogl_thread_lists[_SAOGL_THREAD_COMMAND_BUFFERS];
+static _Thread_local uint32_t _saogl_thread_list_next;
+
+saogl_CommandList*
+_saogl_command_list(saogl_RenderCommands* commands, uint32_t* list_index)
+{
+    unsigned generation = atomic_load_explicit(&commands->generation, memory_order_acquire);
+    int slot = -1;
+    for (int i=0; i<_SAOGL_THREAD_COMMAND_BUFFERS; i++) {
+        if (_saogl_thread_lists[i].commands == commands) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        // Past that many buffers the oldest one claims again when it comes back.
+        slot = _saogl_thread_list_next++ % _SAOGL_THREAD_COMMAND_BUFFERS;
+        _saogl_thread_lists[slot].commands = NULL;
+    }
+    // A buffer freed and made again at the same address starts over at generation 1, its
+    // list count says whether the list is really this one's.
+    if (_saogl_thread_lists[slot].commands != commands || _saogl_thread_lists[slot].generation != generation ||
+        _saogl_thread_lists[slot].list >= atomic_load_explicit(&commands->list_count, memory_order_relaxed)) {
+        uint32_t list = atomic_fetch_add(&commands->list_count, 1);
+        if (list >= SAOGL_MAX_COMMAND_LISTS) {
+            fprintf(stderr, "Error: more than %d threads recording render commands\n", SAOGL_MAX_COMMAND_LISTS);
+            return NULL;
+        }
+        _saogl_thread_lists[slot].commands = commands;
+        _saogl_thread_lists[slot].generation = generation;
+        _saogl_thread_lists[slot].list = list;
+    }
+    *list_index = _saogl_thread_lists[slot].list;
+    return commands->lists + _saogl_thread_lists[slot].list;
+}
+
+// Appends size bytes to this thread's list with an entry for the key. The pointer is only
+// good until the next push from this thread.
+void*
+_saogl_push_command(saogl_RenderCommands* commands, uint64_t key, uint32_t type, uint32_t size)
+{
+    uint32_t list_index;
+    saogl_CommandList* list = _saogl_command_list(commands, &list_index);
+    if (!list) {
+        return NULL;
+    }
+
+    size = (size + 7) & ~7u;
+    if (list->size + size > list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 4096;
+        while (capacity < list->size + size) {
+            capacity *= 2;
+        }
+        uint8_t* data = (uint8_t*)SAOGL_REALLOC(list->data, capacity);
+        if (!data) {
+            return NULL;
+        }
+        list->data = data;
+        list->capacity = capacity;
+    }
+    if (list->count == list->entry_capacity) {
+        uint32_t capacity = list->entry_capacity ? list->entry_capacity * 2 : 256;
+        saogl_CommandEntry* entries = (saogl_CommandEntry*)SAOGL_REALLOC(list->entries, capacity * sizeof(saogl_CommandEntry));
+        if (!entries) {
+            return NULL;
+        }
+        list->entries = entries;
+        list->entry_capacity = capacity;
+    }
+
+    _saogl_CommandHeader* header = (_saogl_CommandHeader*)(list->data + list->size);
+    header->type = type;
+    header->size = size;
+    list->entries[list->count++] = (saogl_CommandEntry){key, list_index, list->size};
+    list->size += size;
+    return header;
+}
+
+void
+saogl_push_clear(saogl_RenderCommands* commands, uint64_t key, uint32_t mask,
+                 float r, float g, float b, float a, float depth)
+{
+    _saogl_ClearCommand* clear = (_saogl_ClearCommand*)
+        _saogl_push_command(commands, key, _SAOGL_COMMAND_CLEAR, sizeof(_saogl_ClearCommand));
+    if (clear) {
+        clear->mask = mask;
+        clear->color[0] = r;
+        clear->color[1] = g;
+        clear->color[2] = b;
+        clear->color[3] = a;
+        clear->depth = depth;
+    }
+}
+
+void
+saogl_push_draw(saogl_RenderCommands* commands, uint64_t key, const saogl_DrawCommand* draw)
+{
+    _saogl_DrawCommandData* data = (_saogl_DrawCommandData*)
+        _saogl_push_command(commands, key, _SAOGL_COMMAND_DRAW, sizeof(_saogl_DrawCommandData));
+    if (data) {
+        data->draw = *draw;
+    }
+}
+
+uint32_t
+_saogl_uniform_value_size(GLenum type)
+{
+    switch (type) {
+    case GL_INT: case GL_FLOAT: return 4;
+    case GL_FLOAT_VEC2: return 8;
+    case GL_FLOAT_VEC3: return 12;
+    case GL_FLOAT_VEC4: return 16;
+    case GL_FLOAT_MAT3: return 36;
+    case GL_FLOAT_MAT4: return 64;
+    default: return 0;
+    }
+}
+
+void
+saogl_push_uniform(saogl_RenderCommands* commands, uint64_t key, saogl_Program* program,
+                   int uniform, uint32_t type, int count, const void* value)
+{
+    uint32_t value_size = _saogl_uniform_value_size(type) * count;
+    if (!value_size) {
+        fprintf(stderr, "Error: can't record uniform of type 0x%x\n", type);
+        return;
+    }
+
+    _saogl_UniformCommand* command = (_saogl_UniformCommand*)
+        _saogl_push_command(commands, key, _SAOGL_COMMAND_UNIFORM, sizeof(_saogl_UniformCommand) + value_size);
+    if (command) {
+        command->program = program;
+        command->uniform = uniform;
+        command->type = type;
+        command->count = count;
+        memcpy(command + 1, value, value_size);
+    }
+}
+
+// LSD radix sort on 8 bit digits, skipping digits every key shares. Usually only a few of
+// the 8 passes do any work. Stable so push order is kept for equal keys.
+saogl_CommandEntry*
+_saogl_radix_sort(saogl_CommandEntry* entries, saogl_CommandEntry* temp, uint32_t count)
+{
+    uint32_t histograms[8][256] = {0};
+    for (uint32_t i=0; i<count; i++) {
+        uint64_t key = entries[i].key;
+        for (int digit=0; digit<8; digit++) {
+            histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+        }
+    }
+
+    saogl_CommandEntry* from = entries;
+    saogl_CommandEntry* to = temp;
+    for (int digit=0; digit<8; digit++) {
+        uint32_t* histogram = histograms[digit];
+        if (count == 0 || histogram[(from[0].key >> (digit * 8)) & 0xFF] == count) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (int i=0; i<256; i++) {
+            uint32_t n = histogram[i];
+            histogram[i] = offset;
+            offset += n;
+        }
+        for (uint32_t i=0; i<count; i++) {
+            to[histogram[(from[i].key >> (digit * 8)) & 0xFF]++] = from[i];
+        }
+
+        saogl_CommandEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+    return from;
+}
+
+_saogl_CommandHeader*
+_saogl_command(saogl_RenderCommands* commands, saogl_CommandEntry* entry)
+{
+    return (_saogl_CommandHeader*)(commands->lists[entry->list].data + entry->offset);
+}
+
+// Draws that differ only in their range can go in one glMultiDraw* call.
+bool
+_saogl_draws_compatible(const saogl_DrawCommand* a, const saogl_DrawCommand* b)
+{
+    return a->program == b->program &&
+        a->vertex_array == b->vertex_array &&
+        memcmp(a->textures, b->textures, sizeof(a->textures)) == 0 &&
+        a->mode == b->mode &&
+        a->index_type == b->index_type &&
+        a->instance_count <= 1 && b->instance_count <= 1;
+}
+
+uint32_t
+_saogl_index_size(GLenum index_type)
+{
+    return index_type == GL_UNSIGNED_INT ? 4 : index_type == GL_UNSIGNED_SHORT ? 2 : 1;
+}
+
+void
+_saogl_execute_draw(saogl_RenderCommands* commands, const saogl_DrawCommand* draw, uint32_t run_count)
+{
+    saogl_use_program(draw->program);
+    saogl_bind_vertex_array(draw->vertex_array);
+    for (int i=0; i<SAOGL_DRAW_TEXTURES; i++) {
+        if (draw->textures[i]) {
+            saogl_bind_texture(i, GL_TEXTURE_2D, draw->textures[i]);
+        }
+    }
+    commands->last_frame.draw_calls++;
+
+    if (run_count > 1) {
+        if (!draw->index_type) {
+            glMultiDrawArrays(draw->mode, commands->multi_firsts, commands->multi_counts, run_count);
+        } else {
+            // glMultiDrawElements wants byte offsets as pointers, convert them in chunks.
+            const void* offsets[64];
+            for (uint32_t start=0; start<run_count; start+=64) {
+                uint32_t n = run_count - start < 64 ? run_count - start : 64;
+                for (uint32_t i=0; i<n; i++) {
+                    offsets[i] = (const void*)((uintptr_t)commands->multi_firsts[start + i] * _saogl_index_size(draw->index_type));
+                }
+                glMultiDrawElementsBaseVertex(draw->mode, commands->multi_counts + start, draw->index_type,
+                                              offsets, n, commands->multi_base_vertices + start);
+            }
+        }
+        return;
+    }
+
+    GLint first = commands->multi_firsts[0];
+    GLsizei count = commands->multi_counts[0];
+    GLsizei instances = draw->instance_count > 1 ? draw->instance_count : 1;
+    if (!draw->index_type) {
+        glDrawArraysInstanced(draw->mode, first, count, instances);
+    } else {
+        const void* offset = (const void*)((uintptr_t)first * _saogl_index_size(draw->index_type));
+        glDrawElementsInstancedBaseVertex(draw->mode, count, draw->index_type, offset, instances, draw->base_vertex);
+    }
+}
+
+void
+_saogl_execute_uniform(_saogl_UniformCommand* command)
+{
+    const void* value = command + 1;
+    switch (command->type) {
+    case GL_INT:
+        saogl_set_uniform_1i(command->program, command->uniform, *(const int32_t*)value);
+        break;
+    case GL_FLOAT:
+        saogl_set_uniform_1f(command->program, command->uniform, *(const float*)value);
+        break;
+    case GL_FLOAT_VEC2:
+        saogl_set_uniform_2fv(command->program, command->uniform, command->count, (const float*)value);
+        break;
+    case GL_FLOAT_VEC3:
+        saogl_set_uniform_3fv(command->program, command->uniform, command->count, (const float*)value);
+        break;
+    case GL_FLOAT_VEC4:
+        saogl_set_uniform_4fv(command->program, command->uniform, command->count, (const float*)value);
+        break;
+    case GL_FLOAT_MAT3:
+        saogl_set_uniform_matrix3fv(command->program, command->uniform, command->count, (const float*)value);
+        break;
+    case GL_FLOAT_MAT4:
+        saogl_set_uniform_matrix4fv(command->program, command->uniform, command->count, (const float*)value);
+        break;
+    }
+}
+
+bool
+_saogl_reserve_multi_draw(saogl_RenderCommands* commands, uint32_t count)
+{
+    if (count <= commands->multi_capacity) {
+        return true;
+    }
+    uint32_t capacity = commands->multi_capacity ? commands->multi_capacity * 2 : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    int32_t* firsts = (int32_t*)SAOGL_REALLOC(commands->multi_firsts, capacity * sizeof(int32_t));
+    if (firsts) commands->multi_firsts = firsts;
+    int32_t* counts = (int32_t*)SAOGL_REALLOC(commands->multi_counts, capacity * sizeof(int32_t));
+    if (counts) commands->multi_counts = counts;
+    int32_t* base_vertices = (int32_t*)SAOGL_REALLOC(commands->multi_base_vertices, capacity * sizeof(int32_t));
+    if (base_vertices) commands->multi_base_vertices = base_vertices;
+    if (!firsts || !counts || !base_vertices) {
+        return false;
+    }
+    commands->multi_capacity = capacity;
+    return true;
+}
+
+void
+saogl_render_commands_submit(saogl_RenderCommands* commands)
+{
+    commands->last_frame = (saogl_RenderStats){0};
+
+    uint32_t list_count = atomic_load_explicit(&commands->list_count, memory_order_acquire);
+    if (list_count > SAOGL_MAX_COMMAND_LISTS) {
+        list_count = SAOGL_MAX_COMMAND_LISTS;
+    }
+
+    uint32_t total = 0;
+    for (uint32_t i=0; i<list_count; i++) {
+        total += commands->lists[i].count;
+    }
+    if (total > commands->sort_capacity) {
+        SAOGL_FREE(commands->sorted);
+        SAOGL_FREE(commands->sort_temp);
+        commands->sort_capacity = total * 2;
+        commands->sorted = (saogl_CommandEntry*)SAOGL_MALLOC(commands->sort_capacity * sizeof(saogl_CommandEntry));
+        commands->sort_temp = (saogl_CommandEntry*)SAOGL_MALLOC(commands->sort_capacity * sizeof(saogl_CommandEntry));
+        if (!commands->sorted || !commands->sort_temp) {
+            fprintf(stderr, "Error: out of memory submitting %u render commands\n", total);
+            commands->sort_capacity = 0;
+            total = 0;
+        }
+    }
+
+    if (!_saogl_reserve_multi_draw(commands, total)) {
+        fprintf(stderr, "Error: out of memory submitting %u render commands\n", total);
+        total = 0;
+    }
+
+    uint32_t at = 0;
+    for (uint32_t i=0; i<list_count && total; i++) {
+        memcpy(commands->sorted + at, commands->lists[i].entries, commands->lists[i].count * sizeof(saogl_CommandEntry));
+        at += commands->lists[i].count;
+    }
+    saogl_CommandEntry* sorted = _saogl_radix_sort(commands->sorted, commands->sort_temp, total);
+    commands->last_frame.commands = total;
+
+    for (uint32_t i=0; i<total; i++) {
+        _saogl_CommandHeader* header = _saogl_command(commands, sorted + i);
+        if (header->type == _SAOGL_COMMAND_CLEAR) {
+            _saogl_ClearCommand* clear = (_saogl_ClearCommand*)header;
+            glClearColor(clear->color[0], clear->color[1], clear->color[2], clear->color[3]);
+            glClearDepth(clear->depth);
+            glClear(clear->mask);
+        } else if (header->type == _SAOGL_COMMAND_UNIFORM) {
+            _saogl_execute_uniform((_saogl_UniformCommand*)header);
+        } else if (header->type == _SAOGL_COMMAND_DRAW) {
+            // Collect the run of following draws with the same state, joining ranges that
+            // continue each other.
+            const saogl_DrawCommand* draw = &((_saogl_DrawCommandData*)header)->draw;
+            uint32_t run = 0;
+            commands->multi_firsts[0] = draw->first;
+            commands->multi_counts[0] = draw->count;
+            commands->multi_base_vertices[0] = draw->base_vertex;
+            commands->last_frame.draws++;
+
+            while (i + 1 < total) {
+                _saogl_CommandHeader* next_header = _saogl_command(commands, sorted + i + 1);
+                if (next_header->type != _SAOGL_COMMAND_DRAW) {
+                    break;
+                }
+                const saogl_DrawCommand* next = &((_saogl_DrawCommandData*)next_header)->draw;
+                if (!_saogl_draws_compatible(draw, next)) {
+                    break;
+                }
+                i++;
+                commands->last_frame.draws++;
+                commands->last_frame.merged_draws++;
+
+                if (commands->multi_firsts[run] + commands->multi_counts[run] == (int32_t)next->first &&
+                    commands->multi_base_vertices[run] == next->base_vertex) {
+                    commands->multi_counts[run] += next->count;
+                } else {
+                    run++;
+                    commands->multi_firsts[run] = next->first;
+                    commands->multi_counts[run] = next->count;
+                    commands->multi_base_vertices[run] = next->base_vertex;
+                }
+            }
+            _saogl_execute_draw(commands, draw, run + 1);
+        }
+    }
+
+    for (uint32_t i=0; i<list_count; i++) {
+        commands->lists[i].size = 0;
+        commands->lists[i].count = 0;
+    }
+    atomic_store_explicit(&commands->list_count, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&commands->generation, 1, memory_order_release);
+}
+
+// Streaming buffer.
+// GL_ARB_buffer_storage isn't in the osx headers, we always orphan there.
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define _SAOGL_HAS_BUFFER_STORAGE 1
+#else
+#define _SAOGL_HAS_BUFFER_STORAGE 0
+#endif
+
+double
+_saogl_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool
+saogl_stream_init(saogl_StreamBuffer* stream, uint32_t frame_size, int flags)
+{
+    memset(stream, 0, sizeof(*stream));
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &stream->uniform_alignment);
+    stream->frame_size = frame_size;
+
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    stream->buffer = buffer;
+    // Copy write so we don't touch the vao's element buffer or the array buffer binding
+    // the game expects.
+    saogl_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+
+#if _SAOGL_HAS_BUFFER_STORAGE
+    if (!(flags & SAOGL_STREAM_ORPHAN) && saogl_has_extension("GL_ARB_buffer_storage")) {
+        stream->frame_count = SAOGL_STREAM_FRAMES;
+        GLbitfield map_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)frame_size * stream->frame_count, NULL, map_flags);
+        stream->mapped = (uint8_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                                                    (GLsizeiptr)frame_size * stream->frame_count, map_flags);
+        if (stream->mapped) {
+            stream->persistent = true;
+            return true;
+        }
+
+        // Storage is immutable, start over with a new buffer.
+        fprintf(stderr, "Couldn't persistently map stream buffer, orphaning instead\n");
+        glDeleteBuffers(1, &buffer);
+        // The new buffer can get the same name, the cache would think it's still bound.
+        saogl_state_invalidate();
+        glGenBuffers(1, &buffer);
+        stream->buffer = buffer;
+        saogl_bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+    }
+#endif
+
+    stream->frame_count = 1;
+    stream->mapped = (uint8_t*)SAOGL_MALLOC(frame_size);
+    if (!stream->mapped) {
+        glDeleteBuffers(1, &buffer);
+        saogl_state_invalidate();
+        stream->buffer = 0;
+        return false;
+    }
+    glBufferData(GL_COPY_WRITE_BUFFER, frame_size, NULL, GL_STREAM_DRAW);
+    return true;
+}
+
+void
+saogl_stream_free(saogl_StreamBuffer* stream)
+{
+    for (int i=0; i<SAOGL_STREAM_FRAMES; i++) {
+        if (stream->fences[i]) {
+            glDeleteSync((GLsync)stream->fences[i]);
+        }
+    }
+    if (stream->persistent) {
+        saogl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    } else {
+        SAOGL_FREE(stream->mapped);
+    }
+    GLuint buffer = stream->buffer;
+    glDeleteBuffers(1, &buffer);
+    // Deleting unbinds it, the cache doesn't know that.
+    saogl_state_invalidate();
+    memset(stream, 0, sizeof(*stream));
+}
+
+saogl_StreamAllocation
+saogl_stream_alloc(saogl_StreamBuffer* stream, uint32_t size, uint32_t alignment)
+{
+    saogl_StreamAllocation allocation = {0};
+    uint32_t offset = alignment > 1 ? (stream->offset + alignment - 1) & ~(alignment - 1) : stream->offset;
+    // Aligning can wrap, and so could offset + size.
+    if (offset < stream->offset || offset > stream->frame_size || size > stream->frame_size - offset) {
+        stream->stats.failed_allocations++;
+        return allocation;
+    }
+
+    uint32_t frame_start = stream->frame * stream->frame_size;
+    allocation.data = stream->mapped + frame_start + offset;
+    allocation.offset = frame_start + offset;
+    stream->offset = offset + size;
+
+    stream->stats.allocations++;
+    stream->stats.bytes += size;
+    if (stream->offset > stream->stats.peak_frame_bytes) {
+        stream->stats.peak_frame_bytes = stream->offset;
+    }
+    return allocation;
+}
+
+void
+saogl_stream_flush(saogl_StreamBuffer* stream)
+{
+    if (stream->persistent || stream->flushed == stream->offset) {
+        return;
+    }
+    saogl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, stream->flushed, stream->offset - stream->flushed,
+                    stream->mapped + stream->flushed);
+    stream->flushed = stream->offset;
+}
+
+void
+saogl_stream_end_frame(saogl_StreamBuffer* stream)
+{
+    stream->offset = 0;
+    stream->flushed = 0;
+
+    if (!stream->persistent) {
+        // Orphan, the driver hands us fresh storage if the gpu still uses the old one.
+        saogl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, stream->frame_size, NULL, GL_STREAM_DRAW);
+        return;
+    }
+
+    stream->fences[stream->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stream->frame = (stream->frame + 1) % stream->frame_count;
+
+    // The part we're about to write was used SAOGL_STREAM_FRAMES - 1 frames ago. Usually
+    // the gpu is done with it, if not that's a stall.
+    GLsync fence = (GLsync)stream->fences[stream->frame];
+    if (!fence) {
+        return;
+    }
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        double start = _saogl_seconds();
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        stream->stats.stalls++;
+        stream->stats.stall_seconds += _saogl_seconds() - start;
+    }
+    if (result == GL_WAIT_FAILED) {
+        fprintf(stderr, "Error: waiting on stream buffer fence failed\n");
+    }
+    glDeleteSync(fence);
+    stream->fences[stream->frame] = NULL;
+}
+
+void
+saogl_stream_print_stats(saogl_StreamBuffer* stream)
+{
+    fprintf(stderr, "Stream buffer (%s, %u x %u bytes): %llu allocations, %llu bytes, peak %u bytes a frame, "
+            "%u failed, %u stalls (%.3f ms)\n",
+            stream->persistent ? "persistent" : "orphaning", stream->frame_count, stream->frame_size,
+            (unsigned long long)stream->stats.allocations, (unsigned long long)stream->stats.bytes,
+            stream->stats.peak_frame_bytes, stream->stats.failed_allocations,
+            stream->stats.stalls, stream->stats.stall_seconds * 1000.0);
+}
+
+// Instanced drawing.
+uint32_t
+saogl_draw_instanced(saogl_StreamBuffer* stream, saogl_InstancedMesh* mesh,
+                     const float* transforms, const float* attributes,
+                     const uint32_t* visible, uint32_t count)
+{
+    int transform_floats = mesh->transform_format == SAOGL_INSTANCE_AFFINE ? 12 : 16;
+    int attribute_floats = mesh->attribute_location >= 0 && attributes ? mesh->attribute_components : 0;
+    uint32_t stride = (transform_floats + attribute_floats) * sizeof(float);
+
+    saogl_bind_vertex_array(mesh->vertex_array);
+    saogl_bind_buffer(GL_ARRAY_BUFFER, stream->buffer);
+    for (int i=0; i<transform_floats / 4; i++) {
+        glEnableVertexAttribArray(mesh->transform_location + i);
+        glVertexAttribDivisor(mesh->transform_location + i, 1);
+    }
+    if (attribute_floats) {
+        glEnableVertexAttribArray(mesh->attribute_location);
+        glVertexAttribDivisor(mesh->attribute_location, 1);
+    }
+
+    uint32_t draw_calls = 0;
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t chunk = count - done;
+        if (mesh->max_instances_per_draw && chunk > mesh->max_instances_per_draw) {
+            chunk = mesh->max_instances_per_draw;
+        }
+        uint32_t space = stream->frame_size > stream->offset + 16 ? stream->frame_size - stream->offset - 16 : 0;
+        if (chunk > space / stride) {
+            chunk = space / stride;
+        }
+
+        saogl_StreamAllocation allocation = {0};
+        if (chunk) {
+            allocation = saogl_stream_alloc(stream, chunk * stride, 16);
+        }
+        if (!allocation.data) {
+            mesh->instances_dropped += count - done;
+            break;
+        }
+
+        // Gather the visible instances' data next to each other.
+        float* out = (float*)allocation.data;
+        for (uint32_t i=0; i<chunk; i++) {
+            uint32_t instance = visible ? visible[done + i] : done + i;
+            memcpy(out, transforms + (size_t)instance * transform_floats, transform_floats * sizeof(float));
+            out += transform_floats;
+            if (attribute_floats) {
+                memcpy(out, attributes + (size_t)instance * attribute_floats, attribute_floats * sizeof(float));
+                out += attribute_floats;
+            }
+        }
+        saogl_stream_flush(stream);
+
+        for (int i=0; i<transform_floats / 4; i++) {
+            glVertexAttribPointer(mesh->transform_location + i, 4, GL_FLOAT, GL_FALSE, stride,
+                                  (const void*)(uintptr_t)(allocation.offset + i * 4 * sizeof(float)));
+        }
+        if (attribute_floats) {
+            glVertexAttribPointer(mesh->attribute_location, attribute_floats, GL_FLOAT, GL_FALSE, stride,
+                                  (const void*)(uintptr_t)(allocation.offset + transform_floats * sizeof(float)));
+        }
+
+        if (mesh->index_type) {
+            glDrawElementsInstanced(mesh->mode, mesh->count, mesh->index_type, 0, chunk);
+        } else {
+            glDrawArraysInstanced(mesh->mode, 0, mesh->count, chunk);
+        }
+        draw_calls++;
+        done += chunk;
+    }
+
+    mesh->instances_drawn += done;
+    mesh->draw_calls += draw_calls;
+    return draw_calls;
+}
+
+// Debug drawing.
+static const char* _saogl_debug_vertex_shader =
+    "#version 330\n"
+    "layout (location = 0) in vec3 position;\n"
+    "layout (location = 1) in vec4 color;\n"
+    "uniform mat4 transform;\n"
+    "out vec4 vertex_color;\n"
+    "void main()\n"
+    "{\n"
+    "	vertex_color = color;\n"
+    "	gl_Position = transform * vec4(position, 1.0);\n"
+    "}\n";
+
+static const char* _saogl_debug_fragment_shader =
+    "#version 330\n"
+    "in vec4 vertex_color;\n"
+    "out vec4 color;\n"
+    "void main() { color = vertex_color; }\n";
+
+bool
+saogl_debug_draw_init(saogl_DebugDraw* dd, uint32_t max_lines, uint32_t max_text_lines)
+{
+    memset(dd, 0, sizeof(*dd));
+    dd->enabled = true;
+    dd->depth_test = true;
+    dd->line_capacity = max_lines * 2;
+    dd->text_capacity = max_text_lines * 2;
+    dd->lines = (saogl_DebugVertex*)SAOGL_MALLOC(dd->line_capacity * sizeof(saogl_DebugVertex));
+    dd->text = (saogl_DebugVertex*)SAOGL_MALLOC(dd->text_capacity * sizeof(saogl_DebugVertex));
+    atomic_init(&dd->line_count, 0);
+    atomic_init(&dd->text_count, 0);
+    atomic_init(&dd->dropping, 0);
+    if (!dd->lines || !dd->text ||
+        !saogl_program_build(&dd->program, _saogl_debug_vertex_shader, _saogl_debug_fragment_shader)) {
+        SAOGL_FREE(dd->lines);
+        SAOGL_FREE(dd->text);
+        dd->lines = dd->text = NULL;
+        dd->enabled = false;
+        return false;
+    }
+    dd->transform_uniform = saogl_uniform(&dd->program, "transform");
+
+    GLuint vertex_array, vertex_buffer;
+    glGenVertexArrays(1, &vertex_array);
+    glGenBuffers(1, &vertex_buffer);
+    dd->vertex_array = vertex_array;
+    dd->vertex_buffer = vertex_buffer;
+    saogl_bind_vertex_array(vertex_array);
+    saogl_bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, (dd->line_capacity + dd->text_capacity) * sizeof(saogl_DebugVertex), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(saogl_DebugVertex), 0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(saogl_DebugVertex),
+                          (const void*)offsetof(saogl_DebugVertex, color));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    return true;
+}
+
+void
+saogl_debug_draw_free(saogl_DebugDraw* dd)
+{
+    if (dd->program.program > 0) {
+        glDeleteProgram(dd->program.program);
+    }
+    saogl_program_free(&dd->program);
+    GLuint vertex_array = dd->vertex_array;
+    GLuint vertex_buffer = dd->vertex_buffer;
+    glDeleteVertexArrays(1, &vertex_array);
+    glDeleteBuffers(1, &vertex_buffer);
+    saogl_state_invalidate();
+    SAOGL_FREE(dd->lines);
+    SAOGL_FREE(dd->text);
+    memset(dd, 0, sizeof(*dd));
+}
+
+void
+saogl_debug_draw_submit(saogl_DebugDraw* dd, const float* view_projection)
+{
+    uint32_t line_count = atomic_exchange(&dd->line_count, 0);
+    uint32_t text_count = atomic_exchange(&dd->text_count, 0);
+    dd->dropped = atomic_exchange(&dd->dropping, 0);
+    dd->lines_drawn = line_count / 2;
+    dd->text_lines_drawn = text_count / 2;
+    if (!line_count && !text_count) {
+        return;
+    }
+
+    // Orphan and upload only what was used, lines first then text.
+    saogl_bind_vertex_array(dd->vertex_array);
+    saogl_bind_buffer(GL_ARRAY_BUFFER, dd->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, (dd->line_capacity + dd->text_capacity) * sizeof(saogl_DebugVertex), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, line_count * sizeof(saogl_DebugVertex), dd->lines);
+    glBufferSubData(GL_ARRAY_BUFFER, line_count * sizeof(saogl_DebugVertex),
+                    text_count * sizeof(saogl_DebugVertex), dd->text);
+
+    // Put the depth state back afterwards, a depth mask left off would stop the next clear.
+    bool depth_test, depth_write;
+    GLenum depth_func;
+    if (_saogl_state.known & _SAOGL_KNOWN_DEPTH) {
+        depth_test = _saogl_state.depth_test;
+        depth_write = _saogl_state.depth_write;
+        depth_func = _saogl_state.depth_func;
+    } else {
+        GLboolean mask;
+        GLint func;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &mask);
+        glGetIntegerv(GL_DEPTH_FUNC, &func);
+        depth_test = glIsEnabled(GL_DEPTH_TEST);
+        depth_write = mask;
+        depth_func = func;
+    }
+
+    saogl_use_program(dd->program.program);
+    if (line_count) {
+        saogl_set_uniform_matrix4fv(&dd->program, dd->transform_uniform, 1, view_projection);
+        saogl_set_depth(dd->depth_test, false, GL_LEQUAL);
+        glDrawArrays(GL_LINES, 0, line_count);
+    }
+
+    if (text_count) {
+        // Pixels from the top left to clip space.
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        float pixels[16] = {
+            2.0f / viewport[2], 0, 0, 0,
+            0, -2.0f / viewport[3], 0, 0,
+            0, 0, 1, 0,
+            -1, 1, 0, 1
+        };
+        saogl_set_uniform_matrix4fv(&dd->program, dd->transform_uniform, 1, pixels);
+        saogl_set_depth(false, false, GL_LEQUAL);
+        glDrawArrays(GL_LINES, line_count, text_count);
+    }
+    saogl_set_depth(depth_test, depth_write, depth_func);
+}
+
+#ifndef SAOGL_NO_DEBUG_DRAW
+// Returns where to write count vertices or NULL if they don't fit.
+saogl_DebugVertex*
+_saogl_debug_reserve(saogl_DebugVertex* vertices, atomic_uint* used, uint32_t capacity, uint32_t count,
+                     atomic_uint* dropped)
+{
+    // Never counts past capacity, submit draws exactly what was written.
+    uint32_t at = atomic_load_explicit(used, memory_order_relaxed);
+    do {
+        if (count > capacity - at) {
+            atomic_fetch_add_explicit(dropped, count / 2, memory_order_relaxed);
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(used, &at, at + count,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return vertices + at;
+}
+
+void
+saogl_debug_line(saogl_DebugDraw* dd, const float* a, const float* b, uint32_t color)
+{
+    if (!dd->enabled) {
+        return;
+    }
+    saogl_DebugVertex* v = _saogl_debug_reserve(dd->lines, &dd->line_count, dd->line_capacity, 2, &dd->dropping);
+    if (v) {
+        v[0] = (saogl_DebugVertex){{a[0], a[1], a[2]}, color};
+        v[1] = (saogl_DebugVertex){{b[0], b[1], b[2]}, color};
+    }
+}
+
+// Appends lines between pairs of points with one reservation.
+void
+_saogl_debug_segments(saogl_DebugDraw* dd, const float (*points)[3], const uint8_t* pairs, int pair_count, uint32_t color)
+{
+    saogl_DebugVertex* v = _saogl_debug_reserve(dd->lines, &dd->line_count, dd->line_capacity, pair_count * 2,
+                                                &dd->dropping);
+    if (!v) {
+        return;
+    }
+    for (int i=0; i<pair_count * 2; i++) {
+        const float* p = points[pairs[i]];
+        v[i] = (saogl_DebugVertex){{p[0], p[1], p[2]}, color};
+    }
+}
+
+// Corners are numbered by bits, x is bit 0, y bit 1, z bit 2.
+static const uint8_t _saogl_box_edges[24] = {
+    0,1, 2,3, 4,5, 6,7,
+    0,2, 1,3, 4,6, 5,7,
+    0,4, 1,5, 2,6, 3,7,
+};
+
+void
+saogl_debug_aabb(saogl_DebugDraw* dd, const float* min, const float* max, uint32_t color)
+{
+    if (!dd->enabled) {
+        return;
+    }
+    float corners[8][3];
+    for (int i=0; i<8; i++) {
+        corners[i][0] = i & 1 ? max[0] : min[0];
+        corners[i][1] = i & 2 ? max[1] : min[1];
+        corners[i][2] = i & 4 ? max[2] : min[2];
+    }
+    _saogl_debug_segments(dd, (const float (*)[3])corners, _saogl_box_edges, 12, color);
+}
+
+#define _SAOGL_SPHERE_SEGMENTS 24
+
+void
+saogl_debug_sphere(saogl_DebugDraw* dd, const float* center, float radius, uint32_t color)
+{
+    if (!dd->enabled) {
+        return;
+    }
+    saogl_DebugVertex* v = _saogl_debug_reserve(dd->lines, &dd->line_count, dd->line_capacity,
+                                                3 * _SAOGL_SPHERE_SEGMENTS * 2, &dd->dropping);
+    if (!v) {
+        return;
+    }
+
+    // A circle around each axis.
+    float previous_cos = 1, previous_sin = 0;
+    for (int i=1; i<=_SAOGL_SPHERE_SEGMENTS; i++) {
+        float angle = 6.2831853f * i / _SAOGL_SPHERE_SEGMENTS;
+        float c = cosf(angle), s = sinf(angle);
+        for (int axis=0; axis<3; axis++) {
+            int u = (axis + 1) % 3, w = (axis + 2) % 3;
+            saogl_DebugVertex a = {{center[0], center[1], center[2]}, color};
+            saogl_DebugVertex b = a;
+            a.position[u] += radius * previous_cos;
+            a.position[w] += radius * previous_sin;
+            b.position[u] += radius * c;
+            b.position[w] += radius * s;
+            *v++ = a;
+            *v++ = b;
+        }
+        previous_cos = c;
+        previous_sin = s;
+    }
+}
+
+bool
+_saogl_invert_matrix(const float* m, float* out)
+{
+    float inv[16];
+    inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    float determinant = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+    if (determinant == 0) {
+        return false;
+    }
+    for (int i=0; i<16; i++) {
+        out[i] = inv[i] / determinant;
+    }
+    return true;
+}
+
+void
+saogl_debug_frustum(saogl_DebugDraw* dd, const float* view_projection, uint32_t color)
+{
+    if (!dd->enabled) {
+        return;
+    }
+    float inverse[16];
+    if (!_saogl_invert_matrix(view_projection, inverse)) {
+        return;
+    }
+
+    // Clip space cube corners back to world space.
+    float corners[8][3];
+    for (int i=0; i<8; i++) {
+        float clip[4] = {i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f};
+        float world[4];
+        for (int row=0; row<4; row++) {
+            world[row] = inverse[row] * clip[0] + inverse[4 + row] * clip[1] +
+                inverse[8 + row] * clip[2] + inverse[12 + row] * clip[3];
+        }
+        for (int axis=0; axis<3; axis++) {
+            corners[i][axis] = world[axis] / world[3];
+        }
+    }
+    _saogl_debug_segments(dd, (const float (*)[3])corners, _saogl_box_edges, 12, color);
+}
+
+void
+saogl_debug_axes(saogl_DebugDraw* dd, const float* transform, float size)
+{
+    if (!dd->enabled) {
+        return;
+    }
+    const float* origin = transform + 12;
+    static const uint32_t colors[3] = {
+        SAOGL_RGBA(255, 0, 0, 255), SAOGL_RGBA(0, 255, 0, 255), SAOGL_RGBA(0, 0, 255, 255)
+    };
+    for (int axis=0; axis<3; axis++) {
+        const float* column = transform + axis * 4;
+        float end[3] = {
+            origin[0] + column[0] * size,
+            origin[1] + column[1] * size,
+            origin[2] + column[2] * size,
+        };
+        saogl_debug_line(dd, origin, end, colors[axis]);
+    }
+}
+
+// Text is drawn like a 16 segment display. The segments join points on a 3x3 grid,
+// x goes 0..2 left to right and y 0..2 bottom to top.
+enum {
+    _SAOGL_SEG_TOP_LEFT = 1 << 0,
+    _SAOGL_SEG_TOP_RIGHT = 1 << 1,
+    _SAOGL_SEG_RIGHT_UPPER = 1 << 2,
+    _SAOGL_SEG_RIGHT_LOWER = 1 << 3,
+    _SAOGL_SEG_BOTTOM_LEFT = 1 << 4,
+    _SAOGL_SEG_BOTTOM_RIGHT = 1 << 5,
+    _SAOGL_SEG_LEFT_LOWER = 1 << 6,
+    _SAOGL_SEG_LEFT_UPPER = 1 << 7,
+    _SAOGL_SEG_MIDDLE_LEFT = 1 << 8,
+    _SAOGL_SEG_MIDDLE_RIGHT = 1 << 9,
+    _SAOGL_SEG_DIAGONAL_TOP_LEFT = 1 << 10,     // From the center.
+    _SAOGL_SEG_CENTER_UPPER = 1 << 11,
+    _SAOGL_SEG_DIAGONAL_TOP_RIGHT = 1 << 12,
+    _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT = 1 << 13,
+    _SAOGL_SEG_CENTER_LOWER = 1 << 14,
+    _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT = 1 << 15,
+    _SAOGL_SEG_TOP = _SAOGL_SEG_TOP_LEFT | _SAOGL_SEG_TOP_RIGHT,
+    _SAOGL_SEG_BOTTOM = _SAOGL_SEG_BOTTOM_LEFT | _SAOGL_SEG_BOTTOM_RIGHT,
+    _SAOGL_SEG_MIDDLE = _SAOGL_SEG_MIDDLE_LEFT | _SAOGL_SEG_MIDDLE_RIGHT,
+    _SAOGL_SEG_LEFT = _SAOGL_SEG_LEFT_UPPER | _SAOGL_SEG_LEFT_LOWER,
+    _SAOGL_SEG_RIGHT = _SAOGL_SEG_RIGHT_UPPER | _SAOGL_SEG_RIGHT_LOWER,
+    _SAOGL_SEG_CENTER = _SAOGL_SEG_CENTER_UPPER | _SAOGL_SEG_CENTER_LOWER,
+};
+
+// x0 y0 x1 y1 for each segment bit.
+static const uint8_t _saogl_segment_lines[16][4] = {
+    {0,2, 1,2}, {1,2, 2,2}, {2,2, 2,1}, {2,1, 2,0},
+    {0,0, 1,0}, {1,0, 2,0}, {0,1, 0,0}, {0,2, 0,1},
+    {0,1, 1,1}, {1,1, 2,1}, {0,2, 1,1}, {1,2, 1,1},
+    {2,2, 1,1}, {0,0, 1,1}, {1,0, 1,1}, {2,0, 1,1},
+};
+
+static const uint16_t _saogl_font[128] = {
+    ['0'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_LEFT |
+            _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT,
+    ['1'] = _SAOGL_SEG_RIGHT | _SAOGL_SEG_DIAGONAL_TOP_RIGHT,
+    ['2'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT_UPPER | _SAOGL_SEG_MIDDLE | _SAOGL_SEG_LEFT_LOWER |
+            _SAOGL_SEG_BOTTOM,
+    ['3'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_MIDDLE_RIGHT | _SAOGL_SEG_BOTTOM,
+    ['4'] = _SAOGL_SEG_LEFT_UPPER | _SAOGL_SEG_MIDDLE | _SAOGL_SEG_RIGHT,
+    ['5'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT_UPPER | _SAOGL_SEG_MIDDLE | _SAOGL_SEG_RIGHT_LOWER |
+            _SAOGL_SEG_BOTTOM,
+    ['6'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT | _SAOGL_SEG_MIDDLE | _SAOGL_SEG_BOTTOM |
+            _SAOGL_SEG_RIGHT_LOWER,
+    ['7'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT,
+    ['8'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_LEFT |
+            _SAOGL_SEG_MIDDLE,
+    ['9'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_LEFT_UPPER |
+            _SAOGL_SEG_MIDDLE,
+    ['A'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_LEFT | _SAOGL_SEG_MIDDLE,
+    ['B'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_CENTER |
+            _SAOGL_SEG_MIDDLE_RIGHT,
+    ['C'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT | _SAOGL_SEG_BOTTOM,
+    ['D'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_CENTER,
+    ['E'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_MIDDLE_LEFT,
+    ['F'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT | _SAOGL_SEG_MIDDLE_LEFT,
+    ['G'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_RIGHT_LOWER |
+            _SAOGL_SEG_MIDDLE_RIGHT,
+    ['H'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_RIGHT | _SAOGL_SEG_MIDDLE,
+    ['I'] = _SAOGL_SEG_TOP | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_CENTER,
+    ['J'] = _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_LEFT_LOWER,
+    ['K'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_MIDDLE_LEFT | _SAOGL_SEG_DIAGONAL_TOP_RIGHT |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['L'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_BOTTOM,
+    ['M'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_RIGHT | _SAOGL_SEG_DIAGONAL_TOP_LEFT |
+            _SAOGL_SEG_DIAGONAL_TOP_RIGHT,
+    ['N'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_RIGHT | _SAOGL_SEG_DIAGONAL_TOP_LEFT |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['O'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_LEFT,
+    ['P'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT_UPPER | _SAOGL_SEG_LEFT | _SAOGL_SEG_MIDDLE,
+    ['Q'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_LEFT |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['R'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT_UPPER | _SAOGL_SEG_LEFT | _SAOGL_SEG_MIDDLE |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['S'] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT_UPPER | _SAOGL_SEG_MIDDLE | _SAOGL_SEG_RIGHT_LOWER |
+            _SAOGL_SEG_BOTTOM,
+    ['T'] = _SAOGL_SEG_TOP | _SAOGL_SEG_CENTER,
+    ['U'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_BOTTOM | _SAOGL_SEG_RIGHT,
+    ['V'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT | _SAOGL_SEG_DIAGONAL_TOP_RIGHT,
+    ['W'] = _SAOGL_SEG_LEFT | _SAOGL_SEG_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['X'] = _SAOGL_SEG_DIAGONAL_TOP_LEFT | _SAOGL_SEG_DIAGONAL_TOP_RIGHT |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT | _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['Y'] = _SAOGL_SEG_DIAGONAL_TOP_LEFT | _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_CENTER_LOWER,
+    ['Z'] = _SAOGL_SEG_TOP | _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT |
+            _SAOGL_SEG_BOTTOM,
+    ['-'] = _SAOGL_SEG_MIDDLE,
+    ['+'] = _SAOGL_SEG_MIDDLE | _SAOGL_SEG_CENTER,
+    ['='] = _SAOGL_SEG_MIDDLE | _SAOGL_SEG_BOTTOM,
+    ['_'] = _SAOGL_SEG_BOTTOM,
+    ['/'] = _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT,
+    ['\\'] = _SAOGL_SEG_DIAGONAL_TOP_LEFT | _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['|'] = _SAOGL_SEG_CENTER,
+    [':'] = _SAOGL_SEG_CENTER,
+    ['*'] = _SAOGL_SEG_MIDDLE | _SAOGL_SEG_DIAGONAL_TOP_LEFT | _SAOGL_SEG_CENTER |
+            _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT |
+            _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['%'] = _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT,
+    ['.'] = _SAOGL_SEG_BOTTOM_LEFT,
+    [','] = _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT,
+    ['('] = _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    [')'] = _SAOGL_SEG_DIAGONAL_TOP_LEFT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT,
+    ['<'] = _SAOGL_SEG_DIAGONAL_TOP_RIGHT | _SAOGL_SEG_DIAGONAL_BOTTOM_RIGHT,
+    ['>'] = _SAOGL_SEG_DIAGONAL_TOP_LEFT | _SAOGL_SEG_DIAGONAL_BOTTOM_LEFT,
+    ['\''] = _SAOGL_SEG_CENTER_UPPER,
+    ['['] = _SAOGL_SEG_TOP | _SAOGL_SEG_LEFT | _SAOGL_SEG_BOTTOM,
+    [']'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT | _SAOGL_SEG_BOTTOM,
+    ['?'] = _SAOGL_SEG_TOP | _SAOGL_SEG_RIGHT_UPPER | _SAOGL_SEG_MIDDLE_RIGHT |
+            _SAOGL_SEG_CENTER_LOWER,
+    ['!'] = _SAOGL_SEG_CENTER_UPPER,
+};
+
+uint16_t
+_saogl_glyph(char c)
+{
+    if (c >= 'a' && c <= 'z') {
+        c = c - 'a' + 'A';
+    }
+    return (unsigned char)c < 128 ? _saogl_font[(unsigned char)c] : 0;
+}
+
+void
+saogl_debug_text(saogl_DebugDraw* dd, float x, float y, float size, uint32_t color, const char* format, ...)
+{
+    if (!dd->enabled) {
+        return;
+    }
+
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    // Count first so the whole string is one reservation.
+    uint32_t segment_count = 0;
+    for (const char* c=text; *c; c++) {
+        segment_count += __builtin_popcount(_saogl_glyph(*c));
+    }
+    saogl_DebugVertex* v = _saogl_debug_reserve(dd->text, &dd->text_count, dd->text_capacity, segment_count * 2,
+                                                &dd->dropping);
+    if (!v) {
+        return;
+    }
+
+    float grid_x = size * 0.25f;
+    float grid_y = size * 0.5f;
+    float left = x;
+    for (const char* c=text; *c; c++) {
+        if (*c == '\n') {
+            x = left;
+            y += size * 1.5f;
+            continue;
+        }
+        uint16_t glyph = _saogl_glyph(*c);
+        for (int bit=0; bit<16; bit++) {
+            if (glyph & (1 << bit)) {
+                const uint8_t* line = _saogl_segment_lines[bit];
+                *v++ = (saogl_DebugVertex){{x + line[0] * grid_x, y + (2 - line[1]) * grid_y, 0}, color};
+                *v++ = (saogl_DebugVertex){{x + line[2] * grid_x, y + (2 - line[3]) * grid_y, 0}, color};
+            }
+        }
+        x += size * 0.75f;
+    }
+}
+#endif
+
+// Texture streaming.
+// Block compressed formats by value so we don't depend on which extension headers exist.
+static const struct {
+    uint32_t internal_format;
+    uint32_t block_bytes;
+} _saogl_compressed_formats[] = {
+    {0x83F0, 8}, {0x83F1, 8}, {0x83F2, 16}, {0x83F3, 16},       // BC1-3 (S3TC)
+    {0x8C4C, 8}, {0x8C4D, 8}, {0x8C4E, 16}, {0x8C4F, 16},       // BC1-3 sRGB
+    {0x8DBB, 8}, {0x8DBC, 8}, {0x8DBD, 16}, {0x8DBE, 16},       // BC4-5 (RGTC)
+    {0x8E8C, 16}, {0x8E8D, 16}, {0x8E8E, 16}, {0x8E8F, 16},     // BC6H, BC7 (BPTC)
+    {0x9270, 8}, {0x9271, 8}, {0x9272, 16}, {0x9273, 16},       // EAC R11, RG11
+    {0x9274, 8}, {0x9275, 8}, {0x9276, 8}, {0x9277, 8},         // ETC2 RGB, punchthrough alpha
+    {0x9278, 16}, {0x9279, 16},                                 // ETC2 RGBA
+};
+
+uint32_t
+_saogl_compressed_block_bytes(uint32_t internal_format)
+{
+    for (size_t i=0; i<sizeof(_saogl_compressed_formats) / sizeof(_saogl_compressed_formats[0]); i++) {
+        if (_saogl_compressed_formats[i].internal_format == internal_format) {
+            return _saogl_compressed_formats[i].block_bytes;
+        }
+    }
+    return 0;
+}
+
+uint8_t*
+_saogl_read_file(const char* filename, size_t* size)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* data = length > 0 ? (uint8_t*)SAOGL_MALLOC(length) : NULL;
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        SAOGL_FREE(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = length;
+    return data;
+}
+
+uint32_t
+_saogl_mip_size(uint32_t size, uint32_t level)
+{
+    size >>= level;
+    return size ? size : 1;
+}
+
+// Box filters RGBA8 level 0 down to 1x1, level 0 has to be in image->data already.
+bool
+_saogl_generate_mips(saogl_Image* image)
+{
+    size_t total = 0;
+    uint32_t level_count = 0;
+    while (level_count < SAOGL_MAX_MIP_LEVELS) {
+        uint32_t width = _saogl_mip_size(image->width, level_count);
+        uint32_t height = _saogl_mip_size(image->height, level_count);
+        image->level_offsets[level_count] = total;
+        image->level_sizes[level_count] = (size_t)width * height * 4;
+        total += image->level_sizes[level_count];
+        level_count++;
+        if (width == 1 && height == 1) {
+            break;
+        }
+    }
+
+    uint8_t* data = (uint8_t*)SAOGL_REALLOC(image->data, total);
+    if (!data) {
+        return false;
+    }
+    image->data = data;
+    image->level_count = level_count;
+
+    for (uint32_t level=1; level<level_count; level++) {
+        uint32_t src_width = _saogl_mip_size(image->width, level - 1);
+        uint32_t src_height = _saogl_mip_size(image->height, level - 1);
+        uint32_t width = _saogl_mip_size(image->width, level);
+        uint32_t height = _saogl_mip_size(image->height, level);
+        const uint8_t* src = data + image->level_offsets[level - 1];
+        uint8_t* dst = data + image->level_offsets[level];
+
+        for (uint32_t y=0; y<height; y++) {
+            uint32_t y0 = y * 2, y1 = y * 2 + 1 < src_height ? y * 2 + 1 : y * 2;
+            for (uint32_t x=0; x<width; x++) {
+                uint32_t x0 = x * 2, x1 = x * 2 + 1 < src_width ? x * 2 + 1 : x * 2;
+                for (int c=0; c<4; c++) {
+                    uint32_t sum = src[(y0 * src_width + x0) * 4 + c] + src[(y0 * src_width + x1) * 4 + c] +
+                        src[(y1 * src_width + x0) * 4 + c] + src[(y1 * src_width + x1) * 4 + c];
+                    dst[(y * width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool
+_saogl_load_tga(const char* filename, const uint8_t* file, size_t size, saogl_Image* image)
+{
+    if (size < 18 || file[1] != 0 || file[2] != 2 || (file[16] != 24 && file[16] != 32)) {
+        fprintf(stderr, "Error: %s isn't an uncompressed 24 or 32 bit tga\n", filename);
+        return false;
+    }
+    uint32_t width = file[12] | (file[13] << 8);
+    uint32_t height = file[14] | (file[15] << 8);
+    uint32_t pixel_bytes = file[16] / 8;
+    bool top_to_bottom = file[17] & 0x20;
+    const uint8_t* pixels = file + 18 + file[0];
+    if (!width || !height || pixels + (size_t)width * height * pixel_bytes > file + size) {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        return false;
+    }
+
+    image->internal_format = GL_RGBA8;
+    image->compressed = false;
+    image->block_bytes = 4;
+    image->width = width;
+    image->height = height;
+    image->data = (uint8_t*)SAOGL_MALLOC((size_t)width * height * 4);
+    if (!image->data) {
+        return false;
+    }
+
+    // BGR(A) to RGBA, gl wants the bottom row first which is tga's default.
+    for (uint32_t y=0; y<height; y++) {
+        const uint8_t* src = pixels + (size_t)(top_to_bottom ? height - 1 - y : y) * width * pixel_bytes;
+        uint8_t* dst = image->data + (size_t)y * width * 4;
+        for (uint32_t x=0; x<width; x++, src += pixel_bytes, dst += 4) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = pixel_bytes == 4 ? src[3] : 255;
+        }
+    }
+    return _saogl_generate_mips(image);
+}
+
+bool
+_saogl_load_ktx(const char* filename, const uint8_t* file, size_t size, saogl_Image* image)
+{
+    static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+    uint32_t header[13];
+    if (size < 64 || memcmp(file, identifier, 12) != 0) {
+        fprintf(stderr, "Error: %s isn't a ktx file\n", filename);
+        return false;
+    }
+    memcpy(header, file + 12, sizeof(header));
+    if (header[0] != 0x04030201) {
+        fprintf(stderr, "Error: %s has the wrong endianness\n", filename);
+        return false;
+    }
+
+    uint32_t gl_type = header[1], gl_format = header[3], internal_format = header[4];
+    uint32_t width = header[6], height = header[7];
+    uint32_t faces = header[10], level_count = header[11] ? header[11] : 1;
+    if (header[8] > 1 || header[9] > 0 || faces != 1 || !width || !height || level_count > SAOGL_MAX_MIP_LEVELS ||
+        width > SAOGL_MAX_TEXTURE_SIZE || height > SAOGL_MAX_TEXTURE_SIZE) {
+        fprintf(stderr, "Error: %s isn't a plain 2d texture\n", filename);
+        return false;
+    }
+
+    image->internal_format = internal_format;
+    image->width = width;
+    image->height = height;
+    image->level_count = level_count;
+    if (gl_type == 0) {
+        image->compressed = true;
+        image->block_bytes = _saogl_compressed_block_bytes(internal_format);
+    } else if (gl_type == GL_UNSIGNED_BYTE && gl_format == GL_RGBA) {
+        image->compressed = false;
+        image->block_bytes = 4;
+    }
+    if (!image->block_bytes) {
+        fprintf(stderr, "Error: %s has unsupported format 0x%x\n", filename, internal_format);
+        return false;
+    }
+
+    // Levels are each a 4 byte size and the data padded to 4 bytes. Every size has to be
+    // exactly what the level's dimensions and format need, uploads copy that much.
+    size_t at = 64 + (size_t)header[12];
+    size_t total = 0;
+    for (uint32_t level=0; level<level_count; level++) {
+        uint32_t level_size;
+        if (at > size || size - at < 4) {
+            fprintf(stderr, "Error: %s is truncated\n", filename);
+            return false;
+        }
+        memcpy(&level_size, file + at, 4);
+        uint64_t level_width = _saogl_mip_size(width, level);
+        uint64_t level_height = _saogl_mip_size(height, level);
+        uint64_t expected = image->compressed ?
+            ((level_width + 3) / 4) * ((level_height + 3) / 4) * image->block_bytes :
+            level_width * level_height * 4;
+        if (level_size != expected) {
+            fprintf(stderr, "Error: %s level %u is %u bytes, expected %llu\n", filename, level,
+                    level_size, (unsigned long long)expected);
+            return false;
+        }
+        size_t padded = ((size_t)level_size + 3) & ~(size_t)3;
+        if (padded > size - at - 4) {
+            fprintf(stderr, "Error: %s is truncated\n", filename);
+            return false;
+        }
+        image->level_offsets[level] = total;
+        image->level_sizes[level] = level_size;
+        total += level_size;
+        at += 4 + padded;
+    }
+
+    image->data = (uint8_t*)SAOGL_MALLOC(total ? total : 1);
+    if (!image->data) {
+        return false;
+    }
+    at = 64 + header[12];
+    for (uint32_t level=0; level<level_count; level++) {
+        memcpy(image->data + image->level_offsets[level], file + at + 4, image->level_sizes[level]);
+        at += 4 + ((image->level_sizes[level] + 3) & ~3u);
+    }
+
+    if (!image->compressed && level_count == 1) {
+        return _saogl_generate_mips(image);
+    }
+    return true;
+}
+
+bool
+saogl_load_image(const char* filename, saogl_Image* image)
+{
+    memset(image, 0, sizeof(*image));
+    size_t size;
+    uint8_t* file = _saogl_read_file(filename, &size);
+    if (!file) {
+        fprintf(stderr, "Error: couldn't read %s\n", filename);
+        return false;
+    }
+
+    const char* extension = strrchr(filename, '.');
+    bool ok;
+    if (extension && strcmp(extension, ".ktx") == 0) {
+        ok = _saogl_load_ktx(filename, file, size, image);
+    } else {
+        ok = _saogl_load_tga(filename, file, size, image);
+    }
+    SAOGL_FREE(file);
+    if (!ok) {
+        SAOGL_FREE(image->data);
+        image->data = NULL;
+    }
+    return ok;
+}
+
+void*
+_saogl_texture_worker(void* data)
+{
+    saogl_TextureStreamer* streamer = (saogl_TextureStreamer*)data;
+    for (;;) {
+        pthread_mutex_lock(&streamer->mutex);
+        while (!streamer->queue_count && !streamer->quit) {
+            pthread_cond_wait(&streamer->wake, &streamer->mutex);
+        }
+        if (streamer->quit) {
+            pthread_mutex_unlock(&streamer->mutex);
+            return NULL;
+        }
+        saogl_Texture* texture = streamer->queue[streamer->queue_head];
+        streamer->queue_head = (streamer->queue_head + 1) % streamer->queue_capacity;
+        streamer->queue_count--;
+        pthread_mutex_unlock(&streamer->mutex);
+
+        bool ok = saogl_load_image(texture->filename, &texture->image);
+        atomic_store_explicit(&texture->status, ok ? SAOGL_TEXTURE_DECODED : SAOGL_TEXTURE_FAILED,
+                              memory_order_release);
+    }
+}
+
+bool
+saogl_texture_streamer_init(saogl_TextureStreamer* streamer, int thread_count, uint32_t bytes_per_frame)
+{
+    memset(streamer, 0, sizeof(*streamer));
+    streamer->bytes_per_frame = bytes_per_frame;
+    if (!saogl_stream_init(&streamer->upload, bytes_per_frame, 0)) {
+        return false;
+    }
+
+    // The driver's list leaves out formats that aren't "general purpose", like RGTC and BPTC,
+    // so add the ones core or an extension promises.
+    GLint listed = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &listed);
+    streamer->compressed_formats = (int32_t*)_saogl_calloc(listed + 16, sizeof(int32_t));
+    glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, streamer->compressed_formats);
+    streamer->compressed_format_count = listed;
+    for (int i=0; i<4; i++) {
+        streamer->compressed_formats[streamer->compressed_format_count++] = 0x8DBB + i;
+    }
+    if (saogl_has_extension("GL_ARB_texture_compression_bptc")) {
+        for (int i=0; i<4; i++) {
+            streamer->compressed_formats[streamer->compressed_format_count++] = 0x8E8C + i;
+        }
+    }
+    if (saogl_has_extension("GL_EXT_texture_compression_s3tc")) {
+        for (int i=0; i<4; i++) {
+            streamer->compressed_formats[streamer->compressed_format_count++] = 0x83F0 + i;
+        }
+    }
+
+    pthread_mutex_init(&streamer->mutex, NULL);
+    pthread_cond_init(&streamer->wake, NULL);
+    streamer->threads = (pthread_t*)_saogl_calloc(thread_count, sizeof(pthread_t));
+    for (int i=0; i<thread_count; i++) {
+        if (pthread_create(streamer->threads + i, NULL, _saogl_texture_worker, streamer) != 0) {
+            break;
+        }
+        streamer->thread_count++;
+    }
+    return streamer->thread_count > 0;
+}
+
+void
+saogl_texture_streamer_free(saogl_TextureStreamer* streamer)
+{
+    pthread_mutex_lock(&streamer->mutex);
+    streamer->quit = true;
+    pthread_cond_broadcast(&streamer->wake);
+    pthread_mutex_unlock(&streamer->mutex);
+    for (int i=0; i<streamer->thread_count; i++) {
+        pthread_join(streamer->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&streamer->mutex);
+    pthread_cond_destroy(&streamer->wake);
+
+    for (uint32_t i=0; i<streamer->texture_count; i++) {
+        saogl_Texture* texture = streamer->textures[i];
+        GLuint name = texture->texture;
+        glDeleteTextures(1, &name);
+        SAOGL_FREE(texture->image.data);
+        SAOGL_FREE(texture->filename);
+        SAOGL_FREE(texture);
+    }
+    // Deleting unbinds them, the cache doesn't know that.
+    saogl_state_invalidate();
+    saogl_stream_free(&streamer->upload);
+    SAOGL_FREE(streamer->textures);
+    SAOGL_FREE(streamer->queue);
+    SAOGL_FREE(streamer->threads);
+    SAOGL_FREE(streamer->compressed_formats);
+    memset(streamer, 0, sizeof(*streamer));
+}
+
+saogl_Texture*
+saogl_texture_load(saogl_TextureStreamer* streamer, const char* filename)
+{
+    saogl_Texture* texture = (saogl_Texture*)_saogl_calloc(1, sizeof(saogl_Texture));
+    if (!texture) {
+        return NULL;
+    }
+    GLuint name;
+    glGenTextures(1, &name);
+    texture->texture = name;
+    texture->filename = _saogl_strdup(filename);
+    atomic_init(&texture->status, SAOGL_TEXTURE_QUEUED);
+
+    if (streamer->texture_count == streamer->texture_capacity) {
+        streamer->texture_capacity = streamer->texture_capacity ? streamer->texture_capacity * 2 : 64;
+        streamer->textures = (saogl_Texture**)SAOGL_REALLOC(streamer->textures,
+                                                      streamer->texture_capacity * sizeof(saogl_Texture*));
+    }
+    streamer->textures[streamer->texture_count++] = texture;
+
+    pthread_mutex_lock(&streamer->mutex);
+    if (streamer->queue_count == streamer->queue_capacity) {
+        // Grow and unwrap the ring.
+        uint32_t capacity = streamer->queue_capacity ? streamer->queue_capacity * 2 : 64;
+        saogl_Texture** queue = (saogl_Texture**)SAOGL_MALLOC(capacity * sizeof(saogl_Texture*));
+        for (uint32_t i=0; i<streamer->queue_count; i++) {
+            queue[i] = streamer->queue[(streamer->queue_head + i) % streamer->queue_capacity];
+        }
+        SAOGL_FREE(streamer->queue);
+        streamer->queue = queue;
+        streamer->queue_head = 0;
+        streamer->queue_capacity = capacity;
+    }
+    streamer->queue[(streamer->queue_head + streamer->queue_count) % streamer->queue_capacity] = texture;
+    streamer->queue_count++;
+    pthread_cond_signal(&streamer->wake);
+    pthread_mutex_unlock(&streamer->mutex);
+    return texture;
+}
+
+bool
+_saogl_format_supported(saogl_TextureStreamer* streamer, const saogl_Image* image)
+{
+    if (!image->compressed) {
+        return true;
+    }
+    for (int i=0; i<streamer->compressed_format_count; i++) {
+        if ((uint32_t)streamer->compressed_formats[i] == image->internal_format) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Makes every level with undefined contents, we fill them in later.
+void
+_saogl_texture_allocate(saogl_Texture* texture)
+{
+    saogl_Image* image = &texture->image;
+    saogl_bind_texture(0, GL_TEXTURE_2D, texture->texture);
+    for (uint32_t level=0; level<image->level_count; level++) {
+        GLsizei width = _saogl_mip_size(image->width, level);
+        GLsizei height = _saogl_mip_size(image->height, level);
+        if (image->compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, image->internal_format, width, height, 0,
+                                   image->level_sizes[level], NULL);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, image->internal_format, width, height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, image->level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    image->level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    texture->level = image->level_count - 1;
+    texture->row = 0;
+}
+
+// Uploads rows (block rows if compressed) of the current level until the budget runs out.
+// Returns bytes uploaded, sets *failed if a single row can never fit.
+uint32_t
+_saogl_texture_upload(saogl_TextureStreamer* streamer, saogl_Texture* texture, uint32_t budget, bool* failed)
+{
+    saogl_Image* image = &texture->image;
+    uint32_t uploaded = 0;
+    saogl_bind_texture(0, GL_TEXTURE_2D, texture->texture);
+    saogl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, streamer->upload.buffer);
+
+    while (texture->level >= 0) {
+        uint32_t width = _saogl_mip_size(image->width, texture->level);
+        uint32_t height = _saogl_mip_size(image->height, texture->level);
+        uint32_t row_pixels = image->compressed ? 4 : 1;
+        uint32_t rows = (height + row_pixels - 1) / row_pixels;
+        uint32_t row_bytes = image->compressed ? ((width + 3) / 4) * image->block_bytes : width * 4;
+        if (row_bytes > streamer->bytes_per_frame) {
+            *failed = true;
+            break;
+        }
+
+        uint32_t count = (budget - uploaded) / row_bytes;
+        if (count > rows - texture->row) {
+            count = rows - texture->row;
+        }
+        if (!count) {
+            break;
+        }
+        saogl_StreamAllocation allocation = saogl_stream_alloc(&streamer->upload, count * row_bytes, 16);
+        if (!allocation.data) {
+            break;
+        }
+        memcpy(allocation.data, image->data + image->level_offsets[texture->level] + (size_t)texture->row * row_bytes,
+               count * row_bytes);
+        saogl_stream_flush(&streamer->upload);
+
+        GLint y = texture->row * row_pixels;
+        GLsizei region_height = count * row_pixels;
+        if (y + region_height > (GLint)height) {
+            region_height = height - y;
+        }
+        const void* offset = (const void*)(uintptr_t)allocation.offset;
+        if (image->compressed) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, texture->level, 0, y, width, region_height,
+                                      image->internal_format, count * row_bytes, offset);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, texture->level, 0, y, width, region_height,
+                            GL_RGBA, GL_UNSIGNED_BYTE, offset);
+        }
+        uploaded += count * row_bytes;
+        texture->row += count;
+
+        if (texture->row == rows) {
+            // This level is done, let it be sampled.
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture->level);
+            texture->level--;
+            texture->row = 0;
+        }
+    }
+
+    saogl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return uploaded;
+}
+
+void
+saogl_texture_streamer_update(saogl_TextureStreamer* streamer)
+{
+    double start = _saogl_seconds();
+    uint32_t budget = streamer->bytes_per_frame;
+    uint32_t uploaded = 0;
+
+    // Oldest first so textures finish in the order they were asked for.
+    for (uint32_t i=streamer->first_pending; i<streamer->texture_count && uploaded < budget; i++) {
+        saogl_Texture* texture = streamer->textures[i];
+        int loaded = atomic_load_explicit(&texture->status, memory_order_acquire);
+        int status = loaded;
+
+        if (status == SAOGL_TEXTURE_DECODED) {
+            if (!_saogl_format_supported(streamer, &texture->image)) {
+                fprintf(stderr, "Error: %s uses format 0x%x which the driver doesn't support\n",
+                        texture->filename, texture->image.internal_format);
+                status = SAOGL_TEXTURE_FAILED;
+            } else {
+                _saogl_texture_allocate(texture);
+                status = SAOGL_TEXTURE_UPLOADING;
+            }
+        }
+
+        if (status == SAOGL_TEXTURE_UPLOADING) {
+            bool failed = false;
+            uploaded += _saogl_texture_upload(streamer, texture, budget - uploaded, &failed);
+            if (failed) {
+                fprintf(stderr, "Error: a row of %s is bigger than the %u byte upload budget\n",
+                        texture->filename, streamer->bytes_per_frame);
+                status = SAOGL_TEXTURE_FAILED;
+            } else if (texture->level < 0) {
+                status = SAOGL_TEXTURE_READY;
+            }
+        }
+
+        if ((status == SAOGL_TEXTURE_FAILED || status == SAOGL_TEXTURE_READY) && !texture->finished) {
+            texture->finished = true;
+            SAOGL_FREE(texture->image.data);
+            texture->image.data = NULL;
+            if (status == SAOGL_TEXTURE_READY) {
+                streamer->stats.loaded++;
+            } else {
+                streamer->stats.failed++;
+            }
+        }
+        // Only store what this thread moved it to, a worker may be writing QUEUED and
+        // DECODING ones right now.
+        if (status != loaded) {
+            atomic_store_explicit(&texture->status, status, memory_order_relaxed);
+        }
+    }
+
+    // Skip over the finished ones next time.
+    while (streamer->first_pending < streamer->texture_count) {
+        int status = atomic_load_explicit(&streamer->textures[streamer->first_pending]->status, memory_order_relaxed);
+        if (status != SAOGL_TEXTURE_READY && status != SAOGL_TEXTURE_FAILED) {
+            break;
+        }
+        streamer->first_pending++;
+    }
+
+    saogl_stream_end_frame(&streamer->upload);
+
+    double seconds = _saogl_seconds() - start;
+    streamer->stats.bytes += uploaded;
+    streamer->stats.bytes_last_frame = uploaded;
+    streamer->stats.seconds_last_frame = seconds;
+    if (uploaded > streamer->stats.peak_bytes_frame) {
+        streamer->stats.peak_bytes_frame = uploaded;
+    }
+    if (seconds > streamer->stats.peak_seconds_frame) {
+        streamer->stats.peak_seconds_frame = seconds;
+    }
+}
+
+bool
+saogl_texture_streamer_busy(saogl_TextureStreamer* streamer)
+{
+    return streamer->first_pending < streamer->texture_count;
+}
+
+void
+saogl_texture_streamer_print_stats(saogl_TextureStreamer* streamer)
+{
+    fprintf(stderr, "Textures: %u loaded, %u failed, %llu bytes uploaded, last frame %u bytes in %.3f ms, "
+            "peak %u bytes, %.3f ms\n",
+            streamer->stats.loaded, streamer->stats.failed, (unsigned long long)streamer->stats.bytes,
+            streamer->stats.bytes_last_frame, streamer->stats.seconds_last_frame * 1000.0,
+            streamer->stats.peak_bytes_frame, streamer->stats.peak_seconds_frame * 1000.0);
+}
+
+// Mesh import.
+// .mesh layout, native endian: _saogl_MeshHeader, vertex_count * stride floats, then
+// index_count uint32 indices.
+#define _SAOGL_MESH_MAGIC 0x48534D53 // SMSH
+#define _SAOGL_MESH_VERSION 1
+#define _SAOGL_MESH_MIN_CHUNK (1 << 20)
+#define _SAOGL_MESH_MAX_THREADS 64
+#define _SAOGL_NO_INDEX UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t stride;
+    uint32_t vertex_count;
+    uint32_t index_count;
+} _saogl_MeshHeader;
+
+typedef struct {
+    const char* start;
+    const char* end;
+
+    // Counted in the first pass, then where this chunk's go in the shared arrays.
+    uint64_t position_count;
+    uint64_t texcoord_count;
+    uint64_t normal_count;
+    uint64_t triangle_count;
+    uint64_t first_position;
+    uint64_t first_texcoord;
+    uint64_t first_normal;
+    uint64_t first_triangle;
+
+    // Shared by every chunk. Corners are position, texcoord, normal indices, 0 based.
+    float* positions;
+    float* texcoords;
+    float* normals;
+    uint32_t* corners;
+    uint64_t total_positions;
+    uint64_t total_texcoords;
+    uint64_t total_normals;
+
+    bool has_texcoords;
+    bool has_normals;
+    bool failed;
+} _saogl_ObjChunk;
+
+static inline bool
+_saogl_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char*
+_saogl_skip_spaces(const char* p, const char* end)
+{
+    while (p < end && _saogl_is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+// Decimal with optional fraction and exponent. Returns where it stopped, p if there was no number.
+static const char*
+_saogl_parse_float(const char* p, const char* end, float* value)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Up to 19 significant digits fit in the mantissa, the rest only move the exponent.
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; p < end && (unsigned)(*p - '0') < 10; p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && (unsigned)(*p - '0') < 10; p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e == '-';
+            e++;
+        }
+        if (e < end && (unsigned)(*e - '0') < 10) {
+            int written = 0;
+            for (; e < end && (unsigned)(*e - '0') < 10; e++) {
+                written = written < 10000 ? written * 10 + (*e - '0') : written;
+            }
+            exponent += negative_exponent ? -written : written;
+            p = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0) {
+        result = exponent >= -22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+    } else if (exponent > 0) {
+        result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+    }
+    *value = (float)(negative ? -result : result);
+    return p;
+}
+
+static const char*
+_saogl_parse_int(const char* p, const char* end, int64_t* value)
+{
+    const char* start = p;
+    bool negative = p < end && *p == '-';
+    p += negative;
+    int64_t result = 0;
+    const char* digits = p;
+    for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+        result = result < INT64_MAX / 10 ? result * 10 + (*p - '0') : result;
+    }
+    if (p == digits) {
+        return start;
+    }
+    *value = negative ? -result : result;
+    return p;
+}
+
+// 1 based, or negative counting back from the last one defined before the face.
+static inline bool
+_saogl_obj_index(int64_t value, uint64_t seen, uint64_t total, uint32_t* index)
+{
+    int64_t resolved = value > 0 ? value - 1 : (int64_t)seen + value;
+    if (value == 0 || resolved < 0 || (uint64_t)resolved >= total) {
+        return false;
+    }
+    *index = (uint32_t)resolved;
+    return true;
+}
+
+// Finds the line at *cursor and moves *cursor past it. Returns what it is, 'v' position,
+// 't' texcoord, 'n' normal, 'f' face or 0 for anything else, with *line at its first
+// non space character.
+static inline char
+_saogl_obj_line(const char** cursor, const char* end, const char** line, const char** line_end)
+{
+    const char* newline = (const char*)memchr(*cursor, '\n', end - *cursor);
+    *line_end = newline ? newline : end;
+    const char* p = _saogl_skip_spaces(*cursor, *line_end);
+    *cursor = newline ? newline + 1 : end;
+    *line = p;
+
+    if (*line_end - p < 2) {
+        return 0;
+    }
+    if (p[0] == 'f' && _saogl_is_space(p[1])) {
+        return 'f';
+    }
+    if (p[0] != 'v') {
+        return 0;
+    }
+    if (_saogl_is_space(p[1])) {
+        return 'v';
+    }
+    if ((p[1] == 't' || p[1] == 'n') && *line_end - p > 2 && _saogl_is_space(p[2])) {
+        return p[1];
+    }
+    return 0;
+}
+
+void*
+_saogl_obj_count(void* data)
+{
+    _saogl_ObjChunk* chunk = (_saogl_ObjChunk*)data;
+    const char* cursor = chunk->start;
+    while (cursor < chunk->end) {
+        const char *p, *line_end;
+        char type = _saogl_obj_line(&cursor, chunk->end, &p, &line_end);
+        if (type == 'v') {
+            chunk->position_count++;
+        } else if (type == 't') {
+            chunk->texcoord_count++;
+        } else if (type == 'n') {
+            chunk->normal_count++;
+        } else if (type == 'f') {
+            // Corners are the runs of non space after the f.
+            int corners = 0;
+            for (const char* c = p + 1; c < line_end; c++) {
+                corners += !_saogl_is_space(*c) && _saogl_is_space(c[-1]);
+            }
+            chunk->triangle_count += corners > 2 ? corners - 2 : 0;
+        }
+    }
+    return NULL;
+}
+
+void*
+_saogl_obj_parse(void* data)
+{
+    _saogl_ObjChunk* chunk = (_saogl_ObjChunk*)data;
+    uint64_t position = chunk->first_position;
+    uint64_t texcoord = chunk->first_texcoord;
+    uint64_t normal = chunk->first_normal;
+    uint32_t* corners = chunk->corners + 9 * chunk->first_triangle;
+    const char* cursor = chunk->start;
+
+    while (cursor < chunk->end) {
+        const char *p, *line_end;
+        char type = _saogl_obj_line(&cursor, chunk->end, &p, &line_end);
+        if (type == 0) {
+            continue;
+        }
+        if (type == 'v' || type == 'n') {
+            float* out = type == 'v' ? chunk->positions + 3 * position++ : chunk->normals + 3 * normal++;
+            p += type == 'v' ? 1 : 2;
+            for (int i=0; i<3; i++) {
+                const char* start = _saogl_skip_spaces(p, line_end);
+                p = _saogl_parse_float(start, line_end, out + i);
+                chunk->failed |= p == start;
+            }
+            continue;
+        }
+        if (type == 't') {
+            float* out = chunk->texcoords + 2 * texcoord++;
+            p += 2;
+            for (int i=0; i<2; i++) {
+                const char* start = _saogl_skip_spaces(p, line_end);
+                p = _saogl_parse_float(start, line_end, out + i);
+                chunk->failed |= p == start;
+            }
+            continue;
+        }
+
+        // Fan the polygon out from its first corner.
+        uint32_t first[3];
+        uint32_t last[3];
+        int count = 0;
+        p++;
+        for (;;) {
+            p = _saogl_skip_spaces(p, line_end);
+            if (p == line_end) {
+                break;
+            }
+            uint32_t corner[3] = {0, _SAOGL_NO_INDEX, _SAOGL_NO_INDEX};
+            int64_t value;
+            const char* start = p;
+            p = _saogl_parse_int(p, line_end, &value);
+            bool ok = p != start && _saogl_obj_index(value, position, chunk->total_positions, &corner[0]);
+            if (ok && p < line_end && *p == '/') {
+                p++;
+                if (p < line_end && *p != '/') {
+                    start = p;
+                    p = _saogl_parse_int(p, line_end, &value);
+                    ok = p != start && _saogl_obj_index(value, texcoord, chunk->total_texcoords, &corner[1]);
+                    chunk->has_texcoords = true;
+                }
+                if (ok && p < line_end && *p == '/') {
+                    p++;
+                    start = p;
+                    p = _saogl_parse_int(p, line_end, &value);
+                    ok = p != start && _saogl_obj_index(value, normal, chunk->total_normals, &corner[2]);
+                    chunk->has_normals = true;
+                }
+            }
+            if (!ok || (p < line_end && !_saogl_is_space(*p))) {
+                chunk->failed = true;
+                break;
+            }
+
+            if (count == 0) {
+                memcpy(first, corner, sizeof(first));
+            } else if (count >= 2) {
+                memcpy(corners, first, sizeof(first));
+                memcpy(corners + 3, last, sizeof(last));
+                memcpy(corners + 6, corner, sizeof(corner));
+                corners += 9;
+            }
+            memcpy(last, corner, sizeof(last));
+            count++;
+        }
+        if (chunk->failed) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Runs function on every chunk, the first on this thread.
+void
+_saogl_run_chunks(_saogl_ObjChunk* chunks, int count, void* (*function)(void*))
+{
+    pthread_t threads[_SAOGL_MESH_MAX_THREADS];
+    bool started[_SAOGL_MESH_MAX_THREADS] = {0};
+    for (int i=1; i<count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, function, &chunks[i]) == 0;
+    }
+    function(&chunks[0]);
+    for (int i=1; i<count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            function(&chunks[i]);
+        }
+    }
+}
+
+static inline uint64_t
+_saogl_corner_hash(const uint32_t* corner)
+{
+    uint64_t hash = corner[0] * 0x9E3779B97F4A7C15ull;
+    hash ^= (corner[1] + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+    hash ^= (corner[2] + 0x165667B19E3779F9ull) * 0x85EBCA77C2B2AE63ull;
+    return hash ^ (hash >> 29);
+}
+
+bool
+saogl_parse_obj(saogl_Mesh* mesh, const char* text, size_t size, int thread_count)
+{
+    memset(mesh, 0, sizeof(*mesh));
+    if (thread_count <= 0) {
+        thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    int chunk_count = (int)(size / _SAOGL_MESH_MIN_CHUNK) + 1;
+    chunk_count = chunk_count < thread_count ? chunk_count : thread_count;
+    chunk_count = chunk_count < _SAOGL_MESH_MAX_THREADS ? chunk_count : _SAOGL_MESH_MAX_THREADS;
+    chunk_count = chunk_count > 0 ? chunk_count : 1;
+
+    // Split at line breaks.
+    _saogl_ObjChunk chunks[_SAOGL_MESH_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    const char* end = text + size;
+    const char* at = text;
+    for (int i=0; i<chunk_count; i++) {
+        const char* chunk_end = i == chunk_count - 1 ? end : text + size / chunk_count * (i + 1);
+        chunk_end = chunk_end < at ? at : chunk_end;
+        const char* newline = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+        chunk_end = newline ? newline + 1 : end;
+        chunks[i].start = at;
+        chunks[i].end = chunk_end;
+        at = chunk_end;
+    }
+
+    _saogl_run_chunks(chunks, chunk_count, _saogl_obj_count);
+
+    uint64_t positions = 0, texcoords = 0, normals = 0, triangles = 0;
+    for (int i=0; i<chunk_count; i++) {
+        chunks[i].first_position = positions;
+        chunks[i].first_texcoord = texcoords;
+        chunks[i].first_normal = normals;
+        chunks[i].first_triangle = triangles;
+        positions += chunks[i].position_count;
+        texcoords += chunks[i].texcoord_count;
+        normals += chunks[i].normal_count;
+        triangles += chunks[i].triangle_count;
+    }
+    if (triangles * 3 >= UINT32_MAX || positions >= UINT32_MAX) {
+        fprintf(stderr, "Error: obj has more than 2^32 corners or positions\n");
+        return false;
+    }
+    // Only matters where size_t is 32 bits, the counts are bounded by the text.
+    if (triangles * 9 + 1 > SIZE_MAX / sizeof(uint32_t) || positions * 3 + 1 > SIZE_MAX / sizeof(float) ||
+        texcoords * 2 + 1 > SIZE_MAX / sizeof(float) || normals * 3 + 1 > SIZE_MAX / sizeof(float)) {
+        fprintf(stderr, "Error: obj is too big to load\n");
+        return false;
+    }
+
+    float* position_data = (float*)SAOGL_MALLOC((positions * 3 + 1) * sizeof(float));
+    float* texcoord_data = (float*)SAOGL_MALLOC((texcoords * 2 + 1) * sizeof(float));
+    float* normal_data = (float*)SAOGL_MALLOC((normals * 3 + 1) * sizeof(float));
+    uint32_t* corners = (uint32_t*)SAOGL_MALLOC((triangles * 9 + 1) * sizeof(uint32_t));
+    bool ok = position_data && texcoord_data && normal_data && corners;
+    if (ok) {
+        for (int i=0; i<chunk_count; i++) {
+            chunks[i].positions = position_data;
+            chunks[i].texcoords = texcoord_data;
+            chunks[i].normals = normal_data;
+            chunks[i].corners = corners;
+            chunks[i].total_positions = positions;
+            chunks[i].total_texcoords = texcoords;
+            chunks[i].total_normals = normals;
+        }
+        _saogl_run_chunks(chunks, chunk_count, _saogl_obj_parse);
+    }
+
+    uint32_t format = 0;
+    for (int i=0; ok && i<chunk_count; i++) {
+        if (chunks[i].failed) {
+            fprintf(stderr, "Error: bad number or face index in obj\n");
+            ok = false;
+        }
+        format |= chunks[i].has_normals ? SAOGL_MESH_NORMALS : 0;
+        format |= chunks[i].has_texcoords ? SAOGL_MESH_TEXCOORDS : 0;
+    }
+
+    // Dedupe corners. The table holds vertex index + 1 and grows at half full, keys are
+    // kept in unique, three per vertex.
+    uint32_t corner_count = (uint32_t)(triangles * 3);
+    uint32_t* indices = ok ? (uint32_t*)SAOGL_MALLOC(((size_t)corner_count + 1) * sizeof(uint32_t)) : NULL;
+    uint32_t* unique = ok ? (uint32_t*)SAOGL_MALLOC(((size_t)corner_count * 3 + 1) * sizeof(uint32_t)) : NULL;
+    uint64_t table_size = 1024;
+    while (table_size < positions * 2) {
+        table_size *= 2;
+    }
+    uint32_t* table = ok ? (uint32_t*)_saogl_calloc(table_size, sizeof(uint32_t)) : NULL;
+    ok = ok && indices && unique && table;
+    uint32_t vertex_count = 0;
+
+    for (uint32_t i=0; ok && i<corner_count; i++) {
+        const uint32_t* corner = corners + 3*i;
+        if ((uint64_t)vertex_count * 2 >= table_size) {
+            uint32_t* grown = (uint32_t*)_saogl_calloc(table_size * 2, sizeof(uint32_t));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            table_size *= 2;
+            for (uint32_t v=0; v<vertex_count; v++) {
+                uint64_t slot = _saogl_corner_hash(unique + 3*v) & (table_size - 1);
+                while (grown[slot]) {
+                    slot = (slot + 1) & (table_size - 1);
+                }
+                grown[slot] = v + 1;
+            }
+            SAOGL_FREE(table);
+            table = grown;
+        }
+
+        uint64_t slot = _saogl_corner_hash(corner) & (table_size - 1);
+        for (;;) {
+            uint32_t entry = table[slot];
+            if (!entry) {
+                memcpy(unique + 3*vertex_count, corner, 3 * sizeof(uint32_t));
+                table[slot] = ++vertex_count;
+                indices[i] = vertex_count - 1;
+                break;
+            }
+            if (memcmp(unique + 3*(entry - 1), corner, 3 * sizeof(uint32_t)) == 0) {
+                indices[i] = entry - 1;
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    uint32_t stride = 3 + ((format & SAOGL_MESH_NORMALS) ? 3 : 0) + ((format & SAOGL_MESH_TEXCOORDS) ? 2 : 0);
+    float* vertices = ok ? (float*)SAOGL_MALLOC(((size_t)vertex_count * stride + 1) * sizeof(float)) : NULL;
+    ok = ok && vertices;
+    for (uint32_t v=0; ok && v<vertex_count; v++) {
+        const uint32_t* corner = unique + 3*v;
+        float* out = vertices + (size_t)v * stride;
+        memcpy(out, position_data + 3 * (size_t)corner[0], 3 * sizeof(float));
+        out += 3;
+        if (format & SAOGL_MESH_NORMALS) {
+            if (corner[2] == _SAOGL_NO_INDEX) {
+                memset(out, 0, 3 * sizeof(float));
+            } else {
+                memcpy(out, normal_data + 3 * (size_t)corner[2], 3 * sizeof(float));
+            }
+            out += 3;
+        }
+        if (format & SAOGL_MESH_TEXCOORDS) {
+            if (corner[1] == _SAOGL_NO_INDEX) {
+                memset(out, 0, 2 * sizeof(float));
+            } else {
+                memcpy(out, texcoord_data + 2 * (size_t)corner[1], 2 * sizeof(float));
+            }
+        }
+    }
+
+    SAOGL_FREE(position_data);
+    SAOGL_FREE(texcoord_data);
+    SAOGL_FREE(normal_data);
+    SAOGL_FREE(corners);
+    SAOGL_FREE(unique);
+    SAOGL_FREE(table);
+    if (!ok) {
+        SAOGL_FREE(indices);
+        SAOGL_FREE(vertices);
+        return false;
+    }
+
+    mesh->format = format;
+    mesh->stride = stride;
+    mesh->vertex_count = vertex_count;
+    mesh->index_count = corner_count;
+    mesh->vertices = vertices;
+    mesh->indices = indices;
+    return true;
+}
+
+bool
+_saogl_load_mesh_binary(saogl_Mesh* mesh, const char* filename, const uint8_t* file, size_t size)
+{
+    _saogl_MeshHeader header;
+    if (size < sizeof(header)) {
+        fprintf(stderr, "Error: %s is too small to be a mesh\n", filename);
+        return false;
+    }
+    memcpy(&header, file, sizeof(header));
+    uint32_t format = header.format;
+    uint32_t stride = 3 + ((format & SAOGL_MESH_NORMALS) ? 3 : 0) + ((format & SAOGL_MESH_TEXCOORDS) ? 2 : 0);
+    if (header.magic != _SAOGL_MESH_MAGIC || header.version != _SAOGL_MESH_VERSION ||
+        (format & ~(SAOGL_MESH_NORMALS | SAOGL_MESH_TEXCOORDS)) || header.stride != stride ||
+        header.index_count % 3) {
+        fprintf(stderr, "Error: %s isn't a version %d mesh or is damaged\n", filename, _SAOGL_MESH_VERSION);
+        return false;
+    }
+
+    // With the stride checked neither can overflow 64 bits, then they have to fit what's left.
+    uint64_t vertex_bytes = (uint64_t)header.vertex_count * stride * sizeof(float);
+    uint64_t index_bytes = (uint64_t)header.index_count * sizeof(uint32_t);
+    size_t left = size - sizeof(header);
+    if (vertex_bytes > left || index_bytes != left - vertex_bytes) {
+        fprintf(stderr, "Error: %s is %zu bytes, the header needs %llu\n", filename, size,
+                (unsigned long long)(sizeof(header) + vertex_bytes + index_bytes));
+        return false;
+    }
+
+    mesh->format = format;
+    mesh->stride = stride;
+    mesh->vertex_count = header.vertex_count;
+    mesh->index_count = header.index_count;
+    mesh->vertices = (float*)SAOGL_MALLOC((size_t)vertex_bytes + 1);
+    mesh->indices = (uint32_t*)SAOGL_MALLOC((size_t)index_bytes + 1);
+    if (!mesh->vertices || !mesh->indices) {
+        saogl_mesh_free(mesh);
+        return false;
+    }
+    memcpy(mesh->vertices, file + sizeof(header), vertex_bytes);
+    memcpy(mesh->indices, file + sizeof(header) + vertex_bytes, index_bytes);
+    for (uint32_t i=0; i<mesh->index_count; i++) {
+        if (mesh->indices[i] >= mesh->vertex_count) {
+            fprintf(stderr, "Error: %s has index %u past its %u vertices\n", filename, mesh->indices[i],
+                    mesh->vertex_count);
+            saogl_mesh_free(mesh);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+saogl_load_mesh(saogl_Mesh* mesh, const char* filename, int thread_count)
+{
+    memset(mesh, 0, sizeof(*mesh));
+    int fd = open(filename, O_RDONLY);
+    struct stat attr;
+    if (fd == -1 || fstat(fd, &attr) == -1) {
+        fprintf(stderr, "Error: couldn't read %s\n", filename);
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    size_t size = attr.st_size;
+    void* file = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (file == MAP_FAILED) {
+        fprintf(stderr, "Error: couldn't map %s\n", filename);
+        return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    if (file) {
+        madvise(file, size, MADV_SEQUENTIAL);
+    }
+#endif
+
+    const char* extension = strrchr(filename, '.');
+    bool ok;
+    if (extension && strcmp(extension, ".mesh") == 0) {
+        ok = _saogl_load_mesh_binary(mesh, filename, (const uint8_t*)file, size);
+    } else {
+        ok = saogl_parse_obj(mesh, (const char*)file, size, thread_count);
+        if (!ok) {
+            fprintf(stderr, "Error: couldn't parse %s\n", filename);
+        }
+    }
+    if (file) {
+        munmap(file, size);
+    }
+    return ok;
+}
+
+bool
+saogl_save_mesh(const saogl_Mesh* mesh, const char* filename)
+{
+    FILE* f = fopen(filename, "wb");
+    if (!f) {
+        fprintf(stderr, "Error: couldn't write %s\n", filename);
+        return false;
+    }
+    _saogl_MeshHeader header = {
+        _SAOGL_MESH_MAGIC, _SAOGL_MESH_VERSION, mesh->format, mesh->stride,
+        mesh->vertex_count, mesh->index_count,
+    };
+    size_t floats = (size_t)mesh->vertex_count * mesh->stride;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(mesh->vertices, sizeof(float), floats, f) == floats &&
+        fwrite(mesh->indices, sizeof(uint32_t), mesh->index_count, f) == mesh->index_count;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: couldn't write %s\n", filename);
+        remove(filename);
+    }
+    return ok;
+}
+
+void
+saogl_mesh_free(saogl_Mesh* mesh)
+{
+    SAOGL_FREE(mesh->vertices);
+    SAOGL_FREE(mesh->indices);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+void
+saogl_mesh_upload(const saogl_Mesh* mesh, uint32_t* vertex_array, uint32_t* vertex_buffer,
+                  uint32_t* index_buffer)
+{
+    glGenVertexArrays(1, vertex_array);
+    glGenBuffers(1, vertex_buffer);
+    glGenBuffers(1, index_buffer);
+    saogl_bind_vertex_array(*vertex_array);
+
+    GLsizei stride = mesh->stride * sizeof(float);
+    saogl_bind_buffer(GL_ARRAY_BUFFER, *vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)mesh->vertex_count * stride, mesh->vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    size_t offset = 3 * sizeof(float);
+    if (mesh->format & SAOGL_MESH_NORMALS) {
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        offset += 3 * sizeof(float);
+    }
+    if (mesh->format & SAOGL_MESH_TEXCOORDS) {
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+    }
+
+    saogl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, *index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)mesh->index_count * sizeof(uint32_t), mesh->indices,
+                 GL_STATIC_DRAW);
+}
+
+// Level of detail.
+typedef float _saogl_f32x4 __attribute__((vector_size(16)));
+typedef int32_t _saogl_i32x4 __attribute__((vector_size(16)));
+
+static inline _saogl_f32x4
+_saogl_sqrt4(_saogl_f32x4 v)
+{
+#if defined(__SSE__)
+    return _mm_sqrt_ps(v);
+#elif defined(__aarch64__)
+    return vsqrtq_f32(v);
+#else
+    for (int i=0; i<4; i++) {
+        v[i] = sqrtf(v[i]);
+    }
+    return v;
+#endif
+}
+
+static inline _saogl_f32x4
+_saogl_max4(_saogl_f32x4 a, _saogl_f32x4 b)
+{
+    _saogl_i32x4 a_bigger = a > b;
+    return (_saogl_f32x4)(((_saogl_i32x4)a & a_bigger) | ((_saogl_i32x4)b & ~a_bigger));
+}
+
+static inline _saogl_f32x4
+_saogl_splat4(float f)
+{
+    return (_saogl_f32x4){f, f, f, f};
+}
+
+// Grows one array to hold capacity things, zeroing the new ones.
+static bool
+_saogl_lod_grow(void** array, size_t element_size, uint32_t old_capacity, uint32_t capacity)
+{
+    void* grown = SAOGL_REALLOC(*array, (size_t)capacity * element_size + 1);
+    if (!grown) {
+        return false;
+    }
+    memset((uint8_t*)grown + (size_t)old_capacity * element_size, 0, (size_t)(capacity - old_capacity) * element_size);
+    *array = grown;
+    return true;
+}
+
+bool
+_saogl_lod_reserve(saogl_Lod* lod, uint32_t capacity)
+{
+    // Round up so the last batch of four can read past count.
+    capacity = (capacity + 3) & ~3u;
+    if (capacity <= lod->capacity && lod->x) {
+        return true;
+    }
+    uint32_t old = lod->capacity;
+    bool ok =
+        _saogl_lod_grow((void**)&lod->x, sizeof(float), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->y, sizeof(float), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->z, sizeof(float), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->radius, sizeof(float), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->model, sizeof(uint16_t), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->level, sizeof(uint8_t), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->indices, sizeof(uint32_t), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->allowed_error, sizeof(float), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->sort, sizeof(saogl_CommandEntry), old, capacity) &&
+        _saogl_lod_grow((void**)&lod->sort_temp, sizeof(saogl_CommandEntry), old, capacity);
+    if (!ok) {
+        // Some arrays may have grown, the smallest capacity is still true for all of them.
+        fprintf(stderr, "Error: out of memory for %u lod objects\n", capacity);
+        return false;
+    }
+    lod->capacity = capacity;
+    return true;
+}
+
+bool
+saogl_lod_init(saogl_Lod* lod, const saogl_LodModel* models, uint32_t model_count, uint32_t capacity)
+{
+    memset(lod, 0, sizeof(*lod));
+    lod->models = models;
+    lod->model_count = model_count;
+    lod->threshold_pixels = 1.0f;
+    lod->hysteresis = 0.1f;
+    lod->list_first = (uint32_t*)_saogl_calloc((size_t)model_count * SAOGL_MAX_LODS + 1, sizeof(uint32_t));
+    lod->list_count = (uint32_t*)_saogl_calloc((size_t)model_count * SAOGL_MAX_LODS + 1, sizeof(uint32_t));
+    if (!lod->list_first || !lod->list_count || !_saogl_lod_reserve(lod, capacity)) {
+        saogl_lod_free(lod);
+        return false;
+    }
+    return true;
+}
+
+bool
+saogl_lod_resize(saogl_Lod* lod, uint32_t count)
+{
+    if (count > lod->capacity) {
+        uint32_t capacity = lod->capacity * 2 > count ? lod->capacity * 2 : count;
+        if (!_saogl_lod_reserve(lod, capacity)) {
+            return false;
+        }
+    }
+    // Objects that were removed and come back start from the finest level again.
+    if (count > lod->count) {
+        memset(lod->level + lod->count, 0, count - lod->count);
+    }
+    lod->count = count;
+    return true;
+}
+
+void
+saogl_lod_free(saogl_Lod* lod)
+{
+    SAOGL_FREE(lod->x);
+    SAOGL_FREE(lod->y);
+    SAOGL_FREE(lod->z);
+    SAOGL_FREE(lod->radius);
+    SAOGL_FREE(lod->model);
+    SAOGL_FREE(lod->level);
+    SAOGL_FREE(lod->indices);
+    SAOGL_FREE(lod->list_first);
+    SAOGL_FREE(lod->list_count);
+    SAOGL_FREE(lod->allowed_error);
+    SAOGL_FREE(lod->sort);
+    SAOGL_FREE(lod->sort_temp);
+    memset(lod, 0, sizeof(*lod));
+}
+
+static inline const saogl_LodModel*
+_saogl_lod_model(const saogl_Lod* lod, uint32_t i)
+{
+    return &lod->models[lod->model[i] < lod->model_count ? lod->model[i] : 0];
+}
+
+void
+saogl_lod_select(saogl_Lod* lod, const float* eye, float field_of_view, float viewport_height,
+                 float near_clip)
+{
+    double start = _saogl_seconds();
+    saogl_LodStats stats = {0};
+    uint32_t count = lod->count;
+
+    // error * projection_scale / distance <= threshold, so each object can have
+    // distance * threshold / projection_scale of world space error.
+    float projection_scale = viewport_height / (2.0f * tanf(field_of_view * 3.14159265f / 360.0f));
+    _saogl_f32x4 per_distance = _saogl_splat4(lod->threshold_pixels / projection_scale);
+    _saogl_f32x4 eye_x = _saogl_splat4(eye[0]);
+    _saogl_f32x4 eye_y = _saogl_splat4(eye[1]);
+    _saogl_f32x4 eye_z = _saogl_splat4(eye[2]);
+    _saogl_f32x4 nearest = _saogl_splat4(near_clip);
+    for (uint32_t i=0; i<count; i+=4) {
+        _saogl_f32x4 x, y, z, radius;
+        memcpy(&x, lod->x + i, sizeof(x));
+        memcpy(&y, lod->y + i, sizeof(y));
+        memcpy(&z, lod->z + i, sizeof(z));
+        memcpy(&radius, lod->radius + i, sizeof(radius));
+        x -= eye_x;
+        y -= eye_y;
+        z -= eye_z;
+        _saogl_f32x4 distance = _saogl_max4(_saogl_sqrt4(x * x + y * y + z * z) - radius, nearest);
+        _saogl_f32x4 allowed = distance * per_distance;
+        memcpy(lod->allowed_error + i, &allowed, sizeof(allowed));
+    }
+
+    float coarser_scale = 1.0f - lod->hysteresis;
+    for (uint32_t i=0; i<count; i++) {
+        const saogl_LodModel* model = _saogl_lod_model(lod, i);
+        uint32_t last = model->level_count ? model->level_count - 1 : 0;
+        float allowed = lod->allowed_error[i];
+        uint32_t level = 0;
+        while (level < last && model->error[level + 1] <= allowed) {
+            level++;
+        }
+        uint32_t previous = lod->level[i] < last ? lod->level[i] : last;
+        if (level > previous) {
+            uint32_t wanted = level;
+            while (level > previous && model->error[level] > allowed * coarser_scale) {
+                level--;
+            }
+            stats.held += level != wanted;
+        }
+        stats.changed += level != lod->level[i];
+        lod->level[i] = (uint8_t)level;
+        stats.triangles += model->triangles[level];
+        stats.full_detail_triangles += model->triangles[0];
+    }
+
+    if (lod->triangle_budget && stats.triangles > lod->triangle_budget) {
+        // Largest allowed error first, floats this size sort like their bits.
+        for (uint32_t i=0; i<count; i++) {
+            uint32_t bits;
+            memcpy(&bits, lod->allowed_error + i, sizeof(bits));
+            lod->sort[i] = (saogl_CommandEntry){~bits, 0, i};
+        }
+        saogl_CommandEntry* order = _saogl_radix_sort(lod->sort, lod->sort_temp, count);
+        // Take each object as coarse as it goes before touching a nearer one.
+        for (uint32_t j=0; j<count && stats.triangles > lod->triangle_budget; j++) {
+            uint32_t i = order[j].offset;
+            const saogl_LodModel* model = _saogl_lod_model(lod, i);
+            uint32_t level = lod->level[i];
+            while (level + 1 < model->level_count && stats.triangles > lod->triangle_budget) {
+                stats.triangles -= model->triangles[level] - model->triangles[level + 1];
+                level++;
+                stats.coarsened++;
+            }
+            lod->level[i] = (uint8_t)level;
+        }
+    }
+
+    uint32_t list_total = lod->model_count * SAOGL_MAX_LODS;
+    memset(lod->list_count, 0, list_total * sizeof(uint32_t));
+    for (uint32_t i=0; i<count; i++) {
+        uint32_t model = lod->model[i] < lod->model_count ? lod->model[i] : 0;
+        lod->list_count[model * SAOGL_MAX_LODS + lod->level[i]]++;
+    }
+    uint32_t first = 0;
+    for (uint32_t list=0; list<list_total; list++) {
+        lod->list_first[list] = first;
+        first += lod->list_count[list];
+        lod->list_count[list] = 0;
+    }
+    for (uint32_t i=0; i<count; i++) {
+        uint32_t model = lod->model[i] < lod->model_count ? lod->model[i] : 0;
+        uint32_t list = model * SAOGL_MAX_LODS + lod->level[i];
+        lod->indices[lod->list_first[list] + lod->list_count[list]++] = i;
+    }
+
+    stats.seconds = _saogl_seconds() - start;
+    lod->last_select = stats;
+}
+
+// Shader hot reload.
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} _saogl_Text;
+
+static bool
+_saogl_text_append(_saogl_Text* text, const char* s, size_t size)
+{
+    if (text->size + size + 1 > text->capacity) {
+        size_t capacity = text->capacity ? text->capacity * 2 : 4096;
+        while (capacity < text->size + size + 1) {
+            capacity *= 2;
+        }
+        char* data = (char*)SAOGL_REALLOC(text->data, capacity);
+        if (!data) {
+            return false;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->size, s, size);
+    text->size += size;
+    text->data[text->size] = '\0';
+    return true;
+}
+
+// Every file either stage used, numbered the way #line numbers them. stages says which stage
+// last included each one.
+typedef struct {
+    char** paths;
+    uint8_t* stages;
+    uint32_t count;
+    uint32_t capacity;
+    uint8_t stage;
+} _saogl_Preprocessor;
+
+static char*
+_saogl_read_text_file(const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat attr;
+    if (fd == -1 || fstat(fd, &attr) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return NULL;
+    }
+    char* text = (char*)SAOGL_MALLOC(attr.st_size + 1);
+    size_t size = 0;
+    while (text && size < (size_t)attr.st_size) {
+        ssize_t got = read(fd, text + size, attr.st_size - size);
+        if (got <= 0) {
+            break;
+        }
+        size += got;
+    }
+    close(fd);
+    if (text) {
+        text[size] = '\0';
+    }
+    return text;
+}
+
+static int
+_saogl_preprocessor_file(_saogl_Preprocessor* pp, const char* path)
+{
+    for (uint32_t i=0; i<pp->count; i++) {
+        if (strcmp(pp->paths[i], path) == 0) {
+            return i;
+        }
+    }
+    if (pp->count == pp->capacity) {
+        uint32_t capacity = pp->capacity ? pp->capacity * 2 : 8;
+        char** paths = (char**)SAOGL_REALLOC(pp->paths, capacity * sizeof(char*));
+        if (paths) {
+            pp->paths = paths;
+        }
+        uint8_t* stages = (uint8_t*)SAOGL_REALLOC(pp->stages, capacity);
+        if (stages) {
+            pp->stages = stages;
+        }
+        if (!paths || !stages) {
+            return -1;
+        }
+        pp->capacity = capacity;
+    }
+    pp->paths[pp->count] = _saogl_strdup(path);
+    if (!pp->paths[pp->count]) {
+        return -1;
+    }
+    pp->stages[pp->count] = 0;
+    return pp->count++;
+}
+
+static bool
+_saogl_has_version(const char* source)
+{
+    for (const char* line = source; line; line = strchr(line, '\n'), line = line ? line + 1 : NULL) {
+        const char* c = line + strspn(line, " \t");
+        if (*c == '#' && strncmp(c + 1 + strspn(c + 1, " \t"), "version", 7) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+_saogl_preprocess_file(_saogl_Preprocessor* pp, _saogl_Text* out, const char* path, bool included)
+{
+    int number = _saogl_preprocessor_file(pp, path);
+    if (number < 0) {
+        return false;
+    }
+    if (pp->stages[number] == pp->stage) {
+        return true;
+    }
+    pp->stages[number] = pp->stage;
+
+    char* source = _saogl_read_text_file(path);
+    if (!source) {
+        fprintf(stderr, "Error: couldn't read shader file %s\n", path);
+        return false;
+    }
+    // Included files are numbered from their first line. #version has to come first, so a
+    // stage's own file is numbered from the line after it, or from the top if there isn't one.
+    char directive[32];
+    bool ok = true;
+    bool numbered = false;
+    if (included || !_saogl_has_version(source)) {
+        snprintf(directive, sizeof(directive), "#line 1 %d\n", number);
+        ok = _saogl_text_append(out, directive, strlen(directive));
+        numbered = true;
+    }
+
+    const char* slash = strrchr(path, '/');
+    int directory_length = slash ? (int)(slash - path + 1) : 0;
+    int line_number = 1;
+    for (const char* line = source; *line; line_number++) {
+        const char* end = strchr(line, '\n');
+        const char* next = end ? end + 1 : line + strlen(line);
+
+        const char* c = line;
+        while (*c == ' ' || *c == '\t') {
+            c++;
+        }
+        bool is_include = false;
+        bool is_version = false;
+        if (*c == '#') {
+            c++;
+            while (*c == ' ' || *c == '\t') {
+                c++;
+            }
+            is_include = strncmp(c, "include", 7) == 0;
+            is_version = strncmp(c, "version", 7) == 0;
+        }
+        if (is_include) {
+            const char* name = strchr(c, '"');
+            const char* name_end = name && name < next ? strchr(name + 1, '"') : NULL;
+            if (!name_end || name_end >= next) {
+                fprintf(stderr, "Error: %s:%d: expected #include \"file\"\n", path, line_number);
+                ok = false;
+            } else {
+                name++;
+                // Relative to the including file unless it's absolute.
+                int prefix = name[0] == '/' ? 0 : directory_length;
+                int name_length = (int)(name_end - name);
+                char* include_path = (char*)SAOGL_MALLOC(prefix + name_length + 1);
+                if (include_path) {
+                    memcpy(include_path, path, prefix);
+                    memcpy(include_path + prefix, name, name_length);
+                    include_path[prefix + name_length] = '\0';
+                    if (!_saogl_preprocess_file(pp, out, include_path, true)) {
+                        fprintf(stderr, "  included from %s:%d\n", path, line_number);
+                        ok = false;
+                    }
+                    SAOGL_FREE(include_path);
+                } else {
+                    ok = false;
+                }
+                snprintf(directive, sizeof(directive), "#line %d %d\n", line_number + 1, number);
+                ok &= _saogl_text_append(out, directive, strlen(directive));
+            }
+        } else {
+            ok &= _saogl_text_append(out, line, next - line);
+            if (!end) {
+                ok &= _saogl_text_append(out, "\n", 1);
+            }
+            if (is_version && !numbered) {
+                snprintf(directive, sizeof(directive), "#line %d %d\n", line_number + 1, number);
+                ok &= _saogl_text_append(out, directive, strlen(directive));
+                numbered = true;
+            }
+        }
+        line = next;
+    }
+    SAOGL_FREE(source);
+    return ok;
+}
+
+static char*
+_saogl_preprocess(_saogl_Preprocessor* pp, const char* path)
+{
+    _saogl_Text text = {0};
+    pp->stage++;
+    bool ok = _saogl_preprocess_file(pp, &text, path, false);
+    if (!ok || !text.data) {
+        SAOGL_FREE(text.data);
+        return NULL;
+    }
+    return text.data;
+}
+
+static int64_t
+_saogl_modified(const char* path)
+{
+    struct stat attr;
+    if (stat(path, &attr) == -1) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return attr.st_mtimespec.tv_sec * 1000000000ll + attr.st_mtimespec.tv_nsec;
+#else
+    return attr.st_mtim.tv_sec * 1000000000ll + attr.st_mtim.tv_nsec;
+#endif
+}
+
+// Index into watch->files, adds and watches it if it's new. Under the mutex.
+static int
+_saogl_shader_watch_file(saogl_ShaderWatch* watch, const char* path)
+{
+    for (uint32_t i=0; i<watch->file_count; i++) {
+        if (strcmp(watch->files[i].path, path) == 0) {
+            return i;
+        }
+    }
+    if (watch->file_count == watch->file_capacity) {
+        uint32_t capacity = watch->file_capacity ? watch->file_capacity * 2 : 64;
+        saogl_ShaderFile* files = (saogl_ShaderFile*)SAOGL_REALLOC(watch->files, capacity * sizeof(saogl_ShaderFile));
+        if (!files) {
+            return -1;
+        }
+        watch->files = files;
+        watch->file_capacity = capacity;
+    }
+    saogl_ShaderFile* file = watch->files + watch->file_count;
+    file->path = _saogl_strdup(path);
+    if (!file->path) {
+        return -1;
+    }
+    const char* slash = strrchr(file->path, '/');
+    file->name = slash ? slash + 1 : file->path;
+    file->watch = -1;
+    file->modified = _saogl_modified(path);
+
+#ifdef __linux__
+    if (watch->notify != -1) {
+        // Watch the directory, editors often save by writing a new file and renaming it over
+        // the old one. Adding the same directory again gives back the same watch.
+        char directory[4096] = ".";
+        if (slash == file->path) {
+            strcpy(directory, "/");
+        } else if (slash) {
+            snprintf(directory, sizeof(directory), "%.*s", (int)(slash - file->path), file->path);
+        }
+        file->watch = inotify_add_watch(watch->notify, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (file->watch == -1) {
+            fprintf(stderr, "Warning: can't watch %s for shader changes\n", directory);
+        }
+    }
+#endif
+    return watch->file_count++;
+}
+
+// Reads and preprocesses a program, records its files and queues it for update.
+static void
+_saogl_shader_watch_build(saogl_ShaderWatch* watch, uint32_t index, const char* vertex_filename,
+                          const char* fragment_filename, double seen)
+{
+    _saogl_Preprocessor pp = {0};
+    char* vertex_src = _saogl_preprocess(&pp, vertex_filename);
+    char* fragment_src = _saogl_preprocess(&pp, fragment_filename);
+
+    // Without the list errors just don't say which file is which.
+    _saogl_Text file_list = {0};
+    bool listed = true;
+    for (uint32_t i=0; i<pp.count; i++) {
+        char number[16];
+        snprintf(number, sizeof(number), "  %u ", i);
+        listed &= _saogl_text_append(&file_list, number, strlen(number));
+        listed &= _saogl_text_append(&file_list, pp.paths[i], strlen(pp.paths[i]));
+        listed &= _saogl_text_append(&file_list, "\n", 1);
+    }
+    if (!listed) {
+        SAOGL_FREE(file_list.data);
+        file_list.data = NULL;
+    }
+
+    pthread_mutex_lock(&watch->mutex);
+    saogl_WatchedProgram* program = watch->programs + index;
+    uint32_t* files = (uint32_t*)SAOGL_REALLOC(program->files, (pp.count ? pp.count : 1) * sizeof(uint32_t));
+    if (files) {
+        program->files = files;
+        program->file_count = 0;
+        for (uint32_t i=0; i<pp.count; i++) {
+            int file = _saogl_shader_watch_file(watch, pp.paths[i]);
+            if (file >= 0) {
+                files[program->file_count++] = file;
+            }
+        }
+    }
+
+    // Nothing to compile if a file couldn't be read, it's watched and comes back when fixed.
+    bool queued = false;
+    if (vertex_src && fragment_src) {
+        if (watch->job_count == watch->job_capacity) {
+            uint32_t capacity = watch->job_capacity ? watch->job_capacity * 2 : 64;
+            saogl_ShaderJob* jobs = (saogl_ShaderJob*)SAOGL_REALLOC(watch->jobs, capacity * sizeof(saogl_ShaderJob));
+            if (jobs) {
+                watch->jobs = jobs;
+                watch->job_capacity = capacity;
+            }
+        }
+        if (watch->job_count < watch->job_capacity) {
+            saogl_ShaderJob* job = watch->jobs + watch->job_count++;
+            job->program = index;
+            job->vertex_src = vertex_src;
+            job->fragment_src = fragment_src;
+            job->file_list = file_list.data;
+            job->seen = seen;
+            queued = true;
+        }
+    }
+    pthread_mutex_unlock(&watch->mutex);
+
+    if (!queued) {
+        SAOGL_FREE(vertex_src);
+        SAOGL_FREE(fragment_src);
+        SAOGL_FREE(file_list.data);
+    }
+    for (uint32_t i=0; i<pp.count; i++) {
+        SAOGL_FREE(pp.paths[i]);
+    }
+    SAOGL_FREE(pp.paths);
+    SAOGL_FREE(pp.stages);
+}
+
+// Marks every program built from file dirty. Under the mutex.
+static void
+_saogl_shader_watch_changed(saogl_ShaderWatch* watch, uint32_t file)
+{
+    watch->stats.changes++;
+    for (uint32_t i=0; i<watch->program_count; i++) {
+        saogl_WatchedProgram* program = watch->programs + i;
+        for (uint32_t j=0; j<program->file_count; j++) {
+            if (program->files[j] == file) {
+                program->dirty = true;
+                break;
+            }
+        }
+    }
+}
+
+static void*
+_saogl_shader_watch_thread(void* data)
+{
+    saogl_ShaderWatch* watch = (saogl_ShaderWatch*)data;
+    while (!atomic_load(&watch->quit)) {
+#ifdef __linux__
+        if (watch->notify != -1) {
+            struct pollfd fd = {watch->notify, POLLIN, 0};
+            if (poll(&fd, 1, watch->poll_ms) <= 0) {
+                continue;
+            }
+            char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t size;
+            pthread_mutex_lock(&watch->mutex);
+            while ((size = read(watch->notify, buffer, sizeof(buffer))) > 0) {
+                for (char* at = buffer; at < buffer + size;) {
+                    struct inotify_event* event = (struct inotify_event*)at;
+                    for (uint32_t i=0; event->len && i<watch->file_count; i++) {
+                        saogl_ShaderFile* file = watch->files + i;
+                        if (file->watch == event->wd && strcmp(file->name, event->name) == 0) {
+                            _saogl_shader_watch_changed(watch, i);
+                        }
+                    }
+                    at += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            pthread_mutex_unlock(&watch->mutex);
+        } else
+#endif
+        {
+            struct timespec wait = {watch->poll_ms / 1000, (watch->poll_ms % 1000) * 1000000l};
+            nanosleep(&wait, NULL);
+            pthread_mutex_lock(&watch->mutex);
+            for (uint32_t i=0; i<watch->file_count; i++) {
+                saogl_ShaderFile* file = watch->files + i;
+                int64_t modified = _saogl_modified(file->path);
+                if (modified != file->modified) {
+                    file->modified = modified;
+                    _saogl_shader_watch_changed(watch, i);
+                }
+            }
+            pthread_mutex_unlock(&watch->mutex);
+        }
+
+        // Rebuild without holding the mutex, the filenames never move or change.
+        double seen = _saogl_seconds();
+        for (uint32_t i=0;; i++) {
+            pthread_mutex_lock(&watch->mutex);
+            while (i < watch->program_count && !watch->programs[i].dirty) {
+                i++;
+            }
+            if (i == watch->program_count) {
+                pthread_mutex_unlock(&watch->mutex);
+                break;
+            }
+            saogl_WatchedProgram* program = watch->programs + i;
+            program->dirty = false;
+            const char* vertex_filename = program->vertex_filename;
+            const char* fragment_filename = program->fragment_filename;
+            pthread_mutex_unlock(&watch->mutex);
+            _saogl_shader_watch_build(watch, i, vertex_filename, fragment_filename, seen);
+        }
+    }
+    return NULL;
+}
+
+bool
+saogl_shader_watch_init(saogl_ShaderWatch* watch)
+{
+    memset(watch, 0, sizeof(*watch));
+    watch->notify = -1;
+    watch->poll_ms = 100;
+#ifdef __linux__
+    watch->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->notify == -1) {
+        fprintf(stderr, "Warning: no inotify, polling shader files\n");
+    }
+#endif
+    saogl_shader_batch_init(&watch->batch);
+    pthread_mutex_init(&watch->mutex, NULL);
+    atomic_init(&watch->quit, false);
+    if (pthread_create(&watch->thread, NULL, _saogl_shader_watch_thread, watch) != 0) {
+        fprintf(stderr, "Error: couldn't start the shader watch thread\n");
+        pthread_mutex_destroy(&watch->mutex);
+        if (watch->notify != -1) {
+            close(watch->notify);
+        }
+        saogl_shader_batch_free(&watch->batch);
+        memset(watch, 0, sizeof(*watch));
+        watch->notify = -1;
+        return false;
+    }
+    watch->started = true;
+    return true;
+}
+
+void
+saogl_shader_watch_free(saogl_ShaderWatch* watch)
+{
+    // After a failed init there's nothing to stop.
+    if (!watch->started) {
+        return;
+    }
+    atomic_store(&watch->quit, true);
+    pthread_join(watch->thread, NULL);
+    if (watch->notify != -1) {
+        close(watch->notify);
+    }
+    pthread_mutex_destroy(&watch->mutex);
+
+    for (uint32_t i=0; i<watch->job_count; i++) {
+        SAOGL_FREE(watch->jobs[i].vertex_src);
+        SAOGL_FREE(watch->jobs[i].fragment_src);
+        SAOGL_FREE(watch->jobs[i].file_list);
+    }
+    for (uint32_t i=0; i<watch->batch.count; i++) {
+        saogl_ShaderBatchProgram* build = watch->batch.programs + i;
+        if (build->status == SAOGL_SHADER_PENDING) {
+            glDeleteShader(build->vert_shader);
+            glDeleteShader(build->frag_shader);
+            glDeleteProgram(build->program);
+        }
+        if (watch->builds[i].program != UINT32_MAX) {
+            if (build->status == SAOGL_SHADER_READY) {
+                glDeleteProgram(build->program);
+            }
+            SAOGL_FREE(watch->builds[i].file_list);
+        }
+    }
+    for (uint32_t i=0; i<watch->program_count; i++) {
+        saogl_WatchedProgram* program = watch->programs + i;
+        if (program->program) {
+            glDeleteProgram(program->program);
+        }
+        SAOGL_FREE(program->vertex_filename);
+        SAOGL_FREE(program->fragment_filename);
+        SAOGL_FREE(program->files);
+    }
+    for (uint32_t i=0; i<watch->file_count; i++) {
+        SAOGL_FREE(watch->files[i].path);
+    }
+    saogl_shader_batch_free(&watch->batch);
+    SAOGL_FREE(watch->programs);
+    SAOGL_FREE(watch->files);
+    SAOGL_FREE(watch->jobs);
+    SAOGL_FREE(watch->builds);
+    memset(watch, 0, sizeof(*watch));
+    watch->notify = -1;
+}
+
+int
+saogl_shader_watch_add(saogl_ShaderWatch* watch, const char* vertex_filename, const char* fragment_filename)
+{
+    char* vertex_copy = _saogl_strdup(vertex_filename);
+    char* fragment_copy = _saogl_strdup(fragment_filename);
+    if (!vertex_copy || !fragment_copy) {
+        SAOGL_FREE(vertex_copy);
+        SAOGL_FREE(fragment_copy);
+        return -1;
+    }
+
+    pthread_mutex_lock(&watch->mutex);
+    if (watch->program_count == watch->program_capacity) {
+        uint32_t capacity = watch->program_capacity ? watch->program_capacity * 2 : 64;
+        saogl_WatchedProgram* programs = (saogl_WatchedProgram*)SAOGL_REALLOC(watch->programs,
+                                                                             capacity * sizeof(saogl_WatchedProgram));
+        if (!programs) {
+            pthread_mutex_unlock(&watch->mutex);
+            SAOGL_FREE(vertex_copy);
+            SAOGL_FREE(fragment_copy);
+            return -1;
+        }
+        watch->programs = programs;
+        watch->program_capacity = capacity;
+    }
+    uint32_t index = watch->program_count++;
+    saogl_WatchedProgram* program = watch->programs + index;
+    memset(program, 0, sizeof(*program));
+    program->vertex_filename = vertex_copy;
+    program->fragment_filename = fragment_copy;
+    pthread_mutex_unlock(&watch->mutex);
+
+    _saogl_shader_watch_build(watch, index, vertex_copy, fragment_copy, _saogl_seconds());
+    return index;
+}
+
+bool
+saogl_shader_watch_update(saogl_ShaderWatch* watch)
+{
+    // Skip a frame rather than wait while the thread holds the mutex.
+    bool queued = true;
+    if (pthread_mutex_trylock(&watch->mutex) == 0) {
+        if (watch->batch.count + watch->job_count > watch->build_capacity) {
+            uint32_t capacity = watch->build_capacity ? watch->build_capacity : 64;
+            while (capacity < watch->batch.count + watch->job_count) {
+                capacity *= 2;
+            }
+            saogl_ShaderJob* builds = (saogl_ShaderJob*)SAOGL_REALLOC(watch->builds, capacity * sizeof(saogl_ShaderJob));
+            if (builds) {
+                watch->builds = builds;
+                watch->build_capacity = capacity;
+            }
+        }
+        // Without parallel compile poll waits for every build, so start one a frame.
+        uint32_t limit = watch->batch.parallel ? watch->job_count : SAOGL_WATCH_SERIAL_BUILDS;
+        uint32_t started = 0;
+        for (; started < watch->job_count && started < limit && watch->batch.count < watch->build_capacity;
+             started++) {
+            saogl_ShaderJob* job = watch->jobs + started;
+            saogl_WatchedProgram* program = watch->programs + job->program;
+            int index = saogl_shader_batch_add(&watch->batch, program->vertex_filename,
+                                               job->vertex_src, job->fragment_src);
+            SAOGL_FREE(job->vertex_src);
+            SAOGL_FREE(job->fragment_src);
+            job->vertex_src = NULL;
+            job->fragment_src = NULL;
+            watch->builds[index] = *job;
+            program->building = index + 1;
+        }
+        watch->job_count -= started;
+        memmove(watch->jobs, watch->jobs + started, watch->job_count * sizeof(saogl_ShaderJob));
+        queued = watch->job_count != 0;
+        pthread_mutex_unlock(&watch->mutex);
+    }
+
+    saogl_shader_batch_poll(&watch->batch);
+    for (uint32_t i=0; i<watch->batch.count; i++) {
+        saogl_ShaderBatchProgram* build = watch->batch.programs + i;
+        saogl_ShaderJob* job = watch->builds + i;
+        if (job->program == UINT32_MAX || build->status == SAOGL_SHADER_PENDING) {
+            continue;
+        }
+        saogl_WatchedProgram* program = watch->programs + job->program;
+        if (program->building != i + 1) {
+            // A newer edit is already building.
+            if (build->status == SAOGL_SHADER_READY) {
+                glDeleteProgram(build->program);
+            }
+            watch->stats.superseded++;
+        } else {
+            program->building = 0;
+            if (build->status == SAOGL_SHADER_READY) {
+                if (program->program) {
+                    glDeleteProgram(program->program);
+                }
+                program->program = build->program;
+                program->version++;
+                watch->stats.swapped++;
+                watch->stats.last_seconds = _saogl_seconds() - job->seen;
+                if (watch->stats.last_seconds > watch->stats.max_seconds) {
+                    watch->stats.max_seconds = watch->stats.last_seconds;
+                }
+            } else {
+                fprintf(stderr, "%s the old program stays. Files:\n%s",
+                        program->program ? "Shader reload failed," : "Shader build failed,",
+                        job->file_list ? job->file_list : "");
+                watch->stats.failed++;
+            }
+        }
+        SAOGL_FREE(job->file_list);
+        job->file_list = NULL;
+        job->program = UINT32_MAX;
+    }
+
+    if (watch->batch.pending_count == 0) {
+        watch->batch.count = 0;
+        watch->batch.ready_count = 0;
+        watch->batch.failed_count = 0;
+    }
+    return !queued && watch->batch.count == 0;
+}
+
+void
+saogl_shader_watch_print_stats(saogl_ShaderWatch* watch)
+{
+    fprintf(stderr, "Shader watch: %u programs, %u files, %s, %u changes, %u swapped in, %u failed, "
+            "%u superseded, last %.2f ms, max %.2f ms\n",
+            watch->program_count, watch->file_count, watch->notify != -1 ? "inotify" : "polling",
+            watch->stats.changes, watch->stats.swapped, watch->stats.failed, watch->stats.superseded,
+            watch->stats.last_seconds * 1000.0, watch->stats.max_seconds * 1000.0);
 }
 #endif
@@ -0,0 +1,188 @@
+#define SAO_GAMEGUY_AUDIO_IMPLEMENTATION
+#include "sao_gameguy.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#define RATE 48000
+#define FRAMES 256
+
+static ggAudio audio;
+static ggGameAudio game;
+static float ramp[1000];
+static float out[2 * FRAMES];
+
+static bool
+near(float a, float b)
+{
+    return fabsf(a - b) < 1e-5f;
+}
+
+void
+setup()
+{
+    gg_audio_mixer_init(&audio, &game, RATE, FRAMES);
+    for (int i=0; i<1000; i++) {
+        ramp[i] = i * 0.0005f;
+    }
+}
+
+void
+test_rate()
+{
+    setup();
+    ggSound sound = {ramp, 1000, 1, RATE};
+    float center = cosf(0.78539816f);
+
+    // Rate 1 is the sound as is, both sides at constant power.
+    game.frame_sample = 100;
+    gg_audio_play(&game, &sound, 0, 1, 0, 1, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<FRAMES; i++) {
+        float expected = i < 100 ? 0 : ramp[i - 100] * center;
+        assert(near(out[2*i], expected) && near(out[2*i + 1], expected));
+    }
+    assert(audio.voice_count == 1);
+
+    // Half rate reads every source frame twice, interpolating in between.
+    setup();
+    game.frame_sample = 0;
+    gg_audio_play(&game, &sound, 0, 1, 0, 0.5f, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<FRAMES; i++) {
+        assert(near(out[2*i], i * 0.5f * 0.0005f * center));
+    }
+
+    // Half the source rate at rate 1 is the same.
+    setup();
+    ggSound slow = {ramp, 1000, 1, RATE / 2};
+    gg_audio_play(&game, &slow, 0, 1, 0, 1, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<FRAMES; i++) {
+        assert(near(out[2*i + 1], i * 0.5f * 0.0005f * center));
+    }
+}
+
+void
+test_pan_gain()
+{
+    setup();
+    ggSound sound = {ramp, 1000, 1, RATE};
+    gg_audio_play(&game, &sound, 0, 0.5f, -1, 1, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<FRAMES; i++) {
+        assert(near(out[2*i], ramp[i] * 0.5f) && near(out[2*i + 1], 0));
+    }
+
+    setup();
+    gg_audio_play(&game, &sound, 0, 2, 1, 1, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<FRAMES; i++) {
+        assert(near(out[2*i], 0) && near(out[2*i + 1], ramp[i] * 2));
+    }
+
+    // Stereo sounds keep their sides, and the sum is clipped.
+    setup();
+    float stereo[8] = {0.25f, -0.25f, 0.5f, -0.5f, 0.75f, -0.75f, 1, -1};
+    ggSound both = {stereo, 4, 2, RATE};
+    uint32_t voice = gg_audio_play(&game, &both, 0, 2, 0, 1, 0);
+    assert(voice);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    float center = 2 * cosf(0.78539816f);
+    for (int i=0; i<4; i++) {
+        float left = fminf(stereo[2*i] * center, 1);
+        assert(near(out[2*i], left) && near(out[2*i + 1], -left));
+    }
+    assert(out[8] == 0 && audio.voice_count == 0);
+}
+
+void
+test_schedule()
+{
+    setup();
+    ggSound sound = {ramp, 1000, 1, RATE};
+
+    // A start in the next buffer is held until then and lands on its sample.
+    game.frame_sample = FRAMES + 44;
+    uint32_t voice = gg_audio_play(&game, &sound, 0, 1, -1, 1, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<2 * FRAMES; i++) {
+        assert(out[i] == 0);
+    }
+    assert(audio.voice_count == 0 && audio.pending_count == 1);
+
+    // Quieter from 100 in, stopped at 200.
+    game.frame_sample = FRAMES + 100;
+    gg_audio_set(&game, voice, 0, 0.5f, -1, 1);
+    game.frame_sample = FRAMES + 200;
+    gg_audio_stop(&game, voice, 0);
+    gg_audio_mix(&audio, out, FRAMES, FRAMES);
+    for (int i=0; i<FRAMES; i++) {
+        float expected = i < 44 ? 0 : i < 100 ? ramp[i - 44] : i < 200 ? ramp[i - 44] * 0.5f : 0;
+        assert(near(out[2*i], expected) && out[2*i + 1] == 0);
+    }
+    assert(audio.voice_count == 0 && audio.pending_count == 0);
+
+    // Late commands start at the beginning of the buffer and are counted.
+    game.frame_sample = 0;
+    gg_audio_play(&game, &sound, 0, 1, -1, 1, 0);
+    gg_audio_mix(&audio, out, FRAMES, 2 * FRAMES);
+    assert(near(out[2], ramp[1]) && game.late_commands == 1);
+}
+
+void
+test_loop()
+{
+    setup();
+    ggSound sound = {ramp, 10, 1, RATE};
+    game.frame_sample = 0;
+    uint32_t voice = gg_audio_play(&game, &sound, 0, 1, -1, 1, GG_AUDIO_LOOP);
+    game.frame_sample = 50;
+    gg_audio_stop(&game, voice, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<FRAMES; i++) {
+        assert(near(out[2*i], i < 50 ? ramp[i % 10] : 0));
+    }
+
+    // Resampled loops interpolate across the loop point.
+    setup();
+    gg_audio_play(&game, &sound, 0, 1, -1, 0.5f, GG_AUDIO_LOOP);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    assert(near(out[2*19], ramp[9] * 0.5f));
+    assert(near(out[2*20], 0) && near(out[2*21], ramp[0] * 0.5f + ramp[1] * 0.5f));
+    assert(audio.voice_count == 1);
+}
+
+void
+test_bad_rate()
+{
+    // Negative and nan rates hold the voice silent where it is until it's set again.
+    setup();
+    ggSound sound = {ramp, 1000, 1, RATE};
+    game.frame_sample = 0;
+    uint32_t voice = gg_audio_play(&game, &sound, 0, 1, -1, -1, 0);
+    gg_audio_play(&game, &sound, 0, 1, -1, NAN, 0);
+    gg_audio_mix(&audio, out, FRAMES, 0);
+    for (int i=0; i<2 * FRAMES; i++) {
+        assert(out[i] == 0);
+    }
+    assert(audio.voice_count == 2);
+
+    game.frame_sample = FRAMES;
+    gg_audio_set(&game, voice, 0, 1, -1, 1);
+    gg_audio_mix(&audio, out, FRAMES, FRAMES);
+    for (int i=0; i<FRAMES; i++) {
+        assert(near(out[2*i], ramp[i]));
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    test_rate();
+    test_pan_gain();
+    test_schedule();
+    test_loop();
+    test_bad_rate();
+    printf("Audio tests passed.\n");
+}
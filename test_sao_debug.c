@@ -0,0 +1,176 @@
+#define SAO_GAMEGUY_DEBUG_IMPLEMENTATION
+#define GG_DEBUG_TABLE table
+#include "sao_gameguy.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#define FRAME_SECONDS (1.0 / 60)
+#define FRAME_EVENTS 10000
+
+static ggDebugCollator* collator;
+static ggDebugTable* table;
+
+void
+setup(bool recording)
+{
+    if (collator) {
+        gg_debug_free(collator);
+    }
+    collator = (ggDebugCollator*)gg_alloc(GG_TAG_DEBUG, sizeof(ggDebugCollator));
+    gg_debug_init(collator, recording, false);
+    table = &collator->table;
+}
+
+ggDebugBlockStats*
+find_block(const char* name)
+{
+    ggDebugFrameStats* frame = &table->last_frame;
+    for (uint32_t i=0; i<frame->block_count; i++) {
+        if (strcmp(frame->blocks[i].name, name) == 0) {
+            return &frame->blocks[i];
+        }
+    }
+    return NULL;
+}
+
+void
+test_collate()
+{
+    setup(true);
+    for (int i=0; i<3; i++) {
+        TIMED_BLOCK("outer");
+        for (int j=0; j<2; j++) {
+            TIMED_BLOCK("inner");
+        }
+    }
+    gg_debug_collate(collator);
+    assert(find_block("outer")->hit_count == 3);
+    assert(find_block("inner")->hit_count == 6);
+    assert(find_block("outer")->total_cycles >= find_block("inner")->total_cycles);
+    assert(collator->frames_collated == 1);
+    assert(collator->depths[0] == 0);
+}
+
+void
+test_toggle()
+{
+    // Off, nothing is recorded and frames aren't counted.
+    setup(false);
+    {
+        TIMED_BLOCK("block");
+    }
+    gg_debug_collate(collator);
+    assert(atomic_load(&table->ring_count) == 0);
+    assert(table->last_frame.block_count == 0 && collator->frames_collated == 0);
+
+    // Switched on at runtime it collates from the next frame.
+    atomic_store(&table->recording, true);
+    {
+        TIMED_BLOCK("block");
+    }
+    gg_debug_collate(collator);
+    assert(find_block("block")->hit_count == 1);
+    assert(collator->frames_collated == 1);
+
+    // Events from before it was switched off are still collated, then it stops.
+    {
+        TIMED_BLOCK("block");
+    }
+    atomic_store(&table->recording, false);
+    gg_debug_collate(collator);
+    assert(find_block("block")->hit_count == 1);
+    gg_debug_collate(collator);
+    assert(table->last_frame.block_count == 0);
+    assert(collator->frames_collated == 2 && collator->totals[0].hit_count == 2);
+}
+
+void
+test_unmatched()
+{
+    // An end that never comes doesn't keep the blocks around it from matching.
+    setup(true);
+    for (int i=0; i<2 * GG_DEBUG_MAX_DEPTH; i++) {
+        BEGIN_TIMED_BLOCK("frame");
+        BEGIN_TIMED_BLOCK("lost");
+        END_TIMED_BLOCK("frame");
+    }
+    gg_debug_collate(collator);
+    assert(find_block("frame")->hit_count == 2 * GG_DEBUG_MAX_DEPTH);
+    assert(collator->name_count == 2 && collator->totals[1].hit_count == 0);
+    assert(collator->depths[0] == 0);
+
+    // A begin left open when recording stops is forgotten.
+    BEGIN_TIMED_BLOCK("frame");
+    atomic_store(&table->recording, false);
+    gg_debug_collate(collator);
+    assert(collator->depths[0] == 0);
+
+    // Same once the ring overflows.
+    atomic_store(&table->recording, true);
+    for (int i=0; i<GG_DEBUG_RING_SIZE / 2 + 1; i++) {
+        BEGIN_TIMED_BLOCK("frame");
+        BEGIN_TIMED_BLOCK("overflow");
+    }
+    assert(atomic_load(&table->rings[0].dropped) == 2);
+    gg_debug_collate(collator);
+    assert(collator->depths[0] == 0);
+    {
+        TIMED_BLOCK("frame");
+    }
+    gg_debug_collate(collator);
+    assert(find_block("frame")->hit_count == 1);
+}
+
+double
+time_frame(bool recording)
+{
+    atomic_store(&table->recording, recording);
+    uint64_t start = _gg_debug_nanoseconds();
+    for (int i=0; i<FRAME_EVENTS / 2; i++) {
+        TIMED_BLOCK("block");
+    }
+    gg_debug_collate(collator);
+    return (_gg_debug_nanoseconds() - start) * 1e-9;
+}
+
+void
+test_overhead()
+{
+    // 10k events a frame, recorded and collated, should stay under 2% of a 60hz frame and
+    // cost next to nothing when recording is off. Best of a few frames to skip the noise.
+    // Virtual machines can trap the cycle counter, so reading it is timed on its own and
+    // left out of the budget, it's the one cost that doesn't depend on this code.
+    setup(true);
+    time_frame(true);
+    double enabled = 1, disabled = 1, counter = 1;
+    for (int i=0; i<50; i++) {
+        enabled = fmin(enabled, time_frame(true));
+        disabled = fmin(disabled, time_frame(false));
+
+        volatile uint64_t clock;
+        uint64_t start = _gg_debug_nanoseconds();
+        for (int j=0; j<FRAME_EVENTS; j++) {
+            clock = gg_read_cycle_counter();
+        }
+        (void)clock;
+        counter = fmin(counter, (_gg_debug_nanoseconds() - start) * 1e-9);
+    }
+    printf("%d events a frame: %.1f us recording (%.1f us reading the counter), %.1f us off\n",
+           FRAME_EVENTS, enabled * 1e6, counter * 1e6, disabled * 1e6);
+    assert(enabled - counter < FRAME_SECONDS * 0.02);
+    assert(disabled < FRAME_SECONDS * 0.001);
+    assert(find_block("block") == NULL && collator->totals[0].hit_count == 51 * FRAME_EVENTS / 2);
+}
+
+int
+main(int argc, char* argv[])
+{
+    test_collate();
+    test_toggle();
+    test_unmatched();
+    test_overhead();
+    gg_debug_free(collator);
+    printf("Debug tests passed.\n");
+}
@@ -0,0 +1,1444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// Count what sao_gl allocates so tests can check it all comes back.
+static _Atomic int64_t live_allocations;
+
+static void*
+counting_malloc(size_t size)
+{
+    live_allocations++;
+    return malloc(size);
+}
+
+static void*
+counting_realloc(void* pointer, size_t size)
+{
+    live_allocations += pointer == NULL;
+    return realloc(pointer, size);
+}
+
+static void
+counting_free(void* pointer)
+{
+    live_allocations -= pointer != NULL;
+    free(pointer);
+}
+
+#define SAOGL_MALLOC(size) counting_malloc(size)
+#define SAOGL_REALLOC(pointer, size) counting_realloc(pointer, size)
+#define SAOGL_FREE(pointer) counting_free(pointer)
+#define SAO_GL_IMPLEMENTATION
+#include "sao_gl.h"
+
+// These need a gl context but no display, they run on mesa's software renderer.
+
+static const char* vertex_shader =
+    "#version 330\n"
+    "layout (location = 0) in vec3 position;\n"
+    "void main()\n"
+    "{\n"
+    "	gl_Position = vec4(position, 1.0);\n"
+    "}\n";
+
+static const char* fragment_shader =
+    "#version 330\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "	color = vec4(1.0,0.0,0.0,1.0);\n"
+    "}\n";
+
+static const char* other_fragment_shader =
+    "#version 330\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "	color = vec4(0.0,1.0,0.0,1.0);\n"
+    "}\n";
+
+static bool
+create_headless_context()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!get_platform_display) {
+        return false;
+    }
+
+    EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (!eglInitialize(display, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API)) {
+        return false;
+    }
+
+    EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    return context != EGL_NO_CONTEXT &&
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+static int
+test_get_file_size(const char* filename)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    int size = (int)ftell(f);
+    fclose(f);
+    return size;
+}
+
+static bool
+test_read_entire_file(const char* filename, char* buffer, size_t buffer_size)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fread(buffer, 1, buffer_size, f) == buffer_size;
+    fclose(f);
+    return ok;
+}
+
+static void
+write_text_file(const char* filename, const char* text)
+{
+    FILE* f = fopen(filename, "wb");
+    assert(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+static void
+test_build_shader_from_files()
+{
+    write_text_file("test_sao_gl.vert", vertex_shader);
+    write_text_file("test_sao_gl.frag", fragment_shader);
+    write_text_file("test_sao_gl_broken.frag", "#version 330\nvoid main() { nope }\n");
+    int64_t live = live_allocations;
+
+    // Files aren't nul terminated, the sources have to be.
+    int program = saogl_build_shader_from_files(test_get_file_size, test_read_entire_file,
+                                                "test_sao_gl.vert", "test_sao_gl.frag");
+    assert(program > 0);
+    glDeleteProgram(program);
+    assert(live_allocations == live);
+
+    // Failing doesn't leak either.
+    assert(saogl_build_shader_from_files(test_get_file_size, test_read_entire_file,
+                                         "test_sao_gl.vert", "test_sao_gl_missing.frag") < 0);
+    assert(saogl_build_shader_from_files(test_get_file_size, test_read_entire_file,
+                                         "test_sao_gl.vert", "test_sao_gl_broken.frag") < 0);
+    assert(live_allocations == live);
+
+    remove("test_sao_gl.vert");
+    remove("test_sao_gl.frag");
+    remove("test_sao_gl_broken.frag");
+}
+
+static void
+test_shader_cache()
+{
+    const char* filename = "test_sao_gl_shaders.cache";
+    remove(filename);
+
+    saogl_ShaderCache* cache = saogl_shader_cache_open(filename);
+    assert(cache);
+    if (!cache->supported) {
+        printf("No program binary formats, skipping shader cache test.\n");
+        saogl_shader_cache_close(cache);
+        return;
+    }
+
+    int program = saogl_compile_shader_program_cached(cache, vertex_shader, fragment_shader);
+    assert(program > 0);
+    assert(cache->hits == 0 && cache->misses == 1);
+    assert(saogl_shader_cache_save(cache));
+    saogl_shader_cache_close(cache);
+
+    // A fresh cache loads the binary from disk.
+    cache = saogl_shader_cache_open(filename);
+    assert(cache->count == 1);
+    program = saogl_compile_shader_program_cached(cache, vertex_shader, fragment_shader);
+    assert(program > 0);
+    assert(cache->hits == 1 && cache->misses == 0);
+
+    GLint is_ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &is_ok);
+    assert(is_ok);
+
+    program = saogl_compile_shader_program_cached(cache, vertex_shader, other_fragment_shader);
+    assert(program > 0);
+    assert(cache->hits == 1 && cache->misses == 1);
+    assert(cache->count == 2);
+
+    // A binary the driver won't take falls back to compiling.
+    for (uint32_t i=0; i<cache->capacity; i++) {
+        saogl_ShaderCacheEntry* entry = cache->entries + i;
+        if (entry->data) {
+            memset(entry->data, 0xab, entry->size);
+        }
+    }
+    program = saogl_compile_shader_program_cached(cache, vertex_shader, fragment_shader);
+    assert(program > 0);
+    assert(cache->rejected == 1 && cache->misses == 2);
+
+    saogl_shader_cache_print_stats(cache);
+    saogl_shader_cache_close(cache);
+    remove(filename);
+}
+
+static void
+test_shader_batch()
+{
+    const char* broken_fragment_shader =
+        "#version 330\n"
+        "out vec4 color;\n"
+        "void main() { color = not_a_thing; }\n";
+
+    saogl_ShaderBatch batch;
+    saogl_shader_batch_init(&batch);
+
+    int a = saogl_shader_batch_add(&batch, "red", vertex_shader, fragment_shader);
+    int b = saogl_shader_batch_add(&batch, "broken", vertex_shader, broken_fragment_shader);
+    int c = saogl_shader_batch_add(&batch, "green", vertex_shader, other_fragment_shader);
+    assert(batch.count == 3 && batch.pending_count == 3);
+
+    int polls = 0;
+    while (!saogl_shader_batch_poll(&batch)) {
+        polls++;
+        assert(polls < 1000000);
+    }
+
+    assert(batch.ready_count == 2 && batch.failed_count == 1);
+    assert(batch.programs[a].status == SAOGL_SHADER_READY && batch.programs[a].program);
+    assert(batch.programs[b].status == SAOGL_SHADER_FAILED && batch.programs[b].program == 0);
+    assert(batch.programs[c].status == SAOGL_SHADER_READY && batch.programs[c].program);
+
+    GLint is_ok;
+    glGetProgramiv(batch.programs[c].program, GL_LINK_STATUS, &is_ok);
+    assert(is_ok);
+
+    saogl_shader_batch_free(&batch);
+}
+
+static void
+test_program_reflection()
+{
+    const char* vertex_src =
+        "#version 330\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 2) in vec2 uv;\n"
+        "uniform mat4 mvp;\n"
+        "uniform float scales[4];\n"
+        "uniform vec2 offsets[2];\n"
+        "out vec2 frag_uv;\n"
+        "void main()\n"
+        "{\n"
+        "	frag_uv = uv * scales[3] + offsets[0] + offsets[1];\n"
+        "	gl_Position = mvp * vec4(position * scales[0], 1.0);\n"
+        "}\n";
+    const char* fragment_src =
+        "#version 330\n"
+        "layout (std140) uniform Lights { vec4 light_color; float intensity; };\n"
+        "uniform vec4 tint;\n"
+        "uniform sampler2D image;\n"
+        "in vec2 frag_uv;\n"
+        "out vec4 color;\n"
+        "void main()\n"
+        "{\n"
+        "	color = texture(image, frag_uv) * tint * light_color * intensity;\n"
+        "}\n";
+
+    saogl_Program program;
+    assert(saogl_program_build(&program, vertex_src, fragment_src));
+    assert(program.attribute_count == 2);
+    assert(saogl_attribute(&program, "position") == 0);
+    assert(saogl_attribute(&program, "uv") == 2);
+    assert(saogl_attribute(&program, "normal") == -1);
+
+    int mvp = saogl_uniform(&program, "mvp");
+    int scales = saogl_uniform(&program, "scales");
+    int tint = saogl_uniform(&program, "tint");
+    int image = saogl_uniform(&program, "image");
+    assert(mvp >= 0 && scales >= 0 && tint >= 0 && image >= 0);
+    assert(program.uniforms[mvp].type == GL_FLOAT_MAT4);
+    assert(program.uniforms[scales].size == 4);
+    assert(saogl_uniform(&program, "missing") == -1);
+
+    int block = saogl_uniform_block(&program, "Lights");
+    assert(block >= 0);
+    assert(program.blocks[block].data_size >= 20);
+    int intensity = saogl_uniform(&program, "intensity");
+    assert(intensity >= 0);
+    assert(program.uniforms[intensity].location == -1);
+    assert(program.uniforms[intensity].block_index == (int)program.blocks[block].index);
+    assert(program.uniforms[intensity].offset == 16);
+
+    // Same values twice only uploads once.
+    float identity[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+    float white[4] = {1,1,1,1};
+    saogl_set_uniform_matrix4fv(&program, mvp, 1, identity);
+    saogl_set_uniform_4fv(&program, tint, 1, white);
+    saogl_set_uniform_1i(&program, image, 0);
+    assert(program.uploads == 3 && program.skipped_uploads == 0);
+    saogl_set_uniform_matrix4fv(&program, mvp, 1, identity);
+    saogl_set_uniform_4fv(&program, tint, 1, white);
+    saogl_set_uniform_1i(&program, image, 0);
+    assert(program.uploads == 3 && program.skipped_uploads == 3);
+    identity[12] = 2;
+    saogl_set_uniform_matrix4fv(&program, mvp, 1, identity);
+    assert(program.uploads == 4);
+
+    GLfloat uploaded[16];
+    glGetUniformfv(program.program, program.uniforms[mvp].location, uploaded);
+    assert(uploaded[12] == 2);
+
+    // More than the array holds still uploads, and what we kept can't be trusted after.
+    int offsets = saogl_uniform(&program, "offsets");
+    assert(offsets >= 0 && program.uniforms[offsets].size == 2);
+    float zeros[4] = {0};
+    float more[6] = {1,2, 3,4, 5,6};
+    saogl_set_uniform_2fv(&program, offsets, 2, zeros);
+    saogl_set_uniform_2fv(&program, offsets, 3, more);
+    glGetUniformfv(program.program, program.uniforms[offsets].location, uploaded);
+    assert(uploaded[0] == 1);
+    saogl_set_uniform_2fv(&program, offsets, 2, zeros);
+    glGetUniformfv(program.program, program.uniforms[offsets].location, uploaded);
+    assert(uploaded[0] == 0);
+    assert(program.uploads == 7);
+
+    // Missing uniforms are ignored.
+    saogl_set_uniform_1f(&program, -1, 1.0f);
+    assert(program.uploads == 7);
+    assert(glGetError() == GL_NO_ERROR);
+
+    glDeleteProgram(program.program);
+    saogl_program_free(&program);
+}
+
+static void
+test_state_cache()
+{
+    saogl_state_invalidate();
+    saogl_state_reset_stats();
+
+    GLuint vaos[2], buffers[2], textures[2];
+    glGenVertexArrays(2, vaos);
+    glGenBuffers(2, buffers);
+    glGenTextures(2, textures);
+    int program = saogl_compile_shader_program(vertex_shader, fragment_shader);
+
+    saogl_use_program(program);
+    saogl_use_program(program);
+    saogl_bind_vertex_array(vaos[0]);
+    saogl_bind_vertex_array(vaos[0]);
+    saogl_bind_buffer(GL_ARRAY_BUFFER, buffers[0]);
+    saogl_bind_buffer(GL_ARRAY_BUFFER, buffers[0]);
+    saogl_StateStats stats = saogl_state_stats();
+    assert(stats.issued == 3 && stats.skipped == 3);
+
+    GLint bound;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &bound);
+    assert(bound == program);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &bound);
+    assert(bound == (GLint)buffers[0]);
+
+    // The element buffer belongs to the vao so switching vaos has to rebind it.
+    saogl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    saogl_bind_vertex_array(vaos[1]);
+    saogl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &bound);
+    assert(bound == (GLint)buffers[1]);
+
+    saogl_state_reset_stats();
+    saogl_bind_texture(0, GL_TEXTURE_2D, textures[0]);
+    saogl_bind_texture(1, GL_TEXTURE_2D, textures[1]);
+    saogl_bind_texture(0, GL_TEXTURE_2D, textures[0]);
+    saogl_bind_texture(1, GL_TEXTURE_2D, textures[1]);
+    stats = saogl_state_stats();
+    assert(stats.issued == 4 && stats.skipped == 2);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    assert(bound == (GLint)textures[0]);
+    saogl_state_invalidate();
+
+    saogl_state_reset_stats();
+    saogl_set_blend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    saogl_set_blend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    saogl_set_depth(true, true, GL_LESS);
+    saogl_set_depth(true, false, GL_LESS);
+    saogl_set_cull(true, GL_BACK);
+    saogl_set_cull(true, GL_BACK);
+    stats = saogl_state_stats();
+    assert(stats.issued == 2 + 3 + 1 + 2);
+    assert(stats.skipped == 2 + 2 + 2);
+    GLboolean depth_write;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_write);
+    assert(!depth_write && glIsEnabled(GL_BLEND) && glIsEnabled(GL_CULL_FACE));
+
+    // After invalidating everything goes through again.
+    saogl_state_invalidate();
+    saogl_state_reset_stats();
+    saogl_use_program(program);
+    assert(saogl_state_stats().issued == 1);
+
+    saogl_set_blend(false, 0, 0);
+    saogl_set_depth(false, true, GL_LESS);
+    saogl_set_cull(false, GL_BACK);
+    saogl_use_program(0);
+    saogl_bind_vertex_array(0);
+    saogl_state_invalidate();
+    glDeleteProgram(program);
+    glDeleteTextures(2, textures);
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(2, vaos);
+    assert(glGetError() == GL_NO_ERROR);
+}
+
+typedef struct {
+    saogl_RenderCommands* commands;
+    saogl_DrawCommand draw;
+} RecordThread;
+
+static void*
+record_on_thread(void* data)
+{
+    RecordThread* thread = (RecordThread*)data;
+    for (int i=0; i<100; i++) {
+        saogl_DrawCommand draw = thread->draw;
+        draw.first = i * 3;
+        saogl_push_draw(thread->commands, saogl_sort_key(1, 2, 0, i / 100.0f), &draw);
+    }
+    return NULL;
+}
+
+static void
+test_render_commands()
+{
+    // The sort has to be stable and order by the whole key.
+    saogl_CommandEntry entries[6] = {
+        {0x0200000000000001, 0, 0}, {0x0100000000000002, 0, 1}, {0x0100000000000002, 0, 2},
+        {0x0000000000000000, 0, 3}, {0xFF00000000000000, 0, 4}, {0x0100000000000001, 0, 5},
+    };
+    saogl_CommandEntry temp[6];
+    saogl_CommandEntry* sorted = _saogl_radix_sort(entries, temp, 6);
+    uint32_t expected[6] = {3, 5, 1, 2, 0, 4};
+    for (int i=0; i<6; i++) {
+        assert(sorted[i].offset == expected[i]);
+    }
+    assert(saogl_sort_key(1, 0, 0, 0.0f) < saogl_sort_key(1, 0, 0, 0.5f));
+    assert(saogl_sort_key(1, 0, 0, 1.0f) < saogl_sort_key(2, 0, 0, 0.0f));
+
+    const char* tint_fragment_shader =
+        "#version 330\n"
+        "uniform vec4 tint;\n"
+        "out vec4 color;\n"
+        "void main() { color = tint; }\n";
+    saogl_Program program;
+    assert(saogl_program_build(&program, vertex_shader, tint_fragment_shader));
+    int tint = saogl_uniform(&program, "tint");
+
+    GLuint vaos[2], vbo;
+    glGenVertexArrays(2, vaos);
+    glGenBuffers(1, &vbo);
+    float vertices[300 * 3] = {0};
+    for (int i=0; i<2; i++) {
+        saogl_bind_vertex_array(vaos[i]);
+        saogl_bind_buffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(0);
+    }
+
+    // A surfaceless context has no default framebuffer to draw into.
+    GLuint framebuffer, renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 4, 4);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+    saogl_RenderCommands commands;
+    saogl_render_commands_init(&commands);
+
+    saogl_DrawCommand draw = {
+        .program = program.program,
+        .vertex_array = vaos[0],
+        .mode = GL_TRIANGLES,
+        .count = 3,
+    };
+
+    // Pushed out of order on purpose, the clear has the lowest key.
+    float red[4] = {1, 0, 0, 1};
+    saogl_push_uniform(&commands, saogl_sort_key(1, 1, 0, 0.0f), &program, tint, GL_FLOAT_VEC4, 1, red);
+    for (int i=0; i<3; i++) {
+        draw.first = i * 3;
+        saogl_push_draw(&commands, saogl_sort_key(1, 1, 0, 0.1f * (i + 1)), &draw);
+    }
+    draw.first = 30;
+    saogl_push_draw(&commands, saogl_sort_key(1, 1, 0, 0.5f), &draw);
+    saogl_push_clear(&commands, 0, GL_COLOR_BUFFER_BIT, 0, 0, 0, 1, 1);
+
+    RecordThread thread = {&commands, draw};
+    thread.draw.vertex_array = vaos[1];
+    pthread_t pthread;
+    pthread_create(&pthread, NULL, record_on_thread, &thread);
+    pthread_join(pthread, NULL);
+
+    saogl_render_commands_submit(&commands);
+    assert(commands.last_frame.commands == 1 + 1 + 4 + 100);
+    assert(commands.last_frame.draws == 104);
+    // The first three join into one range, the fourth joins by multi draw, the thread's
+    // 100 draws use another vao and become one more call.
+    assert(commands.last_frame.draw_calls == 2);
+    assert(commands.last_frame.merged_draws == 102);
+    assert(glGetError() == GL_NO_ERROR);
+
+    // Lists are empty after submitting and threads claim new ones.
+    saogl_render_commands_submit(&commands);
+    assert(commands.last_frame.commands == 0);
+    pthread_create(&pthread, NULL, record_on_thread, &thread);
+    pthread_join(pthread, NULL);
+    saogl_render_commands_submit(&commands);
+    assert(commands.last_frame.commands == 100 && commands.last_frame.draw_calls == 1);
+
+    // Switching back and forth between two buffers keeps one list in each.
+    saogl_RenderCommands ui;
+    saogl_render_commands_init(&ui);
+    for (int i=0; i<100; i++) {
+        saogl_push_draw(&commands, saogl_sort_key(1, 1, 0, 0.5f), &draw);
+        saogl_push_draw(&ui, saogl_sort_key(1, 1, 0, 0.5f), &draw);
+    }
+    assert(atomic_load(&commands.list_count) == 1 && atomic_load(&ui.list_count) == 1);
+    saogl_render_commands_submit(&commands);
+    saogl_render_commands_submit(&ui);
+    assert(commands.last_frame.commands == 100 && ui.last_frame.commands == 100);
+    saogl_render_commands_free(&ui);
+
+    saogl_render_commands_free(&commands);
+    saogl_use_program(0);
+    saogl_bind_vertex_array(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(2, vaos);
+    glDeleteProgram(program.program);
+    saogl_program_free(&program);
+    saogl_state_invalidate();
+}
+
+static void
+test_stream_buffer_mode(int flags)
+{
+    saogl_StreamBuffer stream;
+    assert(saogl_stream_init(&stream, 1024, flags));
+    assert(stream.uniform_alignment > 0);
+    if (flags & SAOGL_STREAM_ORPHAN) {
+        assert(!stream.persistent && stream.frame_count == 1);
+    }
+
+    for (int frame=0; frame<10; frame++) {
+        saogl_StreamAllocation a = saogl_stream_alloc(&stream, 3, 1);
+        saogl_StreamAllocation b = saogl_stream_alloc(&stream, 64, stream.uniform_alignment);
+        assert(a.data && b.data);
+        assert(b.offset % stream.uniform_alignment == 0);
+        assert(b.offset >= a.offset + 3);
+        memset(a.data, frame, 3);
+        memset(b.data, 0x80 + frame, 64);
+        saogl_stream_flush(&stream);
+
+        uint8_t readback[64];
+        saogl_bind_buffer(GL_COPY_READ_BUFFER, stream.buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, b.offset, 64, readback);
+        assert(readback[0] == 0x80 + frame && readback[63] == 0x80 + frame);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, a.offset, 3, readback);
+        assert(readback[2] == frame);
+
+        // Doesn't fit in what's left.
+        assert(!saogl_stream_alloc(&stream, 1024, 4).data);
+        // Or anywhere, without wrapping around.
+        assert(!saogl_stream_alloc(&stream, UINT32_MAX - 8, 4).data);
+        saogl_stream_end_frame(&stream);
+    }
+
+    assert(stream.stats.allocations == 20);
+    assert(stream.stats.failed_allocations == 20);
+    assert(stream.stats.peak_frame_bytes <= 1024);
+    assert(glGetError() == GL_NO_ERROR);
+    saogl_stream_print_stats(&stream);
+    saogl_stream_free(&stream);
+}
+
+static void
+test_stream_buffer()
+{
+    test_stream_buffer_mode(0);
+    test_stream_buffer_mode(SAOGL_STREAM_ORPHAN);
+}
+
+static void
+test_instancing_format(int format)
+{
+    const char* mat4_vertex_src =
+        "#version 330\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in mat4 transform;\n"
+        "layout (location = 5) in vec4 instance_color;\n"
+        "out vec4 vertex_color;\n"
+        "void main()\n"
+        "{\n"
+        "	vertex_color = instance_color;\n"
+        "	gl_Position = transform * vec4(position, 1.0);\n"
+        "}\n";
+    const char* affine_vertex_src =
+        "#version 330\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in vec4 row0;\n"
+        "layout (location = 2) in vec4 row1;\n"
+        "layout (location = 3) in vec4 row2;\n"
+        "layout (location = 5) in vec4 instance_color;\n"
+        "out vec4 vertex_color;\n"
+        "void main()\n"
+        "{\n"
+        "	vertex_color = instance_color;\n"
+        "	mat4 transform = transpose(mat4(row0, row1, row2, vec4(0, 0, 0, 1)));\n"
+        "	gl_Position = transform * vec4(position, 1.0);\n"
+        "}\n";
+    const char* fragment_src =
+        "#version 330\n"
+        "in vec4 vertex_color;\n"
+        "out vec4 color;\n"
+        "void main() { color = vertex_color; }\n";
+
+    int program = saogl_compile_shader_program(format == SAOGL_INSTANCE_MAT4 ? mat4_vertex_src : affine_vertex_src,
+                                               fragment_src);
+    assert(program > 0);
+
+    // 4x1 pixels, one point instance per pixel.
+    GLuint framebuffer, renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 4, 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+    glViewport(0, 0, 4, 1);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    GLuint vao, vbo, ebo;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    saogl_bind_vertex_array(vao);
+    float point[3] = {0, 0, 0};
+    uint16_t index = 0;
+    saogl_bind_buffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(point), point, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    saogl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index), &index, GL_STATIC_DRAW);
+
+    float transforms[4][16];
+    float colors[4][4];
+    for (int i=0; i<4; i++) {
+        float x = -0.75f + 0.5f * i;
+        float mat4[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, x,0,0,1};
+        float affine[12] = {1,0,0,x, 0,1,0,0, 0,0,1,0};
+        if (format == SAOGL_INSTANCE_MAT4) {
+            memcpy(transforms[0] + i * 16, mat4, sizeof(mat4));
+        } else {
+            memcpy(transforms[0] + i * 12, affine, sizeof(affine));
+        }
+        colors[i][0] = 1;
+        colors[i][1] = i / 4.0f;
+        colors[i][2] = 0;
+        colors[i][3] = 1;
+    }
+
+    saogl_StreamBuffer stream;
+    assert(saogl_stream_init(&stream, 4096, 0));
+    saogl_InstancedMesh mesh = {
+        .vertex_array = vao,
+        .mode = GL_POINTS,
+        .index_type = GL_UNSIGNED_SHORT,
+        .count = 1,
+        .transform_format = format,
+        .transform_location = 1,
+        .attribute_location = 5,
+        .attribute_components = 4,
+        .max_instances_per_draw = 1,
+    };
+
+    // Culling left instances 1 and 3.
+    uint32_t visible[2] = {1, 3};
+    saogl_use_program(program);
+    assert(saogl_draw_instanced(&stream, &mesh, transforms[0], colors[0], visible, 2) == 2);
+    assert(mesh.instances_drawn == 2 && mesh.instances_dropped == 0);
+
+    uint8_t pixels[4][4];
+    glReadPixels(0, 0, 4, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    assert(pixels[0][3] == 0 && pixels[2][3] == 0);
+    assert(pixels[1][0] == 255 && pixels[1][1] == 64);
+    assert(pixels[3][0] == 255 && pixels[3][1] == 191);
+
+    // Without a limit everything goes in one draw.
+    mesh.max_instances_per_draw = 0;
+    assert(saogl_draw_instanced(&stream, &mesh, transforms[0], colors[0], NULL, 4) == 1);
+    glReadPixels(0, 0, 4, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    assert(pixels[0][3] == 255 && pixels[2][1] == 128);
+    assert(glGetError() == GL_NO_ERROR);
+
+    saogl_stream_end_frame(&stream);
+    saogl_stream_free(&stream);
+    saogl_use_program(0);
+    saogl_bind_vertex_array(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+    saogl_state_invalidate();
+}
+
+static void
+test_instancing()
+{
+    test_instancing_format(SAOGL_INSTANCE_MAT4);
+    test_instancing_format(SAOGL_INSTANCE_AFFINE);
+}
+
+static void*
+debug_lines_on_thread(void* data)
+{
+    saogl_DebugDraw* dd = (saogl_DebugDraw*)data;
+    for (int i=0; i<25000; i++) {
+        float a[3] = {-1, i / 25000.0f * 2 - 1, 0};
+        float b[3] = {1, i / 25000.0f * 2 - 1, 0};
+        saogl_debug_line(dd, a, b, SAOGL_RGBA(255, 255, 255, 255));
+    }
+    return NULL;
+}
+
+static void
+test_debug_draw()
+{
+    GLuint framebuffer, renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 64, 64);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+    glViewport(0, 0, 64, 64);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    saogl_DebugDraw dd;
+    assert(saogl_debug_draw_init(&dd, 200000, 1000));
+    float identity[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+
+    pthread_t threads[4];
+    for (int i=0; i<4; i++) {
+        pthread_create(threads + i, NULL, debug_lines_on_thread, &dd);
+    }
+    for (int i=0; i<4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    float min[3] = {-0.5f, -0.5f, -0.5f}, max[3] = {0.5f, 0.5f, 0.5f};
+    saogl_debug_aabb(&dd, min, max, SAOGL_RGBA(255, 0, 0, 255));
+    float center[3] = {0, 0, 0};
+    saogl_debug_sphere(&dd, center, 0.5f, SAOGL_RGBA(0, 255, 0, 255));
+    saogl_debug_axes(&dd, identity, 1.0f);
+    assert(atomic_load(&dd.line_count) == 2 * (100000 + 12 + 72 + 3));
+
+    // The identity's frustum is the clip space cube.
+    saogl_debug_frustum(&dd, identity, SAOGL_RGBA(0, 0, 255, 255));
+    assert(dd.lines[2 * 100087].position[0] == -1.0f && dd.lines[2 * 100087].position[2] == -1.0f);
+
+    // 'H' is 6 segments, '1' 3, the space none.
+    saogl_debug_text(&dd, 10.5f, 10.5f, 16, SAOGL_RGBA(255, 255, 0, 255), "H %d", 1);
+    assert(atomic_load(&dd.text_count) == 2 * 9);
+    assert(dd.text[0].position[1] >= 10 && dd.text[0].position[1] <= 27);
+
+    struct timespec start, end;
+    saogl_set_depth(true, true, GL_LESS);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    saogl_debug_draw_submit(&dd, identity);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Debug draw: %u lines submitted in %.2f ms of cpu time\n", dd.lines_drawn + dd.text_lines_drawn,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) * 1e-6);
+    assert(dd.lines_drawn == 100099 && dd.text_lines_drawn == 9 && dd.dropped == 0);
+    assert(atomic_load(&dd.line_count) == 0);
+
+    // Depth writes are back on so the next clear clears depth.
+    GLboolean depth_write = GL_FALSE;
+    GLint depth_func = 0;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_write);
+    glGetIntegerv(GL_DEPTH_FUNC, &depth_func);
+    assert(depth_write && depth_func == GL_LESS && glIsEnabled(GL_DEPTH_TEST));
+
+    // The H's left side is yellow.
+    uint8_t pixel[4];
+    glReadPixels(10, 64 - 1 - 18, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    assert(pixel[0] == 255 && pixel[1] == 255 && pixel[2] == 0);
+
+    // Past the capacity gets dropped, disabled does nothing. '-' is 2 segments.
+    for (int i=0; i<1100; i++) {
+        saogl_debug_text(&dd, 0, 0, 8, SAOGL_RGBA(255, 255, 255, 255), "-");
+    }
+    dd.enabled = false;
+    saogl_debug_line(&dd, min, max, 0);
+    assert(atomic_load(&dd.line_count) == 0);
+    saogl_debug_draw_submit(&dd, identity);
+    assert(dd.text_lines_drawn == 1000 && dd.dropped == 1200);
+    assert(atomic_load(&dd.text_count) == 0 && atomic_load(&dd.dropping) == 0);
+    assert(glGetError() == GL_NO_ERROR);
+
+    saogl_debug_draw_free(&dd);
+    saogl_set_depth(false, true, GL_LESS);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    saogl_state_invalidate();
+}
+
+static void
+write_file(const char* filename, const void* data, size_t size)
+{
+    FILE* file = fopen(filename, "wb");
+    assert(file);
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+// A ktx 1 file with the given levels of equal size.
+static void
+write_ktx(const char* filename, uint32_t gl_type, uint32_t gl_format, uint32_t internal_format,
+          uint32_t width, uint32_t height, uint32_t level_count, const uint8_t* levels, const uint32_t* level_sizes)
+{
+    static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+    uint32_t header[13] = {0x04030201, gl_type, gl_type ? 1 : 0, gl_format, internal_format, gl_format,
+                           width, height, 0, 0, 1, level_count, 0};
+    FILE* file = fopen(filename, "wb");
+    assert(file);
+    fwrite(identifier, 1, 12, file);
+    fwrite(header, 4, 13, file);
+    for (uint32_t i=0; i<level_count; i++) {
+        fwrite(level_sizes + i, 4, 1, file);
+        fwrite(levels, 1, level_sizes[i], file);
+        levels += level_sizes[i];
+    }
+    fclose(file);
+}
+
+static void
+test_texture_streaming()
+{
+    // 5x3 32 bit tga stored top to bottom, pixel (x, y from the top) = (x*40, y*80, 7, 255) in BGRA.
+    uint8_t tga[18 + 5 * 3 * 4] = {0, 0, 2, 0,0,0,0,0, 0,0,0,0, 5,0, 3,0, 32, 0x20};
+    for (int y=0; y<3; y++) {
+        for (int x=0; x<5; x++) {
+            uint8_t* p = tga + 18 + (y * 5 + x) * 4;
+            p[0] = 7;
+            p[1] = y * 80;
+            p[2] = x * 40;
+            p[3] = 255;
+        }
+    }
+    write_file("test_sao_gl_texture.tga", tga, sizeof(tga));
+
+    // 8x8 BC1 with its mips, each level is random blocks.
+    uint8_t bc1[32 + 8 + 8 + 8];
+    for (size_t i=0; i<sizeof(bc1); i++) {
+        bc1[i] = (uint8_t)(i * 37 + 11);
+    }
+    uint32_t bc1_sizes[4] = {32, 8, 8, 8};
+    write_ktx("test_sao_gl_texture_bc1.ktx", 0, 0, 0x83F0, 8, 8, 4, bc1, bc1_sizes);
+
+    uint8_t rgba[4 * 4 * 4];
+    memset(rgba, 200, sizeof(rgba));
+    uint32_t rgba_size = sizeof(rgba);
+    write_ktx("test_sao_gl_texture_rgba.ktx", GL_UNSIGNED_BYTE, GL_RGBA, GL_RGBA8, 4, 4, 1, rgba, &rgba_size);
+
+    // Astc isn't something we know the block size of.
+    write_ktx("test_sao_gl_texture_astc.ktx", 0, 0, 0x93B0, 4, 4, 1, bc1, bc1_sizes);
+
+    // A tiny budget so everything takes a few frames.
+    saogl_TextureStreamer streamer;
+    assert(saogl_texture_streamer_init(&streamer, 2, 64));
+    saogl_Texture* tga_texture = saogl_texture_load(&streamer, "test_sao_gl_texture.tga");
+    saogl_Texture* bc1_texture = saogl_texture_load(&streamer, "test_sao_gl_texture_bc1.ktx");
+    saogl_Texture* rgba_texture = saogl_texture_load(&streamer, "test_sao_gl_texture_rgba.ktx");
+    saogl_Texture* astc_texture = saogl_texture_load(&streamer, "test_sao_gl_texture_astc.ktx");
+    saogl_Texture* missing_texture = saogl_texture_load(&streamer, "test_sao_gl_no_such_texture.tga");
+    assert(tga_texture->texture && bc1_texture->texture);
+
+    // Frames that uploaded something, sleep while waiting on the workers.
+    int frames = 0;
+    for (int i=0; i<10000 && saogl_texture_streamer_busy(&streamer); i++) {
+        saogl_texture_streamer_update(&streamer);
+        assert(streamer.stats.bytes_last_frame <= 64);
+        if (streamer.stats.bytes_last_frame) {
+            frames++;
+        } else {
+            nanosleep(&(struct timespec){0, 1000000}, NULL);
+        }
+    }
+    assert(!saogl_texture_streamer_busy(&streamer));
+    saogl_texture_streamer_print_stats(&streamer);
+    assert(atomic_load(&tga_texture->status) == SAOGL_TEXTURE_READY);
+    assert(atomic_load(&rgba_texture->status) == SAOGL_TEXTURE_READY);
+    assert(atomic_load(&astc_texture->status) == SAOGL_TEXTURE_FAILED);
+    assert(atomic_load(&missing_texture->status) == SAOGL_TEXTURE_FAILED);
+    assert(streamer.stats.failed >= 2);
+    // 60 + 8 + 4 bytes of tga mips alone need more than one frame.
+    assert(frames > 2);
+
+    // Bottom row first in gl, that's y = 2 from the top.
+    uint8_t pixels[5 * 3 * 4];
+    saogl_bind_texture(0, GL_TEXTURE_2D, tga_texture->texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    assert(pixels[0] == 0 && pixels[1] == 160 && pixels[2] == 7 && pixels[3] == 255);
+    assert(pixels[4 * 4] == 160 && pixels[4 * 4 + 1] == 160);
+    GLint base_level, width;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &base_level);
+    assert(base_level == 0);
+    // Level 1 is 2x1, the first pixel averages x 0-1 of the bottom two rows.
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_WIDTH, &width);
+    assert(width == 2);
+    glGetTexImage(GL_TEXTURE_2D, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    assert(pixels[0] == 20 && pixels[1] == 120);
+
+    if (atomic_load(&bc1_texture->status) == SAOGL_TEXTURE_READY) {
+        uint8_t compressed[32];
+        saogl_bind_texture(0, GL_TEXTURE_2D, bc1_texture->texture);
+        glGetCompressedTexImage(GL_TEXTURE_2D, 0, compressed);
+        assert(memcmp(compressed, bc1, 32) == 0);
+        glGetCompressedTexImage(GL_TEXTURE_2D, 3, compressed);
+        assert(memcmp(compressed, bc1 + 48, 8) == 0);
+    } else {
+        printf("No BC1 support, skipping compressed texture check.\n");
+    }
+
+    // Level sizes have to match the level and fit in the file, without wrapping around.
+    saogl_Image image;
+    uint32_t bad_sizes[2] = {16, 0xFFFFFFFF};
+    for (int i=0; i<2; i++) {
+        write_ktx("test_sao_gl_texture_bad.ktx", GL_UNSIGNED_BYTE, GL_RGBA, GL_RGBA8, 4, 4, 1, rgba, &rgba_size);
+        FILE* file = fopen("test_sao_gl_texture_bad.ktx", "r+b");
+        fseek(file, 64, SEEK_SET);
+        fwrite(bad_sizes + i, 4, 1, file);
+        fclose(file);
+        assert(!saogl_load_image("test_sao_gl_texture_bad.ktx", &image) && !image.data);
+    }
+    write_ktx("test_sao_gl_texture_bad.ktx", 0, 0, 0x83F0, 8, 8, 4, bc1, bc1_sizes);
+    assert(truncate("test_sao_gl_texture_bad.ktx", 64 + 4 + 32 + 4 + 8 + 4) == 0);
+    assert(!saogl_load_image("test_sao_gl_texture_bad.ktx", &image) && !image.data);
+    remove("test_sao_gl_texture_bad.ktx");
+
+    // Lots of small ones, every one gets there while the workers race the gl thread.
+    saogl_TextureStreamer many;
+    assert(saogl_texture_streamer_init(&many, 4, 1 << 20));
+    saogl_Texture* textures[256];
+    for (int i=0; i<256; i++) {
+        textures[i] = saogl_texture_load(&many, "test_sao_gl_texture_rgba.ktx");
+    }
+    for (int i=0; i<10000 && saogl_texture_streamer_busy(&many); i++) {
+        saogl_texture_streamer_update(&many);
+        nanosleep(&(struct timespec){0, 100000}, NULL);
+    }
+    assert(!saogl_texture_streamer_busy(&many));
+    for (int i=0; i<256; i++) {
+        assert(atomic_load(&textures[i]->status) == SAOGL_TEXTURE_READY);
+    }
+    assert(many.stats.loaded == 256);
+    saogl_texture_streamer_free(&many);
+
+    // Free forgets the deleted textures were bound, a new one with a reused name binds.
+    saogl_texture_streamer_free(&streamer);
+    GLuint reused;
+    glGenTextures(1, &reused);
+    saogl_bind_texture(0, GL_TEXTURE_2D, reused);
+    GLint bound;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    assert((GLuint)bound == reused);
+    glDeleteTextures(1, &reused);
+    saogl_state_invalidate();
+    assert(glGetError() == GL_NO_ERROR);
+    remove("test_sao_gl_texture.tga");
+    remove("test_sao_gl_texture_bc1.ktx");
+    remove("test_sao_gl_texture_rgba.ktx");
+    remove("test_sao_gl_texture_astc.ktx");
+}
+
+static void
+test_mesh_import()
+{
+    // A quad with uvs and normals, then a triangle reusing two of its corners with negative
+    // indices and one with no uv. Comments, blank lines, crlf and other statements are skipped.
+    const char* obj =
+        "# a quad\r\n"
+        "mtllib nothing.mtl\n"
+        "v -1 -1 0\n"
+        "v 1 -1 0\r\n"
+        "v 1.0 1.0 0.0\n"
+        "v -1e0 10E-1 -0.0\n"
+        "\n"
+        "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        "vn 0 0 1\n"
+        "usemtl stone\n"
+        "f 1/1/1 2/2/1 3/3/1 4/4/1\r\n"
+        "v 0.5 2.5e+0 -.25\n"
+        "f -2/-1/-1 -3/-2/-1 5//1\n";
+    saogl_Mesh mesh;
+    assert(saogl_parse_obj(&mesh, obj, strlen(obj), 1));
+    assert(mesh.format == (SAOGL_MESH_NORMALS | SAOGL_MESH_TEXCOORDS));
+    assert(mesh.stride == 8);
+    assert(mesh.index_count == 9);
+    assert(mesh.vertex_count == 5);
+    uint32_t expected_indices[9] = {0, 1, 2, 0, 2, 3, 3, 2, 4};
+    assert(memcmp(mesh.indices, expected_indices, sizeof(expected_indices)) == 0);
+    float expected_last[8] = {0.5f, 2.5f, -0.25f, 0, 0, 1, 0, 0};
+    assert(memcmp(mesh.vertices + 4 * 8, expected_last, sizeof(expected_last)) == 0);
+    assert(mesh.vertices[3 * 8 + 0] == -1.0f && mesh.vertices[3 * 8 + 1] == 1.0f);
+    assert(mesh.vertices[2 * 8 + 6] == 1.0f && mesh.vertices[2 * 8 + 7] == 1.0f);
+    saogl_mesh_free(&mesh);
+
+    const char* bad_index = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n";
+    assert(!saogl_parse_obj(&mesh, bad_index, strlen(bad_index), 1));
+    const char* bad_number = "v 0 x 0\nf 1 1 1\n";
+    assert(!saogl_parse_obj(&mesh, bad_number, strlen(bad_number), 1));
+
+    // A grid big enough to be split, parsed with one and four threads, must come out the same.
+    int size = 300;
+    size_t capacity = (size_t)size * size * 80 + (size_t)size * size * 2 * 40;
+    char* text = (char*)malloc(capacity);
+    size_t length = 0;
+    for (int y=0; y<size; y++) {
+        for (int x=0; x<size; x++) {
+            length += snprintf(text + length, capacity - length, "v %d.%03d %d.5 %g\nvt %g %g\n",
+                               x, y % 1000, y, x * 0.001, x / (double)size, y / (double)size);
+        }
+    }
+    for (int y=0; y<size-1; y++) {
+        for (int x=0; x<size-1; x++) {
+            int a = y * size + x + 1;
+            length += snprintf(text + length, capacity - length, "f %d/%d %d/%d %d/%d %d/%d\n",
+                               a, a, a + 1, a + 1, a + size + 1, a + size + 1, a + size, a + size);
+        }
+    }
+    write_file("test_sao_gl_mesh.obj", text, length);
+
+    saogl_Mesh serial, parallel;
+    double start = _saogl_seconds();
+    assert(saogl_load_mesh(&serial, "test_sao_gl_mesh.obj", 1));
+    double serial_seconds = _saogl_seconds() - start;
+    start = _saogl_seconds();
+    assert(saogl_load_mesh(&parallel, "test_sao_gl_mesh.obj", 4));
+    double parallel_seconds = _saogl_seconds() - start;
+    printf("Mesh import: %.1f MB obj in %.1f ms on 1 thread, %.1f ms on 4\n",
+           length / 1e6, serial_seconds * 1000.0, parallel_seconds * 1000.0);
+
+    assert(serial.format == SAOGL_MESH_TEXCOORDS && serial.stride == 5);
+    assert(serial.vertex_count == (uint32_t)(size * size));
+    assert(serial.index_count == (uint32_t)((size - 1) * (size - 1) * 6));
+    assert(parallel.vertex_count == serial.vertex_count && parallel.index_count == serial.index_count);
+    assert(memcmp(parallel.vertices, serial.vertices, serial.vertex_count * 5 * sizeof(float)) == 0);
+    assert(memcmp(parallel.indices, serial.indices, serial.index_count * sizeof(uint32_t)) == 0);
+    // Vertex (x 7, y 3), first seen as the top left of quad (7, 3).
+    uint32_t vertex = serial.indices[(3 * (size - 1) + 7) * 6];
+    assert(serial.vertices[vertex * 5 + 0] == 7.003f);
+    assert(serial.vertices[vertex * 5 + 1] == 3.5f);
+    assert(serial.vertices[vertex * 5 + 2] == 0.007f);
+
+    // Round trip through the binary format.
+    assert(saogl_save_mesh(&serial, "test_sao_gl_mesh.mesh"));
+    saogl_Mesh binary;
+    assert(saogl_load_mesh(&binary, "test_sao_gl_mesh.mesh", 0));
+    assert(binary.vertex_count == serial.vertex_count && binary.stride == serial.stride);
+    assert(memcmp(binary.vertices, serial.vertices, serial.vertex_count * 5 * sizeof(float)) == 0);
+    assert(memcmp(binary.indices, serial.indices, serial.index_count * sizeof(uint32_t)) == 0);
+    write_file("test_sao_gl_mesh.mesh", "SMSH", 4);
+    assert(!saogl_load_mesh(&mesh, "test_sao_gl_mesh.mesh", 0));
+
+    // Damaged headers and indices, as offset and value.
+    uint32_t damage[][2] = {
+        {8, 4}, {12, 8}, {16, 0x40000000}, {16, serial.vertex_count - 1}, {20, 0xFFFFFFFF}, {20, 1},
+        {24 + serial.vertex_count * 5 * 4, serial.vertex_count},
+    };
+    for (int i=0; i<(int)(sizeof(damage) / sizeof(damage[0])); i++) {
+        assert(saogl_save_mesh(&serial, "test_sao_gl_mesh.mesh"));
+        FILE* file = fopen("test_sao_gl_mesh.mesh", "r+b");
+        fseek(file, damage[i][0], SEEK_SET);
+        fwrite(&damage[i][1], 4, 1, file);
+        fclose(file);
+        assert(!saogl_load_mesh(&mesh, "test_sao_gl_mesh.mesh", 0) && !mesh.vertices && !mesh.indices);
+    }
+
+    uint32_t vertex_array, vertex_buffer, index_buffer;
+    saogl_mesh_upload(&binary, &vertex_array, &vertex_buffer, &index_buffer);
+    GLint buffer_size;
+    glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &buffer_size);
+    assert(buffer_size == (GLint)(binary.index_count * sizeof(uint32_t)));
+    saogl_bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &buffer_size);
+    assert(buffer_size == (GLint)(binary.vertex_count * 5 * sizeof(float)));
+    GLint enabled;
+    glGetVertexAttribiv(1, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+    assert(!enabled);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+    assert(enabled);
+
+    glDeleteVertexArrays(1, &vertex_array);
+    glDeleteBuffers(1, &vertex_buffer);
+    glDeleteBuffers(1, &index_buffer);
+    saogl_state_invalidate();
+    assert(glGetError() == GL_NO_ERROR);
+    saogl_mesh_free(&serial);
+    saogl_mesh_free(&parallel);
+    saogl_mesh_free(&binary);
+    free(text);
+    remove("test_sao_gl_mesh.obj");
+    remove("test_sao_gl_mesh.mesh");
+}
+
+// Coarsest level whose error looks under a pixel, without hysteresis.
+static uint32_t
+expected_lod(const saogl_LodModel* model, float distance, float radius, float projection_scale)
+{
+    float near_side = distance - radius > 0.1f ? distance - radius : 0.1f;
+    uint32_t level = 0;
+    while (level + 1 < model->level_count && model->error[level + 1] * projection_scale / near_side <= 1.0f) {
+        level++;
+    }
+    return level;
+}
+
+static void
+test_lod()
+{
+    static const saogl_LodModel models[2] = {
+        {4, {0, 0.01f, 0.05f, 0.2f}, {10000, 2500, 600, 150}},
+        {2, {0, 0.1f}, {500, 20}},
+    };
+    float eye[3] = {0, 0, 0};
+    float projection_scale = 1080.0f / (2.0f * tanf(30.0f * 3.14159265f / 180.0f));
+
+    // Objects in a line down -z, a bit off axis so nothing is exactly on a boundary.
+    saogl_Lod lod;
+    assert(saogl_lod_init(&lod, models, 2, 10));
+    lod.hysteresis = 0;
+    uint32_t count = 1001;
+    assert(saogl_lod_resize(&lod, count));
+    assert(lod.capacity >= count);
+    for (uint32_t i=0; i<count; i++) {
+        lod.x[i] = 0.37f;
+        lod.y[i] = 0;
+        lod.z[i] = -(float)i * 0.5f;
+        lod.radius[i] = 0.5f;
+        lod.model[i] = i % 3 == 0;
+    }
+    saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+    for (uint32_t i=0; i<count; i++) {
+        float distance = sqrtf(lod.x[i] * lod.x[i] + lod.z[i] * lod.z[i]);
+        assert(lod.level[i] == expected_lod(&models[lod.model[i]], distance, 0.5f, projection_scale));
+    }
+    assert(lod.level[0] == 0 && lod.level[count - 1] == 3);
+    assert(lod.last_select.triangles < lod.last_select.full_detail_triangles / 4);
+
+    // Every object is in exactly one list, the one for its model and level.
+    uint32_t listed = 0;
+    for (uint32_t m=0; m<2; m++) {
+        for (uint32_t l=0; l<SAOGL_MAX_LODS; l++) {
+            uint32_t n;
+            const uint32_t* list = saogl_lod_list(&lod, m, l, &n);
+            for (uint32_t j=0; j<n; j++) {
+                assert(lod.model[list[j]] == m && lod.level[list[j]] == l);
+                assert(j == 0 || list[j] > list[j - 1]);
+            }
+            listed += n;
+        }
+    }
+    assert(listed == count);
+
+    // Hysteresis: a little past where level 2 is allowed stays on 1, well past it switches.
+    // Coming back closer goes finer straight away.
+    lod.hysteresis = 0.1f;
+    assert(saogl_lod_resize(&lod, 1));
+    lod.model[0] = 0;
+    lod.x[0] = 0;
+    lod.radius[0] = 0;
+    float boundary = 0.05f * projection_scale;
+    float distances[] = {boundary * 0.9f, boundary * 1.05f, boundary * 1.2f, boundary * 1.05f, boundary * 0.95f};
+    uint32_t levels[] = {1, 1, 2, 2, 1};
+    lod.level[0] = 0;
+    for (int i=0; i<5; i++) {
+        lod.z[0] = -distances[i];
+        saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+        assert(lod.level[0] == levels[i]);
+    }
+    assert(lod.last_select.changed == 1);
+
+    // The budget coarsens from the far end, the near objects keep their detail.
+    assert(saogl_lod_resize(&lod, count));
+    for (uint32_t i=0; i<count; i++) {
+        lod.x[i] = 0.37f;
+        lod.z[i] = -(float)i * 0.5f;
+        lod.radius[i] = 0.5f;
+        lod.model[i] = 0;
+    }
+    lod.hysteresis = 0;
+    saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+    uint64_t unlimited = lod.last_select.triangles;
+    lod.triangle_budget = unlimited / 2;
+    saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+    assert(lod.last_select.triangles <= lod.triangle_budget);
+    assert(lod.last_select.coarsened > 0);
+    assert(lod.level[0] == 0 && lod.level[1] == 0);
+    for (uint32_t i=1; i<count; i++) {
+        assert(lod.level[i] >= lod.level[i - 1]);
+    }
+
+    // When the farthest object going all the way down is enough, nothing nearer changes.
+    assert(saogl_lod_resize(&lod, 3));
+    for (uint32_t i=0; i<3; i++) {
+        lod.z[i] = -1.0f - i;
+        lod.level[i] = 0;
+    }
+    lod.triangle_budget = 0;
+    saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+    assert(lod.last_select.triangles == 3 * 10000);
+    lod.triangle_budget = 2 * 10000 + 150;
+    saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+    assert(lod.level[0] == 0 && lod.level[1] == 0 && lod.level[2] == 3);
+    assert(lod.last_select.triangles == lod.triangle_budget && lod.last_select.coarsened == 3);
+    lod.triangle_budget = 0;
+
+    // A dense field for timing, most objects far enough to drop detail.
+    uint32_t field = 1 << 18;
+    assert(saogl_lod_resize(&lod, field));
+    uint32_t seed = 1;
+    for (uint32_t i=0; i<field; i++) {
+        seed = seed * 1664525 + 1013904223;
+        lod.x[i] = (float)(seed >> 16) / 65536.0f * 400.0f - 200.0f;
+        seed = seed * 1664525 + 1013904223;
+        lod.z[i] = (float)(seed >> 16) / 65536.0f * -400.0f;
+        lod.y[i] = 0;
+        lod.radius[i] = 0.5f;
+        lod.model[i] = 0;
+    }
+    saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+    double seconds = 1e9;
+    for (int i=0; i<5; i++) {
+        saogl_lod_select(&lod, eye, 60.0f, 1080.0f, 0.1f);
+        seconds = lod.last_select.seconds < seconds ? lod.last_select.seconds : seconds;
+    }
+    printf("Lod: %u objects in %.3f ms, %.1fx fewer triangles than full detail\n", field, seconds * 1000.0,
+           (double)lod.last_select.full_detail_triangles / lod.last_select.triangles);
+    saogl_lod_free(&lod);
+}
+
+#define WATCH_DIRECTORY "test_sao_gl_shaders"
+#define WATCH_PROGRAMS 64
+
+// Updates until every program has reached its version in versions, or failed has grown by one.
+static void
+wait_for_shader_watch(saogl_ShaderWatch* watch, const uint32_t* versions, uint32_t failed)
+{
+    double start = _saogl_seconds();
+    for (;;) {
+        bool done = saogl_shader_watch_update(watch);
+        bool reached = true;
+        for (uint32_t i=0; i<watch->program_count; i++) {
+            reached = reached && watch->programs[i].version >= versions[i];
+        }
+        if (done && (reached || watch->stats.failed > failed)) {
+            return;
+        }
+        assert(_saogl_seconds() - start < 30);
+        struct timespec wait = {0, 200000};
+        nanosleep(&wait, NULL);
+    }
+}
+
+static void
+test_shader_watch()
+{
+    mkdir(WATCH_DIRECTORY, 0755);
+    mkdir(WATCH_DIRECTORY "/lib", 0755);
+    write_text_file(WATCH_DIRECTORY "/lib/math.glsl", "float half_of(float x) { return x * 0.5; }\n");
+    // Both lib files include math.glsl and special.frag includes both of them, each one only
+    // goes in once.
+    write_text_file(WATCH_DIRECTORY "/lib/common.glsl",
+                    "#include \"math.glsl\"\n"
+                    "vec4 tint() { return vec4(half_of(1.0), 0.0, 0.0, 1.0); }\n");
+    write_text_file(WATCH_DIRECTORY "/lib/special.glsl",
+                    "  #  include \"math.glsl\"\n"
+                    "vec4 special() { return vec4(0.0, half_of(1.0), 0.0, 1.0); }\n");
+    write_text_file(WATCH_DIRECTORY "/shader.vert",
+                    "#version 330\n"
+                    "#include \"lib/math.glsl\"\n"
+                    "layout (location = 0) in vec3 position;\n"
+                    "void main() { gl_Position = vec4(position * half_of(2.0), 1.0); }\n");
+    write_text_file(WATCH_DIRECTORY "/special.frag",
+                    "#version 330\n"
+                    "#include \"lib/common.glsl\"\n"
+                    "#include \"lib/special.glsl\"\n"
+                    "out vec4 color;\n"
+                    "void main() { color = tint() + special(); }\n");
+    char filename[256];
+    char source[256];
+    for (int i=0; i<WATCH_PROGRAMS; i++) {
+        snprintf(filename, sizeof(filename), WATCH_DIRECTORY "/plain%d.frag", i);
+        snprintf(source, sizeof(source),
+                 "#version 330\n"
+                 "#include \"lib/common.glsl\"\n"
+                 "out vec4 color;\n"
+                 "void main() { color = tint() * %d.0; }\n", i);
+        write_text_file(filename, source);
+    }
+    int64_t live = live_allocations;
+
+    // Each stage's own file is numbered from the line after #version.
+    _saogl_Preprocessor pp = {0};
+    char* vertex_src = _saogl_preprocess(&pp, WATCH_DIRECTORY "/shader.vert");
+    char* fragment_src = _saogl_preprocess(&pp, WATCH_DIRECTORY "/special.frag");
+    const char* vertex_start = "#version 330\n#line 2 0\n#line 1 1\n";
+    const char* fragment_start = "#version 330\n#line 2 2\n#line 1 3\n";
+    assert(strncmp(vertex_src, vertex_start, strlen(vertex_start)) == 0);
+    assert(strncmp(fragment_src, fragment_start, strlen(fragment_start)) == 0);
+    assert(strstr(fragment_src, "#line 3 2\n#line 1 4\n"));
+    SAOGL_FREE(vertex_src);
+    SAOGL_FREE(fragment_src);
+    for (uint32_t i=0; i<pp.count; i++) {
+        SAOGL_FREE(pp.paths[i]);
+    }
+    SAOGL_FREE(pp.paths);
+    SAOGL_FREE(pp.stages);
+
+    // Free is safe on a watch whose init failed.
+    saogl_ShaderWatch watch = {0};
+    saogl_shader_watch_free(&watch);
+    assert(saogl_shader_watch_init(&watch));
+    for (int i=0; i<WATCH_PROGRAMS; i++) {
+        snprintf(filename, sizeof(filename), WATCH_DIRECTORY "/plain%d.frag", i);
+        assert(saogl_shader_watch_add(&watch, WATCH_DIRECTORY "/shader.vert", filename) == i);
+    }
+    int special = saogl_shader_watch_add(&watch, WATCH_DIRECTORY "/shader.vert",
+                                         WATCH_DIRECTORY "/special.frag");
+    uint32_t versions[WATCH_PROGRAMS + 1];
+    for (int i=0; i<=WATCH_PROGRAMS; i++) {
+        versions[i] = 1;
+    }
+    wait_for_shader_watch(&watch, versions, 0);
+    assert(watch.stats.failed == 0);
+    for (int i=0; i<=WATCH_PROGRAMS; i++) {
+        assert(watch.programs[i].program && watch.programs[i].version == 1);
+    }
+    // shader.vert, math, special.frag, common, special.
+    assert(watch.programs[special].file_count == 5);
+    assert(watch.file_count == WATCH_PROGRAMS + 5);
+
+    // Only the program that includes special.glsl rebuilds.
+    write_text_file(WATCH_DIRECTORY "/lib/special.glsl",
+                    "#include \"math.glsl\"\n"
+                    "vec4 special() { return vec4(0.0, 0.0, half_of(1.0), 1.0); }\n");
+    versions[special] = 2;
+    wait_for_shader_watch(&watch, versions, 0);
+    for (int i=0; i<WATCH_PROGRAMS; i++) {
+        assert(watch.programs[i].version == 1);
+    }
+    assert(watch.programs[special].version == 2);
+    printf("Reloaded one of %d shader programs in %.2f ms\n", WATCH_PROGRAMS + 1,
+           watch.stats.last_seconds * 1000.0);
+
+    // A broken edit keeps the program that's there.
+    uint32_t program = watch.programs[special].program;
+    write_text_file(WATCH_DIRECTORY "/lib/special.glsl", "vec4 special() { return nope; }\n");
+    versions[special] = 3;
+    wait_for_shader_watch(&watch, versions, 0);
+    assert(watch.stats.failed == 1);
+    assert(watch.programs[special].program == program && watch.programs[special].version == 2);
+    GLint is_ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &is_ok);
+    assert(is_ok);
+
+    // Fixing it swaps the new one in.
+    write_text_file(WATCH_DIRECTORY "/lib/special.glsl",
+                    "vec4 special() { return vec4(1.0); }\n");
+    wait_for_shader_watch(&watch, versions, 1);
+    assert(watch.stats.failed == 1 && watch.programs[special].version == 3);
+
+    // math.glsl is included everywhere, directly or not. Renaming over a file counts too.
+    write_text_file(WATCH_DIRECTORY "/lib/math.tmp", "float half_of(float x) { return x / 2.0; }\n");
+    rename(WATCH_DIRECTORY "/lib/math.tmp", WATCH_DIRECTORY "/lib/math.glsl");
+    for (int i=0; i<=WATCH_PROGRAMS; i++) {
+        versions[i]++;
+    }
+    wait_for_shader_watch(&watch, versions, 1);
+    for (int i=0; i<=WATCH_PROGRAMS; i++) {
+        assert(watch.programs[i].version == versions[i]);
+    }
+
+    saogl_shader_watch_print_stats(&watch);
+    saogl_shader_watch_free(&watch);
+    assert(live_allocations == live);
+
+    for (int i=0; i<WATCH_PROGRAMS; i++) {
+        snprintf(filename, sizeof(filename), WATCH_DIRECTORY "/plain%d.frag", i);
+        remove(filename);
+    }
+    remove(WATCH_DIRECTORY "/shader.vert");
+    remove(WATCH_DIRECTORY "/special.frag");
+    remove(WATCH_DIRECTORY "/lib/math.glsl");
+    remove(WATCH_DIRECTORY "/lib/common.glsl");
+    remove(WATCH_DIRECTORY "/lib/special.glsl");
+    rmdir(WATCH_DIRECTORY "/lib");
+    rmdir(WATCH_DIRECTORY);
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (!create_headless_context()) {
+        printf("Couldn't create a headless gl context, skipping gl tests.\n");
+        return 0;
+    }
+    printf("Testing on %s\n", glGetString(GL_RENDERER));
+
+    test_build_shader_from_files();
+    test_shader_cache();
+    test_shader_batch();
+    test_program_reflection();
+    test_state_cache();
+    test_render_commands();
+    test_stream_buffer();
+    test_instancing();
+    test_debug_draw();
+    test_texture_streaming();
+    test_mesh_import();
+    test_lod();
+    test_shader_watch();
+}
@@ -0,0 +1,108 @@
+#define SAO_GAMEGUY_MEMORY_IMPLEMENTATION
+#include "sao_gameguy.h"
+
+#include <assert.h>
+
+void
+test_tags()
+{
+    ggMemoryStats* stats = gg_memory_stats();
+    uint8_t* a = (uint8_t*)gg_alloc(GG_TAG_ASSETS, 100);
+    uint8_t* b = (uint8_t*)gg_alloc(GG_TAG_GAME + 1, 1000);
+    assert(a && b);
+    assert(((uintptr_t)a & 15) == 0 && ((uintptr_t)b & 15) == 0);
+    for (int i=0; i<100; i++) {
+        assert(a[i] == 0);
+    }
+    assert(stats->tags[GG_TAG_ASSETS].live_bytes == 100);
+    assert(stats->tags[GG_TAG_GAME + 1].live_bytes == 1000);
+    assert(stats->live_bytes == 1100);
+
+    // Growing keeps the contents and the tag and zeroes the rest, the tag argument is only
+    // for NULL.
+    memset(a, 7, 100);
+    a = (uint8_t*)gg_realloc(GG_TAG_NET, a, 5000);
+    assert(a[99] == 7 && a[100] == 0 && a[4999] == 0);
+    assert(stats->tags[GG_TAG_ASSETS].live_bytes == 5000);
+    assert(stats->tags[GG_TAG_NET].live_bytes == 0);
+    assert(stats->tags[GG_TAG_ASSETS].live_count == 1);
+    a = (uint8_t*)gg_realloc(GG_TAG_NET, a, 10);
+    assert(a[9] == 7);
+    assert(stats->tags[GG_TAG_ASSETS].live_bytes == 10);
+    assert(stats->tags[GG_TAG_ASSETS].high_water_bytes == 5000);
+
+    gg_deallocate(a);
+    gg_deallocate(b);
+    gg_deallocate(NULL);
+    assert(stats->tags[GG_TAG_ASSETS].live_bytes == 0);
+    assert(stats->tags[GG_TAG_ASSETS].live_count == 0);
+    assert(stats->live_bytes == 0);
+    assert(stats->high_water_bytes == 6000);
+
+    // Out of range tags land on the last one.
+    void* c = gg_alloc(1000, 8);
+    assert(stats->tags[GG_MEMORY_TAGS - 1].live_bytes == 8);
+    gg_deallocate(c);
+
+    gg_memory_account(GG_TAG_STATE, 1 << 20);
+    assert(stats->tags[GG_TAG_STATE].mapped_bytes == 1 << 20);
+    assert(stats->live_bytes == 0);
+}
+
+void
+test_frames()
+{
+    ggMemoryStats* stats = gg_memory_stats();
+    gg_memory_end_frame();
+    uint64_t allocating_frames = stats->allocating_frames;
+
+    // Setting up allocates, the steady state frames after don't.
+    void* kept = gg_alloc(GG_TAG_GAME, 64);
+    gg_deallocate(gg_alloc(GG_TAG_GAME, 32));
+    gg_memory_end_frame();
+    assert(stats->last_frame_allocations == 2);
+    assert(stats->last_frame_bytes == 96);
+    assert(stats->tags[GG_TAG_GAME].last_frame_allocations == 2);
+    assert(stats->tags[GG_TAG_GAME].max_frame_allocations >= 2);
+    assert(stats->allocating_frames == allocating_frames + 1);
+    const ggMemorySite* newest = &stats->recent[(stats->recent_count - 1) % GG_MEMORY_RECENT];
+    assert(newest->size == 32 && newest->tag == GG_TAG_GAME && strcmp(newest->file, __FILE__) == 0);
+
+    for (int i=0; i<10; i++) {
+        gg_memory_end_frame();
+        assert(stats->last_frame_allocations == 0);
+        assert(stats->last_frame_bytes == 0);
+    }
+    assert(stats->allocating_frames == allocating_frames + 1);
+    gg_deallocate(kept);
+}
+
+void
+test_report()
+{
+    // Reports go to stderr, this just runs them over allocations from before and after a
+    // generation starts.
+    void* before = gg_alloc(GG_TAG_PLATFORM, 10);
+    uint32_t generation = gg_memory_begin_generation();
+    void* after[5];
+    for (int i=0; i<5; i++) {
+        after[i] = gg_alloc(GG_TAG_GAME, 100);
+    }
+    gg_memory_report_live("Test: live since the generation", generation, 4);
+    gg_memory_report_live("Test: everything live", 0, 4);
+    gg_memory_print_stats();
+    for (int i=0; i<5; i++) {
+        gg_deallocate(after[i]);
+    }
+    gg_deallocate(before);
+    assert(gg_memory_stats()->live_bytes == 0);
+}
+
+int
+main(int argc, char* argv[])
+{
+    test_tags();
+    test_frames();
+    test_report();
+    printf("Memory tests passed.\n");
+}
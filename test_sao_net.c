@@ -0,0 +1,330 @@
+#define SAO_GAMEGUY_NET_IMPLEMENTATION
+#include "sao_gameguy.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <sys/wait.h>
+
+typedef struct {
+    float position[3];
+    float rotation[4];
+    int32_t health;
+    char name[6];
+} Entity;
+
+#define ENTITY_COUNT 10000
+
+static const ggNetField entity_fields[] = {
+    {GG_NET_V3, offsetof(Entity, position), 0, 18, -512.0f, 512.0f},
+    {GG_NET_QUAT, offsetof(Entity, rotation), 0, 10},
+    {GG_NET_INT32, offsetof(Entity, health)},
+    {GG_NET_BYTES, offsetof(Entity, name), sizeof(((Entity*)0)->name)},
+};
+
+static const ggNetRegion entity_region = {
+    0, sizeof(Entity), ENTITY_COUNT, entity_fields, sizeof(entity_fields) / sizeof(entity_fields[0])
+};
+
+static uint32_t seed = 1;
+
+float
+random_float(float min, float max)
+{
+    seed = seed * 1664525 + 1013904223;
+    return min + (float)(seed >> 8) / (float)(1 << 24) * (max - min);
+}
+
+void
+random_rotation(float* q)
+{
+    float length = 0;
+    for (int i=0; i<4; i++) {
+        q[i] = random_float(-1, 1);
+        length += q[i] * q[i];
+    }
+    length = sqrtf(length);
+    for (int i=0; i<4; i++) {
+        q[i] /= length;
+    }
+}
+
+void
+assert_replicated(const Entity* host, const Entity* client)
+{
+    for (int i=0; i<ENTITY_COUNT; i++) {
+        for (int j=0; j<3; j++) {
+            assert(fabsf(host[i].position[j] - client[i].position[j]) < 0.004f);
+        }
+        // q and -q are the same rotation.
+        float dot = 0;
+        for (int j=0; j<4; j++) {
+            dot += host[i].rotation[j] * client[i].rotation[j];
+        }
+        assert(fabsf(dot) > 0.999f);
+        assert(host[i].health == client[i].health);
+        assert(memcmp(host[i].name, client[i].name, sizeof(host[i].name)) == 0);
+    }
+}
+
+void
+test_codec()
+{
+    // Zigzag differences and xor both round trip through the bit packing, unchanged entities
+    // are a single bit.
+    uint8_t data[64] = {0};
+    uint8_t kinds[3] = {_GG_NET_DIFFERENCE, _GG_NET_DIFFERENCE, _GG_NET_XOR};
+    uint32_t baseline[3] = {1000, 5, 0xDEADBEEF};
+    uint32_t words[3] = {990, 70000, 0xDEADBEEE};
+    _ggBits bits = {data, sizeof(data)};
+    _gg_net_encode_entity(&bits, words, baseline, kinds, 3);
+    _gg_net_encode_entity(&bits, baseline, baseline, kinds, 3);
+    _gg_bits_flush(&bits);
+    // 1 + (6 + 5) + (6 + 18) + (6 + 1) bits, then 1.
+    assert(bits.at == 6);
+
+    uint32_t decoded[3];
+    memcpy(decoded, baseline, sizeof(decoded));
+    _ggBits reading = {data, bits.at};
+    _gg_net_decode_entity(&reading, decoded, kinds, 3);
+    assert(memcmp(decoded, words, sizeof(words)) == 0);
+    _gg_net_decode_entity(&reading, decoded, kinds, 3);
+    assert(memcmp(decoded, words, sizeof(words)) == 0);
+    assert(reading.at <= reading.size);
+}
+
+void
+test_replication()
+{
+    Entity* host_state = (Entity*)calloc(ENTITY_COUNT, sizeof(Entity));
+    Entity* client_state = (Entity*)calloc(ENTITY_COUNT, sizeof(Entity));
+    for (int i=0; i<ENTITY_COUNT; i++) {
+        for (int j=0; j<3; j++) {
+            host_state[i].position[j] = random_float(-500, 500);
+        }
+        random_rotation(host_state[i].rotation);
+        host_state[i].health = 100;
+        snprintf(host_state[i].name, sizeof(host_state[i].name), "e%d", i % 10000);
+    }
+
+    ggNet host, client;
+    assert(gg_net_open(&host, true, NULL, 0, &entity_region, 1));
+    struct sockaddr_in bound;
+    socklen_t bound_size = sizeof(bound);
+    assert(getsockname(host.socket, (struct sockaddr*)&bound, &bound_size) == 0);
+    assert(gg_net_open(&client, false, "127.0.0.1", ntohs(bound.sin_port), &entity_region, 1));
+
+    // Nothing goes out until the client says hello.
+    assert(gg_net_send_snapshot(&host, host_state));
+    assert(host.stats.snapshots_sent == 0);
+    assert(gg_net_receive(&client, client_state) == 0);
+
+    uint64_t delta_bytes = 0;
+    int delta_snapshots = 0;
+    int ticks = 0;
+    for (; ticks < 64 || client.acked != host.sequence; ticks++) {
+        assert(ticks < 1000);
+        // A tenth of the entities move each tick.
+        if (ticks < 64) {
+            for (int i=0; i<ENTITY_COUNT / 10; i++) {
+                Entity* entity = &host_state[(int)random_float(0, ENTITY_COUNT) % ENTITY_COUNT];
+                for (int j=0; j<3; j++) {
+                    entity->position[j] += random_float(-0.5f, 0.5f);
+                }
+                random_rotation(entity->rotation);
+                if (i % 10 == 0) {
+                    entity->health--;
+                }
+            }
+        }
+        gg_net_send_snapshot(&host, host_state);
+        if (host.stats.last_baseline_age) {
+            delta_bytes += host.stats.last_snapshot_bytes;
+            delta_snapshots++;
+        }
+        gg_net_receive(&client, client_state);
+        // The first snapshot has to arrive whole, after that lost packets only age the baseline.
+        host.loss_percent = client.acked ? 2 : 0;
+    }
+    assert_replicated(host_state, client_state);
+    assert(delta_snapshots > 32);
+
+    // One bit for each idle entity and ~100 for a moved one.
+    double bytes = (double)delta_bytes / delta_snapshots;
+    printf("Replicated %d entities: %u bytes raw, delta %.0f bytes (%.0f kbit/s at 64 Hz), "
+           "encode %.0f us, decode %.0f us, %llu dropped\n",
+           ENTITY_COUNT, host.stats.snapshot_words * 4, bytes, bytes * 8 * 64 / 1000.0,
+           (double)host.stats.encode_us / host.stats.snapshots_sent,
+           (double)client.stats.decode_us / client.stats.snapshots_applied,
+           (unsigned long long)client.stats.snapshots_dropped);
+    assert(bytes < 16 * 1024);
+
+    // Nothing changed, just the bits saying so.
+    gg_net_send_snapshot(&host, host_state);
+    assert(host.stats.last_snapshot_bytes < ENTITY_COUNT / 8 + 64);
+
+    gg_net_print_stats(&host, 64);
+    gg_net_print_stats(&client, 64);
+    gg_net_close(&host);
+    gg_net_close(&client);
+    free(host_state);
+    free(client_state);
+}
+
+void
+test_fields()
+{
+    // Fields with no step or too wide for their word are refused up front.
+    ggNetField bad[][1] = {
+        {{GG_NET_FLOAT, 0, 0, 0, -1, 1}},
+        {{GG_NET_FLOAT, 0, 0, 32, -1, 1}},
+        {{GG_NET_V3, 0, 0, 25, -1, 1}},
+        {{GG_NET_FLOAT, 0, 0, 16, 1, 1}},
+        {{GG_NET_QUAT, 0, 0, 11}},
+        {{GG_NET_QUAT, 0, 0, 0}},
+        {{99}},
+    };
+    ggNet net;
+    for (int i=0; i<(int)(sizeof(bad) / sizeof(bad[0])); i++) {
+        ggNetRegion region = {0, 16, 4, bad[i], 1};
+        assert(!gg_net_open(&net, true, NULL, 0, &region, 1));
+    }
+    ggNetField good[] = {{GG_NET_FLOAT, 0, 0, 24, -1, 1}, {GG_NET_QUAT, 4, 0, 10}};
+    ggNetRegion region = {0, 20, 4, good, 2};
+    assert(gg_net_open(&net, true, NULL, 0, &region, 1));
+    gg_net_close(&net);
+}
+
+static void
+send_to(int socket, const ggNet* net, const void* data, size_t size)
+{
+    struct sockaddr_in address;
+    socklen_t address_size = sizeof(address);
+    assert(getsockname(net->socket, (struct sockaddr*)&address, &address_size) == 0);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(sendto(socket, data, size, 0, (struct sockaddr*)&address, sizeof(address)) == (ssize_t)size);
+}
+
+void
+test_peers()
+{
+    static const ggNetField fields[] = {{GG_NET_INT32, 0}};
+    ggNetRegion region = {0, 4, 4, fields, 1};
+    int32_t host_state[4] = {1, 2, 3, 4};
+    int32_t client_state[4] = {0};
+
+    ggNet host, client;
+    assert(gg_net_open(&host, true, NULL, 0, &region, 1));
+    struct sockaddr_in bound;
+    socklen_t bound_size = sizeof(bound);
+    assert(getsockname(host.socket, (struct sockaddr*)&bound, &bound_size) == 0);
+    assert(gg_net_open(&client, false, "127.0.0.1", ntohs(bound.sin_port), &region, 1));
+    gg_net_receive(&client, client_state);
+    gg_net_send_snapshot(&host, host_state);
+    assert(gg_net_receive(&client, client_state) == 1 && client_state[3] == 4);
+    uint16_t client_port = host.peer_port;
+    assert(client_port);
+
+    int stranger = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(stranger != -1);
+
+    // Junk doesn't move the host's peer.
+    uint8_t junk[sizeof(_ggNetHeader)] = {0};
+    send_to(stranger, &host, junk, sizeof(junk));
+    gg_net_send_snapshot(&host, host_state);
+    assert(host.peer_port == client_port);
+    assert(gg_net_receive(&client, client_state) == 1);
+
+    // A snapshot from anyone but the host is ignored.
+    uint32_t acked = client.acked;
+    _ggNetHeader forged = {GG_NET_MAGIC, acked + 100, 0, 0, 0, 0, 1, _GG_NET_SNAPSHOT};
+    send_to(stranger, &client, &forged, sizeof(forged));
+    assert(gg_net_receive(&client, client_state) == 0 && client.acked == acked);
+
+    // From the host, a range that wraps past the entity count is malformed, not applied.
+    _ggNetHeader wrapping = {GG_NET_MAGIC, acked + 100, 0, 0xFFFFFFFF, 2, 0, 1, _GG_NET_SNAPSHOT};
+    send_to(host.socket, &client, &wrapping, sizeof(wrapping));
+    uint64_t dropped = client.stats.snapshots_dropped;
+    assert(gg_net_receive(&client, client_state) == 0 && client.acked == acked);
+    assert(client.stats.snapshots_dropped == dropped + 1);
+
+    // An empty fragment may start right at the end, it has nothing to decode.
+    _ggNetHeader empty = {GG_NET_MAGIC, acked + 101, 0, 4, 0, 0, 1, _GG_NET_SNAPSHOT};
+    send_to(host.socket, &client, &empty, sizeof(empty));
+    assert(gg_net_receive(&client, client_state) == 1 && client.acked == acked + 101);
+    assert(client.stats.snapshots_dropped == dropped + 1);
+
+    // A real ack does move it, the host answers whoever acked last.
+    _ggNetHeader ack = {GG_NET_MAGIC, 0, 0, 0, 0, 0, 0, _GG_NET_ACK};
+    send_to(stranger, &host, &ack, sizeof(ack));
+    gg_net_send_snapshot(&host, host_state);
+    assert(host.peer_port != client_port);
+
+    close(stranger);
+    gg_net_close(&host);
+    gg_net_close(&client);
+}
+
+// The client in a child process, so nothing is shared but the socket traffic.
+void
+test_two_processes()
+{
+    Entity* host_state = (Entity*)calloc(ENTITY_COUNT, sizeof(Entity));
+    for (int i=0; i<ENTITY_COUNT; i++) {
+        for (int j=0; j<3; j++) {
+            host_state[i].position[j] = random_float(-500, 500);
+        }
+        random_rotation(host_state[i].rotation);
+        host_state[i].health = i;
+        snprintf(host_state[i].name, sizeof(host_state[i].name), "p%d", i % 10000);
+    }
+
+    ggNet host;
+    assert(gg_net_open(&host, true, NULL, 0, &entity_region, 1));
+    struct sockaddr_in bound;
+    socklen_t bound_size = sizeof(bound);
+    assert(getsockname(host.socket, (struct sockaddr*)&bound, &bound_size) == 0);
+
+    pid_t child = fork();
+    assert(child != -1);
+    if (child == 0) {
+        // The child's copy of host_state is what it should end up with.
+        close(host.socket);
+        Entity* client_state = (Entity*)calloc(ENTITY_COUNT, sizeof(Entity));
+        ggNet client;
+        assert(gg_net_open(&client, false, "127.0.0.1", ntohs(bound.sin_port), &entity_region, 1));
+        for (int i=0; i<5000 && !client.stats.snapshots_applied; i++) {
+            gg_net_receive(&client, client_state);
+            usleep(1000);
+        }
+        assert(client.stats.snapshots_applied);
+        assert_replicated(host_state, client_state);
+        _exit(0);
+    }
+
+    int status = 0;
+    pid_t done = 0;
+    for (int i=0; i<10000 && !done; i++) {
+        gg_net_send_snapshot(&host, host_state);
+        usleep(1000);
+        done = waitpid(child, &status, WNOHANG);
+    }
+    if (!done) {
+        kill(child, SIGKILL);
+        waitpid(child, &status, 0);
+    }
+    assert(done == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(host.stats.connected && host.stats.snapshots_sent);
+    gg_net_close(&host);
+    free(host_state);
+}
+
+int
+main(int argc, char* argv[])
+{
+    test_codec();
+    test_fields();
+    test_peers();
+    test_replication();
+    test_two_processes();
+    printf("Net tests passed.\n");
+}
@@ -0,0 +1,141 @@
+#define SAO_GAMEGUY_PACK_IMPLEMENTATION
+#include "sao_gameguy.h"
+
+#include <assert.h>
+
+void
+write_file(const char* filename, const void* data, size_t size)
+{
+    FILE* f = fopen(filename, "wb");
+    assert(f);
+    assert(fwrite(data, 1, size, f) == size);
+    fclose(f);
+}
+
+void
+test_lz4()
+{
+    // Repetitive text, long runs and noise cover literals, overlapping matches and long lengths.
+    int size = 100000;
+    uint8_t* src = (uint8_t*)malloc(size);
+    uint32_t seed = 1;
+    for (int i=0; i<size; i++) {
+        seed = seed * 1664525 + 1013904223;
+        if (i < 30000) {
+            src[i] = "the quick brown fox "[i % 20];
+        } else if (i < 60000) {
+            src[i] = 7;
+        } else {
+            src[i] = seed >> 24;
+        }
+    }
+
+    int capacity = size + size / 255 + 64;
+    uint8_t* compressed = (uint8_t*)malloc(capacity);
+    uint8_t* decompressed = (uint8_t*)malloc(size);
+    int compressed_size = gg_lz4_compress(src, size, compressed, capacity);
+    assert(compressed_size > 0 && compressed_size < size / 2 + 1000);
+    assert(gg_lz4_decompress(compressed, compressed_size, decompressed, size) == size);
+    assert(memcmp(src, decompressed, size) == 0);
+
+    // Too small an output fails instead of overflowing.
+    assert(gg_lz4_decompress(compressed, compressed_size, decompressed, size - 1) == -1);
+    assert(gg_lz4_compress(src, size, compressed, 100) == -1);
+
+    // Tiny inputs are all literals.
+    assert(gg_lz4_compress((const uint8_t*)"abc", 3, compressed, capacity) == 4);
+    assert(gg_lz4_decompress(compressed, 4, decompressed, 3) == 3);
+    assert(memcmp(decompressed, "abc", 3) == 0);
+
+    free(src);
+    free(compressed);
+    free(decompressed);
+}
+
+void
+test_pack(int compression)
+{
+    const char* names[40];
+    char name_data[40][32];
+    char contents[4096];
+    for (int i=0; i<40; i++) {
+        snprintf(name_data[i], sizeof(name_data[i]), "/tmp/test_sao_pack_%d.txt", i);
+        names[i] = name_data[i];
+        int length = 0;
+        for (int j=0; j<i * 20; j++) {
+            length += snprintf(contents + length, sizeof(contents) - length, "%d ", i);
+        }
+        write_file(names[i], contents, length);
+    }
+
+    const char* pack_filename = "/tmp/test_sao_pack.pack";
+    assert(gg_pack_build(pack_filename, names, 40, compression));
+
+    ggPack pack;
+    assert(gg_pack_open(&pack, pack_filename));
+    assert(pack.header->entry_count == 40);
+
+    bool compressed_any = false;
+    for (int i=0; i<40; i++) {
+        const ggPackEntry* entry = gg_pack_find(&pack, names[i]);
+        assert(entry);
+        assert(entry->offset % GG_PACK_ALIGNMENT == 0);
+        assert(strcmp(pack.names + entry->name_offset, names[i]) == 0);
+        compressed_any |= entry->compression != GG_PACK_RAW;
+
+        FILE* f = fopen(names[i], "rb");
+        size_t length = fread(contents, 1, sizeof(contents), f);
+        fclose(f);
+        assert(entry->size == length);
+
+        char buffer[4096];
+        assert(gg_pack_read(&pack, entry, buffer, sizeof(buffer)));
+        assert(memcmp(buffer, contents, length) == 0);
+        remove(names[i]);
+    }
+    assert(compressed_any == (compression != GG_PACK_RAW));
+    assert(!gg_pack_find(&pack, "/tmp/not_in_the_pack"));
+    gg_pack_close(&pack);
+
+    // Damaged or truncated packs are rejected instead of read out of bounds.
+    FILE* f = fopen(pack_filename, "rb");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    uint8_t* file = (uint8_t*)malloc(size);
+    fseek(f, 0, SEEK_SET);
+    assert(fread(file, 1, size, f) == (size_t)size);
+    fclose(f);
+    const ggPackHeader* header = (const ggPackHeader*)file;
+    ggPackEntry* entries = (ggPackEntry*)(file + header->entries_offset);
+    uint32_t* slots = (uint32_t*)(file + header->slots_offset);
+    for (int damage=0; damage<6; damage++) {
+        uint8_t* damaged = (uint8_t*)malloc(size);
+        memcpy(damaged, file, size);
+        ggPackHeader* damaged_header = (ggPackHeader*)damaged;
+        ggPackEntry* entry = (ggPackEntry*)(damaged + ((uint8_t*)(entries + 7) - file));
+        switch (damage) {
+        case 0: entry->name_offset = 0xFFFFFF00; break;
+        case 1: entry->offset = size - 4; break;
+        case 2: entry->offset = UINT64_MAX - 8; break;
+        case 3: damaged_header->entry_count = damaged_header->slot_count; break;
+        case 4: ((uint32_t*)(damaged + ((uint8_t*)slots - file)))[0] = 1000; break;
+        case 5: damaged_header->entries_offset = UINT64_MAX - 63; break;
+        }
+        write_file(pack_filename, damaged, size);
+        assert(!gg_pack_open(&pack, pack_filename));
+        free(damaged);
+    }
+    write_file(pack_filename, file, size - 1);
+    assert(!gg_pack_open(&pack, pack_filename));
+    free(file);
+    remove(pack_filename);
+}
+
+int
+main(int argc, char* argv[])
+{
+    test_lz4();
+    test_pack(GG_PACK_RAW);
+    test_pack(GG_PACK_LZ4);
+    printf("Pack tests passed.\n");
+}